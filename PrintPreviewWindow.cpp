@@ -485,9 +485,14 @@ BOOL ShowModernPrintPreview(HWND parent, PrintRenderContext *ctx) {
         xamlSource.Content(hostRoot);
 
         auto previewState = std::make_shared<PreviewState>();
-        previewState->text = ctx->text ? ctx->text : L"";
         previewState->ctx = *ctx;
-        previewState->ctx.text = previewState->text.c_str();
+        // A snapshot is read in place: the caller holds it until the preview
+        // has closed. Only flat text is copied.
+        if (!ctx->snapshot) {
+            if (ctx->text) previewState->text.assign(ctx->text, ctx->textLength);
+            previewState->ctx.text = previewState->text.c_str();
+            previewState->ctx.textLength = previewState->text.size();
+        }
         previewState->testMode = ctx->testMode ? true : false;
 
         PrintDocument printDoc;
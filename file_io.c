@@ -1,215 +1,2849 @@
 // Text file load/save helpers with simple BOM detection for retropad.
 #include "file_io.h"
+#include "text_detect.h"
+#include "text_loader.h"
+#include "text_baseline.h"
+#include "text_follow.h"
+#include "text_gzip.h"
+#include "text_hash.h"
+#include "text_codepage.h"
+#include "text_split.h"
+#include "text_history.h"
+#include "text_journal.h"
 #include <commdlg.h>
+#include <shlobj.h>
 #include <strsafe.h>
 #include <stdlib.h>
 
-static TextEncoding DetectEncoding(const BYTE *data, DWORD size) {
-    if (size >= 2 && data[0] == 0xFF && data[1] == 0xFE) {
-        return ENC_UTF16LE;
+// Loads and splits stream a plain handle through ReadFile; mapped views are
+// only for the paged view, session snapshots and re-hashing a file whose
+// timestamp changed, walked one LOAD_VIEW_BYTES window at a time.
+#define LOAD_VIEW_BYTES (64u * 1024u * 1024u)
+
+typedef struct MappedFile {
+    HANDLE file;
+    HANDLE mapping; // NULL when opened by OpenInputFile, or empty
+    ULONGLONG size;
+} MappedFile;
+
+typedef BOOL (*ViewCallback)(void *context, const BYTE *data, SIZE_T size, BOOL final);
+
+// Opens `path` for reading and records its size, without a mapping: for
+// callers that only ReadFile it. CloseMappedFile closes it.
+static BOOL OpenInputFile(LPCWSTR path, MappedFile *mf) {
+    ZeroMemory(mf, sizeof(*mf));
+    // Share writes and deletes so logs that are still being written (or
+    // rotated) can be opened.
+    mf->file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (mf->file == INVALID_HANDLE_VALUE) {
+        mf->file = NULL;
+        return FALSE;
+    }
+    LARGE_INTEGER size = {0};
+    if (!GetFileSizeEx(mf->file, &size)) {
+        CloseHandle(mf->file);
+        mf->file = NULL;
+        return FALSE;
+    }
+    mf->size = (ULONGLONG)size.QuadPart;
+    return TRUE;
+}
+
+// As OpenInputFile, plus a mapping covering the size seen here.
+static BOOL OpenMappedFile(LPCWSTR path, MappedFile *mf) {
+    if (!OpenInputFile(path, mf)) return FALSE;
+    if (mf->size == 0) {
+        return TRUE; // zero-length files cannot be mapped
+    }
+    mf->mapping = CreateFileMappingW(mf->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mf->mapping) {
+        CloseHandle(mf->file);
+        mf->file = NULL;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void CloseMappedFile(MappedFile *mf) {
+    if (mf->mapping) CloseHandle(mf->mapping);
+    if (mf->file) CloseHandle(mf->file);
+    ZeroMemory(mf, sizeof(*mf));
+}
+
+// Maps [offset, offset + LOAD_VIEW_BYTES) clamped to the file size. `offset`
+// must be a multiple of LOAD_VIEW_BYTES (and therefore of the allocation
+// granularity).
+static const BYTE *MapFileView(const MappedFile *mf, ULONGLONG offset, SIZE_T *bytesOut) {
+    ULONGLONG remaining = mf->size - offset;
+    SIZE_T bytes = (SIZE_T)(remaining < LOAD_VIEW_BYTES ? remaining : LOAD_VIEW_BYTES);
+    const BYTE *view = (const BYTE *)MapViewOfFile(mf->mapping, FILE_MAP_READ, (DWORD)(offset >> 32), (DWORD)(offset & 0xFFFFFFFFu), bytes);
+    *bytesOut = view ? bytes : 0;
+    return view;
+}
+
+// Walks the file one view at a time starting at byte `skip` (used to step
+// over a BOM). The callback sees each view exactly once, in order.
+static BOOL ForEachFileView(const MappedFile *mf, ULONGLONG skip, ViewCallback callback, void *context) {
+    for (ULONGLONG offset = 0; offset < mf->size; offset += LOAD_VIEW_BYTES) {
+        SIZE_T bytes = 0;
+        const BYTE *view = MapFileView(mf, offset, &bytes);
+        if (!view) return FALSE;
+        BOOL final = (offset + bytes >= mf->size);
+        BOOL ok = TRUE;
+        if (offset + bytes > skip) {
+            SIZE_T start = (skip > offset) ? (SIZE_T)(skip - offset) : 0;
+            ok = callback(context, view + start, bytes - start, final);
+        }
+        UnmapViewOfFile(view);
+        if (!ok) return FALSE;
+    }
+    return TRUE;
+}
+
+// ANSI decoding state carried from one chunk to the next.
+typedef struct DecodeJob {
+    UINT codePage;
+    BOOL ansiTable;       // codePage has a built-in table (text_codepage.h)
+    UINT ansiMaxCharSize; // >1 when codePage is a DBCS code page
+    BYTE ansiCarry;       // DBCS lead byte split across views
+    BOOL hasAnsiCarry;
+    WCHAR *out;           // NULL while measuring
+    ULONGLONG units;
+} DecodeJob;
+
+static UINT g_ansiCodePage; // 0: the system ANSI code page
+
+void SetAnsiCodePage(UINT codePage) {
+    g_ansiCodePage = codePage;
+}
+
+UINT GetAnsiCodePage(void) {
+    return g_ansiCodePage ? g_ansiCodePage : GetACP();
+}
+
+static void InitDecodeJob(DecodeJob *job, UINT codePage, WCHAR *out) {
+    ZeroMemory(job, sizeof(*job));
+    job->codePage = codePage;
+    job->ansiTable = TextCodePageKnown(codePage);
+    job->out = out;
+    CPINFO info;
+    job->ansiMaxCharSize = (!job->ansiTable && GetCPInfo(codePage, &info)) ? info.MaxCharSize : 1;
+}
+
+static BOOL DecodeAnsiRun(DecodeJob *job, const BYTE *data, int size) {
+    if (size <= 0) return TRUE;
+    // A code page never yields more characters than input bytes.
+    WCHAR *dst = job->out ? job->out + job->units : NULL;
+    if (job->ansiTable) {
+        // One unit per byte, so measuring costs nothing.
+        if (dst) TextCodePageDecode(job->codePage, data, (size_t)size, (uint16_t *)dst);
+        job->units += (ULONGLONG)size;
+        return TRUE;
+    }
+    int chars = MultiByteToWideChar(job->codePage, 0, (LPCSTR)data, size, dst, dst ? size : 0);
+    if (chars <= 0) return FALSE;
+    job->units += (ULONGLONG)chars;
+    return TRUE;
+}
+
+static BOOL DecodeAnsiView(DecodeJob *job, const BYTE *data, SIZE_T size, BOOL final) {
+    SIZE_T start = 0;
+    if (job->hasAnsiCarry && size > 0) {
+        BYTE pair[2] = { job->ansiCarry, data[0] };
+        job->hasAnsiCarry = FALSE;
+        if (!DecodeAnsiRun(job, pair, 2)) return FALSE;
+        start = 1;
+    }
+
+    SIZE_T end = size;
+    if (job->ansiMaxCharSize > 1 && !final) {
+        // Never split a double-byte character across views: carry a
+        // dangling lead byte over to the next one.
+        SIZE_T k = start;
+        while (k < size) {
+            k += IsDBCSLeadByteEx(job->codePage, data[k]) ? 2 : 1;
+        }
+        if (k > size) {
+            job->ansiCarry = data[size - 1];
+            job->hasAnsiCarry = TRUE;
+            end = size - 1;
+        }
+    }
+    return DecodeAnsiRun(job, data + start, (int)(end - start));
+}
+
+// Reads the regions planned by TextPlanSamples (a few hundred KB at most,
+// whatever the file size) and ranks the candidate encodings.
+static BOOL GuessFileEncoding(const MappedFile *mf, EncodingGuess *guess) {
+    TextSampleSpan spans[TEXT_DETECT_MAX_SAMPLES];
+    size_t count = TextPlanSamples(mf->size, spans, TEXT_DETECT_MAX_SAMPLES);
+    SIZE_T total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        total += spans[i].size;
+    }
+    BYTE *buffer = (BYTE *)HeapAlloc(GetProcessHeap(), 0, total ? total : 1);
+    if (!buffer) return FALSE;
+
+    TextSample samples[TEXT_DETECT_MAX_SAMPLES];
+    SIZE_T used = 0;
+    BOOL ok = TRUE;
+    for (size_t i = 0; ok && i < count; ++i) {
+        OVERLAPPED at = {0};
+        at.Offset = (DWORD)(spans[i].offset & 0xFFFFFFFFu);
+        at.OffsetHigh = (DWORD)(spans[i].offset >> 32);
+        DWORD read = 0;
+        ok = ReadFile(mf->file, buffer + used, (DWORD)spans[i].size, &read, &at);
+        samples[i].data = buffer + used;
+        samples[i].size = read;
+        samples[i].offset = spans[i].offset;
+        used += read;
+    }
+    if (ok) {
+        TextDetectEncoding(samples, count, mf->size, GetAnsiCodePage(), guess);
+    }
+    HeapFree(GetProcessHeap(), 0, buffer);
+    return ok;
+}
+
+struct SaveBaseline {
+    TextBaseline map;
+    WCHAR *path;       // file the map describes...
+    ULONGLONG size;    // ...and how it looked, to notice outside changes
+    FILETIME lastWrite;
+};
+
+// Wraps `map` (taken over) for the file at `path`; NULL if it is unusable.
+static SaveBaseline *CreateSaveBaseline(LPCWSTR path, TextBaseline *map) {
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    SaveBaseline *baseline = NULL;
+    if (map->valid && GetFileAttributesExW(path, GetFileExInfoStandard, &data)) {
+        baseline = (SaveBaseline *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(SaveBaseline));
+    }
+    size_t chars = wcslen(path) + 1;
+    if (baseline) baseline->path = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, chars * sizeof(WCHAR));
+    if (!baseline || !baseline->path) {
+        if (baseline) HeapFree(GetProcessHeap(), 0, baseline);
+        TextBaselineFree(map);
+        return NULL;
+    }
+    CopyMemory(baseline->path, path, chars * sizeof(WCHAR));
+    baseline->size = ((ULONGLONG)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    baseline->lastWrite = data.ftLastWriteTime;
+    baseline->map = *map;
+    ZeroMemory(map, sizeof(*map));
+    return baseline;
+}
+
+void FreeSaveBaseline(SaveBaseline *baseline) {
+    if (!baseline) return;
+    TextBaselineFree(&baseline->map);
+    HeapFree(GetProcessHeap(), 0, baseline->path);
+    HeapFree(GetProcessHeap(), 0, baseline);
+}
+
+void NoteBaselineEdit(SaveBaseline *baseline, size_t editStart, size_t editEnd, size_t newLength) {
+    if (baseline) TextBaselineNoteEdit(&baseline->map, editStart, editEnd, newLength);
+}
+
+void NoteBaselineRewrite(SaveBaseline *baseline) {
+    if (baseline) TextBaselineNoteRewrite(&baseline->map);
+}
+
+size_t SaveBaselineLength(const SaveBaseline *baseline) {
+    return baseline ? (size_t)baseline->map.units : 0;
+}
+
+// Recently decoded documents, so reopening an unchanged file skips reading
+// and decoding it. Only the UI thread touches the cache; load workers build
+// the text for it and EndLoadTextFile files it.
+#define FINGERPRINT_SAMPLE_BYTES 4096u
+
+typedef struct DocumentKey {
+    ULONGLONG size;
+    FILETIME lastWrite;
+    ULONGLONG fingerprint; // of the first and last FINGERPRINT_SAMPLE_BYTES
+} DocumentKey;
+
+typedef struct CacheEntry {
+    struct CacheEntry *next; // most recently used first
+    WCHAR *path;
+    DocumentKey key;
+    WCHAR *text;             // NUL-terminated
+    size_t length;
+    TextEncoding encoding;
+    UINT codePage;
+    BOOL compressed;
+    TextLineIndex lines;
+    TextBaseline map;
+    BOOL hashed;             // contentHash is known
+    ULONGLONG contentHash;   // XXH64 of the whole file
+    SIZE_T bytes;            // charged against the budget
+} CacheEntry;
+
+static struct {
+    CacheEntry *entries;
+    SIZE_T bytesUsed;
+    SIZE_T budget;
+    ULONGLONG hits;
+    ULONGLONG misses;
+    ULONGLONG evictions;
+} g_cache;
+
+// Size, last-write time and a hash of the ends of an open file. Size and
+// time alone miss a same-second rewrite of the same length.
+static BOOL ReadDocumentKey(HANDLE file, DocumentKey *key) {
+    BY_HANDLE_FILE_INFORMATION info;
+    if (!GetFileInformationByHandle(file, &info)) return FALSE;
+    key->size = ((ULONGLONG)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    key->lastWrite = info.ftLastWriteTime;
+    BYTE sample[FINGERPRINT_SAMPLE_BYTES];
+    TextHash hash;
+    TextHashInit(&hash, 0);
+    ULONGLONG tail = key->size > FINGERPRINT_SAMPLE_BYTES ? key->size - FINGERPRINT_SAMPLE_BYTES : 0;
+    ULONGLONG offsets[2] = { 0, tail < FINGERPRINT_SAMPLE_BYTES ? FINGERPRINT_SAMPLE_BYTES : tail };
+    for (int i = 0; i < 2 && offsets[i] < key->size; ++i) {
+        OVERLAPPED at = {0};
+        at.Offset = (DWORD)(offsets[i] & 0xFFFFFFFFu);
+        at.OffsetHigh = (DWORD)(offsets[i] >> 32);
+        DWORD read = 0;
+        if (!ReadFile(file, sample, sizeof(sample), &read, &at)) return FALSE;
+        TextHashUpdate(&hash, sample, read);
+    }
+    key->fingerprint = TextHashDigest(&hash);
+    return TRUE;
+}
+
+static BOOL SameDocumentKey(const DocumentKey *a, const DocumentKey *b) {
+    return a->size == b->size && CompareFileTime(&a->lastWrite, &b->lastWrite) == 0 && a->fingerprint == b->fingerprint;
+}
+
+static void FreeCacheEntry(CacheEntry *entry) {
+    TextLineIndexFree(&entry->lines);
+    TextBaselineFree(&entry->map);
+    HeapFree(GetProcessHeap(), 0, entry->text);
+    HeapFree(GetProcessHeap(), 0, entry->path);
+    HeapFree(GetProcessHeap(), 0, entry);
+}
+
+static CacheEntry **FindCacheEntry(LPCWSTR path) {
+    CacheEntry **link = &g_cache.entries;
+    while (*link && lstrcmpiW((*link)->path, path) != 0) link = &(*link)->next;
+    return link;
+}
+
+static void RemoveCacheEntry(CacheEntry **link) {
+    CacheEntry *entry = *link;
+    *link = entry->next;
+    g_cache.bytesUsed -= entry->bytes;
+    FreeCacheEntry(entry);
+}
+
+// Drops least recently used entries until `incoming` more bytes fit.
+static void EvictCacheEntries(SIZE_T incoming) {
+    while (g_cache.entries && g_cache.bytesUsed + incoming > g_cache.budget) {
+        CacheEntry **last = &g_cache.entries;
+        while ((*last)->next) last = &(*last)->next;
+        RemoveCacheEntry(last);
+        g_cache.evictions++;
+    }
+}
+
+void SetDocumentCacheBudget(SIZE_T bytes) {
+    g_cache.budget = bytes;
+    EvictCacheEntries(0);
+}
+
+void GetDocumentCacheStats(DocumentCacheStats *stats) {
+    stats->hits = g_cache.hits;
+    stats->misses = g_cache.misses;
+    stats->evictions = g_cache.evictions;
+    stats->bytesUsed = g_cache.bytesUsed;
+    stats->budget = g_cache.budget;
+    stats->entries = 0;
+    for (CacheEntry *entry = g_cache.entries; entry; entry = entry->next) stats->entries++;
+}
+
+// Files a finished load, taking over `text`. Whatever cannot be cached is
+// freed.
+static void CacheDocument(LPCWSTR path, const DocumentKey *key, const FileFingerprint *fingerprint, WCHAR *text,
+                          size_t length, TextEncoding encoding, UINT codePage, BOOL compressed, const TextLineIndex *lines,
+                          const TextBaseline *map) {
+    CacheEntry **existing = FindCacheEntry(path);
+    if (*existing) RemoveCacheEntry(existing);
+    size_t chars = wcslen(path) + 1;
+    CacheEntry *entry = (CacheEntry *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(CacheEntry));
+    WCHAR *copy = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, chars * sizeof(WCHAR));
+    if (!entry || !copy || !TextLineIndexCopy(&entry->lines, lines)) {
+        if (entry) HeapFree(GetProcessHeap(), 0, entry);
+        if (copy) HeapFree(GetProcessHeap(), 0, copy);
+        HeapFree(GetProcessHeap(), 0, text);
+        return;
+    }
+    TextBaselineCopy(&entry->map, map); // an invalid copy only costs verbatim saves
+    CopyMemory(copy, path, chars * sizeof(WCHAR));
+    entry->path = copy;
+    entry->key = *key;
+    entry->hashed = fingerprint->valid;
+    entry->contentHash = fingerprint->hash;
+    entry->text = text;
+    entry->length = length;
+    entry->encoding = encoding;
+    entry->codePage = codePage;
+    entry->compressed = compressed;
+    entry->bytes = sizeof(CacheEntry) + (length + 1 + chars) * sizeof(WCHAR) +
+                   entry->lines.slotCapacity * TEXT_LINES_BLOCK * sizeof(uint32_t) +
+                   entry->lines.blockCapacity * (sizeof(TextLineBlock) + 2 * sizeof(uint64_t) + sizeof(uint32_t)) +
+                   entry->map.markCount * sizeof(TextBaselineMark);
+    if (entry->bytes > g_cache.budget) {
+        FreeCacheEntry(entry);
+        return;
+    }
+    EvictCacheEntries(entry->bytes);
+    entry->next = g_cache.entries;
+    g_cache.entries = entry;
+    g_cache.bytesUsed += entry->bytes;
+}
+
+BOOL LookupCachedDocument(LPCWSTR path, CachedDocument *doc, SaveBaseline **baselineOut, TextLineIndex *linesOut) {
+    CacheEntry **link = FindCacheEntry(path);
+    if (!*link) {
+        g_cache.misses++;
+        return FALSE;
+    }
+    HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    DocumentKey key;
+    BOOL current = file != INVALID_HANDLE_VALUE && ReadDocumentKey(file, &key) && SameDocumentKey(&key, &(*link)->key);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    if (!current) {
+        RemoveCacheEntry(link); // changed on disk: it will be reloaded and cached afresh
+        g_cache.misses++;
+        return FALSE;
+    }
+    CacheEntry *entry = *link;
+    *link = entry->next;
+    entry->next = g_cache.entries;
+    g_cache.entries = entry;
+    g_cache.hits++;
+
+    doc->text = entry->text;
+    doc->length = entry->length;
+    doc->encoding = entry->encoding;
+    doc->codePage = entry->codePage;
+    doc->compressed = entry->compressed;
+    ZeroMemory(&doc->fingerprint, sizeof(doc->fingerprint));
+    doc->fingerprint.valid = entry->hashed;
+    doc->fingerprint.size = entry->key.size;
+    doc->fingerprint.lastWrite = entry->key.lastWrite;
+    doc->fingerprint.hash = entry->contentHash;
+    TextBaseline map;
+    TextBaselineCopy(&map, &entry->map);
+    *baselineOut = CreateSaveBaseline(path, &map); // NULL if the copy failed
+    if (!TextLineIndexCopy(linesOut, &entry->lines)) TextLineIndexInit(linesOut);
+    return TRUE;
+}
+
+struct LoadJob {
+    HWND notify;
+    MappedFile file;       // read through ReadFile; never mapped
+    HANDLE thread;
+    HANDLE slots;          // semaphore: chunks the UI may hold at once
+    HANDLE cancelEvent;
+    BOOL ok;               // outcome, valid once WM_APP_LOAD_DONE is posted
+    BOOL cancelled;
+    TextEncoding encoding;
+    UINT codePage;         // ANSI code page, fixed when the load begins
+    WCHAR *path;
+    TextBaseline baseline; // unit/byte marks gathered while decoding
+    TextLineIndex lines;   // line starts gathered while decoding
+    BOOL compressed;       // gzip: decoded from the decompressed stream
+    BOOL keyed;            // `key` holds the file as it looked when loading began
+    DocumentKey key;
+    TextHash hash;         // of the file bytes read so far...
+    ULONGLONG hashedBytes;
+    FileFingerprint fingerprint; // ...and the result, valid if the file held still
+    SIZE_T cacheBudget;    // document cache budget when the load began
+    BOOL cacheable;        // still worth keeping a copy for the cache
+    WCHAR *cacheText;      // decoded text so far
+    size_t cacheLength;
+    size_t cacheCapacity;
+};
+
+// Decoded chunks waiting for the UI; bounds memory when the edit control
+// appends more slowly than the worker decodes.
+#define LOAD_CHUNKS_IN_FLIGHT 4
+
+// Chunk memory is recycled rather than handed back to the heap. Blocks this
+// large are mapped afresh by each HeapAlloc, so every new chunk would fault
+// in and zero its pages again, and the growing chunk sizes of one load after
+// another fragment the process heap. Freed blocks wait here (smallest first)
+// for the next chunk; the largest one outlives the load for the next open.
+typedef struct ChunkBlock {
+    struct ChunkBlock *next;
+    size_t capacity;       // units of text, not counting the NUL
+    LoadChunk chunk;       // the text follows the block
+} ChunkBlock;
+
+static SRWLOCK g_chunkLock = SRWLOCK_INIT;
+static ChunkBlock *g_idleBlocks;
+static int g_idleBlockCount;
+
+static LoadChunk *AllocLoadChunk(size_t capacity) {
+    ChunkBlock *block = NULL;
+    AcquireSRWLockExclusive(&g_chunkLock);
+    for (ChunkBlock **link = &g_idleBlocks; *link; link = &(*link)->next) {
+        if ((*link)->capacity >= capacity) {
+            block = *link;
+            *link = block->next;
+            g_idleBlockCount--;
+            break;
+        }
+    }
+    ReleaseSRWLockExclusive(&g_chunkLock);
+    if (!block) {
+        block = (ChunkBlock *)HeapAlloc(GetProcessHeap(), 0, sizeof(ChunkBlock) + (capacity + 1) * sizeof(WCHAR));
+        if (!block) return NULL;
+        block->capacity = capacity;
+    }
+    block->chunk.text = (WCHAR *)(block + 1);
+    return &block->chunk;
+}
+
+// Lets go of every idle block but the largest.
+static void TrimLoadChunks(void) {
+    ChunkBlock *spare = NULL;
+    AcquireSRWLockExclusive(&g_chunkLock);
+    while (g_idleBlocks && g_idleBlocks->next) {
+        ChunkBlock *block = g_idleBlocks;
+        g_idleBlocks = block->next;
+        block->next = spare;
+        spare = block;
+        g_idleBlockCount--;
+    }
+    ReleaseSRWLockExclusive(&g_chunkLock);
+    while (spare) {
+        ChunkBlock *next = spare->next;
+        HeapFree(GetProcessHeap(), 0, spare);
+        spare = next;
+    }
+}
+
+static void DropCacheCopy(LoadJob *job) {
+    if (job->cacheText) HeapFree(GetProcessHeap(), 0, job->cacheText);
+    job->cacheText = NULL;
+    job->cacheLength = 0;
+    job->cacheCapacity = 0;
+    job->cacheable = FALSE;
+}
+
+// Mirrors decoded text for the document cache while it fits the budget.
+// `expected` is the likely final length, so most files allocate once.
+static void KeepForCache(LoadJob *job, const WCHAR *text, size_t units, ULONGLONG expected) {
+    if (!job->cacheable) return;
+    size_t needed = job->cacheLength + units + 1;
+    if (needed > job->cacheCapacity) {
+        SIZE_T limit = job->cacheBudget / sizeof(WCHAR);
+        ULONGLONG capacity = max(max((ULONGLONG)job->cacheCapacity * 2, (ULONGLONG)needed), expected + 1);
+        if (capacity > limit) capacity = limit;
+        WCHAR *grown = NULL;
+        if (capacity >= needed) {
+            SIZE_T bytes = (SIZE_T)capacity * sizeof(WCHAR);
+            grown = job->cacheText ? (WCHAR *)HeapReAlloc(GetProcessHeap(), 0, job->cacheText, bytes)
+                                   : (WCHAR *)HeapAlloc(GetProcessHeap(), 0, bytes);
+        }
+        if (!grown) {
+            DropCacheCopy(job); // too big for the cache after all
+            return;
+        }
+        job->cacheText = grown;
+        job->cacheCapacity = (size_t)capacity;
+    }
+    CopyMemory(job->cacheText + job->cacheLength, text, units * sizeof(WCHAR));
+    job->cacheLength += units;
+}
+
+static size_t ReadLoadInput(void *context, uint8_t *buffer, size_t size) {
+    DWORD read = 0;
+    if (!ReadFile((HANDLE)context, buffer, (DWORD)size, &read, NULL)) return 0;
+    return read;
+}
+
+// Fingerprints the file on the way past: every byte the loader reads.
+static size_t ReadHashedInput(void *context, uint8_t *buffer, size_t size) {
+    LoadJob *job = (LoadJob *)context;
+    size_t read = ReadLoadInput(job->file.file, buffer, size);
+    TextHashUpdate(&job->hash, buffer, read);
+    job->hashedBytes += read;
+    return read;
+}
+
+// True when the file starts with the gzip magic. Moves the file pointer.
+static BOOL HasGzipMagic(HANDLE file) {
+    BYTE magic[3];
+    DWORD read = 0;
+    OVERLAPPED at = {0};
+    return ReadFile(file, magic, sizeof(magic), &read, &at) && TextGzipDetect(magic, read);
+}
+
+static size_t ReadGzipInput(void *context, uint8_t *buffer, size_t size) {
+    return TextGzipReaderRead((TextGzipReader *)context, buffer, size);
+}
+
+// Starts inflating the file from its first byte, reading it through
+// `read`; free `gz` either way.
+static BOOL OpenGzipInput(const MappedFile *mf, TextGzipReader *gz, TextGzipRead read, void *readContext) {
+    LARGE_INTEGER start = {0};
+    BOOL ok = TextGzipReaderInit(gz, read, readContext);
+    return ok && SetFilePointerEx(mf->file, start, NULL, FILE_BEGIN);
+}
+
+// A deflate stream cannot seek to the regions TextPlanSamples picks, so
+// compressed files are guessed from their leading decompressed bytes.
+#define GZIP_SAMPLE_BYTES (256u * 1024u)
+
+static BOOL GuessGzipEncoding(const MappedFile *mf, EncodingGuess *guess) {
+    TextGzipReader gz;
+    ZeroMemory(&gz, sizeof(gz));
+    BYTE *buffer = (BYTE *)HeapAlloc(GetProcessHeap(), 0, GZIP_SAMPLE_BYTES);
+    BOOL ok = buffer && OpenGzipInput(mf, &gz, ReadLoadInput, mf->file);
+    size_t got = 0;
+    while (ok && got < GZIP_SAMPLE_BYTES) {
+        size_t n = TextGzipReaderRead(&gz, buffer + got, GZIP_SAMPLE_BYTES - got);
+        if (n == 0) break;
+        got += n;
+    }
+    if (ok && !gz.failed) {
+        TextSample sample;
+        sample.data = buffer;
+        sample.size = got;
+        sample.offset = 0;
+        // Short of the sample size means the whole stream was read.
+        TextDetectEncoding(&sample, 1, got < GZIP_SAMPLE_BYTES ? got : UINT64_MAX, GetAnsiCodePage(), guess);
+    } else {
+        ok = FALSE;
+    }
+    TextGzipReaderFree(&gz);
+    if (buffer) HeapFree(GetProcessHeap(), 0, buffer);
+    return ok;
+}
+
+static size_t DecodeAnsiChunk(void *context, const uint8_t *data, size_t size, bool final, uint16_t *out) {
+    DecodeJob *job = (DecodeJob *)context;
+    job->out = (WCHAR *)out;
+    job->units = 0;
+    if (!DecodeAnsiView(job, data, size, final ? TRUE : FALSE)) return 0;
+    return (size_t)job->units;
+}
+
+// Waits for a free slot (or cancellation) and hands the chunk to the UI.
+static BOOL PostLoadChunk(LoadJob *job, LoadChunk *chunk) {
+    HANDLE waits[2] = { job->cancelEvent, job->slots };
+    if (WaitForMultipleObjects(2, waits, FALSE, INFINITE) != WAIT_OBJECT_0 + 1) {
+        FreeLoadChunk(chunk);
+        return FALSE;
+    }
+    if (!PostMessageW(job->notify, WM_APP_LOAD_CHUNK, (WPARAM)job, (LPARAM)chunk)) {
+        FreeLoadChunk(chunk);
+        ReleaseSemaphore(job->slots, 1, NULL);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Streams one decoding attempt. Returns FALSE with *retryAsAnsi set when an
+// unconfirmed UTF-8 guess turns out to be wrong.
+static BOOL StreamDecodedChunks(LoadJob *job, ULONGLONG bomLength, BOOL checkUtf8, BOOL restart, BOOL *retryAsAnsi) {
+    MappedFile *mf = &job->file;
+    *retryAsAnsi = FALSE;
+    ULONGLONG payload = mf->size - bomLength;
+    TextLoaderRead read = NULL;
+    void *readContext = NULL;
+    TextGzipReader gz;
+    ZeroMemory(&gz, sizeof(gz));
+    BYTE bom[4];
+    TextHashInit(&job->hash, 0);
+    job->hashedBytes = 0;
+    if (job->compressed) {
+        // Inflated bytes feed the decoder directly; how many there are is
+        // only known once the stream ends.
+        if (!OpenGzipInput(mf, &gz, ReadHashedInput, job) || TextGzipReaderRead(&gz, bom, (size_t)bomLength) != bomLength) {
+            TextGzipReaderFree(&gz);
+            return FALSE;
+        }
+        payload = UINT64_MAX;
+        read = ReadGzipInput;
+        readContext = &gz;
+    } else {
+        // From the very start, so the BOM is fingerprinted too.
+        LARGE_INTEGER start = {0};
+        if (!SetFilePointerEx(mf->file, start, NULL, FILE_BEGIN) || ReadHashedInput(job, bom, (size_t)bomLength) != bomLength) {
+            return FALSE;
+        }
+        read = ReadHashedInput;
+        readContext = job;
+    }
+
+    TextLoader loader;
+    if (!TextLoaderInit(&loader, job->encoding, payload, read, readContext)) {
+        TextLoaderFree(&loader);
+        TextGzipReaderFree(&gz);
+        return FALSE;
+    }
+    DecodeJob ansi;
+    if (job->encoding == ENC_ANSI) {
+        InitDecodeJob(&ansi, job->codePage, NULL);
+        TextLoaderSetDecoder(&loader, DecodeAnsiChunk, &ansi);
+    }
+    // A sequence cut off by the end of the file (a log truncated mid-write)
+    // is not evidence of a legacy code page.
+    ULONGLONG invalidTailFrom = payload > 3 ? payload - 3 : 0;
+    BOOL utf16 = (job->encoding == ENC_UTF16LE || job->encoding == ENC_UTF16BE);
+    ULONGLONG unitsSoFar = 0;
+    ULONGLONG expectedUnits = job->compressed ? 0 : utf16 ? payload / 2 : payload;
+    job->cacheLength = 0;
+    TextBaselineFree(&job->baseline);
+    TextBaselineInit(&job->baseline, job->encoding);
+    TextBaselineAddMark(&job->baseline, 0, bomLength);
+    TextLineIndexFree(&job->lines);
+    TextLineIndexInit(&job->lines);
+
+    BOOL ok = TRUE;
+    while (ok) {
+        if (WaitForSingleObject(job->cancelEvent, 0) == WAIT_OBJECT_0) {
+            job->cancelled = TRUE;
+            ok = FALSE;
+            break;
+        }
+        size_t capacity = TextLoaderChunkCapacity(&loader);
+        LoadChunk *chunk = AllocLoadChunk(capacity);
+        if (!chunk) {
+            ok = FALSE;
+            break;
+        }
+        size_t units = 0;
+        if (!TextLoaderNext(&loader, (uint16_t *)chunk->text, &units)) {
+            FreeLoadChunk(chunk);
+            break;
+        }
+        if (checkUtf8 && loader.decoder.invalidCount > 0 && loader.decoder.firstInvalidOffset < invalidTailFrom) {
+            // Malformed UTF-8 before the tail: not UTF-8 after all. Encoded
+            // lone surrogates alone do not count.
+            FreeLoadChunk(chunk);
+            *retryAsAnsi = TRUE;
+            ok = FALSE;
+            break;
+        }
+        chunk->text[units] = L'\0';
+        chunk->length = units;
+        chunk->restart = restart;
+        chunk->bytesDone = job->compressed ? gz.inputBytes : bomLength + loader.bytesDone;
+        chunk->bytesTotal = mf->size;
+        restart = FALSE;
+        // Chunk boundaries double as unit/byte marks for verbatim saves; a
+        // trailing odd UTF-16 byte is not part of any unit.
+        unitsSoFar += units;
+        TextBaselineAddMark(&job->baseline, unitsSoFar,
+                            utf16 ? bomLength + unitsSoFar * 2 : bomLength + loader.bytesDone - loader.decoder.pendingLen);
+        // Index lines while the chunk is still warm in cache.
+        TextLineIndexAppend(&job->lines, (const uint16_t *)chunk->text, units);
+        KeepForCache(job, chunk->text, units, expectedUnits);
+        if (!PostLoadChunk(job, chunk)) {
+            job->cancelled = (WaitForSingleObject(job->cancelEvent, 0) == WAIT_OBJECT_0);
+            ok = FALSE;
+        }
+    }
+    if (loader.decoder.invalidCount > 0 || loader.decoder.surrogateCount > 0 || job->compressed) {
+        job->baseline.valid = false; // re-encoding would not give back the same bytes
+    }
+    if (gz.failed) ok = FALSE; // corrupt or truncated: do not pass off a prefix as the file
+    TextBaselineSeal(&job->baseline, unitsSoFar);
+    TextLineIndexFinish(&job->lines);
+    if (loader.firstNul != TEXT_LOADER_NO_NUL) {
+        // The edit control stops each chunk at its first U+0000 and shows
+        // less than was decoded: the byte map, the line index and a cached
+        // copy would all describe text that is not on screen.
+        job->baseline.valid = false;
+        TextLineIndexFree(&job->lines);
+        TextLineIndexInit(&job->lines);
+        DropCacheCopy(job);
+    }
+    TextLoaderFree(&loader);
+    TextGzipReaderFree(&gz);
+    return ok;
+}
+
+static DWORD WINAPI LoadWorkerThread(LPVOID param) {
+    LoadJob *job = (LoadJob *)param;
+    job->encoding = ENC_UTF8;
+    job->ok = TRUE;
+    job->keyed = ReadDocumentKey(job->file.file, &job->key) && job->key.size == job->file.size;
+    TextHashInit(&job->hash, 0);
+    if (job->file.size > 0) {
+        EncodingGuess guess;
+        job->compressed = HasGzipMagic(job->file.file);
+        job->ok = (job->compressed ? GuessGzipEncoding(&job->file, &guess) : GuessFileEncoding(&job->file, &guess)) &&
+                  guess.count > 0;
+        // Decoded text takes at least as many bytes as the file, so larger
+        // plain files are never copied for the cache.
+        job->cacheable = job->keyed && job->cacheBudget > 0 && (job->compressed || job->file.size <= job->cacheBudget);
+        if (job->ok) {
+            BOOL confident = guess.candidates[0].confidence >= TEXT_DETECT_CONFIDENT;
+            // An unsure guess streams as UTF-8 and is checked as it goes.
+            job->encoding = confident ? guess.candidates[0].encoding : ENC_UTF8;
+            BOOL retryAsAnsi = FALSE;
+            job->ok = StreamDecodedChunks(job, guess.bomLength, !confident, FALSE, &retryAsAnsi);
+            if (retryAsAnsi) {
+                job->encoding = ENC_ANSI;
+                job->ok = StreamDecodedChunks(job, 0, FALSE, TRUE, &retryAsAnsi);
+            }
+        }
+    }
+    // A file written to while it loaded may not match the text.
+    DocumentKey after;
+    if (job->ok && job->keyed && ReadDocumentKey(job->file.file, &after) && SameDocumentKey(&after, &job->key) &&
+        job->hashedBytes == job->key.size) {
+        job->fingerprint.valid = TRUE;
+        job->fingerprint.size = job->key.size;
+        job->fingerprint.lastWrite = job->key.lastWrite;
+        job->fingerprint.hash = TextHashDigest(&job->hash);
+    } else {
+        DropCacheCopy(job);
+    }
+    if (!PostMessageW(job->notify, WM_APP_LOAD_DONE, 0, (LPARAM)job)) {
+        job->ok = FALSE;
+    }
+    return 0;
+}
+
+LoadJob *BeginLoadTextFile(HWND owner, LPCWSTR path) {
+    LoadJob *job = (LoadJob *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(LoadJob));
+    if (!job) return NULL;
+    job->notify = owner;
+    job->cacheBudget = g_cache.budget;
+    job->codePage = GetAnsiCodePage();
+    size_t chars = wcslen(path) + 1;
+    job->path = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, chars * sizeof(WCHAR));
+    if (job->path) CopyMemory(job->path, path, chars * sizeof(WCHAR));
+    if (!job->path || !OpenInputFile(path, &job->file)) {
+        if (job->path) HeapFree(GetProcessHeap(), 0, job->path);
+        HeapFree(GetProcessHeap(), 0, job);
+        MessageBoxW(owner, L"Unable to open file.", L"retropad", MB_ICONERROR);
+        return NULL;
+    }
+    job->slots = CreateSemaphoreW(NULL, LOAD_CHUNKS_IN_FLIGHT, LOAD_CHUNKS_IN_FLIGHT, NULL);
+    job->cancelEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (job->slots && job->cancelEvent) {
+        job->thread = CreateThread(NULL, 0, LoadWorkerThread, job, 0, NULL);
+    }
+    if (!job->thread) {
+        if (job->slots) CloseHandle(job->slots);
+        if (job->cancelEvent) CloseHandle(job->cancelEvent);
+        CloseMappedFile(&job->file);
+        HeapFree(GetProcessHeap(), 0, job->path);
+        HeapFree(GetProcessHeap(), 0, job);
+        MessageBoxW(owner, L"Unable to open file.", L"retropad", MB_ICONERROR);
+        return NULL;
+    }
+    return job;
+}
+
+void FreeLoadChunk(LoadChunk *chunk) {
+    ChunkBlock *block = CONTAINING_RECORD(chunk, ChunkBlock, chunk);
+    ChunkBlock *evicted = NULL;
+    AcquireSRWLockExclusive(&g_chunkLock);
+    ChunkBlock **link = &g_idleBlocks;
+    while (*link && (*link)->capacity < block->capacity) link = &(*link)->next;
+    block->next = *link;
+    *link = block;
+    if (++g_idleBlockCount > LOAD_CHUNKS_IN_FLIGHT) {
+        evicted = g_idleBlocks; // the smallest is the cheapest to remake
+        g_idleBlocks = evicted->next;
+        g_idleBlockCount--;
+    }
+    ReleaseSRWLockExclusive(&g_chunkLock);
+    if (evicted) HeapFree(GetProcessHeap(), 0, evicted);
+}
+
+void AcknowledgeLoadChunk(LoadJob *job, LoadChunk *chunk) {
+    FreeLoadChunk(chunk);
+    ReleaseSemaphore(job->slots, 1, NULL);
+}
+
+void CancelLoadTextFile(LoadJob *job) {
+    SetEvent(job->cancelEvent);
+}
+
+ULONGLONG LoadTextFileSize(const LoadJob *job) {
+    return job->file.size;
+}
+
+BOOL LoadTextFileCompressed(const LoadJob *job) {
+    return job->compressed;
+}
+
+UINT LoadTextFileCodePage(const LoadJob *job) {
+    return job->codePage;
+}
+
+void LoadTextFileFingerprint(const LoadJob *job, FileFingerprint *fingerprintOut) {
+    *fingerprintOut = job->fingerprint;
+}
+
+BOOL EndLoadTextFile(HWND owner, LoadJob *job, TextEncoding *encodingOut, SaveBaseline **baselineOut, TextLineIndex *linesOut) {
+    WaitForSingleObject(job->thread, INFINITE);
+    BOOL ok = job->ok;
+    BOOL cancelled = job->cancelled;
+    if (encodingOut) *encodingOut = job->encoding;
+    CloseHandle(job->thread);
+    CloseHandle(job->slots);
+    CloseHandle(job->cancelEvent);
+    CloseMappedFile(&job->file);
+    TrimLoadChunks();
+    if (ok && job->cacheText) {
+        job->cacheText[job->cacheLength] = L'\0';
+        CacheDocument(job->path, &job->key, &job->fingerprint, job->cacheText, job->cacheLength, job->encoding,
+                      job->codePage, job->compressed, &job->lines, &job->baseline);
+        job->cacheText = NULL;
+    }
+    DropCacheCopy(job);
+    if (baselineOut) {
+        *baselineOut = ok ? CreateSaveBaseline(job->path, &job->baseline) : NULL;
+    }
+    TextBaselineFree(&job->baseline);
+    if (linesOut && ok) {
+        *linesOut = job->lines;
+    } else {
+        TextLineIndexFree(&job->lines);
+        if (linesOut) TextLineIndexInit(linesOut);
+    }
+    HeapFree(GetProcessHeap(), 0, job->path);
+    HeapFree(GetProcessHeap(), 0, job);
+    if (!ok && !cancelled) {
+        MessageBoxW(owner, L"Unable to decode file.", L"retropad", MB_ICONERROR);
+    }
+    return ok;
+}
+
+// Views the paged viewer copies pages out of; a multiple of the allocation
+// granularity, and many pages wide so neighbouring pages share a view.
+#define PAGED_VIEW_BYTES (4u * 1024u * 1024u)
+// Decoded pages kept around: a few screens either side of the viewport.
+#define PAGED_CACHE_PAGES 32
+
+struct PagedFile {
+    MappedFile file;
+    const BYTE *view;      // current mapped window of the file
+    ULONGLONG viewOffset;
+    SIZE_T viewBytes;
+    UINT codePage;         // for ENC_ANSI
+    TextPager pager;
+};
+
+BOOL QueryFileSize(LPCWSTR path, ULONGLONG *sizeOut) {
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(path, GetFileExInfoStandard, &data)) return FALSE;
+    *sizeOut = ((ULONGLONG)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    return TRUE;
+}
+
+BOOL IsGzipFile(LPCWSTR path) {
+    HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return FALSE;
+    BOOL gzip = HasGzipMagic(file);
+    CloseHandle(file);
+    return gzip;
+}
+
+static size_t ReadPagedInput(void *context, uint64_t offset, uint8_t *buffer, size_t size) {
+    PagedFile *pf = (PagedFile *)context;
+    if (offset >= pf->file.size) return 0;
+    if (!pf->view || offset < pf->viewOffset || offset >= pf->viewOffset + pf->viewBytes) {
+        if (pf->view) UnmapViewOfFile(pf->view);
+        ULONGLONG base = offset - offset % PAGED_VIEW_BYTES;
+        ULONGLONG remaining = pf->file.size - base;
+        pf->viewBytes = (SIZE_T)(remaining < PAGED_VIEW_BYTES ? remaining : PAGED_VIEW_BYTES);
+        pf->viewOffset = base;
+        pf->view = (const BYTE *)MapViewOfFile(pf->file.mapping, FILE_MAP_READ, (DWORD)(base >> 32), (DWORD)(base & 0xFFFFFFFFu), pf->viewBytes);
+        if (!pf->view) return 0;
+    }
+    SIZE_T available = (SIZE_T)(pf->viewOffset + pf->viewBytes - offset);
+    if (size > available) size = available;
+    CopyMemory(buffer, pf->view + (offset - pf->viewOffset), size);
+    return size;
+}
+
+static size_t DecodePagedAnsi(void *context, const uint8_t *data, size_t size, uint16_t *out) {
+    const PagedFile *pf = (const PagedFile *)context;
+    if (size == 0) return 0;
+    if (TextCodePageKnown(pf->codePage)) return TextCodePageDecode(pf->codePage, data, size, out);
+    int chars = MultiByteToWideChar(pf->codePage, 0, (LPCSTR)data, (int)size, (WCHAR *)out, (int)size);
+    return chars > 0 ? (size_t)chars : 0;
+}
+
+PagedFile *OpenPagedFile(HWND owner, LPCWSTR path, TextEncoding *encodingOut, UINT *codePageOut) {
+    PagedFile *pf = (PagedFile *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(PagedFile));
+    if (!pf || !OpenMappedFile(path, &pf->file)) {
+        if (pf) HeapFree(GetProcessHeap(), 0, pf);
+        MessageBoxW(owner, L"Unable to open file.", L"retropad", MB_ICONERROR);
+        return NULL;
+    }
+    pf->codePage = GetAnsiCodePage();
+    // No full-file check here: the best sampled guess has to do.
+    EncodingGuess guess;
+    TextEncoding enc = ENC_UTF8;
+    ULONGLONG bomLength = 0;
+    if (pf->file.size > 0 && GuessFileEncoding(&pf->file, &guess) && guess.count > 0) {
+        enc = guess.candidates[0].encoding;
+        bomLength = guess.bomLength;
+    }
+    if (!TextPagerInit(&pf->pager, enc, pf->file.size, bomLength, PAGED_CACHE_PAGES, ReadPagedInput, pf)) {
+        CloseMappedFile(&pf->file);
+        HeapFree(GetProcessHeap(), 0, pf);
+        MessageBoxW(owner, L"Not enough memory to view this file.", L"retropad", MB_ICONERROR);
+        return NULL;
+    }
+    TextPagerSetDecoder(&pf->pager, DecodePagedAnsi, pf);
+    if (encodingOut) *encodingOut = enc;
+    if (codePageOut) *codePageOut = pf->codePage;
+    return pf;
+}
+
+TextPager *GetPagedText(PagedFile *file) {
+    return &file->pager;
+}
+
+void ClosePagedFile(PagedFile *file) {
+    if (!file) return;
+    TextPagerFree(&file->pager);
+    if (file->view) UnmapViewOfFile(file->view);
+    CloseMappedFile(&file->file);
+    HeapFree(GetProcessHeap(), 0, file);
+}
+
+// Most bytes one poll reads; a burst bigger than this arrives over
+// several polls instead of stalling the UI.
+#define FOLLOW_READ_BYTES (4u * 1024u * 1024u)
+
+struct FollowedFile {
+    WCHAR *path;
+    TextFollower follower;
+    DecodeJob ansi;
+    BYTE *input;
+};
+
+// Opens `path` for a look that neither blocks writers nor rotation.
+static HANDLE OpenFollowedPath(LPCWSTR path) {
+    HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    return file == INVALID_HANDLE_VALUE ? NULL : file;
+}
+
+// Size, identity and first bytes of an open file, as TextFollowerCheck wants them.
+static BOOL StatFollowedFile(HANDLE file, ULONGLONG *sizeOut, ULONGLONG *idOut, BYTE *head, DWORD *headLenOut) {
+    BY_HANDLE_FILE_INFORMATION info;
+    if (!GetFileInformationByHandle(file, &info)) return FALSE;
+    *sizeOut = ((ULONGLONG)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    *idOut = ((ULONGLONG)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+    *headLenOut = 0;
+    LARGE_INTEGER zero = {0};
+    if (!SetFilePointerEx(file, zero, NULL, FILE_BEGIN)) return FALSE;
+    return ReadFile(file, head, TEXT_FOLLOW_HEAD_BYTES, headLenOut, NULL);
+}
+
+FollowedFile *BeginFollowingFile(HWND owner, LPCWSTR path, TextEncoding encoding, UINT codePage, ULONGLONG offset) {
+    FollowedFile *ff = (FollowedFile *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(FollowedFile));
+    size_t chars = wcslen(path) + 1;
+    if (ff) ff->path = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, chars * sizeof(WCHAR));
+    if (ff && ff->path) ff->input = (BYTE *)HeapAlloc(GetProcessHeap(), 0, FOLLOW_READ_BYTES);
+    HANDLE file = (ff && ff->input) ? OpenFollowedPath(path) : NULL;
+    ULONGLONG size = 0, id = 0;
+    BYTE head[TEXT_FOLLOW_HEAD_BYTES];
+    DWORD headLen = 0;
+    BOOL ok = file && StatFollowedFile(file, &size, &id, head, &headLen);
+    if (file) CloseHandle(file);
+    if (!ok) {
+        EndFollowingFile(ff);
+        MessageBoxW(owner, L"Unable to follow file.", L"retropad", MB_ICONERROR);
+        return NULL;
+    }
+    CopyMemory(ff->path, path, chars * sizeof(WCHAR));
+    TextFollowerInit(&ff->follower, encoding, offset, id, head, headLen);
+    if (encoding == ENC_ANSI) {
+        InitDecodeJob(&ff->ansi, codePage, NULL);
+        TextFollowerSetDecoder(&ff->follower, DecodeAnsiChunk, &ff->ansi);
+    }
+    return ff;
+}
+
+FollowStatus PollFollowedFile(FollowedFile *ff, WCHAR **textOut, size_t *lengthOut) {
+    *textOut = NULL;
+    *lengthOut = 0;
+    // Between a rotation's rename and the new file appearing there is
+    // nothing to look at yet; try again next time.
+    HANDLE file = OpenFollowedPath(ff->path);
+    if (!file) return FOLLOW_IDLE;
+    ULONGLONG size = 0, id = 0;
+    BYTE head[TEXT_FOLLOW_HEAD_BYTES];
+    DWORD headLen = 0;
+    FollowStatus status = FOLLOW_IDLE;
+    if (StatFollowedFile(file, &size, &id, head, &headLen)) {
+        switch (TextFollowerCheck(&ff->follower, size, id, head, headLen)) {
+        case TEXT_FOLLOW_TRUNCATED:
+        case TEXT_FOLLOW_REPLACED:
+            status = FOLLOW_RESTART;
+            break;
+        case TEXT_FOLLOW_GREW: {
+            ULONGLONG pending = size - ff->follower.offset;
+            DWORD want = (DWORD)(pending < FOLLOW_READ_BYTES ? pending : FOLLOW_READ_BYTES);
+            DWORD got = 0;
+            LARGE_INTEGER at;
+            at.QuadPart = (LONGLONG)ff->follower.offset;
+            if (!SetFilePointerEx(file, at, NULL, FILE_BEGIN) || !ReadFile(file, ff->input, want, &got, NULL) || got == 0) {
+                break;
+            }
+            size_t capacity = TextFollowerMaxOutput(&ff->follower, got);
+            WCHAR *text = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (capacity + 1) * sizeof(WCHAR));
+            if (!text) break;
+            size_t units = TextFollowerDecode(&ff->follower, ff->input, got, (uint16_t *)text);
+            text[units] = L'\0';
+            if (units == 0) {
+                // Only part of a character, or of a BOM, so far.
+                HeapFree(GetProcessHeap(), 0, text);
+                break;
+            }
+            *textOut = text;
+            *lengthOut = units;
+            status = FOLLOW_APPENDED;
+            break;
+        }
+        case TEXT_FOLLOW_UNCHANGED:
+            break;
+        }
+    }
+    CloseHandle(file);
+    return status;
+}
+
+ULONGLONG FollowedFileSize(const FollowedFile *ff) {
+    // Bytes held back as an incomplete character have not been shown.
+    ULONGLONG held = ff->follower.decode ? (ff->ansi.hasAnsiCarry ? 1 : 0) : ff->follower.decoder.pendingLen;
+    return ff->follower.offset - held;
+}
+
+void FreeFollowedText(WCHAR *text) {
+    if (text) HeapFree(GetProcessHeap(), 0, text);
+}
+
+void EndFollowingFile(FollowedFile *ff) {
+    if (!ff) return;
+    if (ff->input) HeapFree(GetProcessHeap(), 0, ff->input);
+    if (ff->path) HeapFree(GetProcessHeap(), 0, ff->path);
+    HeapFree(GetProcessHeap(), 0, ff);
+}
+
+// Version history: every save is also recorded, as written but before any
+// gzip compression, in a store under %LOCALAPPDATA%\retropad\history.
+// chunks.pack holds each distinct chunk once (text_history.h decides where
+// chunks start), chunks.idx a TextChunkRecord per chunk in pack order, and
+// <XXH64 of the path>.ver the versions of one file, each a VersionHeader
+// followed by its chunk ordinals. Files only ever grow; a crash leaves at
+// worst a partial tail, which the next save trims or ignores.
+#define HISTORY_MAGIC 0x31565052u // "RPV1"
+#define HISTORY_COMPRESSED 1u
+
+typedef struct VersionHeader {
+    uint32_t magic;
+    uint32_t chunkCount;
+    uint64_t size;
+    FILETIME saved;
+    uint32_t flags;
+    uint32_t encoding;
+} VersionHeader;
+
+typedef struct HistoryRecorder {
+    HANDLE pack;
+    HANDLE index;
+    ULONGLONG packSize;
+    TextVersionWriter writer;
+    WCHAR versions[MAX_PATH];
+} HistoryRecorder;
+
+static BOOL g_historyEnabled = TRUE;
+// chunks.idx as far as it has been read; reread only past this point.
+static TextChunkIndex g_historyIndex;
+static ULONGLONG g_historyIndexBytes;
+
+void SetHistoryEnabled(BOOL enabled) {
+    g_historyEnabled = enabled;
+}
+
+// A folder under %LOCALAPPDATA%\retropad (created if need be) or, with
+// `name`, a file in it.
+static BOOL AppDataPath(LPCWSTR folder, LPCWSTR name, WCHAR *out, size_t outLen) {
+    WCHAR base[MAX_PATH];
+    if (FAILED(SHGetFolderPathW(NULL, CSIDL_LOCAL_APPDATA | CSIDL_FLAG_CREATE, NULL, SHGFP_TYPE_CURRENT, base))) {
+        return FALSE;
+    }
+    if (FAILED(StringCchPrintfW(out, outLen, L"%s\\retropad", base))) return FALSE;
+    CreateDirectoryW(out, NULL);
+    if (FAILED(StringCchPrintfW(out + wcslen(out), outLen - wcslen(out), L"\\%s", folder))) return FALSE;
+    CreateDirectoryW(out, NULL);
+    return !name || SUCCEEDED(StringCchPrintfW(out + wcslen(out), outLen - wcslen(out), L"\\%s", name));
+}
+
+// The version list for `path`, named by a hash of its case-folded full path.
+static BOOL VersionListPath(LPCWSTR path, WCHAR *out, size_t outLen) {
+    WCHAR full[MAX_PATH * 4];
+    DWORD len = GetFullPathNameW(path, ARRAYSIZE(full), full, NULL);
+    if (len == 0 || len >= ARRAYSIZE(full)) return FALSE;
+    CharUpperBuffW(full, len);
+    WCHAR name[32];
+    StringCchPrintfW(name, ARRAYSIZE(name), L"%016llx.ver", TextHash64(full, len * sizeof(WCHAR), 0));
+    return AppDataPath(L"history", name, out, outLen);
+}
+
+static BOOL SeekFile(HANDLE file, ULONGLONG offset) {
+    LARGE_INTEGER at;
+    at.QuadPart = (LONGLONG)offset;
+    return SetFilePointerEx(file, at, NULL, FILE_BEGIN);
+}
+
+static BOOL ReadExactly(HANDLE file, void *buffer, DWORD size) {
+    DWORD read = 0;
+    return ReadFile(file, buffer, size, &read, NULL) && read == size;
+}
+
+static BOOL WriteExactly(HANDLE file, const void *data, DWORD size) {
+    DWORD written = 0;
+    return WriteFile(file, data, size, &written, NULL) && written == size;
+}
+
+// Brings g_historyIndex up to date with chunks.idx. Records pointing past
+// the end of the pack (a crash between the two writes) end the index.
+static BOOL SyncHistoryIndex(HANDLE index, ULONGLONG packSize, ULONGLONG *validBytesOut) {
+    LARGE_INTEGER size = {0};
+    if (!GetFileSizeEx(index, &size)) return FALSE;
+    ULONGLONG end = (ULONGLONG)size.QuadPart - (ULONGLONG)size.QuadPart % sizeof(TextChunkRecord);
+    if (end < g_historyIndexBytes) {
+        // The store was cleared or replaced under us.
+        TextChunkIndexFree(&g_historyIndex);
+        g_historyIndexBytes = 0;
+    }
+    BOOL ok = SeekFile(index, g_historyIndexBytes);
+    TextChunkRecord records[256];
+    while (ok && g_historyIndexBytes < end) {
+        DWORD want = (DWORD)min((ULONGLONG)sizeof(records), end - g_historyIndexBytes);
+        ok = ReadExactly(index, records, want);
+        for (DWORD i = 0; ok && i < want / sizeof(TextChunkRecord); ++i) {
+            if (records[i].offset + records[i].length > packSize) {
+                end = g_historyIndexBytes;
+                break;
+            }
+            ok = TextChunkIndexAdd(&g_historyIndex, &records[i]);
+            if (ok) g_historyIndexBytes += sizeof(TextChunkRecord);
+        }
+    }
+    if (validBytesOut) *validBytesOut = g_historyIndexBytes;
+    return ok;
+}
+
+static bool StoreHistoryChunk(void *context, const uint8_t *data, size_t size, uint64_t *offsetOut) {
+    HistoryRecorder *recorder = (HistoryRecorder *)context;
+    if (!WriteExactly(recorder->pack, data, (DWORD)size)) return false;
+    *offsetOut = recorder->packSize;
+    recorder->packSize += size;
+    return true;
+}
+
+static HANDLE OpenHistoryFile(LPCWSTR name, BOOL write) {
+    WCHAR path[MAX_PATH];
+    if (!AppDataPath(L"history", name, path, ARRAYSIZE(path))) return INVALID_HANDLE_VALUE;
+    // One writer at a time: a second instance saving meanwhile records nothing.
+    return CreateFileW(path, write ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                       write ? FILE_SHARE_READ : FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                       write ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+// Starts recording a version of `path`; FALSE when history is off or the
+// store cannot be opened, and the save goes ahead without it.
+static BOOL BeginHistoryVersion(HistoryRecorder *recorder, LPCWSTR path) {
+    ZeroMemory(recorder, sizeof(*recorder));
+    recorder->pack = INVALID_HANDLE_VALUE;
+    recorder->index = INVALID_HANDLE_VALUE;
+    if (!g_historyEnabled || !VersionListPath(path, recorder->versions, ARRAYSIZE(recorder->versions))) return FALSE;
+    recorder->pack = OpenHistoryFile(L"chunks.pack", TRUE);
+    recorder->index = OpenHistoryFile(L"chunks.idx", TRUE);
+    LARGE_INTEGER size = {0};
+    ULONGLONG indexBytes = 0;
+    BOOL ok = recorder->pack != INVALID_HANDLE_VALUE && recorder->index != INVALID_HANDLE_VALUE &&
+              GetFileSizeEx(recorder->pack, &size);
+    recorder->packSize = (ULONGLONG)size.QuadPart;
+    ok = ok && SyncHistoryIndex(recorder->index, recorder->packSize, &indexBytes) &&
+         SeekFile(recorder->index, indexBytes) && SetEndOfFile(recorder->index) &&
+         SeekFile(recorder->pack, recorder->packSize) &&
+         TextVersionWriterInit(&recorder->writer, &g_historyIndex, StoreHistoryChunk, recorder);
+    if (!ok) {
+        if (recorder->pack != INVALID_HANDLE_VALUE) CloseHandle(recorder->pack);
+        if (recorder->index != INVALID_HANDLE_VALUE) CloseHandle(recorder->index);
+        TextVersionWriterFree(&recorder->writer);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void AddHistoryBytes(HistoryRecorder *recorder, const BYTE *data, SIZE_T size) {
+    TextVersionWriterAdd(&recorder->writer, data, size);
+}
+
+// Files the version when the save succeeded; otherwise (or if the store
+// fails) forgets the chunks it added, leaving only unreferenced bytes.
+// Returns the bytes the store had to take in for it.
+static ULONGLONG EndHistoryVersion(HistoryRecorder *recorder, BOOL saved, TextEncoding encoding, BOOL compressed) {
+    TextVersionWriter *writer = &recorder->writer;
+    BOOL ok = saved && TextVersionWriterFinish(writer);
+    size_t fresh = g_historyIndex.count - writer->firstNew;
+    if (ok && fresh > 0) {
+        ok = WriteExactly(recorder->index, g_historyIndex.records + writer->firstNew,
+                          (DWORD)(fresh * sizeof(TextChunkRecord)));
+        if (ok) g_historyIndexBytes += fresh * sizeof(TextChunkRecord);
+    }
+    if (ok) {
+        VersionHeader header = {HISTORY_MAGIC, (uint32_t)writer->count, writer->bytes, {0, 0},
+                                compressed ? HISTORY_COMPRESSED : 0u, (uint32_t)encoding};
+        GetSystemTimeAsFileTime(&header.saved);
+        HANDLE list = CreateFileW(recorder->versions, FILE_APPEND_DATA, FILE_SHARE_READ, NULL, OPEN_ALWAYS,
+                                  FILE_ATTRIBUTE_NORMAL, NULL);
+        ok = list != INVALID_HANDLE_VALUE && WriteExactly(list, &header, sizeof(header)) &&
+             WriteExactly(list, writer->chunks, (DWORD)(writer->count * sizeof(uint32_t)));
+        if (list != INVALID_HANDLE_VALUE) CloseHandle(list);
+    }
+    ULONGLONG stored = ok ? writer->newBytes : 0;
+    if (!ok) {
+        TextChunkIndexTruncate(&g_historyIndex, writer->firstNew);
+        g_historyIndexBytes = writer->firstNew * sizeof(TextChunkRecord);
+        SeekFile(recorder->index, g_historyIndexBytes);
+        SetEndOfFile(recorder->index);
     }
-    if (size >= 2 && data[0] == 0xFE && data[1] == 0xFF) {
-        return ENC_UTF16BE;
+    TextVersionWriterFree(writer);
+    CloseHandle(recorder->pack);
+    CloseHandle(recorder->index);
+    return stored;
+}
+
+// Everything a save writes passes through here: hashed for the file's
+// fingerprint and, when recording, handed to the version history as the
+// encoded text (before any gzip).
+typedef struct SaveTap {
+    TextHash hash;
+    HistoryRecorder *history;
+} SaveTap;
+
+// Saves stream through two fixed-size buffers: while a writer thread puts one
+// chunk on disk the next is encoded into the other, so memory stays constant
+// no matter how big the document is.
+#define SAVE_CHUNK_UNITS (256u * 1024u)
+
+typedef struct ChunkCodec ChunkCodec;
+
+// Encodes `units` UTF-16 units into `out` (at least units * maxBytesPerUnit
+// bytes) and returns the byte count, or 0 on failure.
+typedef int (*ChunkEncoder)(const ChunkCodec *codec, const WCHAR *text, int units, BYTE *out, int capacity);
+
+// How a save turns text into bytes.
+struct ChunkCodec {
+    TextEncoding encoding;
+    ChunkEncoder encode;
+    const BYTE *bom;
+    SIZE_T bomLength;
+    int maxBytesPerUnit;
+    UINT codePage;             // for ENC_ANSI...
+    TextCodePageEncoder table; // ...and its reverse table, when built in
+};
+
+typedef struct SaveStream {
+    HANDLE file;
+    HANDLE writer;       // thread that performs the blocking WriteFile calls
+    HANDLE chunkReady;   // signalled by the encoder, consumed by the writer
+    HANDLE chunkDone;    // signalled by the writer once a chunk is on disk
+    BOOL pending;        // the writer owns the other buffer
+    const BYTE *chunk;   // chunk handed to the writer...
+    DWORD chunkBytes;
+    BOOL chunkOk;        // ...and its outcome
+    BOOL stop;
+    BYTE *buffers[2];
+    int active;          // buffer the next chunk is encoded into
+} SaveStream;
+
+// One pass with a vector ASCII path; WideCharToMultiByte would scan twice.
+static int EncodeUtf8Chunk(const ChunkCodec *codec, const WCHAR *text, int units, BYTE *out, int capacity) {
+    (void)codec;
+    (void)capacity;
+    return (int)TextEncodeUtf8((const uint16_t *)text, (size_t)units, out);
+}
+
+static int EncodeAnsiChunk(const ChunkCodec *codec, const WCHAR *text, int units, BYTE *out, int capacity) {
+    return WideCharToMultiByte(codec->codePage, 0, text, units, (LPSTR)out, capacity, NULL, NULL);
+}
+
+// Built-in single-byte tables: one pass, one byte per unit.
+static int EncodeCodePageChunk(const ChunkCodec *codec, const WCHAR *text, int units, BYTE *out, int capacity) {
+    (void)capacity;
+    return (int)TextCodePageEncode(&codec->table, (const uint16_t *)text, (size_t)units, out, NULL);
+}
+
+static int EncodeUtf16LEChunk(const ChunkCodec *codec, const WCHAR *text, int units, BYTE *out, int capacity) {
+    (void)codec;
+    (void)capacity;
+    CopyMemory(out, text, (SIZE_T)units * sizeof(WCHAR));
+    return units * (int)sizeof(WCHAR);
+}
+
+static int EncodeUtf16BEChunk(const ChunkCodec *codec, const WCHAR *text, int units, BYTE *out, int capacity) {
+    (void)codec;
+    (void)capacity;
+    TextSwapBytes16(text, (size_t)units, out);
+    return units * (int)sizeof(WCHAR);
+}
+
+static DWORD WINAPI SaveWriterThread(LPVOID param) {
+    SaveStream *stream = (SaveStream *)param;
+    for (;;) {
+        WaitForSingleObject(stream->chunkReady, INFINITE);
+        if (stream->stop) break;
+        DWORD written = 0;
+        stream->chunkOk = WriteFile(stream->file, stream->chunk, stream->chunkBytes, &written, NULL) &&
+                          written == stream->chunkBytes;
+        SetEvent(stream->chunkDone);
+    }
+    return 0;
+}
+
+static BOOL OpenSaveStream(SaveStream *stream, HANDLE file, SIZE_T bufferBytes) {
+    ZeroMemory(stream, sizeof(*stream));
+    stream->file = file;
+    stream->buffers[0] = (BYTE *)HeapAlloc(GetProcessHeap(), 0, bufferBytes);
+    stream->buffers[1] = (BYTE *)HeapAlloc(GetProcessHeap(), 0, bufferBytes);
+    stream->chunkReady = CreateEventW(NULL, FALSE, FALSE, NULL);
+    stream->chunkDone = CreateEventW(NULL, FALSE, FALSE, NULL);
+    if (!stream->buffers[0] || !stream->buffers[1] || !stream->chunkReady || !stream->chunkDone) return FALSE;
+    stream->writer = CreateThread(NULL, 0, SaveWriterThread, stream, 0, NULL);
+    return stream->writer != NULL;
+}
+
+// Waits for the chunk the writer is working on, if any.
+static BOOL FinishPendingWrite(SaveStream *stream) {
+    if (!stream->pending) return TRUE;
+    stream->pending = FALSE;
+    WaitForSingleObject(stream->chunkDone, INFINITE);
+    return stream->chunkOk;
+}
+
+// Hands `bytes` from the active buffer to the writer and flips to the other
+// one. Only one chunk is ever in flight, so the buffer filled next is idle.
+static BOOL SubmitSaveChunk(SaveStream *stream, DWORD bytes) {
+    if (!FinishPendingWrite(stream)) return FALSE;
+    if (bytes == 0) return TRUE;
+    stream->chunk = stream->buffers[stream->active];
+    stream->chunkBytes = bytes;
+    stream->pending = TRUE;
+    SetEvent(stream->chunkReady);
+    stream->active ^= 1;
+    return TRUE;
+}
+
+static BOOL CloseSaveStream(SaveStream *stream) {
+    BOOL ok = FinishPendingWrite(stream);
+    if (stream->writer) {
+        stream->stop = TRUE;
+        SetEvent(stream->chunkReady);
+        WaitForSingleObject(stream->writer, INFINITE);
+        CloseHandle(stream->writer);
+    }
+    if (stream->chunkReady) CloseHandle(stream->chunkReady);
+    if (stream->chunkDone) CloseHandle(stream->chunkDone);
+    if (stream->buffers[0]) HeapFree(GetProcessHeap(), 0, stream->buffers[0]);
+    if (stream->buffers[1]) HeapFree(GetProcessHeap(), 0, stream->buffers[1]);
+    ZeroMemory(stream, sizeof(*stream));
+    return ok;
+}
+
+// Picks the chunk encoder for `encoding` (and `codePage`, for ANSI) and the
+// BOM saves write with it.
+static void InitChunkCodec(ChunkCodec *codec, TextEncoding encoding, UINT codePage) {
+    static const BYTE utf8Bom[] = {0xEF, 0xBB, 0xBF};
+    static const BYTE utf16LEBom[] = {0xFF, 0xFE};
+    static const BYTE utf16BEBom[] = {0xFE, 0xFF};
+    CPINFO info;
+    ZeroMemory(codec, sizeof(*codec));
+    codec->encoding = encoding;
+    switch (encoding) {
+    case ENC_UTF16LE:
+        codec->bom = utf16LEBom;
+        codec->bomLength = sizeof(utf16LEBom);
+        codec->maxBytesPerUnit = 2;
+        codec->encode = EncodeUtf16LEChunk;
+        break;
+    case ENC_UTF16BE:
+        codec->bom = utf16BEBom;
+        codec->bomLength = sizeof(utf16BEBom);
+        codec->maxBytesPerUnit = 2;
+        codec->encode = EncodeUtf16BEChunk;
+        break;
+    case ENC_ANSI:
+        codec->codePage = codePage;
+        if (TextCodePageEncoderInit(&codec->table, codePage)) {
+            codec->maxBytesPerUnit = 1;
+            codec->encode = EncodeCodePageChunk;
+        } else {
+            codec->maxBytesPerUnit = GetCPInfo(codePage, &info) ? (int)info.MaxCharSize : 2;
+            codec->encode = EncodeAnsiChunk;
+        }
+        break;
+    case ENC_UTF8:
+    default:
+        codec->bom = utf8Bom;
+        codec->bomLength = sizeof(utf8Bom);
+        codec->maxBytesPerUnit = 3; // a surrogate pair is 4 bytes for 2 units
+        codec->encode = EncodeUtf8Chunk;
+        break;
+    }
+}
+
+// How many units of text[pos, length) go in the next chunk, keeping
+// surrogate pairs within one chunk.
+static size_t NextChunkUnits(const WCHAR *text, size_t pos, size_t length) {
+    size_t units = min((size_t)SAVE_CHUNK_UNITS, length - pos);
+    if (pos + units < length && units > 1 && IS_HIGH_SURROGATE(text[pos + units - 1])) {
+        units--;
+    }
+    return units;
+}
+
+// Encodes `text` at file position *position (updated on return). When
+// `marks` is given, records where each chunk of units [unitBase, ...) landed.
+// With `gzip`, each encoded chunk is deflated on its way to the writer and
+// the last one ends the stream. `tap` sees the bytes on their way out.
+static BOOL WriteEncodedText(HANDLE file, const WCHAR *text, size_t length, const ChunkCodec *codec, BOOL withBom,
+                             TextGzipWriter *gzip, SaveTap *tap, TextBaseline *marks, ULONGLONG unitBase,
+                             ULONGLONG *position) {
+    const BYTE *bom = withBom ? codec->bom : NULL;
+    SIZE_T bomLength = withBom ? codec->bomLength : 0;
+    if (marks) TextBaselineAddMark(marks, unitBase, *position + bomLength);
+
+    const int capacity = (int)SAVE_CHUNK_UNITS * codec->maxBytesPerUnit;
+    const SIZE_T encodedBytes = bomLength + (SIZE_T)capacity;
+    SaveStream stream;
+    BOOL ok = OpenSaveStream(&stream, file, gzip ? TextGzipWriterBound(encodedBytes) : encodedBytes);
+    BYTE *scratch = NULL; // encoded bytes waiting to be deflated
+    if (ok && gzip) {
+        scratch = (BYTE *)HeapAlloc(GetProcessHeap(), 0, encodedBytes);
+        ok = scratch != NULL;
+    }
+    size_t pos = 0;
+    BOOL first = TRUE;
+    while (ok && (pos < length || first)) {
+        BYTE *out = gzip ? scratch : stream.buffers[stream.active];
+        SIZE_T prefix = 0;
+        if (first && bomLength) {
+            CopyMemory(out, bom, bomLength);
+            prefix = bomLength;
+        }
+        first = FALSE;
+
+        size_t units = NextChunkUnits(text, pos, length);
+        int bytes = 0;
+        if (units > 0) {
+            bytes = codec->encode(codec, text + pos, (int)units, out + prefix, capacity);
+            ok = bytes > 0;
+        }
+        pos += units;
+        SIZE_T chunkBytes = prefix + (SIZE_T)bytes;
+        if (ok && tap->history) AddHistoryBytes(tap->history, out, chunkBytes);
+        if (ok && gzip) {
+            chunkBytes = TextGzipWriterCompress(gzip, out, chunkBytes, pos >= length, stream.buffers[stream.active]);
+        }
+        if (ok) TextHashUpdate(&tap->hash, stream.buffers[stream.active], chunkBytes);
+        if (ok) ok = SubmitSaveChunk(&stream, (DWORD)chunkBytes);
+        *position += chunkBytes;
+        if (marks) TextBaselineAddMark(marks, unitBase + pos, *position);
+    }
+    if (!CloseSaveStream(&stream)) ok = FALSE;
+    if (scratch) HeapFree(GetProcessHeap(), 0, scratch);
+    return ok;
+}
+
+// True when saving `text` would write exactly the `size` bytes hashing to
+// `expected`. Encodes without writing, and gives up as soon as the output
+// outgrows `size`.
+static BOOL EncodesToHash(const WCHAR *text, size_t length, const ChunkCodec *codec, ULONGLONG size, ULONGLONG expected) {
+    SIZE_T bomLength = codec->bomLength;
+    if (bomLength > size) return FALSE;
+    if (codec->maxBytesPerUnit == 1 && bomLength + (ULONGLONG)length != size) return FALSE;
+    if ((codec->encoding == ENC_UTF16LE || codec->encoding == ENC_UTF16BE) && bomLength + (ULONGLONG)length * 2 != size) {
+        return FALSE;
+    }
+
+    const int capacity = (int)SAVE_CHUNK_UNITS * codec->maxBytesPerUnit;
+    BYTE *out = (BYTE *)HeapAlloc(GetProcessHeap(), 0, (SIZE_T)capacity);
+    if (!out) return FALSE;
+    TextHash hash;
+    TextHashInit(&hash, 0);
+    TextHashUpdate(&hash, codec->bom, bomLength);
+    ULONGLONG total = bomLength;
+    BOOL ok = TRUE;
+    for (size_t pos = 0; ok && pos < length;) {
+        size_t units = NextChunkUnits(text, pos, length);
+        int bytes = codec->encode(codec, text + pos, (int)units, out, capacity);
+        total += (ULONGLONG)bytes;
+        ok = bytes > 0 && total <= size;
+        if (ok) TextHashUpdate(&hash, out, (size_t)bytes);
+        pos += units;
+    }
+    HeapFree(GetProcessHeap(), 0, out);
+    return ok && total == size && TextHashDigest(&hash) == expected;
+}
+
+// Opens the baseline's file for copying, provided nobody changed it since.
+static HANDLE OpenBaselineSource(const SaveBaseline *baseline) {
+    HANDLE file = CreateFileW(baseline->path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return file;
+    BY_HANDLE_FILE_INFORMATION info;
+    if (!GetFileInformationByHandle(file, &info) ||
+        (((ULONGLONG)info.nFileSizeHigh << 32) | info.nFileSizeLow) != baseline->size ||
+        CompareFileTime(&info.ftLastWriteTime, &baseline->lastWrite) != 0) {
+        CloseHandle(file);
+        return INVALID_HANDLE_VALUE;
+    }
+    return file;
+}
+
+static BOOL CopyFileRange(HANDLE source, ULONGLONG from, ULONGLONG to, HANDLE target, SaveTap *tap) {
+    const DWORD chunkBytes = 1024 * 1024;
+    if (from >= to) return TRUE;
+    LARGE_INTEGER at;
+    at.QuadPart = (LONGLONG)from;
+    if (!SetFilePointerEx(source, at, NULL, FILE_BEGIN)) return FALSE;
+    BYTE *buffer = (BYTE *)HeapAlloc(GetProcessHeap(), 0, chunkBytes);
+    if (!buffer) return FALSE;
+    BOOL ok = TRUE;
+    for (ULONGLONG pos = from; ok && pos < to;) {
+        DWORD want = (DWORD)min((ULONGLONG)chunkBytes, to - pos);
+        DWORD read = 0, written = 0;
+        ok = ReadFile(source, buffer, want, &read, NULL) && read == want &&
+             WriteFile(target, buffer, want, &written, NULL) && written == want;
+        if (ok) {
+            TextHashUpdate(&tap->hash, buffer, want);
+            if (tap->history) AddHistoryBytes(tap->history, buffer, want);
+        }
+        pos += want;
+    }
+    HeapFree(GetProcessHeap(), 0, buffer);
+    return ok;
+}
+
+// Writes the document as: unedited head copied from the old file, edited
+// middle encoded, unedited tail copied. Fills `next` for the new file.
+static BOOL WriteReusingBaseline(HANDLE file, HANDLE source, const SaveBaseline *old, const TextBaselinePlan *plan,
+                                 const WCHAR *text, size_t length, const ChunkCodec *codec, SaveTap *tap,
+                                 TextBaseline *next) {
+    if (!CopyFileRange(source, 0, plan->prefixBytes, file, tap)) return FALSE;
+    TextBaselineCarryPrefix(next, &old->map, plan);
+    ULONGLONG position = plan->prefixBytes;
+    if (!WriteEncodedText(file, text + plan->middleStart, (size_t)(plan->middleEnd - plan->middleStart), codec, FALSE,
+                          NULL, tap, next, plan->middleStart, &position)) {
+        return FALSE;
+    }
+    if (!CopyFileRange(source, plan->suffixFrom, plan->suffixTo, file, tap)) return FALSE;
+    TextBaselineCarrySuffix(next, &old->map, plan, position, length);
+    return TRUE;
+}
+
+static double ElapsedMs(const LARGE_INTEGER *start, const LARGE_INTEGER *end) {
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    return (double)(end->QuadPart - start->QuadPart) * 1000.0 / (double)freq.QuadPart;
+}
+
+// Sibling of `path` in the same directory (so the final rename stays on one
+// volume); `attempt` picks another name when earlier ones are taken. Caller
+// frees with HeapFree.
+static WCHAR *MakeTempSavePath(LPCWSTR path, UINT attempt) {
+    size_t len = wcslen(path) + 48;
+    WCHAR *temp = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, len * sizeof(WCHAR));
+    if (!temp) return NULL;
+    HRESULT hr = attempt == 0 ? StringCchPrintfW(temp, len, L"%s.~%lu.tmp", path, GetCurrentProcessId())
+                              : StringCchPrintfW(temp, len, L"%s.~%lu-%u.tmp", path, GetCurrentProcessId(), attempt);
+    if (FAILED(hr)) {
+        HeapFree(GetProcessHeap(), 0, temp);
+        return NULL;
+    }
+    return temp;
+}
+
+// Creates a new temp sibling of `path` and returns its handle and name. A
+// name may be held by a temp file that a crashed process, whose PID has since
+// been reused, left behind; such files are not ours to delete, so the next
+// name is tried instead.
+static HANDLE CreateTempSaveFile(LPCWSTR path, WCHAR **tempOut) {
+    *tempOut = NULL;
+    for (UINT attempt = 0; attempt < 100; ++attempt) {
+        WCHAR *temp = MakeTempSavePath(path, attempt);
+        if (!temp) break;
+        HANDLE file = CreateFileW(temp, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file != INVALID_HANDLE_VALUE) {
+            *tempOut = temp;
+            return file;
+        }
+        DWORD error = GetLastError();
+        HeapFree(GetProcessHeap(), 0, temp);
+        if (error != ERROR_FILE_EXISTS) break;
+    }
+    return INVALID_HANDLE_VALUE;
+}
+
+// Moves the finished temp file over `path`. ReplaceFileW carries over the
+// original's attributes, ACLs and creation time; new files and volumes that
+// do not support it fall back to a plain rename.
+static BOOL CommitTempSave(LPCWSTR temp, LPCWSTR path, BOOL targetExists, SaveDurability durability) {
+    if (targetExists && ReplaceFileW(path, temp, NULL, REPLACEFILE_IGNORE_MERGE_ERRORS, NULL, NULL)) {
+        return TRUE;
     }
-    if (size >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF) {
-        return ENC_UTF8;
+    DWORD flags = MOVEFILE_REPLACE_EXISTING;
+    if (durability == SAVE_DURABILITY_FLUSHED) flags |= MOVEFILE_WRITE_THROUGH;
+    return MoveFileExW(temp, path, flags);
+}
+
+static BOOL StatFilePath(LPCWSTR path, ULONGLONG *sizeOut, FILETIME *lastWriteOut) {
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(path, GetFileExInfoStandard, &data)) return FALSE;
+    *sizeOut = ((ULONGLONG)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    *lastWriteOut = data.ftLastWriteTime;
+    return TRUE;
+}
+
+static BOOL HashFileView(void *context, const BYTE *data, SIZE_T size, BOOL final) {
+    (void)final;
+    TextHashUpdate((TextHash *)context, data, size);
+    return TRUE;
+}
+
+FileCheck CheckFileFingerprint(LPCWSTR path, FileFingerprint *fingerprint) {
+    ULONGLONG size;
+    FILETIME lastWrite;
+    if (!StatFilePath(path, &size, &lastWrite)) return FILE_CHECK_MISSING;
+    if (size != fingerprint->size) return FILE_CHECK_CHANGED;
+    if (CompareFileTime(&lastWrite, &fingerprint->lastWrite) == 0) return FILE_CHECK_SAME;
+
+    // Same size, new time: touched, or rewritten to the same length. Only
+    // the bytes can tell.
+    MappedFile mf;
+    if (!OpenMappedFile(path, &mf)) return FILE_CHECK_MISSING;
+    TextHash hash;
+    TextHashInit(&hash, 0);
+    BOOL read = mf.size == size && ForEachFileView(&mf, 0, HashFileView, &hash);
+    BY_HANDLE_FILE_INFORMATION info;
+    if (read && GetFileInformationByHandle(mf.file, &info)) lastWrite = info.ftLastWriteTime;
+    CloseMappedFile(&mf);
+    if (!read || TextHashDigest(&hash) != fingerprint->hash) return FILE_CHECK_CHANGED;
+    fingerprint->lastWrite = lastWrite;
+    return FILE_CHECK_SAME;
+}
+
+UINT ListFileVersions(LPCWSTR path, FileVersion **versionsOut) {
+    *versionsOut = NULL;
+    WCHAR listPath[MAX_PATH];
+    if (!VersionListPath(path, listPath, ARRAYSIZE(listPath))) return 0;
+    HANDLE list = CreateFileW(listPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (list == INVALID_HANDLE_VALUE) return 0;
+    LARGE_INTEGER size = {0};
+    GetFileSizeEx(list, &size);
+    UINT count = 0, capacity = 0;
+    FileVersion *versions = NULL;
+    ULONGLONG position = 0;
+    VersionHeader header;
+    // Walks the headers; a torn last record ends the list.
+    while (position + sizeof(header) <= (ULONGLONG)size.QuadPart && SeekFile(list, position) &&
+           ReadExactly(list, &header, sizeof(header)) && header.magic == HISTORY_MAGIC) {
+        ULONGLONG next = position + sizeof(header) + (ULONGLONG)header.chunkCount * sizeof(uint32_t);
+        if (next > (ULONGLONG)size.QuadPart) break;
+        if (count == capacity) {
+            UINT grown = capacity ? capacity * 2 : 16;
+            FileVersion *more = versions ? (FileVersion *)HeapReAlloc(GetProcessHeap(), 0, versions, grown * sizeof(FileVersion))
+                                         : (FileVersion *)HeapAlloc(GetProcessHeap(), 0, grown * sizeof(FileVersion));
+            if (!more) break;
+            versions = more;
+            capacity = grown;
+        }
+        versions[count].saved = header.saved;
+        versions[count].size = header.size;
+        versions[count].compressed = (header.flags & HISTORY_COMPRESSED) != 0;
+        versions[count].position = position;
+        count++;
+        position = next;
     }
-    // Assume UTF-8 if it converts cleanly, else ANSI
-    int wlen = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, (LPCSTR)data, size, NULL, 0);
-    return (wlen > 0) ? ENC_UTF8 : ENC_ANSI;
+    CloseHandle(list);
+    *versionsOut = versions;
+    return count;
 }
 
-static BOOL DecodeToWide(const BYTE *data, DWORD size, TextEncoding encoding, WCHAR **outText, size_t *outLength) {
-    int chars = 0;
-    WCHAR *buffer = NULL;
+void FreeFileVersions(FileVersion *versions) {
+    if (versions) HeapFree(GetProcessHeap(), 0, versions);
+}
 
-    switch (encoding) {
-    case ENC_UTF16LE: {
-        if (size < 2) return FALSE;
-        DWORD byteOffset = (data[0] == 0xFF && data[1] == 0xFE) ? 2 : 0;
-        DWORD wcharCount = (size - byteOffset) / 2;
-        buffer = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (wcharCount + 1) * sizeof(WCHAR));
-        if (!buffer) return FALSE;
-        CopyMemory(buffer, data + byteOffset, wcharCount * sizeof(WCHAR));
-        buffer[wcharCount] = L'\0';
-        chars = (int)wcharCount;
-        break;
+// Copies one version's chunks, in order, from the pack to `file`.
+static BOOL WriteVersionChunks(HANDLE list, HANDLE pack, const VersionHeader *header, HANDLE file) {
+    BYTE *chunk = (BYTE *)HeapAlloc(GetProcessHeap(), 0, TEXT_CHUNK_MAX);
+    TextGzipWriter gzip;
+    BOOL compressed = (header->flags & HISTORY_COMPRESSED) != 0;
+    BYTE *deflated = compressed ? (BYTE *)HeapAlloc(GetProcessHeap(), 0, TextGzipWriterBound(TEXT_CHUNK_MAX)) : NULL;
+    BOOL ok = chunk && (!compressed || (deflated && TextGzipWriterInit(&gzip)));
+    uint32_t ordinals[1024];
+    ULONGLONG total = 0;
+    for (uint32_t i = 0; ok && i < header->chunkCount; i += ARRAYSIZE(ordinals)) {
+        DWORD batch = (DWORD)min((uint32_t)ARRAYSIZE(ordinals), header->chunkCount - i);
+        ok = ReadExactly(list, ordinals, batch * (DWORD)sizeof(uint32_t));
+        for (DWORD j = 0; ok && j < batch; ++j) {
+            ok = ordinals[j] < g_historyIndex.count;
+            const TextChunkRecord *record = ok ? &g_historyIndex.records[ordinals[j]] : NULL;
+            ok = ok && record->length <= TEXT_CHUNK_MAX && SeekFile(pack, record->offset) &&
+                 ReadExactly(pack, chunk, record->length) &&
+                 TextChunkKeyOf(chunk, record->length).lo == record->key.lo;
+            if (!ok) break;
+            total += record->length;
+            if (compressed) {
+                BOOL last = i + j + 1 == header->chunkCount;
+                size_t bytes = TextGzipWriterCompress(&gzip, chunk, record->length, last, deflated);
+                ok = WriteExactly(file, deflated, (DWORD)bytes);
+            } else {
+                ok = WriteExactly(file, chunk, record->length);
+            }
+        }
     }
-    case ENC_UTF16BE: {
-        if (size < 2) return FALSE;
-        DWORD byteOffset = (data[0] == 0xFE && data[1] == 0xFF) ? 2 : 0;
-        DWORD wcharCount = (size - byteOffset) / 2;
-        buffer = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (wcharCount + 1) * sizeof(WCHAR));
-        if (!buffer) return FALSE;
-        for (DWORD i = 0; i < wcharCount; ++i) {
-            buffer[i] = (WCHAR)((data[byteOffset + i * 2] << 8) | data[byteOffset + i * 2 + 1]);
-        }
-        buffer[wcharCount] = L'\0';
-        chars = (int)wcharCount;
-        break;
+    if (ok && compressed && header->chunkCount == 0) {
+        size_t bytes = TextGzipWriterCompress(&gzip, chunk, 0, true, deflated);
+        ok = WriteExactly(file, deflated, (DWORD)bytes);
     }
-    case ENC_UTF8: {
-        DWORD byteOffset = (size >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF) ? 3 : 0;
-        chars = MultiByteToWideChar(CP_UTF8, 0, (LPCSTR)(data + byteOffset), size - byteOffset, NULL, 0);
-        if (chars <= 0) return FALSE;
-        buffer = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (chars + 1) * sizeof(WCHAR));
-        if (!buffer) return FALSE;
-        MultiByteToWideChar(CP_UTF8, 0, (LPCSTR)(data + byteOffset), size - byteOffset, buffer, chars);
-        buffer[chars] = L'\0';
-        break;
+    if (compressed && deflated && chunk) TextGzipWriterFree(&gzip);
+    if (deflated) HeapFree(GetProcessHeap(), 0, deflated);
+    if (chunk) HeapFree(GetProcessHeap(), 0, chunk);
+    return ok && total == header->size;
+}
+
+BOOL RestoreFileVersion(HWND owner, LPCWSTR path, const FileVersion *version, LPCWSTR target) {
+    WCHAR listPath[MAX_PATH];
+    HANDLE list = INVALID_HANDLE_VALUE;
+    if (VersionListPath(path, listPath, ARRAYSIZE(listPath))) {
+        list = CreateFileW(listPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, NULL);
     }
-    case ENC_ANSI:
-    default: {
-        chars = MultiByteToWideChar(CP_ACP, 0, (LPCSTR)data, size, NULL, 0);
-        if (chars <= 0) return FALSE;
-        buffer = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (chars + 1) * sizeof(WCHAR));
-        if (!buffer) return FALSE;
-        MultiByteToWideChar(CP_ACP, 0, (LPCSTR)data, size, buffer, chars);
-        buffer[chars] = L'\0';
-        break;
+    HANDLE pack = OpenHistoryFile(L"chunks.pack", FALSE);
+    HANDLE index = OpenHistoryFile(L"chunks.idx", FALSE);
+    LARGE_INTEGER packSize = {0};
+    VersionHeader header;
+    BOOL ok = list != INVALID_HANDLE_VALUE && pack != INVALID_HANDLE_VALUE && index != INVALID_HANDLE_VALUE &&
+              GetFileSizeEx(pack, &packSize) && SyncHistoryIndex(index, (ULONGLONG)packSize.QuadPart, NULL) &&
+              SeekFile(list, version->position) && ReadExactly(list, &header, sizeof(header)) &&
+              header.magic == HISTORY_MAGIC;
+
+    // Like a save: written beside the target and renamed over it once whole.
+    WCHAR *temp = NULL;
+    HANDLE file = ok ? CreateTempSaveFile(target, &temp) : INVALID_HANDLE_VALUE;
+    ok = file != INVALID_HANDLE_VALUE && WriteVersionChunks(list, pack, &header, file);
+    if (file != INVALID_HANDLE_VALUE && !CloseHandle(file)) ok = FALSE;
+    if (ok) ok = CommitTempSave(temp, target, GetFileAttributesW(target) != INVALID_FILE_ATTRIBUTES, SAVE_DURABILITY_ATOMIC);
+    if (!ok && file != INVALID_HANDLE_VALUE) DeleteFileW(temp);
+    if (temp) HeapFree(GetProcessHeap(), 0, temp);
+    if (list != INVALID_HANDLE_VALUE) CloseHandle(list);
+    if (pack != INVALID_HANDLE_VALUE) CloseHandle(pack);
+    if (index != INVALID_HANDLE_VALUE) CloseHandle(index);
+    if (!ok) {
+        MessageBoxW(owner, L"Unable to restore that version.", L"retropad", MB_ICONERROR);
     }
+    return ok;
+}
+
+BOOL SaveTextFile(HWND owner, LPCWSTR path, LPCWSTR text, size_t length, TextEncoding encoding, UINT codePage,
+                  BOOL compress, SaveDurability durability, SaveBaseline **baseline, FileFingerprint *fingerprint,
+                  SaveTimings *timingsOut) {
+    SaveTimings timings = {0};
+    LARGE_INTEGER t0, t1, t2, t3;
+    ChunkCodec codec;
+    InitChunkCodec(&codec, encoding, codePage);
+
+    // Saving a document the file already holds would only churn the disk
+    // (and its timestamp). The file must be as last loaded or saved, and
+    // the text must still encode to the same bytes; that encode-only pass
+    // stops early once the output outgrows the file.
+    ULONGLONG diskSize;
+    FILETIME diskWrite;
+    if (fingerprint && fingerprint->valid && !compress && StatFilePath(path, &diskSize, &diskWrite) &&
+        diskSize == fingerprint->size && CompareFileTime(&diskWrite, &fingerprint->lastWrite) == 0 &&
+        EncodesToHash(text, length, &codec, fingerprint->size, fingerprint->hash)) {
+        timings.skipped = TRUE;
+        if (timingsOut) *timingsOut = timings;
+        return TRUE;
     }
+    if (fingerprint) fingerprint->valid = FALSE;
 
-    *outText = buffer;
-    if (outLength) {
-        *outLength = (size_t)chars;
+    DWORD attributes = GetFileAttributesW(path);
+    BOOL targetExists = (attributes != INVALID_FILE_ATTRIBUTES);
+    if (targetExists && (attributes & FILE_ATTRIBUTE_READONLY)) {
+        // Renaming over a read-only file would silently defeat the flag.
+        MessageBoxW(owner, L"Unable to create file.", L"retropad", MB_ICONERROR);
+        return FALSE;
     }
-    return TRUE;
-}
 
-BOOL LoadTextFile(HWND owner, LPCWSTR path, WCHAR **textOut, size_t *lengthOut, TextEncoding *encodingOut) {
-    *textOut = NULL;
-    if (lengthOut) *lengthOut = 0;
-    if (encodingOut) *encodingOut = ENC_UTF8;
+    // Unedited stretches are copied from the file the document came from,
+    // unless that file is the one about to be truncated. Compressed output
+    // has no byte ranges to copy.
+    SaveBaseline *old = baseline ? *baseline : NULL;
+    TextBaselinePlan plan;
+    HANDLE source = INVALID_HANDLE_VALUE;
+    if (old && !compress && old->map.encoding == encoding &&
+        !(durability == SAVE_DURABILITY_IN_PLACE && lstrcmpiW(old->path, path) == 0) &&
+        TextBaselinePlanSave(&old->map, codec.bomLength, (const uint16_t *)text, length, &plan)) {
+        source = OpenBaselineSource(old);
+    }
 
-    HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    WCHAR *temp = NULL;
+    HANDLE file = durability != SAVE_DURABILITY_IN_PLACE
+                      ? CreateTempSaveFile(path, &temp)
+                      : CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
     if (file == INVALID_HANDLE_VALUE) {
-        MessageBoxW(owner, L"Unable to open file.", L"retropad", MB_ICONERROR);
+        if (source != INVALID_HANDLE_VALUE) CloseHandle(source);
+        MessageBoxW(owner, L"Unable to create file.", L"retropad", MB_ICONERROR);
         return FALSE;
     }
 
-    LARGE_INTEGER size = {0};
-    if (!GetFileSizeEx(file, &size) || size.QuadPart > (LONGLONG)UINT_MAX) {
-        CloseHandle(file);
-        MessageBoxW(owner, L"Unsupported file size.", L"retropad", MB_ICONERROR);
-        return FALSE;
+    TextBaseline next;
+    TextBaselineInit(&next, encoding);
+    SaveTap tap;
+    TextHashInit(&tap.hash, 0);
+    HistoryRecorder history;
+    tap.history = BeginHistoryVersion(&history, path) ? &history : NULL;
+    QueryPerformanceCounter(&t0);
+    BOOL ok;
+    if (source != INVALID_HANDLE_VALUE) {
+        ok = WriteReusingBaseline(file, source, old, &plan, text, length, &codec, &tap, &next);
+        CloseHandle(source);
+    } else if (compress) {
+        TextGzipWriter gzip;
+        ULONGLONG position = 0;
+        ok = TextGzipWriterInit(&gzip) &&
+             WriteEncodedText(file, text, length, &codec, TRUE, &gzip, &tap, NULL, 0, &position);
+        TextGzipWriterFree(&gzip);
+        next.valid = false;
+    } else {
+        ULONGLONG position = 0;
+        ok = WriteEncodedText(file, text, length, &codec, TRUE, NULL, &tap, &next, 0, &position);
+        TextBaselineSeal(&next, length);
+    }
+    QueryPerformanceCounter(&t1);
+    if (ok && durability == SAVE_DURABILITY_FLUSHED) {
+        ok = FlushFileBuffers(file);
+    }
+    CloseHandle(file);
+    QueryPerformanceCounter(&t2);
+
+    if (temp) {
+        // The original is only touched once the new contents are complete,
+        // so a crash or full disk leaves it as it was.
+        if (ok) ok = CommitTempSave(temp, path, targetExists, durability);
+        if (!ok) DeleteFileW(temp);
+        HeapFree(GetProcessHeap(), 0, temp);
     }
+    QueryPerformanceCounter(&t3);
+    if (tap.history) timings.historyBytes = EndHistoryVersion(&history, ok, encoding, compress);
 
-    DWORD bytes = (DWORD)size.QuadPart;
-    BYTE *buffer = (BYTE *)HeapAlloc(GetProcessHeap(), 0, bytes + 3);
-    if (!buffer) {
-        CloseHandle(file);
-        MessageBoxW(owner, L"Out of memory.", L"retropad", MB_ICONERROR);
-        return FALSE;
+    timings.writeMs = ElapsedMs(&t0, &t1);
+    timings.flushMs = ElapsedMs(&t1, &t2);
+    timings.renameMs = ElapsedMs(&t2, &t3);
+    if (timingsOut) *timingsOut = timings;
+
+    if (ok && baseline) {
+        FreeSaveBaseline(*baseline);
+        *baseline = CreateSaveBaseline(path, &next);
+    } else {
+        TextBaselineFree(&next);
+    }
+    if (ok && fingerprint && StatFilePath(path, &fingerprint->size, &fingerprint->lastWrite)) {
+        fingerprint->valid = fingerprint->size == (ULONGLONG)tap.hash.total;
+        fingerprint->hash = TextHashDigest(&tap.hash);
+    }
+    if (!ok) {
+        MessageBoxW(owner, L"Failed writing file.", L"retropad", MB_ICONERROR);
     }
+    return ok;
+}
+
+// Split and join run on a worker thread and never decode: the bytes stream
+// through text_split.c in TEXT_SPLIT_BUFFER reads, so memory stays flat and
+// the only work per byte is the line-break scan.
+struct SplitJob {
+    HWND notify;
+    HANDLE thread;
+    volatile LONG cancelled;
+    BOOL join;
+    WCHAR *path;             // split: the source; join: the target
+    WCHAR **parts;           // join: the inputs, in order
+    UINT partCount;
+    TextSplitOptions options;
+    BYTE *pattern;           // options.pattern, encoded like the file
+    WCHAR *patternText;
+    BOOL ok;
+    BOOL mismatch;           // join: a part's BOM named another encoding
+    BOOL compressed;         // split: refused, the file is gzip
+    BOOL pieceExists;        // split: refused to overwrite an earlier piece
+    UINT count;              // pieces written or parts joined
+    ULONGLONG bytes;
+};
 
+typedef struct SplitInput {
+    SplitJob *job;
+    HANDLE file;
+    BOOL failed;             // a read failed or the job was cancelled
+} SplitInput;
+
+typedef struct SplitOutput {
+    SplitJob *job;
+    HANDLE file;
+} SplitOutput;
+
+static size_t ReadSplitInput(void *context, uint8_t *buffer, size_t size) {
+    SplitInput *in = (SplitInput *)context;
     DWORD read = 0;
-    BOOL ok = ReadFile(file, buffer, bytes, &read, NULL);
-    CloseHandle(file);
+    if (in->failed || in->job->cancelled) {
+        in->failed = TRUE;
+        return 0;
+    }
+    if (!ReadFile(in->file, buffer, (DWORD)size, &read, NULL)) {
+        in->failed = TRUE;
+        return 0;
+    }
+    return read;
+}
+
+static bool WriteSplitOutput(void *context, const uint8_t *data, size_t size) {
+    SplitOutput *out = (SplitOutput *)context;
+    while (size > 0) {
+        DWORD chunk = (DWORD)min(size, (size_t)TEXT_SPLIT_BUFFER);
+        DWORD written = 0;
+        if (out->job->cancelled || !WriteFile(out->file, data, chunk, &written, NULL) || written != chunk) {
+            return false;
+        }
+        data += chunk;
+        size -= chunk;
+        out->job->bytes += chunk;
+    }
+    return true;
+}
+
+// Piece `index` of `path`: "name.txt" becomes "name.001.txt", "name" "name.001".
+static BOOL MakePiecePath(LPCWSTR path, UINT index, WCHAR *out, size_t outLen) {
+    LPCWSTR name = path;
+    for (LPCWSTR p = path; *p; ++p) {
+        if (*p == L'\\' || *p == L'/') name = p + 1;
+    }
+    LPCWSTR ext = wcsrchr(name, L'.');
+    if (!ext || ext == name) ext = name + wcslen(name);
+    return SUCCEEDED(StringCchPrintfW(out, outLen, L"%.*s.%03u%s", (int)(ext - path), path, index + 1, ext));
+}
+
+static bool BeginSplitPiece(void *context, uint32_t index) {
+    SplitOutput *out = (SplitOutput *)context;
+    WCHAR piece[MAX_PATH * 4];
+    if (!MakePiecePath(out->job->path, index, piece, ARRAYSIZE(piece))) return false;
+    // Never overwrite: an earlier split's pieces may be all that is left.
+    out->file = CreateFileW(piece, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (out->file == INVALID_HANDLE_VALUE) {
+        out->job->pieceExists = GetLastError() == ERROR_FILE_EXISTS;
+        out->file = NULL;
+        return false;
+    }
+    out->job->count = index + 1;
+    return true;
+}
+
+static bool EndSplitPiece(void *context) {
+    SplitOutput *out = (SplitOutput *)context;
+    BOOL ok = CloseHandle(out->file);
+    out->file = NULL;
+    return ok != FALSE;
+}
+
+// Encodes the pattern the way the file stores text, so matching is a byte
+// comparison.
+static BOOL EncodeSplitPattern(SplitJob *job, TextEncoding encoding) {
+    ChunkCodec codec;
+    InitChunkCodec(&codec, encoding, GetAnsiCodePage());
+    int units = (int)wcslen(job->patternText);
+    int capacity = units * codec.maxBytesPerUnit;
+    job->pattern = (BYTE *)HeapAlloc(GetProcessHeap(), 0, (SIZE_T)max(capacity, 1));
+    if (!job->pattern) return FALSE;
+    int bytes = units > 0 ? codec.encode(&codec, job->patternText, units, job->pattern, capacity) : 0;
+    job->options.pattern = job->pattern;
+    job->options.patternLength = (size_t)bytes;
+    return bytes > 0;
+}
+
+static BOOL RunSplit(SplitJob *job) {
+    MappedFile mf;
+    if (!OpenInputFile(job->path, &mf)) return FALSE;
+    EncodingGuess guess;
+    TextEncoding encoding = ENC_UTF8;
+    job->compressed = mf.size > 0 && HasGzipMagic(mf.file);
+    BOOL ok = !job->compressed;
+    if (ok && mf.size > 0) {
+        ok = GuessFileEncoding(&mf, &guess);
+        if (ok && guess.count > 0) encoding = guess.candidates[0].encoding;
+    }
+    LARGE_INTEGER start = {0};
+    ok = ok && SetFilePointerEx(mf.file, start, NULL, FILE_BEGIN);
+    job->options.encoding = encoding;
+    if (ok && job->options.mode == TEXT_SPLIT_MATCH) ok = EncodeSplitPattern(job, encoding);
+
+    SplitInput in = {job, mf.file, FALSE};
+    SplitOutput out = {job, NULL};
+    TextSplitSink sink = {BeginSplitPiece, WriteSplitOutput, EndSplitPiece, &out};
+    uint32_t pieces = 0;
+    if (ok) ok = TextSplit(&job->options, ReadSplitInput, &in, &sink, &pieces) && !in.failed;
+    CloseMappedFile(&mf);
     if (!ok) {
-        HeapFree(GetProcessHeap(), 0, buffer);
-        MessageBoxW(owner, L"Failed reading file.", L"retropad", MB_ICONERROR);
-        return FALSE;
+        // Leave nothing half-done behind; only pieces this split created.
+        WCHAR piece[MAX_PATH * 4];
+        for (UINT i = 0; i < job->count; ++i) {
+            if (MakePiecePath(job->path, i, piece, ARRAYSIZE(piece))) DeleteFileW(piece);
+        }
+        job->count = 0;
     }
+    return ok;
+}
 
-    if (read == 0) {
-        WCHAR *empty = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, sizeof(WCHAR));
-        if (!empty) {
-            HeapFree(GetProcessHeap(), 0, buffer);
-            return FALSE;
+static BOOL RunJoin(SplitJob *job) {
+    // Written beside the target and renamed over it at the end, so the
+    // target may be one of the parts.
+    WCHAR *temp;
+    HANDLE file = CreateTempSaveFile(job->path, &temp);
+    if (file == INVALID_HANDLE_VALUE) return FALSE;
+    TextJoiner joiner;
+    BOOL ok = TextJoinerInit(&joiner);
+    SplitOutput out = {job, file};
+    for (UINT i = 0; ok && i < job->partCount; ++i) {
+        HANDLE part = CreateFileW(job->parts[i], GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (part == INVALID_HANDLE_VALUE) {
+            ok = FALSE;
+            break;
         }
-        empty[0] = L'\0';
-        *textOut = empty;
-        if (lengthOut) *lengthOut = 0;
-        if (encodingOut) *encodingOut = ENC_UTF8;
-        HeapFree(GetProcessHeap(), 0, buffer);
-        return TRUE;
+        SplitInput in = {job, part, FALSE};
+        TextJoinStatus status = TextJoinerAdd(&joiner, ReadSplitInput, &in, WriteSplitOutput, &out);
+        CloseHandle(part);
+        job->mismatch = status == TEXT_JOIN_MISMATCH;
+        ok = status == TEXT_JOIN_OK && !in.failed;
+        if (ok) job->count = i + 1;
+    }
+    TextJoinerFree(&joiner);
+    if (!CloseHandle(file)) ok = FALSE;
+    if (ok) ok = CommitTempSave(temp, job->path, GetFileAttributesW(job->path) != INVALID_FILE_ATTRIBUTES,
+                                SAVE_DURABILITY_ATOMIC);
+    if (!ok) {
+        DeleteFileW(temp);
+        job->count = 0;
     }
+    HeapFree(GetProcessHeap(), 0, temp);
+    return ok;
+}
 
-    TextEncoding enc = DetectEncoding(buffer, read);
-    WCHAR *text = NULL;
-    size_t len = 0;
-    if (!DecodeToWide(buffer, read, enc, &text, &len)) {
-        HeapFree(GetProcessHeap(), 0, buffer);
-        MessageBoxW(owner, L"Unable to decode file.", L"retropad", MB_ICONERROR);
-        return FALSE;
+static DWORD WINAPI SplitWorkerThread(LPVOID param) {
+    SplitJob *job = (SplitJob *)param;
+    job->ok = job->join ? RunJoin(job) : RunSplit(job);
+    PostMessageW(job->notify, WM_APP_SPLIT_DONE, 0, (LPARAM)job);
+    return 0;
+}
+
+static WCHAR *CopyPathString(LPCWSTR text) {
+    size_t chars = wcslen(text) + 1;
+    WCHAR *copy = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, chars * sizeof(WCHAR));
+    if (copy) CopyMemory(copy, text, chars * sizeof(WCHAR));
+    return copy;
+}
+
+static void FreeSplitJob(SplitJob *job) {
+    if (job->parts) {
+        for (UINT i = 0; i < job->partCount; ++i) {
+            if (job->parts[i]) HeapFree(GetProcessHeap(), 0, job->parts[i]);
+        }
+        HeapFree(GetProcessHeap(), 0, job->parts);
     }
+    if (job->path) HeapFree(GetProcessHeap(), 0, job->path);
+    if (job->pattern) HeapFree(GetProcessHeap(), 0, job->pattern);
+    if (job->patternText) HeapFree(GetProcessHeap(), 0, job->patternText);
+    HeapFree(GetProcessHeap(), 0, job);
+}
 
-    HeapFree(GetProcessHeap(), 0, buffer);
-    *textOut = text;
-    if (lengthOut) *lengthOut = len;
-    if (encodingOut) *encodingOut = enc;
+static SplitJob *StartSplitJob(HWND owner, SplitJob *job, BOOL ok) {
+    if (ok) job->thread = CreateThread(NULL, 0, SplitWorkerThread, job, 0, NULL);
+    if (!job->thread) {
+        LPCWSTR message = job->join ? L"Unable to join the files." : L"Unable to split the file.";
+        FreeSplitJob(job);
+        MessageBoxW(owner, message, L"retropad", MB_ICONERROR);
+        return NULL;
+    }
+    return job;
+}
+
+SplitJob *BeginSplitTextFile(HWND owner, LPCWSTR path, TextSplitMode mode, ULONGLONG limit, LPCWSTR pattern) {
+    SplitJob *job = (SplitJob *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(SplitJob));
+    if (!job) return NULL;
+    job->notify = owner;
+    job->options.mode = mode;
+    job->options.limit = limit;
+    job->path = CopyPathString(path);
+    BOOL ok = job->path != NULL;
+    if (ok && mode == TEXT_SPLIT_MATCH) {
+        job->patternText = CopyPathString(pattern);
+        ok = job->patternText != NULL;
+    }
+    return StartSplitJob(owner, job, ok);
+}
+
+SplitJob *BeginJoinTextFiles(HWND owner, LPCWSTR const *parts, UINT count, LPCWSTR target) {
+    SplitJob *job = (SplitJob *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(SplitJob));
+    if (!job) return NULL;
+    job->notify = owner;
+    job->join = TRUE;
+    job->path = CopyPathString(target);
+    job->parts = (WCHAR **)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, max(count, 1) * sizeof(WCHAR *));
+    BOOL ok = job->path && job->parts;
+    if (ok) job->partCount = count;
+    for (UINT i = 0; ok && i < count; ++i) {
+        job->parts[i] = CopyPathString(parts[i]);
+        ok = job->parts[i] != NULL;
+    }
+    return StartSplitJob(owner, job, ok);
+}
+
+void CancelSplitJob(SplitJob *job) {
+    InterlockedExchange(&job->cancelled, 1);
+}
+
+BOOL EndSplitJob(HWND owner, SplitJob *job, UINT *countOut, ULONGLONG *bytesOut) {
+    WaitForSingleObject(job->thread, INFINITE);
+    CloseHandle(job->thread);
+    BOOL ok = job->ok;
+    if (countOut) *countOut = job->count;
+    if (bytesOut) *bytesOut = job->bytes;
+    if (!ok && !job->cancelled) {
+        LPCWSTR message = job->join ? L"Unable to join the files." : L"Unable to split the file.";
+        if (job->compressed) {
+            message = L"Compressed files cannot be split.";
+        } else if (job->pieceExists) {
+            message = L"Pieces from an earlier split are in the way. Move or delete them first.";
+        } else if (job->mismatch) {
+            message = L"The files to join are in different encodings.";
+        } else if (!job->join && job->options.mode == TEXT_SPLIT_MATCH && job->options.patternLength == 0) {
+            message = L"The search text cannot be written in the file's encoding.";
+        }
+        MessageBoxW(owner, message, L"retropad", MB_ICONERROR);
+    }
+    FreeSplitJob(job);
+    return ok;
+}
+
+// Crash recovery. While the document has unsaved changes its edits are
+// journaled (text_journal.h records) under %LOCALAPPDATA%\retropad\recovery
+// by a worker thread that writes and flushes them in batches, so typing
+// never waits on the disk. A journal is two files, <session>.0.rpj and
+// <session>.1.rpj, each a JournalHeader followed by records. A checkpoint
+// is written to whichever file is idle, and the other is emptied only once
+// it is on disk, so a crash mid-checkpoint still leaves the previous
+// generation whole. The writer keeps both open without write sharing:
+// a journal that can be opened exclusively has been abandoned.
+#define JOURNAL_MAGIC 0x314A5052u // "RPJ1"
+#define JOURNAL_BASE_FILE 1u      // the records apply to the file as fingerprinted
+#define JOURNAL_BASE_TEXT 2u      // a TEXT_JOURNAL_TEXT record with the base comes first
+#define JOURNAL_FLUSH_MS 500
+#define JOURNAL_BATCH_BYTES (256u * 1024u) // queued bytes that wake the writer early
+#define JOURNAL_COMPACT_MIN (1024u * 1024u)
+
+typedef struct JournalHeader {
+    uint32_t magic;
+    uint32_t generation; // the newest whole generation wins on recovery
+    uint32_t base;
+    uint32_t encoding;
+    uint32_t codePage;
+    uint32_t compressed;
+    uint64_t fileSize;
+    uint64_t fileHash;
+    WCHAR path[JOURNAL_PATH_UNITS];
+    uint64_t check; // XXH64 of everything above
+} JournalHeader;
+
+struct EditJournal {
+    CRITICAL_SECTION lock;
+    HANDLE wake;
+    HANDLE thread;
+    TextJournalBuffer queue; // filled by the UI thread under `lock`
+    TextJournalBuffer batch; // being written by the worker
+    BOOL restart;            // `queue` opens with a new generation's header
+    BOOL stopping;
+    volatile LONG failed;    // worker: a write failed; only a checkpoint resumes
+    BOOL dropped;            // UI thread: an edit could not be queued
+    JournalHeader header;    // UI thread: the current generation's
+    HANDLE files[2];
+    WCHAR paths[2][MAX_PATH];
+    int active;              // worker: the file records are appended to
+    ULONGLONG logBytes;      // UI thread: queued since the last checkpoint
+};
+
+static uint64_t JournalHeaderCheck(const JournalHeader *header) {
+    return TextHash64(header, offsetof(JournalHeader, check), 0);
+}
+
+static BOOL WriteAll(HANDLE file, const BYTE *data, SIZE_T size) {
+    while (size > 0) {
+        DWORD chunk = (DWORD)min(size, (SIZE_T)(64u * 1024u * 1024u));
+        if (!WriteExactly(file, data, chunk)) return FALSE;
+        data += chunk;
+        size -= chunk;
+    }
     return TRUE;
 }
 
-static BOOL WriteUTF8WithBOM(HANDLE file, const WCHAR *text, size_t length) {
-    static const BYTE bom[] = {0xEF, 0xBB, 0xBF};
-    DWORD written = 0;
-    if (!WriteFile(file, bom, sizeof(bom), &written, NULL)) {
-        return FALSE;
+static BOOL WriteJournalBatch(EditJournal *journal, BOOL restart) {
+    int target = restart ? 1 - journal->active : journal->active;
+    HANDLE file = journal->files[target];
+    if (restart && !(SeekFile(file, 0) && SetEndOfFile(file))) return FALSE;
+    if (!WriteAll(file, journal->batch.data, journal->batch.size) || !FlushFileBuffers(file)) return FALSE;
+    if (restart) {
+        // The new generation is on disk; only now let the old one go.
+        HANDLE old = journal->files[journal->active];
+        if (SeekFile(old, 0)) SetEndOfFile(old);
+        journal->active = target;
     }
-    int bytes = WideCharToMultiByte(CP_UTF8, 0, text, (int)length, NULL, 0, NULL, NULL);
-    if (bytes <= 0) return FALSE;
-    BYTE *buffer = (BYTE *)HeapAlloc(GetProcessHeap(), 0, bytes);
-    if (!buffer) return FALSE;
-    WideCharToMultiByte(CP_UTF8, 0, text, (int)length, (LPSTR)buffer, bytes, NULL, NULL);
-    BOOL ok = WriteFile(file, buffer, bytes, &written, NULL);
-    HeapFree(GetProcessHeap(), 0, buffer);
+    return TRUE;
+}
+
+static DWORD WINAPI JournalWriterThread(LPVOID param) {
+    EditJournal *journal = (EditJournal *)param;
+    for (;;) {
+        WaitForSingleObject(journal->wake, JOURNAL_FLUSH_MS);
+        EnterCriticalSection(&journal->lock);
+        TextJournalBuffer swap = journal->batch;
+        journal->batch = journal->queue;
+        journal->queue = swap;
+        journal->queue.size = 0;
+        BOOL restart = journal->restart;
+        BOOL stopping = journal->stopping;
+        journal->restart = FALSE;
+        LeaveCriticalSection(&journal->lock);
+        if (journal->batch.size > 0 && (restart || !journal->failed)) {
+            InterlockedExchange(&journal->failed, WriteJournalBatch(journal, restart) ? 0 : 1);
+        }
+        journal->batch.size = 0;
+        if (stopping) break;
+    }
+    return 0;
+}
+
+// Replaces whatever is queued with a new generation: the header and, for
+// a text base, the whole text.
+static BOOL QueueJournalGeneration(EditJournal *journal, const WCHAR *text, size_t length) {
+    JournalHeader *header = &journal->header;
+    header->generation++;
+    header->check = JournalHeaderCheck(header);
+    EnterCriticalSection(&journal->lock);
+    journal->queue.size = 0;
+    BOOL ok = TextJournalBufferAppend(&journal->queue, header, sizeof(*header)) &&
+              (header->base != JOURNAL_BASE_TEXT || TextJournalAppendText(&journal->queue, (const uint16_t *)text, length));
+    if (!ok) journal->queue.size = 0;
+    journal->restart = ok;
+    LeaveCriticalSection(&journal->lock);
+    journal->logBytes = 0;
+    journal->dropped = !ok;
+    SetEvent(journal->wake);
     return ok;
 }
 
-static BOOL WriteUTF16LE(HANDLE file, const WCHAR *text, size_t length) {
-    static const BYTE bom[] = {0xFF, 0xFE};
-    DWORD written = 0;
-    if (!WriteFile(file, bom, sizeof(bom), &written, NULL)) {
-        return FALSE;
+static void CloseEditJournal(EditJournal *journal) {
+    for (int i = 0; i < 2; ++i) {
+        if (journal->files[i] != INVALID_HANDLE_VALUE) {
+            CloseHandle(journal->files[i]);
+            DeleteFileW(journal->paths[i]);
+        }
     }
-    return WriteFile(file, text, (DWORD)(length * sizeof(WCHAR)), &written, NULL);
+    if (journal->wake) CloseHandle(journal->wake);
+    TextJournalBufferFree(&journal->queue);
+    TextJournalBufferFree(&journal->batch);
+    DeleteCriticalSection(&journal->lock);
+    HeapFree(GetProcessHeap(), 0, journal);
 }
 
-static BOOL WriteANSI(HANDLE file, const WCHAR *text, size_t length) {
-    int bytes = WideCharToMultiByte(CP_ACP, 0, text, (int)length, NULL, 0, NULL, NULL);
-    if (bytes <= 0) return FALSE;
-    BYTE *buffer = (BYTE *)HeapAlloc(GetProcessHeap(), 0, bytes);
-    if (!buffer) return FALSE;
-    WideCharToMultiByte(CP_ACP, 0, text, (int)length, (LPSTR)buffer, bytes, NULL, NULL);
-    DWORD written = 0;
-    BOOL ok = WriteFile(file, buffer, bytes, &written, NULL);
-    HeapFree(GetProcessHeap(), 0, buffer);
+EditJournal *BeginEditJournal(LPCWSTR path, const FileFingerprint *fingerprint, TextEncoding encoding, UINT codePage,
+                              BOOL compressed, const WCHAR *text, size_t length) {
+    static LONG sessions = 0;
+    EditJournal *journal = (EditJournal *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(EditJournal));
+    if (!journal) return NULL;
+    InitializeCriticalSection(&journal->lock);
+    journal->files[0] = journal->files[1] = INVALID_HANDLE_VALUE;
+    journal->wake = CreateEventW(NULL, FALSE, FALSE, NULL);
+    LONG session = InterlockedIncrement(&sessions);
+    WCHAR name[64];
+    StringCchPrintfW(name, ARRAYSIZE(name), L"%08lx%016llx%04lx.0.rpj", GetCurrentProcessId(), GetTickCount64(),
+                     (unsigned long)session);
+    BOOL ok = journal->wake != NULL && AppDataPath(L"recovery", name, journal->paths[0], ARRAYSIZE(journal->paths[0]));
+    if (ok) {
+        StringCchCopyW(journal->paths[1], ARRAYSIZE(journal->paths[1]), journal->paths[0]);
+        journal->paths[1][wcslen(journal->paths[1]) - wcslen(L"0.rpj")] = L'1';
+    }
+    for (int i = 0; ok && i < 2; ++i) {
+        journal->files[i] = CreateFileW(journal->paths[i], GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_NEW,
+                                        FILE_ATTRIBUTE_NORMAL, NULL);
+        ok = journal->files[i] != INVALID_HANDLE_VALUE;
+    }
+
+    JournalHeader *header = &journal->header;
+    header->magic = JOURNAL_MAGIC;
+    header->base = fingerprint ? JOURNAL_BASE_FILE : JOURNAL_BASE_TEXT;
+    header->encoding = (uint32_t)encoding;
+    header->codePage = codePage;
+    header->compressed = compressed ? 1u : 0u;
+    if (fingerprint) {
+        header->fileSize = fingerprint->size;
+        header->fileHash = fingerprint->hash;
+    }
+    if (path) StringCchCopyW(header->path, ARRAYSIZE(header->path), path);
+    // The first generation goes to file 0.
+    journal->active = 1;
+    ok = ok && QueueJournalGeneration(journal, text, length);
+    if (ok) journal->thread = CreateThread(NULL, 0, JournalWriterThread, journal, 0, NULL);
+    if (!journal->thread) {
+        CloseEditJournal(journal);
+        return NULL;
+    }
+    return journal;
+}
+
+void JournalEdit(EditJournal *journal, size_t offset, size_t deleted, const WCHAR *inserted, size_t insertedLength) {
+    EnterCriticalSection(&journal->lock);
+    size_t before = journal->queue.size;
+    BOOL ok = TextJournalAppendEdit(&journal->queue, offset, deleted, (const uint16_t *)inserted, insertedLength);
+    size_t queued = journal->queue.size;
+    LeaveCriticalSection(&journal->lock);
+    if (!ok) journal->dropped = TRUE;
+    journal->logBytes += queued - before;
+    if (queued >= JOURNAL_BATCH_BYTES) SetEvent(journal->wake);
+}
+
+void JournalCheckpoint(EditJournal *journal, const WCHAR *text, size_t length) {
+    journal->header.base = JOURNAL_BASE_TEXT;
+    QueueJournalGeneration(journal, text, length);
+}
+
+BOOL JournalWantsCheckpoint(EditJournal *journal, size_t length) {
+    // A failed write stops the log until a new generation goes down whole.
+    return journal->dropped || InterlockedCompareExchange(&journal->failed, 0, 0) ||
+           (journal->logBytes > JOURNAL_COMPACT_MIN && journal->logBytes > (ULONGLONG)length * sizeof(WCHAR));
+}
+
+void EndEditJournal(EditJournal *journal) {
+    EnterCriticalSection(&journal->lock);
+    journal->stopping = TRUE;
+    journal->queue.size = 0; // the changes were saved or given up
+    LeaveCriticalSection(&journal->lock);
+    SetEvent(journal->wake);
+    WaitForSingleObject(journal->thread, INFINITE);
+    CloseHandle(journal->thread);
+    CloseEditJournal(journal);
+}
+
+// Reads and checks a journal file's header. `file` must be at its start.
+static BOOL ReadJournalHeader(HANDLE file, JournalHeader *header) {
+    return ReadExactly(file, header, sizeof(*header)) && header->magic == JOURNAL_MAGIC &&
+           header->check == JournalHeaderCheck(header);
+}
+
+// Looks at one session given its file 0. FALSE when another instance still
+// has it open; otherwise `journal` describes its newest whole generation,
+// whose file is listed first, and `generationsOut` counts the whole ones
+// (none when both files are empty or damaged).
+static BOOL InspectJournalSession(LPCWSTR first, AbandonedJournal *journal, UINT *generationsOut) {
+    ZeroMemory(journal, sizeof(*journal));
+    StringCchCopyW(journal->files[0], ARRAYSIZE(journal->files[0]), first);
+    StringCchCopyW(journal->files[1], ARRAYSIZE(journal->files[1]), first);
+    journal->files[1][wcslen(first) - wcslen(L"0.rpj")] = L'1';
+    JournalHeader headers[2];
+    BOOL valid[2] = {FALSE, FALSE};
+    for (int i = 0; i < 2; ++i) {
+        HANDLE file = CreateFileW(journal->files[i], GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            if (GetLastError() == ERROR_SHARING_VIOLATION) return FALSE;
+            continue;
+        }
+        valid[i] = ReadJournalHeader(file, &headers[i]);
+        CloseHandle(file);
+    }
+    UINT count = (valid[0] ? 1 : 0) + (valid[1] ? 1 : 0);
+    int newest = valid[0] && !(valid[1] && headers[1].generation > headers[0].generation) ? 0 : 1;
+    if (newest == 1) {
+        WCHAR swap[MAX_PATH];
+        CopyMemory(swap, journal->files[0], sizeof(swap));
+        CopyMemory(journal->files[0], journal->files[1], sizeof(swap));
+        CopyMemory(journal->files[1], swap, sizeof(swap));
+    }
+    if (count > 0) {
+        const JournalHeader *header = &headers[newest];
+        StringCchCopyW(journal->path, ARRAYSIZE(journal->path), header->path);
+        journal->encoding = (TextEncoding)header->encoding;
+        journal->codePage = header->codePage;
+        journal->compressed = header->compressed != 0;
+        journal->fromFile = header->base == JOURNAL_BASE_FILE;
+        journal->fileSize = header->fileSize;
+        journal->fileHash = header->fileHash;
+    }
+    *generationsOut = count;
+    return TRUE;
+}
+
+BOOL FindAbandonedJournal(AbandonedJournal *journal) {
+    WCHAR pattern[MAX_PATH];
+    if (!AppDataPath(L"recovery", L"*.0.rpj", pattern, ARRAYSIZE(pattern))) return FALSE;
+    WCHAR *name = wcsrchr(pattern, L'\\') + 1;
+    WIN32_FIND_DATAW data;
+    HANDLE find = FindFirstFileW(pattern, &data);
+    if (find == INVALID_HANDLE_VALUE) return FALSE;
+    BOOL found = FALSE;
+    do {
+        WCHAR first[MAX_PATH];
+        *name = L'\0';
+        if (FAILED(StringCchPrintfW(first, ARRAYSIZE(first), L"%s%s", pattern, data.cFileName))) continue;
+        UINT generations = 0;
+        if (!InspectJournalSession(first, journal, &generations)) continue;
+        if (generations > 0) {
+            found = TRUE;
+        } else {
+            DiscardAbandonedJournal(journal); // nothing in it survived
+        }
+    } while (!found && FindNextFileW(find, &data));
+    FindClose(find);
+    return found;
+}
+
+// Replays one generation; FALSE when it is unreadable or its base is
+// incomplete, so the caller can fall back to the previous one.
+static BOOL ReplayJournalFile(LPCWSTR path, const WCHAR *base, size_t baseLength, WCHAR **textOut, size_t *lengthOut) {
+    HANDLE file = CreateFileW(path, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return FALSE;
+    LARGE_INTEGER size = {0};
+    JournalHeader header;
+    BYTE *data = NULL;
+    SIZE_T dataSize = 0;
+    BOOL ok = GetFileSizeEx(file, &size) && (ULONGLONG)size.QuadPart >= sizeof(header) &&
+              (ULONGLONG)size.QuadPart - sizeof(header) <= (ULONGLONG)(SIZE_T)-1 && ReadJournalHeader(file, &header) &&
+              (header.base == JOURNAL_BASE_TEXT || base != NULL);
+    if (ok) {
+        dataSize = (SIZE_T)((ULONGLONG)size.QuadPart - sizeof(header));
+        data = (BYTE *)HeapAlloc(GetProcessHeap(), 0, max(dataSize, (SIZE_T)1));
+        for (SIZE_T done = 0; ok && done < dataSize;) {
+            DWORD chunk = (DWORD)min(dataSize - done, (SIZE_T)(64u * 1024u * 1024u));
+            ok = data && ReadExactly(file, data + done, chunk);
+            done += chunk;
+        }
+        ok = ok && data;
+    }
+    CloseHandle(file);
+    TextJournalDocument doc;
+    size_t records = 0;
+    TextJournalStatus status = TEXT_JOURNAL_NO_MEMORY;
+    if (ok && TextJournalDocumentInit(&doc, (const uint16_t *)(header.base == JOURNAL_BASE_FILE ? base : NULL),
+                                      header.base == JOURNAL_BASE_FILE ? baseLength : 0)) {
+        status = TextJournalReplay(&doc, data, dataSize, &records);
+        // A crash can cut the log short; it cannot lose a text base.
+        ok = (status == TEXT_JOURNAL_OK || status == TEXT_JOURNAL_TORN) &&
+             (header.base == JOURNAL_BASE_FILE || records > 0);
+        *textOut = ok ? (WCHAR *)TextJournalDocumentDetach(&doc, lengthOut) : NULL;
+        ok = ok && *textOut != NULL;
+        TextJournalDocumentFree(&doc);
+    } else {
+        ok = FALSE;
+    }
+    if (data) HeapFree(GetProcessHeap(), 0, data);
     return ok;
 }
 
-BOOL SaveTextFile(HWND owner, LPCWSTR path, LPCWSTR text, size_t length, TextEncoding encoding) {
-    HANDLE file = CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
-    if (file == INVALID_HANDLE_VALUE) {
-        MessageBoxW(owner, L"Unable to create file.", L"retropad", MB_ICONERROR);
+BOOL ReplayAbandonedJournal(const AbandonedJournal *journal, const WCHAR *base, size_t baseLength, WCHAR **textOut,
+                            size_t *lengthOut) {
+    *textOut = NULL;
+    *lengthOut = 0;
+    for (int i = 0; i < 2; ++i) {
+        if (ReplayJournalFile(journal->files[i], base, baseLength, textOut, lengthOut)) return TRUE;
+    }
+    return FALSE;
+}
+
+void FreeRecoveredText(WCHAR *text) {
+    free(text);
+}
+
+void DiscardAbandonedJournal(const AbandonedJournal *journal) {
+    DeleteFileW(journal->files[0]);
+    DeleteFileW(journal->files[1]);
+}
+
+// Session snapshot. On a clean exit the open document is written to
+// %LOCALAPPDATA%\retropad\session\session.rps already decoded, together with
+// its line index, save baseline and the window and page-setup state, so
+// the next launch shows it again without reading or decoding the file. The
+// file is a SessionHeader followed by 8-byte aligned sections at the
+// offsets it records; a restore maps it and hands the text straight to the
+// edit control. A new snapshot is written beside the old one and renamed
+// over it. Nothing is flushed: a snapshot the disk lost is caught by the
+// content check and the file is simply decoded again.
+#define SESSION_MAGIC 0x31535052u // "RPS1"
+#define SESSION_NAME L"session.rps"
+
+typedef struct SessionSection {
+    uint64_t offset; // from the start of the file; 0 when absent
+    uint64_t bytes;
+} SessionSection;
+
+typedef struct SessionHeader {
+    uint32_t magic;
+    uint32_t headerBytes;  // sizeof(SessionHeader): another build's layout never matches
+    uint64_t fileBytes;
+    SessionState state;
+    SessionSection text;   // UTF-16 units and a NUL
+    TextLineIndex lines;   // scalars only; the arrays are sections
+    SessionSection blocks;
+    SessionSection deltas;
+    TextBaseline map;      // likewise
+    SessionSection marks;
+    SessionSection devMode;
+    SessionSection devNames;
+    uint64_t contentCheck; // XXH64 of everything after the header
+    uint64_t check;        // XXH64 of the header up to here
+} SessionHeader;
+
+struct Session {
+    MappedFile file;
+    const BYTE *view;
+    const SessionHeader *header;
+};
+
+static void PlanSessionSection(SessionSection *section, uint64_t *end, const void *data, uint64_t bytes) {
+    if (!data || bytes == 0) return;
+    section->offset = *end;
+    section->bytes = bytes;
+    *end += (bytes + 7) & ~(uint64_t)7;
+}
+
+// Writes a planned section at the file position its offset names.
+static BOOL WriteSessionSection(HANDLE file, TextHash *hash, uint64_t *at, const SessionSection *section, const void *data) {
+    static const BYTE zeros[8] = {0};
+    if (!section->offset) return TRUE;
+    if (section->offset > *at) {
+        DWORD pad = (DWORD)(section->offset - *at);
+        if (!WriteExactly(file, zeros, pad)) return FALSE;
+        TextHashUpdate(hash, zeros, pad);
+    }
+    if (!WriteAll(file, (const BYTE *)data, (SIZE_T)section->bytes)) return FALSE;
+    TextHashUpdate(hash, data, (size_t)section->bytes);
+    *at = section->offset + section->bytes;
+    return TRUE;
+}
+
+BOOL SaveSession(const SessionState *state, const WCHAR *text, size_t length, const TextLineIndex *lines,
+                 const SaveBaseline *baseline, HGLOBAL devMode, HGLOBAL devNames) {
+    WCHAR path[MAX_PATH], temp[MAX_PATH];
+    if (!AppDataPath(L"session", SESSION_NAME, path, ARRAYSIZE(path)) ||
+        FAILED(StringCchPrintfW(temp, ARRAYSIZE(temp), L"%s.tmp", path))) {
         return FALSE;
     }
+    SessionHeader header;
+    ZeroMemory(&header, sizeof(header));
+    header.magic = SESSION_MAGIC;
+    header.headerBytes = sizeof(SessionHeader);
+    header.state = *state;
+    const void *devModeData = devMode ? GlobalLock(devMode) : NULL;
+    const void *devNamesData = devNames ? GlobalLock(devNames) : NULL;
+    uint64_t end = sizeof(SessionHeader);
+    if (text) {
+        PlanSessionSection(&header.text, &end, text, ((uint64_t)length + 1) * sizeof(WCHAR));
+        if (lines && lines->valid && lines->lines > 0) {
+            header.lines = *lines;
+            header.lines.deltas = NULL;
+            header.lines.blocks = NULL;
+            header.lines.lineSums = NULL;
+            header.lines.unitSums = NULL;
+            header.lines.freeSlots = NULL;
+            header.lines.freeCount = header.lines.slotCapacity = header.lines.blockCapacity = 0;
+            PlanSessionSection(&header.blocks, &end, lines->blocks, lines->blockCount * sizeof(TextLineBlock));
+            PlanSessionSection(&header.deltas, &end, lines->deltas,
+                               lines->slotCount * TEXT_LINES_BLOCK * sizeof(uint32_t));
+        }
+        if (baseline && baseline->map.valid && baseline->map.markCount > 0) {
+            header.map = baseline->map;
+            header.map.marks = NULL;
+            header.map.markCapacity = 0;
+            PlanSessionSection(&header.marks, &end, baseline->map.marks,
+                               baseline->map.markCount * sizeof(TextBaselineMark));
+        }
+    }
+    if (devModeData) PlanSessionSection(&header.devMode, &end, devModeData, GlobalSize(devMode));
+    if (devNamesData) PlanSessionSection(&header.devNames, &end, devNamesData, GlobalSize(devNames));
+    header.fileBytes = end;
 
     BOOL ok = FALSE;
-    switch (encoding) {
-    case ENC_UTF16LE:
-        ok = WriteUTF16LE(file, text, length);
-        break;
-    case ENC_ANSI:
-        ok = WriteANSI(file, text, length);
-        break;
-    case ENC_UTF16BE:
-        // Saving as UTF-16BE is uncommon; fall back to UTF-8 with BOM to preserve readability
-        ok = WriteUTF8WithBOM(file, text, length);
-        encoding = ENC_UTF8;
-        break;
-    case ENC_UTF8:
-    default:
-        ok = WriteUTF8WithBOM(file, text, length);
-        break;
+    HANDLE file = CreateFileW(temp, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file != INVALID_HANDLE_VALUE) {
+        // The header goes last, once the content check is known.
+        TextHash hash;
+        TextHashInit(&hash, 0);
+        uint64_t at = sizeof(SessionHeader);
+        ok = SeekFile(file, at) && WriteSessionSection(file, &hash, &at, &header.text, text) &&
+             WriteSessionSection(file, &hash, &at, &header.blocks, lines ? lines->blocks : NULL) &&
+             WriteSessionSection(file, &hash, &at, &header.deltas, lines ? lines->deltas : NULL) &&
+             WriteSessionSection(file, &hash, &at, &header.marks, baseline ? baseline->map.marks : NULL) &&
+             WriteSessionSection(file, &hash, &at, &header.devMode, devModeData) &&
+             WriteSessionSection(file, &hash, &at, &header.devNames, devNamesData);
+        if (ok && at < end) {
+            static const BYTE zeros[8] = {0};
+            ok = WriteExactly(file, zeros, (DWORD)(end - at));
+            TextHashUpdate(&hash, zeros, (size_t)(end - at));
+        }
+        header.contentCheck = TextHashDigest(&hash);
+        header.check = TextHash64(&header, offsetof(SessionHeader, check), 0);
+        ok = ok && SeekFile(file, 0) && WriteExactly(file, &header, sizeof(header));
+        CloseHandle(file);
+        ok = ok && MoveFileExW(temp, path, MOVEFILE_REPLACE_EXISTING);
+        if (!ok) DeleteFileW(temp);
+    }
+    if (devModeData) GlobalUnlock(devMode);
+    if (devNamesData) GlobalUnlock(devNames);
+    return ok;
+}
+
+static BOOL SessionSectionFits(const SessionSection *section, uint64_t fileBytes) {
+    if (!section->offset) return section->bytes == 0;
+    return section->offset >= sizeof(SessionHeader) && section->offset % 8 == 0 && section->offset <= fileBytes &&
+           section->bytes <= fileBytes - section->offset;
+}
+
+// Checks everything a restore will trust: the header, that the sections lie
+// inside the file and agree with the counts in it, and the content check.
+// The line blocks must cover exactly the recorded lines from slots that
+// were written, or copying them out would read past the section.
+static BOOL ValidSessionLines(const SessionHeader *header, const BYTE *view) {
+    const TextLineIndex *lines = &header->lines;
+    if (header->blocks.bytes != lines->blockCount * sizeof(TextLineBlock) ||
+        header->deltas.bytes != lines->slotCount * TEXT_LINES_BLOCK * sizeof(uint32_t)) {
+        return FALSE;
+    }
+    const TextLineBlock *blocks = (const TextLineBlock *)(view + header->blocks.offset);
+    uint64_t total = 0;
+    for (size_t b = 0; b < lines->blockCount; ++b) {
+        if (blocks[b].lines == 0 || blocks[b].lines > TEXT_LINES_BLOCK || blocks[b].slot >= lines->slotCount) {
+            return FALSE;
+        }
+        total += blocks[b].lines;
     }
+    return total == lines->lines;
+}
 
-    CloseHandle(file);
-    if (!ok) {
-        MessageBoxW(owner, L"Failed writing file.", L"retropad", MB_ICONERROR);
+static BOOL ValidSession(const SessionHeader *header, uint64_t fileBytes, const BYTE *view) {
+    if (header->magic != SESSION_MAGIC || header->headerBytes != sizeof(SessionHeader) ||
+        header->fileBytes != fileBytes || header->check != TextHash64(header, offsetof(SessionHeader, check), 0)) {
+        return FALSE;
     }
-    return ok;
+    const SessionSection *sections[] = { &header->text, &header->blocks, &header->deltas, &header->marks,
+                                         &header->devMode, &header->devNames };
+    for (size_t i = 0; i < ARRAYSIZE(sections); ++i) {
+        if (!SessionSectionFits(sections[i], fileBytes)) return FALSE;
+    }
+    if (header->text.offset) {
+        if (header->text.bytes < sizeof(WCHAR) || header->text.bytes % sizeof(WCHAR) != 0) return FALSE;
+        const WCHAR *text = (const WCHAR *)(view + header->text.offset);
+        if (text[header->text.bytes / sizeof(WCHAR) - 1] != L'\0') return FALSE;
+    }
+    if (header->deltas.offset && !ValidSessionLines(header, view)) return FALSE;
+    if (header->marks.offset && header->marks.bytes != header->map.markCount * sizeof(TextBaselineMark)) return FALSE;
+    if (header->state.path[SESSION_PATH_UNITS - 1] != L'\0') return FALSE;
+    return TextHash64(view + sizeof(SessionHeader), (size_t)(fileBytes - sizeof(SessionHeader)), 0) ==
+           header->contentCheck;
+}
+
+Session *OpenSession(SessionState *stateOut) {
+    WCHAR path[MAX_PATH];
+    if (!AppDataPath(L"session", SESSION_NAME, path, ARRAYSIZE(path))) return NULL;
+    Session *session = (Session *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(Session));
+    if (!session) return NULL;
+    if (!OpenMappedFile(path, &session->file) || session->file.size < sizeof(SessionHeader) ||
+        session->file.size > (SIZE_T)-1) {
+        CloseSession(session);
+        return NULL;
+    }
+    session->view = (const BYTE *)MapViewOfFile(session->file.mapping, FILE_MAP_READ, 0, 0, 0);
+    session->header = (const SessionHeader *)session->view;
+    if (!session->view || !ValidSession(session->header, session->file.size, session->view)) {
+        CloseSession(session);
+        return NULL;
+    }
+    *stateOut = session->header->state;
+    return session;
+}
+
+const WCHAR *SessionText(const Session *session, size_t *lengthOut) {
+    const SessionSection *text = &session->header->text;
+    *lengthOut = text->offset ? (size_t)(text->bytes / sizeof(WCHAR) - 1) : 0;
+    return text->offset ? (const WCHAR *)(session->view + text->offset) : NULL;
+}
+
+void TakeSessionDocument(const Session *session, LPCWSTR path, SaveBaseline **baselineOut, TextLineIndex *linesOut) {
+    const SessionHeader *header = session->header;
+    TextLineIndexInit(linesOut);
+    if (header->deltas.offset) {
+        // Copied out, so edits can update them as usual.
+        TextLineIndex view = header->lines;
+        view.blocks = (TextLineBlock *)(session->view + header->blocks.offset);
+        view.deltas = (uint32_t *)(session->view + header->deltas.offset);
+        TextLineIndexCopy(linesOut, &view);
+    }
+    *baselineOut = NULL;
+    if (header->marks.offset) {
+        TextBaseline view = header->map;
+        view.marks = (TextBaselineMark *)(session->view + header->marks.offset);
+        view.markCapacity = view.markCount;
+        TextBaseline map;
+        if (TextBaselineCopy(&map, &view)) *baselineOut = CreateSaveBaseline(path, &map);
+    }
+}
+
+static HGLOBAL CopySessionSection(const Session *session, const SessionSection *section) {
+    if (!section->offset) return NULL;
+    HGLOBAL copy = GlobalAlloc(GMEM_MOVEABLE, (SIZE_T)section->bytes);
+    void *data = copy ? GlobalLock(copy) : NULL;
+    if (!data) {
+        if (copy) GlobalFree(copy);
+        return NULL;
+    }
+    CopyMemory(data, session->view + section->offset, (SIZE_T)section->bytes);
+    GlobalUnlock(copy);
+    return copy;
+}
+
+void TakeSessionPageSetup(const Session *session, HGLOBAL *devModeOut, HGLOBAL *devNamesOut) {
+    *devModeOut = CopySessionSection(session, &session->header->devMode);
+    *devNamesOut = CopySessionSection(session, &session->header->devNames);
+}
+
+void CloseSession(Session *session) {
+    if (!session) return;
+    if (session->view) UnmapViewOfFile(session->view);
+    CloseMappedFile(&session->file);
+    HeapFree(GetProcessHeap(), 0, session);
 }
 
 BOOL OpenFileDialog(HWND owner, WCHAR *pathOut, DWORD pathLen) {
@@ -226,6 +2860,62 @@ BOOL OpenFileDialog(HWND owner, WCHAR *pathOut, DWORD pathLen) {
     return GetOpenFileNameW(&ofn);
 }
 
+static int __cdecl ComparePaths(const void *a, const void *b) {
+    return CompareStringOrdinal(*(LPCWSTR const *)a, -1, *(LPCWSTR const *)b, -1, TRUE) - CSTR_EQUAL;
+}
+
+UINT OpenFilesDialog(HWND owner, WCHAR **pathsOut, UINT maxPaths) {
+    // Room for a directory and a good many names, NUL-separated.
+    const DWORD chars = 64 * 1024;
+    WCHAR *buffer = (WCHAR *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, chars * sizeof(WCHAR));
+    if (!buffer) return 0;
+    OPENFILENAMEW ofn = {0};
+    WCHAR filter[] = L"Text Files (*.txt)\0*.txt\0All Files (*.*)\0*.*\0\0";
+    ofn.lStructSize = sizeof(ofn);
+    ofn.hwndOwner = owner;
+    ofn.lpstrFilter = filter;
+    ofn.lpstrFile = buffer;
+    ofn.nMaxFile = chars;
+    ofn.Flags = OFN_ALLOWMULTISELECT | OFN_EXPLORER | OFN_FILEMUSTEXIST | OFN_HIDEREADONLY | OFN_PATHMUSTEXIST;
+    UINT count = 0;
+    if (GetOpenFileNameW(&ofn)) {
+        // One file comes back as a full path; several as the directory
+        // followed by each name.
+        LPCWSTR dir = buffer;
+        LPCWSTR name = buffer + wcslen(buffer) + 1;
+        if (*name == L'\0') name = NULL;
+        for (; count < maxPaths; ++count) {
+            size_t len = wcslen(dir) + (name ? wcslen(name) + 2 : 1);
+            WCHAR *path = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, len * sizeof(WCHAR));
+            if (!path) break;
+            if (name) {
+                StringCchPrintfW(path, len, L"%s\\%s", dir, name);
+            } else {
+                StringCchCopyW(path, len, dir);
+            }
+            pathsOut[count] = path;
+            if (!name) {
+                count++;
+                break;
+            }
+            name += wcslen(name) + 1;
+            if (*name == L'\0') {
+                count++;
+                break;
+            }
+        }
+        qsort(pathsOut, count, sizeof(WCHAR *), ComparePaths);
+    }
+    HeapFree(GetProcessHeap(), 0, buffer);
+    return count;
+}
+
+void FreeFileList(WCHAR **paths, UINT count) {
+    for (UINT i = 0; i < count; ++i) {
+        HeapFree(GetProcessHeap(), 0, paths[i]);
+    }
+}
+
 BOOL SaveFileDialog(HWND owner, WCHAR *pathOut, DWORD pathLen) {
     OPENFILENAMEW ofn = {0};
     WCHAR filter[] = L"Text Files (*.txt)\0*.txt\0All Files (*.*)\0*.*\0\0";
@@ -2,13 +2,10 @@
 #pragma once
 
 #include <windows.h>
-
-typedef enum TextEncoding {
-    ENC_UTF8 = 1,
-    ENC_UTF16LE = 2,
-    ENC_UTF16BE = 3,
-    ENC_ANSI = 4
-} TextEncoding;
+#include "text_codec.h"
+#include "text_lines.h"
+#include "text_pager.h"
+#include "text_split.h"
 
 typedef struct FileResult {
     WCHAR path[MAX_PATH];
@@ -16,7 +13,309 @@ typedef struct FileResult {
 } FileResult;
 
 BOOL OpenFileDialog(HWND owner, WCHAR *pathOut, DWORD pathLen);
+// Multi-select open: fills `pathsOut` with up to `maxPaths` full paths,
+// sorted by name, each from HeapAlloc (free with FreeFileList). Returns the
+// count, 0 when cancelled.
+UINT OpenFilesDialog(HWND owner, WCHAR **pathsOut, UINT maxPaths);
+void FreeFileList(WCHAR **paths, UINT count);
 BOOL SaveFileDialog(HWND owner, WCHAR *pathOut, DWORD pathLen);
 
-BOOL LoadTextFile(HWND owner, LPCWSTR path, WCHAR **textOut, size_t *lengthOut, TextEncoding *encodingOut);
-BOOL SaveTextFile(HWND owner, LPCWSTR path, LPCWSTR text, size_t length, TextEncoding encoding);
+// How hard SaveTextFile works to keep the previous contents safe.
+typedef enum SaveDurability {
+    SAVE_DURABILITY_IN_PLACE = 0, // rewrite the file directly; a failed save truncates it
+    SAVE_DURABILITY_ATOMIC = 1,   // write a sibling temp file, then rename it over the original
+    SAVE_DURABILITY_FLUSHED = 2   // atomic, and flush the data to disk before the rename
+} SaveDurability;
+
+// Wall-clock time spent in each phase of a save, in milliseconds.
+typedef struct SaveTimings {
+    double writeMs;
+    double flushMs;  // flush and close
+    double renameMs;
+    BOOL skipped;    // the file already held these bytes; nothing was written
+    ULONGLONG historyBytes; // new bytes the version history had to store
+} SaveTimings;
+
+// What the file looked like when the document last matched it: size and
+// last-write time for the cheap check, and an XXH64 of every byte for when
+// the time moved but the size did not.
+typedef struct FileFingerprint {
+    BOOL valid;
+    ULONGLONG size;
+    FILETIME lastWrite;
+    ULONGLONG hash;
+} FileFingerprint;
+
+typedef enum FileCheck {
+    FILE_CHECK_SAME = 0,    // unchanged (or touched without changing its bytes)
+    FILE_CHECK_CHANGED = 1,
+    FILE_CHECK_MISSING = 2
+} FileCheck;
+
+// Compares `path` with a valid `fingerprint`, hashing the file only when
+// its size matches but its time does not. A file touched without changing
+// gets the new time recorded in `fingerprint`.
+FileCheck CheckFileFingerprint(LPCWSTR path, FileFingerprint *fingerprint);
+
+// ANSI files load and save through this code page: 0 (the default) means
+// the system's, anything else a specific one. Single-byte pages listed in
+// text_codepage.h convert through built-in tables, the same on every
+// machine; others go through Windows.
+void SetAnsiCodePage(UINT codePage);
+// The code page ANSI files currently load with.
+UINT GetAnsiCodePage(void);
+
+// Remembers how the open document maps onto the file it came from, so saves
+// can copy unedited bytes instead of re-encoding the whole text.
+typedef struct SaveBaseline SaveBaseline;
+
+// Records that units [editStart, editEnd) of the document (now `newLength`
+// units long) were touched. NULL baselines are ignored.
+void NoteBaselineEdit(SaveBaseline *baseline, size_t editStart, size_t editEnd, size_t newLength);
+// Records a change that cannot be located, such as undo.
+void NoteBaselineRewrite(SaveBaseline *baseline);
+// Units of the document the baseline describes; 0 for NULL.
+size_t SaveBaselineLength(const SaveBaseline *baseline);
+void FreeSaveBaseline(SaveBaseline *baseline);
+
+// Progressive loading: a worker thread decodes the file and posts
+// WM_APP_LOAD_CHUNK (wParam = LoadJob*, lParam = LoadChunk*) for each piece,
+// then WM_APP_LOAD_DONE (lParam = LoadJob*) to the owner window.
+#define WM_APP_LOAD_CHUNK (WM_APP + 110)
+#define WM_APP_LOAD_DONE  (WM_APP + 111)
+
+typedef struct LoadChunk {
+    WCHAR *text;          // NUL-terminated
+    size_t length;
+    BOOL restart;         // discard text received so far (encoding changed)
+    ULONGLONG bytesDone;  // progress through the file
+    ULONGLONG bytesTotal;
+} LoadChunk;
+
+typedef struct LoadJob LoadJob;
+
+// Opens `path` (reporting failures to `owner`) and starts decoding it.
+LoadJob *BeginLoadTextFile(HWND owner, LPCWSTR path);
+// Returns a chunk's memory and lets the worker produce the next one.
+void AcknowledgeLoadChunk(LoadJob *job, LoadChunk *chunk);
+// Frees a chunk whose job has already ended.
+void FreeLoadChunk(LoadChunk *chunk);
+void CancelLoadTextFile(LoadJob *job);
+// Bytes of the file being loaded, as it stood when the load began.
+ULONGLONG LoadTextFileSize(const LoadJob *job);
+// Whether the file is gzip-compressed (and was decoded from its inflated
+// contents). Valid once WM_APP_LOAD_DONE has arrived.
+BOOL LoadTextFileCompressed(const LoadJob *job);
+// Code page an ANSI result was decoded with (fixed when the load began).
+UINT LoadTextFileCodePage(const LoadJob *job);
+// The loaded file's fingerprint, hashed as it was read; invalid when the
+// file changed during the load. Valid once WM_APP_LOAD_DONE has arrived.
+void LoadTextFileFingerprint(const LoadJob *job, FileFingerprint *fingerprintOut);
+// Waits for the worker, reports decode errors and frees the job. Returns
+// FALSE when the load failed or was cancelled. `baselineOut` (optional)
+// receives the document's SaveBaseline, or NULL; `linesOut` (optional, the
+// caller frees it) its line index, empty unless the load succeeded.
+BOOL EndLoadTextFile(HWND owner, LoadJob *job, TextEncoding *encodingOut, SaveBaseline **baselineOut, TextLineIndex *linesOut);
+
+// Recently loaded documents are kept decoded (within a memory budget) so
+// reopening one that has not changed on disk skips reading and decoding.
+// Entries are matched on path, size, last-write time and a fingerprint of
+// the file's first and last few KB.
+typedef struct CachedDocument {
+    const WCHAR *text;   // NUL-terminated; owned by the cache, valid until
+    size_t length;       // the next cache or load call
+    TextEncoding encoding;
+    UINT codePage;       // for ENC_ANSI
+    BOOL compressed;
+    FileFingerprint fingerprint;
+} CachedDocument;
+
+typedef struct DocumentCacheStats {
+    ULONGLONG hits;
+    ULONGLONG misses;
+    ULONGLONG evictions;
+    SIZE_T bytesUsed;
+    SIZE_T budget;
+    UINT entries;
+} DocumentCacheStats;
+
+// 0 turns the cache off and empties it.
+void SetDocumentCacheBudget(SIZE_T bytes);
+void GetDocumentCacheStats(DocumentCacheStats *stats);
+// On a hit fills `doc` and hands over a fresh SaveBaseline (or NULL) and a
+// copy of the document's line index.
+BOOL LookupCachedDocument(LPCWSTR path, CachedDocument *doc, SaveBaseline **baselineOut, TextLineIndex *linesOut);
+
+// Read-only paging for files too large for the edit control: the file stays
+// mapped and only the pages around the viewport are decoded.
+typedef struct PagedFile PagedFile;
+
+BOOL QueryFileSize(LPCWSTR path, ULONGLONG *sizeOut);
+// True when `path` starts with the gzip magic; such files are never paged.
+BOOL IsGzipFile(LPCWSTR path);
+// Opens `path` for paged viewing, reporting failures to `owner`.
+PagedFile *OpenPagedFile(HWND owner, LPCWSTR path, TextEncoding *encodingOut, UINT *codePageOut);
+TextPager *GetPagedText(PagedFile *file);
+void ClosePagedFile(PagedFile *file);
+
+// Follow (tail) mode: each poll reopens the file by name, decodes only the
+// bytes it gained past `offset`, and reports truncation or replacement
+// (log rotation) so the caller can reload it.
+typedef struct FollowedFile FollowedFile;
+
+typedef enum FollowStatus {
+    FOLLOW_IDLE = 0,     // nothing new (or the file is briefly missing)
+    FOLLOW_APPENDED = 1, // text to append was returned
+    FOLLOW_RESTART = 2   // truncated or replaced: reload from the start
+} FollowStatus;
+
+// Starts watching `path`, whose first `offset` bytes are already shown.
+// `codePage` applies to ENC_ANSI.
+FollowedFile *BeginFollowingFile(HWND owner, LPCWSTR path, TextEncoding encoding, UINT codePage, ULONGLONG offset);
+// On FOLLOW_APPENDED `textOut` receives NUL-terminated text to release with
+// FreeFollowedText.
+FollowStatus PollFollowedFile(FollowedFile *file, WCHAR **textOut, size_t *lengthOut);
+void FreeFollowedText(WCHAR *text);
+// File bytes the appended text accounts for so far.
+ULONGLONG FollowedFileSize(const FollowedFile *file);
+void EndFollowingFile(FollowedFile *file);
+
+// `codePage` applies to ENC_ANSI; characters a built-in single-byte page
+// lacks are written as '?'. `baseline` (optional) is consulted to reuse unedited bytes and replaced
+// with one describing the saved file. `compress` writes a gzip stream.
+// `fingerprint` (optional) describes `path` as last loaded or saved; when
+// the file still matches it and the encoded text hashes the same, nothing
+// is written. It is replaced with the saved file's fingerprint.
+BOOL SaveTextFile(HWND owner, LPCWSTR path, LPCWSTR text, size_t length, TextEncoding encoding, UINT codePage,
+                  BOOL compress, SaveDurability durability, SaveBaseline **baseline, FileFingerprint *fingerprint,
+                  SaveTimings *timingsOut);
+
+// Every save is also kept as a version of its file in a local history
+// under %LOCALAPPDATA%\retropad\history. Versions are cut into
+// content-defined chunks (text_history.h) and each distinct chunk is stored
+// once, so saving a large file again after a small edit adds little more
+// than the edited chunks. On by default.
+void SetHistoryEnabled(BOOL enabled);
+
+typedef struct FileVersion {
+    FILETIME saved;      // UTC
+    ULONGLONG size;      // bytes before any gzip compression
+    BOOL compressed;
+    ULONGLONG position;  // where the version sits in its list
+} FileVersion;
+
+// The recorded versions of `path`, oldest first, in `versionsOut` (free
+// with FreeFileVersions). Returns the count, 0 when there are none.
+UINT ListFileVersions(LPCWSTR path, FileVersion **versionsOut);
+void FreeFileVersions(FileVersion *versions);
+// Writes `version` of `path` to `target` (which may be `path` itself)
+// through a temp file, reporting failures to `owner`.
+BOOL RestoreFileVersion(HWND owner, LPCWSTR path, const FileVersion *version, LPCWSTR target);
+
+// Crash recovery: while the document has unsaved changes, each edit is
+// queued here and a worker thread appends them in batches to a journal
+// under %LOCALAPPDATA%\retropad\recovery, flushing every half second.
+// Nothing waits on the disk but the worker. A clean end deletes the journal;
+// one left behind by a crash is found and replayed on the next launch.
+#define JOURNAL_PATH_UNITS 1024
+
+typedef struct EditJournal EditJournal;
+
+// Starts a journal for the document at `path` (NULL when untitled). With
+// a `fingerprint`, the document is the file as fingerprinted and `text` is
+// not needed; otherwise the journal starts from a copy of `text`.
+EditJournal *BeginEditJournal(LPCWSTR path, const FileFingerprint *fingerprint, TextEncoding encoding, UINT codePage,
+                              BOOL compressed, const WCHAR *text, size_t length);
+// Units [offset, offset + deleted) were replaced by `inserted`.
+void JournalEdit(EditJournal *journal, size_t offset, size_t deleted, const WCHAR *inserted, size_t insertedLength);
+// Restarts the journal from the whole text: after a change that could not
+// be recorded as an edit, or once the log outgrows the document.
+void JournalCheckpoint(EditJournal *journal, const WCHAR *text, size_t length);
+// Whether the log is due a checkpoint for a document of `length` units, or
+// the worker failed a write and only a checkpoint will resume it.
+BOOL JournalWantsCheckpoint(EditJournal *journal, size_t length);
+// Stops the worker and deletes the journal: its changes were saved or
+// given up.
+void EndEditJournal(EditJournal *journal);
+
+// A journal whose instance ended without saving or giving up its changes.
+typedef struct AbandonedJournal {
+    WCHAR path[JOURNAL_PATH_UNITS]; // the document's file; empty when untitled
+    TextEncoding encoding;
+    UINT codePage;
+    BOOL compressed;
+    BOOL fromFile;       // replays onto `path` as it was: `fileSize` bytes hashing to `fileHash`
+    ULONGLONG fileSize;
+    ULONGLONG fileHash;
+    WCHAR files[2][MAX_PATH];
+} AbandonedJournal;
+
+BOOL FindAbandonedJournal(AbandonedJournal *journal);
+// Rebuilds the unsaved document; `base` is the decoded file when
+// `fromFile`, otherwise NULL. The text (NUL-terminated) is released with
+// FreeRecoveredText.
+BOOL ReplayAbandonedJournal(const AbandonedJournal *journal, const WCHAR *base, size_t baseLength, WCHAR **textOut,
+                            size_t *lengthOut);
+void FreeRecoveredText(WCHAR *text);
+void DiscardAbandonedJournal(const AbandonedJournal *journal);
+
+// The session snapshot: what retropad showed when it last closed, with the
+// document already decoded, kept in one file that a restore maps instead
+// of reading. See SaveSession and OpenSession.
+#define SESSION_PATH_UNITS 1024
+
+typedef struct SessionState {
+    WCHAR path[SESSION_PATH_UNITS]; // the open file; empty when untitled
+    TextEncoding encoding;
+    UINT codePage;
+    BOOL compressed;
+    FileFingerprint fingerprint;    // the file the snapshot's text was decoded from
+    DWORD selStart;
+    DWORD selEnd;
+    int firstLine;                  // topmost visible line
+    BOOL wordWrap;
+    BOOL statusVisible;
+    BOOL followTail;
+    RECT marginsThousandths;
+    WCHAR headerText[128];
+    WCHAR footerText[128];
+} SessionState;
+
+typedef struct Session Session;
+
+// Replaces the snapshot. `text` (with `lines` and `baseline`, both
+// optional) is the decoded file at `state->path`, or NULL to keep only the
+// path, which a restore then opens the usual way.
+BOOL SaveSession(const SessionState *state, const WCHAR *text, size_t length, const TextLineIndex *lines,
+                 const SaveBaseline *baseline, HGLOBAL devMode, HGLOBAL devNames);
+// Maps the snapshot and fills `stateOut`; NULL when there is none or it
+// does not check out.
+Session *OpenSession(SessionState *stateOut);
+// The snapshot's text (NUL-terminated, valid until CloseSession), or NULL.
+const WCHAR *SessionText(const Session *session, size_t *lengthOut);
+// Copies of the text's line index and, for the file at `path`, its
+// SaveBaseline (or NULL), as a finished load would hand them over.
+void TakeSessionDocument(const Session *session, LPCWSTR path, SaveBaseline **baselineOut, TextLineIndex *linesOut);
+// Fresh HGLOBAL copies of the printer settings, or NULL.
+void TakeSessionPageSetup(const Session *session, HGLOBAL *devModeOut, HGLOBAL *devNamesOut);
+void CloseSession(Session *session);
+
+// Split and join work on the files' bytes in their own encoding, never
+// decoding them, on a worker thread that posts WM_APP_SPLIT_DONE
+// (lParam = SplitJob*) to the owner when it finishes.
+#define WM_APP_SPLIT_DONE (WM_APP + 112)
+
+typedef struct SplitJob SplitJob;
+
+// Cuts `path` into "name.001.ext", "name.002.ext", ... beside it, at line
+// boundaries (see text_split.h for `mode` and `limit`). TEXT_SPLIT_MATCH
+// starts a piece at each line containing `pattern`, compared exactly in
+// the file's encoding. Existing pieces are never overwritten.
+SplitJob *BeginSplitTextFile(HWND owner, LPCWSTR path, TextSplitMode mode, ULONGLONG limit, LPCWSTR pattern);
+// Concatenates `parts` in order into `target`, keeping only the first
+// part's BOM. Parts with different BOMs are refused.
+SplitJob *BeginJoinTextFiles(HWND owner, LPCWSTR const *parts, UINT count, LPCWSTR target);
+void CancelSplitJob(SplitJob *job);
+// Waits for the worker, reports failures and frees the job. `countOut`
+// receives the pieces written or parts joined, `bytesOut` the bytes written.
+BOOL EndSplitJob(HWND owner, SplitJob *job, UINT *countOut, ULONGLONG *bytesOut);
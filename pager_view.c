@@ -0,0 +1,269 @@
+// Read-only large-file viewer: paints the lines below a top position taken
+// from the pager and maps the vertical scroll bar onto file offsets, so
+// scrolling and jumping only ever decode the pages on screen.
+#include "pager_view.h"
+
+#define PAGER_VIEW_CLASS L"RetropadPagerView"
+#define PAGER_VIEW_LINE_UNITS 4096   // longer lines are clipped on screen
+#define PAGER_VIEW_SCROLL_RANGE 10000
+
+typedef struct PagerViewState {
+    TextPager *pager;
+    HFONT font;
+    TextPagerPos top;
+    int lineHeight;
+    int charWidth;
+    int xScroll;   // pixels
+    WCHAR *line;   // PAGER_VIEW_LINE_UNITS units of scratch
+} PagerViewState;
+
+static PagerViewState g_pv;
+
+static void MeasureFont(HWND hwnd) {
+    g_pv.lineHeight = 16;
+    g_pv.charWidth = 8;
+    HDC dc = GetDC(hwnd);
+    if (!dc) return;
+    HGDIOBJ old = g_pv.font ? SelectObject(dc, g_pv.font) : NULL;
+    TEXTMETRICW tm;
+    if (GetTextMetricsW(dc, &tm)) {
+        g_pv.lineHeight = tm.tmHeight + tm.tmExternalLeading;
+        g_pv.charWidth = tm.tmAveCharWidth;
+    }
+    if (old) SelectObject(dc, old);
+    ReleaseDC(hwnd, dc);
+}
+
+static int VisibleRows(HWND hwnd) {
+    RECT rc;
+    GetClientRect(hwnd, &rc);
+    int rows = g_pv.lineHeight > 0 ? rc.bottom / g_pv.lineHeight : 1;
+    return rows > 1 ? rows : 1;
+}
+
+static void UpdateScrollBars(HWND hwnd) {
+    SCROLLINFO si = {0};
+    si.cbSize = sizeof(si);
+    si.fMask = SIF_RANGE | SIF_POS | SIF_PAGE | SIF_DISABLENOSCROLL;
+    si.nMax = PAGER_VIEW_SCROLL_RANGE;
+    si.nPage = 1;
+    if (g_pv.pager) {
+        uint64_t span = g_pv.pager->fileSize - g_pv.pager->dataStart;
+        uint64_t at = TextPagerByteOffset(g_pv.pager, g_pv.top) - g_pv.pager->dataStart;
+        si.nPos = span ? (int)(at * PAGER_VIEW_SCROLL_RANGE / span) : 0;
+    }
+    SetScrollInfo(hwnd, SB_VERT, &si, TRUE);
+
+    RECT rc;
+    GetClientRect(hwnd, &rc);
+    si.nMax = PAGER_VIEW_LINE_UNITS * g_pv.charWidth;
+    si.nPage = (UINT)rc.right;
+    si.nPos = g_pv.xScroll;
+    SetScrollInfo(hwnd, SB_HORZ, &si, TRUE);
+}
+
+// Redraws after the top line or horizontal offset changed.
+static void Refresh(HWND hwnd) {
+    UpdateScrollBars(hwnd);
+    InvalidateRect(hwnd, NULL, FALSE);
+    SendMessageW(GetParent(hwnd), WM_COMMAND, MAKEWPARAM(GetDlgCtrlID(hwnd), PVN_SCROLL), (LPARAM)hwnd);
+}
+
+static void ScrollLines(HWND hwnd, int delta) {
+    if (!g_pv.pager) return;
+    for (; delta > 0; --delta) {
+        if (!TextPagerNextLine(g_pv.pager, &g_pv.top)) break;
+    }
+    for (; delta < 0; ++delta) {
+        if (!TextPagerPrevLine(g_pv.pager, &g_pv.top)) break;
+    }
+    Refresh(hwnd);
+}
+
+static void SeekTo(HWND hwnd, uint64_t offset) {
+    if (!g_pv.pager) return;
+    TextPagerSeek(g_pv.pager, offset, &g_pv.top);
+    Refresh(hwnd);
+}
+
+// Puts the last line at the bottom of the window.
+static void ScrollToEnd(HWND hwnd) {
+    if (!g_pv.pager || !TextPagerLastLine(g_pv.pager, &g_pv.top)) return;
+    ScrollLines(hwnd, -(VisibleRows(hwnd) - 1));
+}
+
+static void ScrollHorizontally(HWND hwnd, int x) {
+    int limit = PAGER_VIEW_LINE_UNITS * g_pv.charWidth;
+    if (x > limit) x = limit;
+    if (x < 0) x = 0;
+    g_pv.xScroll = x;
+    Refresh(hwnd);
+}
+
+static void OnVScroll(HWND hwnd, WPARAM wParam) {
+    int page = VisibleRows(hwnd) - 1;
+    switch (LOWORD(wParam)) {
+    case SB_LINEUP: ScrollLines(hwnd, -1); break;
+    case SB_LINEDOWN: ScrollLines(hwnd, 1); break;
+    case SB_PAGEUP: ScrollLines(hwnd, -(page > 0 ? page : 1)); break;
+    case SB_PAGEDOWN: ScrollLines(hwnd, page > 0 ? page : 1); break;
+    case SB_TOP: SeekTo(hwnd, 0); break;
+    case SB_BOTTOM: ScrollToEnd(hwnd); break;
+    case SB_THUMBTRACK:
+    case SB_THUMBPOSITION: {
+        if (!g_pv.pager) break;
+        SCROLLINFO si = {0};
+        si.cbSize = sizeof(si);
+        si.fMask = SIF_TRACKPOS;
+        GetScrollInfo(hwnd, SB_VERT, &si);
+        uint64_t span = g_pv.pager->fileSize - g_pv.pager->dataStart;
+        SeekTo(hwnd, g_pv.pager->dataStart + span * (uint64_t)si.nTrackPos / PAGER_VIEW_SCROLL_RANGE);
+        break;
+    }
+    }
+}
+
+static void OnHScroll(HWND hwnd, WPARAM wParam) {
+    RECT rc;
+    GetClientRect(hwnd, &rc);
+    switch (LOWORD(wParam)) {
+    case SB_LINELEFT: ScrollHorizontally(hwnd, g_pv.xScroll - g_pv.charWidth); break;
+    case SB_LINERIGHT: ScrollHorizontally(hwnd, g_pv.xScroll + g_pv.charWidth); break;
+    case SB_PAGELEFT: ScrollHorizontally(hwnd, g_pv.xScroll - rc.right); break;
+    case SB_PAGERIGHT: ScrollHorizontally(hwnd, g_pv.xScroll + rc.right); break;
+    case SB_LEFT: ScrollHorizontally(hwnd, 0); break;
+    case SB_THUMBTRACK:
+    case SB_THUMBPOSITION: ScrollHorizontally(hwnd, (int)(short)HIWORD(wParam)); break;
+    }
+}
+
+static void OnKeyDown(HWND hwnd, WPARAM key) {
+    BOOL ctrl = (GetKeyState(VK_CONTROL) & 0x8000) != 0;
+    switch (key) {
+    case VK_UP: OnVScroll(hwnd, SB_LINEUP); break;
+    case VK_DOWN: OnVScroll(hwnd, SB_LINEDOWN); break;
+    case VK_PRIOR: OnVScroll(hwnd, SB_PAGEUP); break;
+    case VK_NEXT: OnVScroll(hwnd, SB_PAGEDOWN); break;
+    case VK_LEFT: OnHScroll(hwnd, SB_LINELEFT); break;
+    case VK_RIGHT: OnHScroll(hwnd, SB_LINERIGHT); break;
+    case VK_HOME:
+        if (ctrl) OnVScroll(hwnd, SB_TOP);
+        else ScrollHorizontally(hwnd, 0);
+        break;
+    case VK_END:
+        if (ctrl) OnVScroll(hwnd, SB_BOTTOM);
+        break;
+    }
+}
+
+static void OnPaint(HWND hwnd) {
+    PAINTSTRUCT ps;
+    HDC dc = BeginPaint(hwnd, &ps);
+    FillRect(dc, &ps.rcPaint, GetSysColorBrush(COLOR_WINDOW));
+    if (g_pv.pager && g_pv.line) {
+        HGDIOBJ old = g_pv.font ? SelectObject(dc, g_pv.font) : NULL;
+        SetBkMode(dc, TRANSPARENT);
+        SetTextColor(dc, GetSysColor(COLOR_WINDOWTEXT));
+        RECT rc;
+        GetClientRect(hwnd, &rc);
+        TextPagerPos pos = g_pv.top;
+        for (int y = 0; y < rc.bottom && y < ps.rcPaint.bottom; y += g_pv.lineHeight) {
+            if (y + g_pv.lineHeight > ps.rcPaint.top) {
+                size_t units = TextPagerCopyLine(g_pv.pager, pos, (uint16_t *)g_pv.line, PAGER_VIEW_LINE_UNITS);
+                if (units > 0) {
+                    TabbedTextOutW(dc, -g_pv.xScroll, y, g_pv.line, (int)units, 0, NULL, -g_pv.xScroll);
+                }
+            }
+            if (!TextPagerNextLine(g_pv.pager, &pos)) break;
+        }
+        if (old) SelectObject(dc, old);
+    }
+    EndPaint(hwnd, &ps);
+}
+
+static LRESULT CALLBACK PagerViewProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    switch (msg) {
+    case WM_PAINT:
+        OnPaint(hwnd);
+        return 0;
+    case WM_ERASEBKGND:
+        return 1; // OnPaint fills the background
+    case WM_SIZE:
+        UpdateScrollBars(hwnd);
+        InvalidateRect(hwnd, NULL, FALSE);
+        return 0;
+    case WM_VSCROLL:
+        OnVScroll(hwnd, wParam);
+        return 0;
+    case WM_HSCROLL:
+        OnHScroll(hwnd, wParam);
+        return 0;
+    case WM_KEYDOWN:
+        OnKeyDown(hwnd, wParam);
+        return 0;
+    case WM_MOUSEWHEEL: {
+        UINT perNotch = 3;
+        SystemParametersInfoW(SPI_GETWHEELSCROLLLINES, 0, &perNotch, 0);
+        int notches = GET_WHEEL_DELTA_WPARAM(wParam) / WHEEL_DELTA;
+        ScrollLines(hwnd, -notches * (int)perNotch);
+        return 0;
+    }
+    case WM_LBUTTONDOWN:
+        SetFocus(hwnd);
+        return 0;
+    case WM_DESTROY:
+        if (g_pv.line) HeapFree(GetProcessHeap(), 0, g_pv.line);
+        g_pv.line = NULL;
+        g_pv.pager = NULL;
+        return 0;
+    }
+    return DefWindowProcW(hwnd, msg, wParam, lParam);
+}
+
+HWND CreatePagerView(HWND parent, UINT id) {
+    static BOOL registered = FALSE;
+    HINSTANCE instance = GetModuleHandleW(NULL);
+    if (!registered) {
+        WNDCLASSW wc = {0};
+        wc.lpfnWndProc = PagerViewProc;
+        wc.hInstance = instance;
+        wc.lpszClassName = PAGER_VIEW_CLASS;
+        wc.hCursor = LoadCursorW(NULL, IDC_ARROW);
+        registered = RegisterClassW(&wc) != 0;
+        if (!registered) return NULL;
+    }
+    g_pv.line = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, PAGER_VIEW_LINE_UNITS * sizeof(WCHAR));
+    if (!g_pv.line) return NULL;
+    HWND hwnd = CreateWindowExW(0, PAGER_VIEW_CLASS, NULL, WS_CHILD | WS_VSCROLL | WS_HSCROLL,
+                                0, 0, 0, 0, parent, (HMENU)(UINT_PTR)id, instance, NULL);
+    if (!hwnd) {
+        HeapFree(GetProcessHeap(), 0, g_pv.line);
+        g_pv.line = NULL;
+        return NULL;
+    }
+    MeasureFont(hwnd);
+    return hwnd;
+}
+
+void PagerViewSetDocument(HWND view, TextPager *pager) {
+    g_pv.pager = pager;
+    g_pv.top.page = 0;
+    g_pv.top.unit = 0;
+    g_pv.xScroll = 0;
+    UpdateScrollBars(view);
+    InvalidateRect(view, NULL, FALSE);
+}
+
+void PagerViewSetFont(HWND view, HFONT font) {
+    g_pv.font = font;
+    MeasureFont(view);
+    UpdateScrollBars(view);
+    InvalidateRect(view, NULL, FALSE);
+}
+
+UINT PagerViewPercent(HWND view) {
+    (void)view;
+    if (!g_pv.pager || g_pv.pager->fileSize == 0) return 0;
+    uint64_t at = TextPagerByteOffset(g_pv.pager, g_pv.top);
+    return (UINT)(at * 100 / g_pv.pager->fileSize);
+}
@@ -0,0 +1,16 @@
+// Read-only viewer window for files opened through the paging engine.
+#pragma once
+
+#include <windows.h>
+#include "text_pager.h"
+
+// WM_COMMAND notification (HIWORD of wParam) sent to the parent whenever
+// the view scrolls.
+#define PVN_SCROLL 1
+
+HWND CreatePagerView(HWND parent, UINT id);
+// Shows `pager` from its first line; NULL detaches the view.
+void PagerViewSetDocument(HWND view, TextPager *pager);
+void PagerViewSetFont(HWND view, HFONT font);
+// How far through the file the top line is, 0-100.
+UINT PagerViewPercent(HWND view);
@@ -56,15 +56,27 @@ void DoPageSetup(HWND hwnd) {
 
 void DoPrint(HWND hwnd) {
     DebugLog(L"DoPrint invoked");
-    int len = GetWindowTextLengthW(g_app.hwndEdit);
-    WCHAR *buffer = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (len + 1) * sizeof(WCHAR));
-    if (!buffer) {
-        return;
+    // The preview paginates again whenever its settings change, and the
+    // document may be edited meanwhile: a snapshot keeps the text it started
+    // with without copying it. Taking one is O(1) once the piece table
+    // exists; the first Find or Print of a document builds it, with one copy
+    // of the text. Only if no snapshot can be had is the text copied here.
+    TextPieceSnapshot *snapshot = SnapshotDocument();
+    WCHAR *buffer = NULL;
+    int len = 0;
+    if (!snapshot) {
+        len = GetWindowTextLengthW(g_app.hwndEdit);
+        buffer = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (len + 1) * sizeof(WCHAR));
+        if (!buffer) {
+            return;
+        }
+        len = GetWindowTextW(g_app.hwndEdit, buffer, len + 1);
     }
-    GetWindowTextW(g_app.hwndEdit, buffer, len + 1);
 
     PrintRenderContext ctx = {
+        .snapshot = snapshot,
         .text = buffer,
+        .textLength = (size_t)len,
         .fullPath = g_app.currentPath[0] ? g_app.currentPath : UNTITLED_NAME,
         .marginsThousandths = g_app.marginsThousandths,
         .headerText = g_app.headerText,
@@ -84,7 +96,8 @@ void DoPrint(HWND hwnd) {
         }
     }
 
-    HeapFree(GetProcessHeap(), 0, buffer);
+    TextPieceSnapshotRelease(snapshot);
+    if (buffer) HeapFree(GetProcessHeap(), 0, buffer);
 }
 
 static BOOL TryParseMargin(HWND dlg, int ctrlId, int *outThousandths) {
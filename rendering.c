@@ -1,11 +1,8 @@
 #include <windows.h>
-#include <strsafe.h>
 
 #include "retropad.h"
 #include "rendering.h"
-
-static void SplitHeaderFooterSegments(const WCHAR *format, const WCHAR *fileName, int pageNumber, int totalPages, const WCHAR *dateStr, const WCHAR *timeStr, WCHAR *left, size_t cchLeft, WCHAR *center, size_t cchCenter, WCHAR *right, size_t cchRight);
-static int ComputeTotalPages(const WCHAR *text, int charsPerLine, int linesPerPage);
+#include "text_print.h"
 
 static BOOL RenderInternal(const PrintRenderContext *ctx, const PrintRenderTarget *target);
 
@@ -44,6 +41,43 @@ void InitHdcRenderTarget(HdcRenderTarget *target, HDC hdc) {
     target->documentStarted = FALSE;
 }
 
+// One header or footer: its three expanded segments and where they go.
+typedef struct HeaderFooterLine {
+    BOOL enabled;
+    int y;
+    WCHAR left[128], center[128], right[128];
+} HeaderFooterLine;
+
+static void ExpandHeaderFooter(HeaderFooterLine *line, const WCHAR *format, const TextPrintFields *fields) {
+    TextPrintExpandHeaderFooter((const uint16_t *)format, fields, (uint16_t *)line->left, ARRAYSIZE(line->left),
+                                (uint16_t *)line->center, ARRAYSIZE(line->center), (uint16_t *)line->right,
+                                ARRAYSIZE(line->right));
+}
+
+// Left segment at the left margin, center segment centred but kept within
+// the margins, right segment against the right margin.
+static void DrawHeaderFooter(const PrintRenderTarget *target, const HeaderFooterLine *line, int pageWidth,
+                             int marginLeft, int marginRight) {
+    if (!line->enabled) return;
+    SIZE sz;
+    if (line->left[0]) {
+        target->ops->DrawText(target->userData, marginLeft, line->y, line->left, lstrlenW(line->left));
+    }
+    if (line->center[0]) {
+        target->ops->MeasureText(target->userData, line->center, lstrlenW(line->center), &sz);
+        int cx = (pageWidth - sz.cx) / 2;
+        if (cx < marginLeft) cx = marginLeft;
+        int maxCx = pageWidth - marginRight - sz.cx;
+        if (cx > maxCx) cx = maxCx;
+        target->ops->DrawText(target->userData, cx, line->y, line->center, lstrlenW(line->center));
+    }
+    if (line->right[0]) {
+        target->ops->MeasureText(target->userData, line->right, lstrlenW(line->right), &sz);
+        int rx = pageWidth - marginRight - sz.cx;
+        target->ops->DrawText(target->userData, rx, line->y, line->right, lstrlenW(line->right));
+    }
+}
+
 static BOOL RenderInternal(const PrintRenderContext *ctx, const PrintRenderTarget *target) {
     PrintMetrics metrics;
     if (!target->ops->GetMetrics(target->userData, &metrics)) return FALSE;
@@ -88,7 +122,8 @@ static BOOL RenderInternal(const PrintRenderContext *ctx, const PrintRenderTarge
     GetDateFormatW(LOCALE_USER_DEFAULT, DATE_SHORTDATE, &st, NULL, dateStr, ARRAYSIZE(dateStr));
     GetTimeFormatW(LOCALE_USER_DEFAULT, TIME_NOSECONDS, &st, NULL, timeStr, ARRAYSIZE(timeStr));
 
-    int totalPages = ComputeTotalPages(ctx->text, charsPerLine, linesPerPage);
+    int totalPages = TextPrintCountPages(ctx->snapshot, (const uint16_t *)ctx->text, ctx->textLength, charsPerLine,
+                                         linesPerPage);
     const WCHAR *fullPath = ctx->fullPath ? ctx->fullPath : UNTITLED_NAME;
 
     if (!target->ops->BeginDocument(target->userData, fullPath, totalPages)) {
@@ -102,208 +137,44 @@ static BOOL RenderInternal(const PrintRenderContext *ctx, const PrintRenderTarge
         fileName = slash + 1;
     }
 
-    const int tabWidth = 8;
-    int lineOnPage = 0;
-    int y = contentTop;
-    int pageNumber = 1;
-    WCHAR lineBuf[4096];
-    WCHAR headerLeft[128], headerCenter[128], headerRight[128];
-    WCHAR footerLeft[128], footerCenter[128], footerRight[128];
-
-    SplitHeaderFooterSegments(ctx->headerText, fileName, pageNumber, totalPages, dateStr, timeStr, headerLeft, ARRAYSIZE(headerLeft), headerCenter, ARRAYSIZE(headerCenter), headerRight, ARRAYSIZE(headerRight));
-    SplitHeaderFooterSegments(ctx->footerText, fileName, pageNumber, totalPages, dateStr, timeStr, footerLeft, ARRAYSIZE(footerLeft), footerCenter, ARRAYSIZE(footerCenter), footerRight, ARRAYSIZE(footerRight));
-
-    if (!target->ops->BeginPage(target->userData, pageNumber)) {
+    TextPrintFields fields = { (const uint16_t *)fileName, (const uint16_t *)dateStr, (const uint16_t *)timeStr, 1,
+                               totalPages };
+    HeaderFooterLine header, footer;
+    header.enabled = headerEnabled;
+    header.y = headerTextY;
+    footer.enabled = footerEnabled;
+    footer.y = footerTextY;
+    ExpandHeaderFooter(&header, ctx->headerText, &fields);
+    ExpandHeaderFooter(&footer, ctx->footerText, &fields);
+
+    if (!target->ops->BeginPage(target->userData, fields.page)) {
         target->ops->AbortDocument(target->userData);
         return FALSE;
     }
+    DrawHeaderFooter(target, &header, pageWidth, marginLeft, marginRight);
 
-    if (headerEnabled) {
-        SIZE sz;
-        if (headerLeft[0]) {
-            target->ops->DrawText(target->userData, marginLeft, headerTextY, headerLeft, lstrlenW(headerLeft));
-        }
-        if (headerCenter[0]) {
-            target->ops->MeasureText(target->userData, headerCenter, lstrlenW(headerCenter), &sz);
-            int cx = (pageWidth - sz.cx) / 2;
-            if (cx < marginLeft) cx = marginLeft;
-            int maxCx = pageWidth - marginRight - sz.cx;
-            if (cx > maxCx) cx = maxCx;
-            target->ops->DrawText(target->userData, cx, headerTextY, headerCenter, lstrlenW(headerCenter));
-        }
-        if (headerRight[0]) {
-            target->ops->MeasureText(target->userData, headerRight, lstrlenW(headerRight), &sz);
-            int rx = pageWidth - marginRight - sz.cx;
-            target->ops->DrawText(target->userData, rx, headerTextY, headerRight, lstrlenW(headerRight));
-        }
-    }
-
-    const WCHAR *p = ctx->text;
-    while (*p) {
-        int bufLen = 0;
-        int col = 0;
-        while (*p && *p != L'\r' && *p != L'\n') {
-            WCHAR ch = *p++;
-            if (ch == L'\t') {
-                int spaces = tabWidth - (col % tabWidth);
-                for (int i = 0; i < spaces; ++i) {
-                    if (bufLen < (int)ARRAYSIZE(lineBuf) - 1) {
-                        lineBuf[bufLen++] = L' ';
-                    }
-                    col++;
-                    if (col >= charsPerLine) break;
-                }
-            } else {
-                if (bufLen < (int)ARRAYSIZE(lineBuf) - 1) {
-                    lineBuf[bufLen++] = ch;
-                }
-                col++;
-            }
-
-            if (col >= charsPerLine) {
-                target->ops->DrawText(target->userData, marginLeft, y, lineBuf, bufLen);
-                y += lineHeight;
-                lineOnPage++;
-                bufLen = 0;
-                col = 0;
-                if (lineOnPage >= linesPerPage) {
-                    const WCHAR *peek = p;
-                    while (*peek == L'\r' || *peek == L'\n') peek++;
-                    if (*peek) {
-                        if (footerEnabled && (footerLeft[0] || footerCenter[0] || footerRight[0])) {
-                            SIZE ft;
-                            if (footerLeft[0]) {
-                                target->ops->DrawText(target->userData, marginLeft, footerTextY, footerLeft, lstrlenW(footerLeft));
-                            }
-                            if (footerCenter[0]) {
-                                target->ops->MeasureText(target->userData, footerCenter, lstrlenW(footerCenter), &ft);
-                                int cx = (pageWidth - ft.cx) / 2;
-                                if (cx < marginLeft) cx = marginLeft;
-                                int maxCx = pageWidth - marginRight - ft.cx;
-                                if (cx > maxCx) cx = maxCx;
-                                target->ops->DrawText(target->userData, cx, footerTextY, footerCenter, lstrlenW(footerCenter));
-                            }
-                            if (footerRight[0]) {
-                                target->ops->MeasureText(target->userData, footerRight, lstrlenW(footerRight), &ft);
-                                int rx = pageWidth - marginRight - ft.cx;
-                                target->ops->DrawText(target->userData, rx, footerTextY, footerRight, lstrlenW(footerRight));
-                            }
-                        }
-
-                        if (!target->ops->EndPage(target->userData)) goto abort_doc;
-                        pageNumber++;
-                        if (!target->ops->BeginPage(target->userData, pageNumber)) goto abort_doc;
-                        SplitHeaderFooterSegments(ctx->headerText, fileName, pageNumber, totalPages, dateStr, timeStr, headerLeft, ARRAYSIZE(headerLeft), headerCenter, ARRAYSIZE(headerCenter), headerRight, ARRAYSIZE(headerRight));
-                        SplitHeaderFooterSegments(ctx->footerText, fileName, pageNumber, totalPages, dateStr, timeStr, footerLeft, ARRAYSIZE(footerLeft), footerCenter, ARRAYSIZE(footerCenter), footerRight, ARRAYSIZE(footerRight));
-                        if (headerEnabled) {
-                            SIZE ht;
-                            if (headerLeft[0]) {
-                                target->ops->DrawText(target->userData, marginLeft, headerTextY, headerLeft, lstrlenW(headerLeft));
-                            }
-                            if (headerCenter[0]) {
-                                target->ops->MeasureText(target->userData, headerCenter, lstrlenW(headerCenter), &ht);
-                                int hx = (pageWidth - ht.cx) / 2;
-                                if (hx < marginLeft) hx = marginLeft;
-                                int maxHx = pageWidth - marginRight - ht.cx;
-                                if (hx > maxHx) hx = maxHx;
-                                target->ops->DrawText(target->userData, hx, headerTextY, headerCenter, lstrlenW(headerCenter));
-                            }
-                            if (headerRight[0]) {
-                                target->ops->MeasureText(target->userData, headerRight, lstrlenW(headerRight), &ht);
-                                int rx = pageWidth - marginRight - ht.cx;
-                                target->ops->DrawText(target->userData, rx, headerTextY, headerRight, lstrlenW(headerRight));
-                            }
-                        }
-                        lineOnPage = 0;
-                        y = contentTop;
-                    }
-                }
-            }
+    // The text is a span: NUL characters are printed like any other. The
+    // layout moves to a new page only when text follows, so each break
+    // closes one page and opens the next here.
+    TextPrintLayout layout;
+    TextPrintLayoutInit(&layout, ctx->snapshot, (const uint16_t *)ctx->text, ctx->textLength, charsPerLine, linesPerPage);
+    int y = contentTop;
+    while (TextPrintLayoutNext(&layout)) {
+        if (layout.page != fields.page) {
+            DrawHeaderFooter(target, &footer, pageWidth, marginLeft, marginRight);
+            if (!target->ops->EndPage(target->userData)) goto abort_doc;
+            fields.page = layout.page;
+            if (!target->ops->BeginPage(target->userData, fields.page)) goto abort_doc;
+            ExpandHeaderFooter(&header, ctx->headerText, &fields);
+            ExpandHeaderFooter(&footer, ctx->footerText, &fields);
+            DrawHeaderFooter(target, &header, pageWidth, marginLeft, marginRight);
+            y = contentTop;
         }
-
-        target->ops->DrawText(target->userData, marginLeft, y, lineBuf, bufLen);
+        target->ops->DrawText(target->userData, marginLeft, y, (const WCHAR *)layout.line, layout.lineLength);
         y += lineHeight;
-        lineOnPage++;
-        if (lineOnPage >= linesPerPage) {
-            const WCHAR *peek = p;
-            while (*peek == L'\r' || *peek == L'\n') peek++;
-            if (*peek) {
-                if (footerEnabled && (footerLeft[0] || footerCenter[0] || footerRight[0])) {
-                    SIZE ft;
-                    if (footerLeft[0]) {
-                        target->ops->DrawText(target->userData, marginLeft, footerTextY, footerLeft, lstrlenW(footerLeft));
-                    }
-                    if (footerCenter[0]) {
-                        target->ops->MeasureText(target->userData, footerCenter, lstrlenW(footerCenter), &ft);
-                        int cx = (pageWidth - ft.cx) / 2;
-                        if (cx < marginLeft) cx = marginLeft;
-                        int maxCx = pageWidth - marginRight - ft.cx;
-                        if (cx > maxCx) cx = maxCx;
-                        target->ops->DrawText(target->userData, cx, footerTextY, footerCenter, lstrlenW(footerCenter));
-                    }
-                    if (footerRight[0]) {
-                        target->ops->MeasureText(target->userData, footerRight, lstrlenW(footerRight), &ft);
-                        int rx = pageWidth - marginRight - ft.cx;
-                        target->ops->DrawText(target->userData, rx, footerTextY, footerRight, lstrlenW(footerRight));
-                    }
-                }
-
-                if (!target->ops->EndPage(target->userData)) goto abort_doc;
-                pageNumber++;
-                if (!target->ops->BeginPage(target->userData, pageNumber)) goto abort_doc;
-                SplitHeaderFooterSegments(ctx->headerText, fileName, pageNumber, totalPages, dateStr, timeStr, headerLeft, ARRAYSIZE(headerLeft), headerCenter, ARRAYSIZE(headerCenter), headerRight, ARRAYSIZE(headerRight));
-                SplitHeaderFooterSegments(ctx->footerText, fileName, pageNumber, totalPages, dateStr, timeStr, footerLeft, ARRAYSIZE(footerLeft), footerCenter, ARRAYSIZE(footerCenter), footerRight, ARRAYSIZE(footerRight));
-                if (headerEnabled) {
-                    SIZE ht;
-                    if (headerLeft[0]) {
-                        target->ops->DrawText(target->userData, marginLeft, headerTextY, headerLeft, lstrlenW(headerLeft));
-                    }
-                    if (headerCenter[0]) {
-                        target->ops->MeasureText(target->userData, headerCenter, lstrlenW(headerCenter), &ht);
-                        int hx = (pageWidth - ht.cx) / 2;
-                        if (hx < marginLeft) hx = marginLeft;
-                        int maxHx = pageWidth - marginRight - ht.cx;
-                        if (hx > maxHx) hx = maxHx;
-                        target->ops->DrawText(target->userData, hx, headerTextY, headerCenter, lstrlenW(headerCenter));
-                    }
-                    if (headerRight[0]) {
-                        target->ops->MeasureText(target->userData, headerRight, lstrlenW(headerRight), &ht);
-                        int rx = pageWidth - marginRight - ht.cx;
-                        target->ops->DrawText(target->userData, rx, headerTextY, headerRight, lstrlenW(headerRight));
-                    }
-                }
-                lineOnPage = 0;
-                y = contentTop;
-            }
-        }
-
-        if (*p == L'\r') {
-            p++;
-            if (*p == L'\n') p++;
-        } else if (*p == L'\n') {
-            p++;
-        }
     }
 
-    if (footerEnabled && (footerLeft[0] || footerCenter[0] || footerRight[0])) {
-        SIZE ft;
-        if (footerLeft[0]) {
-            target->ops->DrawText(target->userData, marginLeft, footerTextY, footerLeft, lstrlenW(footerLeft));
-        }
-        if (footerCenter[0]) {
-            target->ops->MeasureText(target->userData, footerCenter, lstrlenW(footerCenter), &ft);
-            int cx = (pageWidth - ft.cx) / 2;
-            if (cx < marginLeft) cx = marginLeft;
-            int maxCx = pageWidth - marginRight - ft.cx;
-            if (cx > maxCx) cx = maxCx;
-            target->ops->DrawText(target->userData, cx, footerTextY, footerCenter, lstrlenW(footerCenter));
-        }
-        if (footerRight[0]) {
-            target->ops->MeasureText(target->userData, footerRight, lstrlenW(footerRight), &ft);
-            int rx = pageWidth - marginRight - ft.cx;
-            target->ops->DrawText(target->userData, rx, footerTextY, footerRight, lstrlenW(footerRight));
-        }
-    }
+    DrawHeaderFooter(target, &footer, pageWidth, marginLeft, marginRight);
 
     if (!target->ops->EndPage(target->userData)) goto abort_doc;
     if (!target->ops->EndDocument(target->userData)) goto abort_doc;
@@ -393,111 +264,3 @@ static BOOL HdcMeasureText(void *userData, const WCHAR *text, int length, SIZE *
     return GetTextExtentPoint32W(target->hdc, text, length, size);
 }
 
-static void SplitHeaderFooterSegments(const WCHAR *format, const WCHAR *fileName, int pageNumber, int totalPages, const WCHAR *dateStr, const WCHAR *timeStr, WCHAR *left, size_t cchLeft, WCHAR *center, size_t cchCenter, WCHAR *right, size_t cchRight) {
-    if (left && cchLeft) left[0] = L'\0';
-    if (center && cchCenter) center[0] = L'\0';
-    if (right && cchRight) right[0] = L'\0';
-    if (!format) return;
-
-    enum { SEG_LEFT = 0, SEG_CENTER = 1, SEG_RIGHT = 2 } seg = SEG_CENTER;
-    WCHAR *targets[3] = { left, center, right };
-    size_t sizes[3] = { cchLeft, cchCenter, cchRight };
-
-    for (const WCHAR *p = format; *p; ++p) {
-        if (*p == L'&') {
-            WCHAR next = *(p + 1);
-            if (next == L'l' || next == L'L') { seg = SEG_LEFT; p++; continue; }
-            if (next == L'c' || next == L'C') { seg = SEG_CENTER; p++; continue; }
-            if (next == L'r' || next == L'R') { seg = SEG_RIGHT; p++; continue; }
-
-            const WCHAR *insert = NULL;
-            WCHAR tmp[2] = {0};
-            WCHAR pageBuf[16], totalBuf[16];
-            switch (next) {
-            case L'&': tmp[0] = L'&'; insert = tmp; p++; break;
-            case L'f': case L'F': insert = fileName; p++; break;
-            case L'p': StringCchPrintfW(pageBuf, ARRAYSIZE(pageBuf), L"%d", pageNumber); insert = pageBuf; p++; break;
-            case L'P': StringCchPrintfW(totalBuf, ARRAYSIZE(totalBuf), L"%d", max(1, totalPages)); insert = totalBuf; p++; break;
-            case L'd': case L'D': insert = dateStr; p++; break;
-            case L't': case L'T': insert = timeStr; p++; break;
-            default:
-                tmp[0] = L'&';
-                insert = tmp;
-                break;
-            }
-
-            if (insert && insert[0] && targets[seg] && sizes[seg] > 0) {
-                size_t curLen = targets[seg] ? wcslen(targets[seg]) : 0;
-                size_t remaining = sizes[seg] > curLen ? sizes[seg] - curLen - 1 : 0;
-                if (remaining > 0 && targets[seg]) {
-                    size_t len = wcslen(insert);
-                    size_t toCopy = min(len, remaining);
-                    CopyMemory(targets[seg] + curLen, insert, toCopy * sizeof(WCHAR));
-                    targets[seg][curLen + toCopy] = L'\0';
-                }
-            }
-        } else if (targets[seg] && sizes[seg] > 0) {
-            size_t curLen = wcslen(targets[seg]);
-            if (curLen + 1 < sizes[seg]) {
-                targets[seg][curLen] = *p;
-                targets[seg][curLen + 1] = L'\0';
-            }
-        }
-    }
-}
-
-static int ComputeTotalPages(const WCHAR *text, int charsPerLine, int linesPerPage) {
-    if (charsPerLine < 1) charsPerLine = 1;
-    if (linesPerPage < 1) linesPerPage = 1;
-
-    const int tabWidth = 8;
-    int lineOnPage = 0;
-    int pageNumber = 1;
-    const WCHAR *p = text;
-    while (*p) {
-        int col = 0;
-        while (*p && *p != L'\r' && *p != L'\n') {
-            if (*p == L'\t') {
-                int spaces = tabWidth - (col % tabWidth);
-                col += spaces;
-            } else {
-                col++;
-            }
-            if (col >= charsPerLine) {
-                lineOnPage++;
-                col = 0;
-                if (lineOnPage >= linesPerPage) {
-                    const WCHAR *peek = p;
-                    while (*peek == L'\r' || *peek == L'\n') peek++;
-                    if (*peek) {
-                        pageNumber++;
-                        lineOnPage = 0;
-                    }
-                }
-            }
-            p++;
-        }
-
-        lineOnPage++;
-        if (lineOnPage >= linesPerPage) {
-            const WCHAR *peek = p;
-            while (*peek == L'\r' || *peek == L'\n') peek++;
-            if (*peek) {
-                pageNumber++;
-                lineOnPage = 0;
-            }
-        }
-
-        if (*p == L'\r') {
-            p++;
-            if (*p == L'\n') p++;
-        } else if (*p == L'\n') {
-            p++;
-        }
-    }
-
-    if (!text || text[0] == L'\0') {
-        pageNumber = 1;
-    }
-    return pageNumber;
-}
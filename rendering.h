@@ -2,8 +2,12 @@
 
 #include <windows.h>
 
+#include "text_piece.h"
+
 typedef struct PrintRenderContext {
-    const WCHAR *text;
+    const TextPieceSnapshot *snapshot; // the document; when NULL, `text` is
+    const WCHAR *text;       // textLength units; may contain NULs
+    size_t textLength;
     const WCHAR *fullPath;
     RECT marginsThousandths;
     const WCHAR *headerText;
@@ -13,6 +13,9 @@
 #define IDM_FILE_PAGE_SETUP     40005
 #define IDM_FILE_PRINT          40006
 #define IDM_FILE_EXIT           40007
+#define IDM_FILE_SPLIT          40008
+#define IDM_FILE_JOIN           40009
+#define IDM_FILE_HISTORY        40060
 
 #define IDM_EDIT_UNDO           40010
 #define IDM_EDIT_CUT            40011
@@ -30,6 +33,7 @@
 #define IDM_FORMAT_FONT         40031
 
 #define IDM_VIEW_STATUS_BAR     40040
+#define IDM_VIEW_FOLLOW_TAIL    40041
 
 #define IDM_HELP_VIEW_HELP      40050
 #define IDM_HELP_ABOUT          40051
@@ -38,6 +42,8 @@
 #define IDD_GOTO                50001
 #define IDD_ABOUT               50002
 #define IDD_PAGE_SETUP          50003
+#define IDD_SPLIT               50004
+#define IDD_HISTORY             50005
 #define IDC_GOTO_EDIT           50010
 #define IDC_PAGE_HEADER         50020
 #define IDC_PAGE_FOOTER         50021
@@ -45,3 +51,10 @@
 #define IDC_MARGIN_RIGHT        50023
 #define IDC_MARGIN_TOP          50024
 #define IDC_MARGIN_BOTTOM       50025
+#define IDC_SPLIT_BY_SIZE       50030
+#define IDC_SPLIT_SIZE          50031
+#define IDC_SPLIT_BY_LINES      50032
+#define IDC_SPLIT_LINES         50033
+#define IDC_SPLIT_BY_MATCH      50034
+#define IDC_SPLIT_MATCH         50035
+#define IDC_HISTORY_LIST        50040
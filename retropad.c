@@ -13,6 +13,10 @@
 #include "retropad.h"
 #include "print.h"
 #include "PrintPreviewWindow.h"
+#include "pager_view.h"
+#include "text_codepage.h"
+#include "text_diff.h"
+#include "text_search.h"
 
 #pragma comment(lib, "comctl32.lib")
 #pragma comment(linker,"/manifestdependency:\"type='win32' name='Microsoft.Windows.Common-Controls' version='6.0.0.0' processorArchitecture='*' publicKeyToken='6595b64144ccf1df' language='*'\"")
@@ -25,6 +29,19 @@ static UINT g_findMsg = 0;
 static HMODULE g_hhLib = NULL;
 static PFNHTMLHELPW g_pHtmlHelp = NULL;
 #define WM_APP_TEST_PRINT (WM_APP + 100)
+#define WM_APP_STARTUP (WM_APP + 101)
+#define WM_APP_REINDEX (WM_APP + 102)
+#define PAGED_THRESHOLD_DEFAULT (128ull * 1024 * 1024)
+#define DOC_CACHE_DEFAULT_BYTES ((SIZE_T)64 * 1024 * 1024)
+#define FOLLOW_TIMER_ID 1
+#define FOLLOW_POLL_MS 500
+#define JOURNAL_TIMER_ID 2
+#define JOURNAL_CHECK_MS 1000
+#define SESSION_RESTORE_TARGET_MS 500.0 // for a 100 MB document; logged when missed
+#define RELOAD_MAX_EDITS 2000 // changed lines a reload diffs before patching one stretch
+#define RELOAD_MAX_HUNKS 8    // stretches patched one by one; more are patched as one
+#define JOIN_MAX_PARTS 4096
+#define FIND_BLOCK_UNITS 65536 // units copied out of the pieces and folded at a time
 
 static void UpdateTitle(HWND hwnd);
 static void CreateEditControl(HWND hwnd);
@@ -43,13 +60,17 @@ static void DoSelectFont(HWND hwnd);
 static void InsertTimeDate(HWND hwnd);
 static void HandleFindReplace(LPFINDREPLACE lpfr);
 static BOOL LoadDocumentFromPath(HWND hwnd, LPCWSTR path);
+static BOOL OpenCachedDocument(HWND hwnd, LPCWSTR path);
 static INT_PTR CALLBACK GoToDlgProc(HWND dlg, UINT msg, WPARAM wParam, LPARAM lParam);
 static INT_PTR CALLBACK AboutDlgProc(HWND dlg, UINT msg, WPARAM wParam, LPARAM lParam);
+static INT_PTR CALLBACK SplitDlgProc(HWND dlg, UINT msg, WPARAM wParam, LPARAM lParam);
+static INT_PTR CALLBACK HistoryDlgProc(HWND dlg, UINT msg, WPARAM wParam, LPARAM lParam);
 static HFONT CreateDefaultUIFont(HWND hwnd);
 static void ApplyMicaBackdrop(HWND hwnd);
 static void ShowHelp(HWND hwnd);
 static LRESULT CALLBACK EditSubclassProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam, UINT_PTR id, DWORD_PTR data);
 static void ParseTestFlag(void);
+static void FinishRecovery(HWND hwnd, BOOL loaded);
 static void TriggerTest(HWND hwnd);
 
 static void DebugLog(const WCHAR *msg) {
@@ -74,153 +95,212 @@ static BOOL GetEditText(HWND hwndEdit, WCHAR **bufferOut, int *lengthOut) {
     int length = GetWindowTextLengthW(hwndEdit);
     WCHAR *buffer = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (length + 1) * sizeof(WCHAR));
     if (!buffer) return FALSE;
-    GetWindowTextW(hwndEdit, buffer, length + 1);
-    if (lengthOut) *lengthOut = length;
+    int copied = GetWindowTextW(hwndEdit, buffer, length + 1);
+    buffer[copied] = L'\0';
+    if (lengthOut) *lengthOut = copied;
     *bufferOut = buffer;
     return TRUE;
 }
 
-static BOOL FindInEdit(HWND hwndEdit, const WCHAR *needle, BOOL matchCase, BOOL searchDown, DWORD startPos, DWORD *outStart, DWORD *outEnd) {
-    if (!needle || needle[0] == L'\0') return FALSE;
+// Copies `length` units into a fresh buffer, lowercased unless `matchCase`.
+static WCHAR *CopySearchText(const WCHAR *text, size_t length, BOOL matchCase) {
+    WCHAR *copy = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (length + 1) * sizeof(WCHAR));
+    if (!copy) return NULL;
+    CopyMemory(copy, text, length * sizeof(WCHAR));
+    copy[length] = L'\0';
+    if (!matchCase) CharLowerBuffW(copy, (DWORD)length);
+    return copy;
+}
 
-    WCHAR *text = NULL;
-    int len = 0;
-    if (!GetEditText(hwndEdit, &text, &len)) return FALSE;
+// The document as a piece table, built from the edit control on first use
+// and kept current by edit tracking afterwards (see NoteDocumentEdit), so
+// searches read it in place instead of copying the text out each time.
+// Built lazily on purpose: the table holds its own copy of the text, so
+// from the first Find or Print on the document is in memory twice, and a
+// document never searched or printed is only ever in the control.
+static TextPieceTable *DocumentPieces(HWND hwndEdit) {
+    if (g_app.pieces.valid) return &g_app.pieces;
+    int length = GetWindowTextLengthW(hwndEdit);
+    HLOCAL handle = (HLOCAL)SendMessageW(hwndEdit, EM_GETHANDLE, 0, 0);
+    const WCHAR *text = handle ? (const WCHAR *)LocalLock(handle) : NULL;
+    if (!text) return NULL;
+    BOOL ok = TextPieceTableReset(&g_app.pieces, (const uint16_t *)text, (size_t)length);
+    LocalUnlock(handle);
+    return ok ? &g_app.pieces : NULL;
+}
 
-    size_t needleLen = wcslen(needle);
-    WCHAR *haystack = text;
-    WCHAR *needleBuf = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (needleLen + 1) * sizeof(WCHAR));
-    if (!needleBuf) {
-        HeapFree(GetProcessHeap(), 0, text);
-        return FALSE;
+TextPieceSnapshot *SnapshotDocument(void) {
+    TextPieceTable *pieces = DocumentPieces(g_app.hwndEdit);
+    return pieces ? TextPieceTableSnapshot(pieces) : NULL;
+}
+
+// Called with each match's offset, in order; FALSE stops the scan.
+typedef BOOL (*MatchCallback)(void *context, size_t offset);
+
+// Reports every occurrence of `pattern` (folded already unless `matchCase`)
+// lying wholly within units [from, to) of the document. The pieces are
+// copied out and folded a block at a time, keeping the last
+// needleLength - 1 units of each block so matches across blocks are found.
+static BOOL ScanPieces(const TextPieceTable *pieces, size_t from, size_t to, const WCHAR *pattern, size_t needleLength,
+                       BOOL matchCase, MatchCallback callback, void *context) {
+    WCHAR *window = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (FIND_BLOCK_UNITS + needleLength) * sizeof(WCHAR));
+    if (!window) return FALSE;
+    size_t keep = 0;
+    size_t pos = from;
+    BOOL more = TRUE;
+    while (more && pos < to) {
+        size_t count = TextPieceTableCopy(pieces, pos, min(to - pos, (size_t)FIND_BLOCK_UNITS), (uint16_t *)window + keep);
+        if (count == 0) break;
+        if (!matchCase) CharLowerBuffW(window + keep, (DWORD)count);
+        size_t have = keep + count;
+        size_t base = pos - keep; // document offset of window[0]
+        for (size_t at = 0; more && have - at >= needleLength;) {
+            size_t hit = TextFind((const uint16_t *)window + at, have - at, (const uint16_t *)pattern, needleLength);
+            if (hit == have - at) break;
+            more = callback(context, base + at + hit);
+            at += hit + 1;
+        }
+        pos += count;
+        keep = min(needleLength - 1, have);
+        MoveMemory(window, window + have - keep, keep * sizeof(WCHAR));
     }
-    StringCchCopyW(needleBuf, needleLen + 1, needle);
+    HeapFree(GetProcessHeap(), 0, window);
+    return TRUE;
+}
+
+typedef struct MatchList {
+    size_t *offsets;
+    size_t count;
+    size_t capacity;
+    size_t next;         // matches starting before here overlap the last one
+    size_t needleLength;
+    BOOL failed;
+} MatchList;
+
+static BOOL TakeFirstMatch(void *context, size_t offset) {
+    MatchList *list = (MatchList *)context;
+    list->count = 1;
+    list->next = offset;
+    return FALSE;
+}
+
+static BOOL TakeLastMatch(void *context, size_t offset) {
+    MatchList *list = (MatchList *)context;
+    list->count = 1;
+    list->next = offset;
+    return TRUE;
+}
 
-    if (!matchCase) {
-        CharLowerBuffW(haystack, len);
-        CharLowerBuffW(needleBuf, (DWORD)needleLen);
+// Collects non-overlapping matches, earliest first, as Replace All needs.
+static BOOL CollectMatch(void *context, size_t offset) {
+    MatchList *list = (MatchList *)context;
+    if (offset < list->next) return TRUE;
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 256;
+        size_t *grown = list->offsets ? (size_t *)HeapReAlloc(GetProcessHeap(), 0, list->offsets, capacity * sizeof(size_t))
+                                      : (size_t *)HeapAlloc(GetProcessHeap(), 0, capacity * sizeof(size_t));
+        if (!grown) {
+            list->failed = TRUE;
+            return FALSE;
+        }
+        list->offsets = grown;
+        list->capacity = capacity;
     }
+    list->offsets[list->count++] = offset;
+    list->next = offset + list->needleLength;
+    return TRUE;
+}
 
-    if (startPos > (DWORD)len) startPos = (DWORD)len;
+// First (or with `last`, last) match within [from, to); FALSE when none.
+static BOOL FindInPieces(const TextPieceTable *pieces, size_t from, size_t to, const WCHAR *pattern, size_t needleLength,
+                         BOOL matchCase, BOOL last, size_t *foundOut) {
+    MatchList match = {0};
+    if (!ScanPieces(pieces, from, to, pattern, needleLength, matchCase, last ? TakeLastMatch : TakeFirstMatch, &match) ||
+        match.count == 0) {
+        return FALSE;
+    }
+    *foundOut = match.next;
+    return TRUE;
+}
+
+// Searches by length rather than up to a NUL, so text past an embedded NUL
+// is still found.
+static BOOL FindInEdit(HWND hwndEdit, const WCHAR *needle, BOOL matchCase, BOOL searchDown, DWORD startPos, DWORD *outStart, DWORD *outEnd) {
+    if (!needle || needle[0] == L'\0') return FALSE;
 
-    WCHAR *found = NULL;
+    const TextPieceTable *pieces = DocumentPieces(hwndEdit);
+    if (!pieces) return FALSE;
+    size_t needleLen = wcslen(needle);
+    WCHAR *pattern = CopySearchText(needle, needleLen, matchCase);
+    if (!pattern) return FALSE;
+    size_t length = TextPieceTableLength(pieces);
+    if (startPos > length) startPos = (DWORD)length;
+
+    size_t found = 0;
+    BOOL result;
     if (searchDown) {
-        found = wcsstr(haystack + startPos, needleBuf);
-        if (!found && startPos > 0) {
-            found = wcsstr(haystack, needleBuf);
-        }
+        result = FindInPieces(pieces, startPos, length, pattern, needleLen, matchCase, FALSE, &found) ||
+                 (startPos > 0 && FindInPieces(pieces, 0, length, pattern, needleLen, matchCase, FALSE, &found));
     } else {
-        WCHAR *p = haystack;
-        while ((p = wcsstr(p, needleBuf)) != NULL) {
-            DWORD idx = (DWORD)(p - haystack);
-            if (idx < startPos) {
-                found = p;
-                p++;
-            } else {
-                break;
-            }
-        }
-        if (!found && startPos < (DWORD)len) {
-            p = haystack + startPos;
-            while ((p = wcsstr(p, needleBuf)) != NULL) {
-                found = p;
-                p++;
-            }
+        // The last match starting before the start may run on past it.
+        size_t to = min(length, (size_t)startPos + needleLen - 1);
+        result = FindInPieces(pieces, 0, to, pattern, needleLen, matchCase, TRUE, &found);
+        if (!result) {
+            // Wrap around to the last match at or after the start.
+            result = FindInPieces(pieces, 0, length, pattern, needleLen, matchCase, TRUE, &found) && found >= startPos;
         }
     }
 
-    BOOL result = FALSE;
-    if (found) {
-        DWORD pos = (DWORD)(found - haystack);
-        *outStart = pos;
-        *outEnd = pos + (DWORD)needleLen;
-        result = TRUE;
+    if (result) {
+        *outStart = (DWORD)found;
+        *outEnd = (DWORD)(found + needleLen);
     }
-
-    HeapFree(GetProcessHeap(), 0, text);
-    HeapFree(GetProcessHeap(), 0, needleBuf);
+    HeapFree(GetProcessHeap(), 0, pattern);
     return result;
 }
 
+// Splices the replacements into the piece table, back to front so earlier
+// offsets hold, then hands the control the table's text in one go.
 static int ReplaceAllOccurrences(HWND hwndEdit, const WCHAR *needle, const WCHAR *replacement, BOOL matchCase) {
     if (!needle || needle[0] == L'\0') return 0;
 
-    WCHAR *text = NULL;
-    int len = 0;
-    if (!GetEditText(hwndEdit, &text, &len)) return 0;
-
+    TextPieceTable *pieces = DocumentPieces(hwndEdit);
+    if (!pieces) return 0;
     size_t needleLen = wcslen(needle);
     size_t replLen = replacement ? wcslen(replacement) : 0;
-
-    WCHAR *searchBuf = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (len + 1) * sizeof(WCHAR));
-    WCHAR *needleBuf = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (needleLen + 1) * sizeof(WCHAR));
-    if (!searchBuf || !needleBuf) {
-        HeapFree(GetProcessHeap(), 0, text);
-        if (searchBuf) HeapFree(GetProcessHeap(), 0, searchBuf);
-        if (needleBuf) HeapFree(GetProcessHeap(), 0, needleBuf);
-        return 0;
-    }
-    StringCchCopyW(searchBuf, len + 1, text);
-    StringCchCopyW(needleBuf, needleLen + 1, needle);
-
-    if (!matchCase) {
-        CharLowerBuffW(searchBuf, len);
-        CharLowerBuffW(needleBuf, (DWORD)needleLen);
-    }
-
-    int count = 0;
-    WCHAR *p = searchBuf;
-    while ((p = wcsstr(p, needleBuf)) != NULL) {
-        count++;
-        p += needleLen;
-    }
-    if (count == 0) {
-        HeapFree(GetProcessHeap(), 0, text);
-        HeapFree(GetProcessHeap(), 0, searchBuf);
-        HeapFree(GetProcessHeap(), 0, needleBuf);
-        return 0;
+    WCHAR *pattern = CopySearchText(needle, needleLen, matchCase);
+    if (!pattern) return 0;
+    MatchList matches = {0};
+    matches.needleLength = needleLen;
+    BOOL scanned = ScanPieces(pieces, 0, TextPieceTableLength(pieces), pattern, needleLen, matchCase, CollectMatch, &matches);
+    HeapFree(GetProcessHeap(), 0, pattern);
+
+    WCHAR *result = NULL;
+    if (scanned && !matches.failed && matches.count > 0) {
+        for (size_t i = matches.count; i-- > 0;) {
+            if (!TextPieceTableReplace(pieces, matches.offsets[i], needleLen, (const uint16_t *)replacement, replLen)) break;
+        }
+        size_t newLen = TextPieceTableLength(pieces);
+        if (pieces->valid) result = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (newLen + 1) * sizeof(WCHAR));
+        if (result) result[TextPieceTableCopy(pieces, 0, newLen, (uint16_t *)result)] = L'\0';
     }
-
-    size_t newLen = (size_t)len - (size_t)count * needleLen + (size_t)count * replLen;
-    WCHAR *result = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (newLen + 1) * sizeof(WCHAR));
+    if (matches.offsets) HeapFree(GetProcessHeap(), 0, matches.offsets);
     if (!result) {
-        HeapFree(GetProcessHeap(), 0, text);
-        HeapFree(GetProcessHeap(), 0, searchBuf);
-        HeapFree(GetProcessHeap(), 0, needleBuf);
+        // Once replacements went in, the table no longer matches the control.
+        if (scanned && !matches.failed && matches.count > 0) TextPieceTableFree(pieces);
         return 0;
     }
 
-    WCHAR *dst = result;
-    WCHAR *searchCur = searchBuf;
-    WCHAR *origCur = text;
-    while ((p = wcsstr(searchCur, needleBuf)) != NULL) {
-        size_t delta = (size_t)(p - searchCur);
-        CopyMemory(dst, origCur, delta * sizeof(WCHAR));
-        dst += delta;
-        origCur += delta;
-        searchCur += delta;
-
-        if (replLen) {
-            CopyMemory(dst, replacement, replLen * sizeof(WCHAR));
-            dst += replLen;
-        }
-        origCur += needleLen;
-        searchCur += needleLen;
-    }
-    size_t tail = wcslen(origCur);
-    CopyMemory(dst, origCur, tail * sizeof(WCHAR));
-    dst += tail;
-    *dst = L'\0';
-
+    // The table already holds the new text; keep it across the rewrite.
+    TextPieceTable kept = g_app.pieces;
+    TextPieceTableInit(&g_app.pieces);
     SetWindowTextW(hwndEdit, result);
-    HeapFree(GetProcessHeap(), 0, text);
-    HeapFree(GetProcessHeap(), 0, searchBuf);
-    HeapFree(GetProcessHeap(), 0, needleBuf);
+    g_app.pieces = kept;
     HeapFree(GetProcessHeap(), 0, result);
     SendMessageW(hwndEdit, EM_SETMODIFY, TRUE, 0);
     g_app.modified = TRUE;
     UpdateTitle(g_app.hwndMain);
-    return count;
+    return (int)matches.count;
 }
 
 static void UpdateTitle(HWND hwnd) {
@@ -234,7 +314,8 @@ static void UpdateTitle(HWND hwnd) {
     }
 
     WCHAR title[MAX_PATH_BUFFER + 32];
-    StringCchPrintfW(title, ARRAYSIZE(title), L"%s%s - %s", (g_app.modified ? L"*" : L""), name, APP_TITLE);
+    StringCchPrintfW(title, ARRAYSIZE(title), L"%s%s%s - %s", (g_app.modified ? L"*" : L""), name,
+                     (g_app.pagedFile ? L" (read-only)" : L""), APP_TITLE);
     SetWindowTextW(hwnd, title);
 }
 
@@ -338,6 +419,9 @@ static void UpdateLayout(HWND hwnd) {
     if (g_app.hwndEdit) {
         MoveWindow(g_app.hwndEdit, 0, 0, rc.right, rc.bottom - statusHeight, TRUE);
     }
+    if (g_app.hwndPager) {
+        MoveWindow(g_app.hwndPager, 0, 0, rc.right, rc.bottom - statusHeight, TRUE);
+    }
 }
 
 static BOOL PromptSaveChanges(HWND hwnd) {
@@ -353,24 +437,828 @@ static BOOL PromptSaveChanges(HWND hwnd) {
     return res == IDNO;
 }
 
-static BOOL LoadDocumentFromPath(HWND hwnd, LPCWSTR path) {
-    WCHAR *text = NULL;
+// Leaves the read-only paged view and brings the edit control back.
+static void ClosePagedDocument(void) {
+    if (!g_app.pagedFile) return;
+    PagerViewSetDocument(g_app.hwndPager, NULL);
+    ShowWindow(g_app.hwndPager, SW_HIDE);
+    ShowWindow(g_app.hwndEdit, SW_SHOW);
+    ClosePagedFile(g_app.pagedFile);
+    g_app.pagedFile = NULL;
+    SetFocus(g_app.hwndEdit);
+}
+
+// Stops watching the file; the document becomes editable again.
+static void StopFollowing(HWND hwnd) {
+    if (!g_app.followed) return;
+    KillTimer(hwnd, FOLLOW_TIMER_ID);
+    g_app.fileBytes = FollowedFileSize(g_app.followed);
+    EndFollowingFile(g_app.followed);
+    g_app.followed = NULL;
+    if (!g_app.loadJob) SendMessageW(g_app.hwndEdit, EM_SETREADONLY, FALSE, 0);
+}
+
+// The edit control's own buffer, locked in place; LocalUnlock the handle
+// before the text next changes.
+static const WCHAR *LockEditText(HLOCAL *handleOut, size_t *lengthOut) {
+    *lengthOut = (size_t)GetWindowTextLengthW(g_app.hwndEdit);
+    *handleOut = (HLOCAL)SendMessageW(g_app.hwndEdit, EM_GETHANDLE, 0, 0);
+    return *handleOut ? (const WCHAR *)LocalLock(*handleOut) : NULL;
+}
+
+// Whether edits go to the crash-recovery journal: the editable document
+// only, and not while a load, reload or follow is rewriting it.
+static BOOL JournalsEdits(void) {
+    return g_app.journalEnabled && !g_app.loadJob && !g_app.reloading && !g_app.followed && !g_app.pagedFile;
+}
+
+// Begins journaling just before the document's first unsaved change. A
+// document still matching its file needs only the file's fingerprint as a
+// base; anything else starts from a copy of the text.
+static void StartJournal(void) {
+    if (g_app.journal || !JournalsEdits()) return;
+    LPCWSTR path = g_app.currentPath[0] ? g_app.currentPath : NULL;
+    if (!g_app.modified && g_app.fingerprint.valid && path) {
+        g_app.journal = BeginEditJournal(path, &g_app.fingerprint, g_app.encoding, g_app.codePage, g_app.compressed,
+                                         NULL, 0);
+    } else {
+        HLOCAL handle;
+        size_t length;
+        const WCHAR *text = LockEditText(&handle, &length);
+        if (!text) return;
+        g_app.journal = BeginEditJournal(path, NULL, g_app.encoding, g_app.codePage, g_app.compressed, text, length);
+        LocalUnlock(handle);
+    }
+    if (!g_app.journal) {
+        // No recovery folder to write to; do not retry on every keystroke.
+        g_app.journalEnabled = FALSE;
+        DebugLog(L"Journal: unable to start; crash recovery is off");
+    }
+    g_app.journalStale = FALSE;
+}
+
+// The document was saved, replaced or given up: nothing left to recover.
+static void StopJournal(void) {
+    if (!g_app.journal) return;
+    EndEditJournal(g_app.journal);
+    g_app.journal = NULL;
+    g_app.journalStale = FALSE;
+}
+
+// Older edit controls break lines only at CRLF; with lone CRs or LFs
+// around, keep the index only if the control agrees on the count.
+static void CheckLineIndexBreaks(void) {
+    size_t lineCount = 0;
+    if (g_app.lines.bareBreaks > 0 &&
+        (g_app.wordWrap || !TextLineIndexCount(&g_app.lines, &lineCount) ||
+         lineCount != (size_t)SendMessageW(g_app.hwndEdit, EM_GETLINECOUNT, 0, 0))) {
+        TextLineIndexFree(&g_app.lines);
+    }
+}
+
+// Records the edit that left units [lo, hi) new and took the document
+// from `before` to `after` units (see TrackEditMessage) in the journal, the
+// piece table and the line index.
+static void NoteDocumentEdit(size_t lo, size_t hi, size_t before, size_t after) {
+    BOOL journal = g_app.journal && !g_app.journalStale;
+    if (!journal && !g_app.pieces.valid && !g_app.lines.complete) {
+        TextLineIndexTruncate(&g_app.lines, lo);
+        return;
+    }
+    HLOCAL handle = NULL;
+    size_t length;
+    const WCHAR *text = NULL;
+    if (hi <= after && hi - lo + before >= after) text = LockEditText(&handle, &length);
+    if (!text) {
+        // Not a single replaced stretch after all, or no text to read.
+        if (g_app.journal) g_app.journalStale = TRUE;
+        TextPieceTableFree(&g_app.pieces);
+        TextLineIndexTruncate(&g_app.lines, lo);
+        return;
+    }
+    size_t deleted = hi - lo + before - after;
+    uint64_t bare = 0;
+    if (deleted != 0 || hi != lo) {
+        if (journal) JournalEdit(g_app.journal, lo, deleted, text + lo, hi - lo);
+        if (g_app.pieces.valid &&
+            !TextPieceTableReplace(&g_app.pieces, lo, deleted, (const uint16_t *)(text + lo), hi - lo)) {
+            TextPieceTableFree(&g_app.pieces);
+        }
+        // Only the lines around the edit are rescanned; see text_lines.h.
+        TextLineIndexEdit(&g_app.lines, lo, deleted, (const uint16_t *)text, length, &bare);
+    }
+    LocalUnlock(handle);
+    if (bare > 0) CheckLineIndexBreaks();
+}
+
+// Whether anything derived from the loaded text needs to hear about edits.
+static BOOL TracksEdits(void) {
+    return g_app.baseline != NULL || g_app.lines.lines > 0 || JournalsEdits() || g_app.pieces.valid;
+}
+
+// Records a change that cannot be located (undo, replace all).
+static void NoteDocumentRewrite(void) {
+    NoteBaselineRewrite(g_app.baseline);
+    TextLineIndexFree(&g_app.lines);
+    if (!g_app.linesStale && g_app.hwndMain) {
+        // Rebuilt once the rewrite is through; see RebuildLineIndex.
+        g_app.linesStale = TRUE;
+        PostMessageW(g_app.hwndMain, WM_APP_REINDEX, 0, 0);
+    }
+    if (g_app.journal) g_app.journalStale = TRUE;
+    TextPieceTableFree(&g_app.pieces);
+}
+
+// Once a second: starts a journal for changes that bypassed the edit
+// tracking (Replace All), and checkpoints one that missed a change or
+// whose log has outgrown the document.
+static void OnJournalTimer(void) {
+    if (!JournalsEdits()) return;
+    if (!g_app.journal) {
+        if (g_app.modified) StartJournal();
+        return;
+    }
+    size_t length = (size_t)GetWindowTextLengthW(g_app.hwndEdit);
+    if (!g_app.journalStale && !JournalWantsCheckpoint(g_app.journal, length)) return;
+    HLOCAL handle;
+    const WCHAR *text = LockEditText(&handle, &length);
+    if (!text) return;
+    JournalCheckpoint(g_app.journal, text, length);
+    LocalUnlock(handle);
+    g_app.journalStale = FALSE;
+}
+
+static void ResetToUntitled(HWND hwnd) {
+    StopJournal();
+    g_app.followTail = FALSE;
+    StopFollowing(hwnd);
+    g_app.fileBytes = 0;
+    ZeroMemory(&g_app.fingerprint, sizeof(g_app.fingerprint));
+    g_app.compressed = FALSE;
+    ClosePagedDocument();
+    FreeSaveBaseline(g_app.baseline);
+    g_app.baseline = NULL;
+    TextLineIndexFree(&g_app.lines);
+    SetWindowTextW(g_app.hwndEdit, L"");
+    g_app.currentPath[0] = L'\0';
+    g_app.encoding = ENC_UTF8;
+    SendMessageW(g_app.hwndEdit, EM_SETMODIFY, FALSE, 0);
+    g_app.modified = FALSE;
+    UpdateTitle(hwnd);
+    UpdateStatusBar(hwnd);
+}
+
+static void FreeReloadText(void) {
+    if (g_app.reloadText) HeapFree(GetProcessHeap(), 0, g_app.reloadText);
+    g_app.reloadText = NULL;
+    g_app.reloadLength = 0;
+    g_app.reloadCapacity = 0;
+}
+
+// Stops an in-flight load and throws away whatever it already queued.
+static void AbortDocumentLoad(HWND hwnd) {
+    if (!g_app.loadJob) return;
+    g_app.reloading = FALSE;
+    FreeReloadText();
+    CancelLoadTextFile(g_app.loadJob);
+    EndLoadTextFile(hwnd, g_app.loadJob, NULL, NULL, NULL);
+    g_app.loadJob = NULL;
+    MSG msg;
+    while (PeekMessageW(&msg, hwnd, WM_APP_LOAD_CHUNK, WM_APP_LOAD_DONE, PM_REMOVE)) {
+        if (msg.message == WM_APP_LOAD_CHUNK) {
+            FreeLoadChunk((LoadChunk *)msg.lParam);
+        }
+    }
+    SendMessageW(g_app.hwndEdit, EM_SETREADONLY, FALSE, 0);
+}
+
+// Files too big for the edit control open read-only: the pager decodes
+// only what is on screen, so memory stays flat whatever the file size.
+static BOOL OpenPagedDocument(HWND hwnd, LPCWSTR path) {
     TextEncoding enc = ENC_UTF8;
-    if (!LoadTextFile(hwnd, path, &text, NULL, &enc)) {
+    UINT codePage = 0;
+    PagedFile *file = OpenPagedFile(hwnd, path, &enc, &codePage);
+    if (!file) {
         return FALSE;
     }
+    if (!g_app.hwndPager) {
+        g_app.hwndPager = CreatePagerView(hwnd, 3);
+        if (!g_app.hwndPager) {
+            ClosePagedFile(file);
+            MessageBoxW(hwnd, L"Unable to create the file viewer.", APP_TITLE, MB_ICONERROR);
+            return FALSE;
+        }
+        PagerViewSetFont(g_app.hwndPager, g_app.hFont);
+        UpdateLayout(hwnd);
+    }
+    ResetToUntitled(hwnd);
+    g_app.pagedFile = file;
+    g_app.encoding = enc;
+    g_app.codePage = codePage;
+    StringCchCopyW(g_app.currentPath, ARRAYSIZE(g_app.currentPath), path);
+    PagerViewSetDocument(g_app.hwndPager, GetPagedText(file));
+    ShowWindow(g_app.hwndEdit, SW_HIDE);
+    ShowWindow(g_app.hwndPager, SW_SHOW);
+    SetFocus(g_app.hwndPager);
+    UpdateTitle(hwnd);
+    UpdateStatusBar(hwnd);
+    return TRUE;
+}
 
-    SetWindowTextW(g_app.hwndEdit, text);
-    HeapFree(GetProcessHeap(), 0, text);
+// The document streams in on a worker; see OnLoadChunk/OnLoadDone.
+static BOOL LoadDocumentFromPath(HWND hwnd, LPCWSTR path) {
+    AbortDocumentLoad(hwnd);
+    StopJournal(); // the changes were saved or discarded already
+    // Reloading the followed file (after a rotation) keeps following it.
+    StopFollowing(hwnd);
+    if (lstrcmpiW(path, g_app.currentPath) != 0) g_app.followTail = FALSE;
+    ULONGLONG size = 0;
+    // Compressed files cannot be paged: offsets into them are not text.
+    if (g_app.pagedThreshold && QueryFileSize(path, &size) && size >= g_app.pagedThreshold && !IsGzipFile(path)) {
+        return OpenPagedDocument(hwnd, path);
+    }
+    if (OpenCachedDocument(hwnd, path)) return TRUE;
+    LoadJob *job = BeginLoadTextFile(hwnd, path);
+    if (!job) {
+        g_app.followTail = FALSE;
+        return FALSE;
+    }
+
+    ClosePagedDocument();
+    g_app.loadJob = job;
+    FreeSaveBaseline(g_app.baseline);
+    g_app.baseline = NULL;
+    TextLineIndexFree(&g_app.lines);
+    g_app.loadBytesDone = 0;
+    g_app.loadBytesTotal = 0;
+    SetWindowTextW(g_app.hwndEdit, L"");
+    SendMessageW(g_app.hwndEdit, EM_SETREADONLY, TRUE, 0);
     StringCchCopyW(g_app.currentPath, ARRAYSIZE(g_app.currentPath), path);
+    g_app.encoding = ENC_UTF8;
+    SendMessageW(g_app.hwndEdit, EM_SETMODIFY, FALSE, 0);
+    g_app.modified = FALSE;
+    UpdateTitle(hwnd);
+    UpdateStatusBar(hwnd);
+    return TRUE;
+}
+
+// Keeps a reloaded chunk aside (NUL-terminated) until the whole file is in.
+static BOOL GatherReloadText(const LoadChunk *chunk) {
+    if (chunk->restart) g_app.reloadLength = 0;
+    size_t needed = g_app.reloadLength + chunk->length + 1;
+    if (needed > g_app.reloadCapacity) {
+        size_t capacity = max(needed, g_app.reloadCapacity * 2);
+        WCHAR *grown = g_app.reloadText
+                           ? (WCHAR *)HeapReAlloc(GetProcessHeap(), 0, g_app.reloadText, capacity * sizeof(WCHAR))
+                           : (WCHAR *)HeapAlloc(GetProcessHeap(), 0, capacity * sizeof(WCHAR));
+        if (!grown) return FALSE;
+        g_app.reloadText = grown;
+        g_app.reloadCapacity = capacity;
+    }
+    CopyMemory(g_app.reloadText + g_app.reloadLength, chunk->text, chunk->length * sizeof(WCHAR));
+    g_app.reloadLength += chunk->length;
+    g_app.reloadText[g_app.reloadLength] = L'\0';
+    return TRUE;
+}
+
+// Appends a decoded chunk without disturbing the caret or scroll position,
+// so the first screenful stays put while the rest arrives.
+static void OnLoadChunk(HWND hwnd, LoadJob *job, LoadChunk *chunk) {
+    HWND edit = g_app.hwndEdit;
+    if (g_app.reloading) {
+        // The document stays as it is until the new text can be diffed in.
+        if (!GatherReloadText(chunk)) CancelLoadTextFile(job);
+        g_app.loadBytesDone = chunk->bytesDone;
+        g_app.loadBytesTotal = chunk->bytesTotal;
+        AcknowledgeLoadChunk(job, chunk);
+        UpdateStatusBar(hwnd);
+        return;
+    }
+    if (chunk->restart) {
+        SetWindowTextW(edit, L"");
+    }
+    int len = GetWindowTextLengthW(edit);
+    if (len == 0) {
+        SetWindowTextW(edit, chunk->text);
+    } else if (chunk->length > 0) {
+        DWORD selStart = 0, selEnd = 0;
+        SendMessageW(edit, EM_GETSEL, (WPARAM)&selStart, (LPARAM)&selEnd);
+        int firstLine = (int)SendMessageW(edit, EM_GETFIRSTVISIBLELINE, 0, 0);
+        SendMessageW(edit, WM_SETREDRAW, FALSE, 0);
+        SendMessageW(edit, EM_SETSEL, len, len);
+        SendMessageW(edit, EM_REPLACESEL, FALSE, (LPARAM)chunk->text);
+        SendMessageW(edit, EM_SETSEL, selStart, selEnd);
+        int nowLine = (int)SendMessageW(edit, EM_GETFIRSTVISIBLELINE, 0, 0);
+        SendMessageW(edit, EM_LINESCROLL, 0, firstLine - nowLine);
+        SendMessageW(edit, WM_SETREDRAW, TRUE, 0);
+        InvalidateRect(edit, NULL, TRUE);
+    }
+    SendMessageW(edit, EM_SETMODIFY, FALSE, 0);
+    g_app.loadBytesDone = chunk->bytesDone;
+    g_app.loadBytesTotal = chunk->bytesTotal;
+    AcknowledgeLoadChunk(job, chunk);
+    UpdateStatusBar(hwnd);
+}
+
+// Watches the current file for appended text. The document is read-only
+// meanwhile so edits never interleave with what arrives, and the caret
+// moves to the end so new lines scroll into view.
+static void StartFollowing(HWND hwnd) {
+    // The file is expected to grow now; the text never matches it again.
+    g_app.fingerprint.valid = FALSE;
+    g_app.followed = BeginFollowingFile(hwnd, g_app.currentPath, g_app.encoding, g_app.codePage, g_app.fileBytes);
+    if (!g_app.followed) {
+        g_app.followTail = FALSE;
+        return;
+    }
+    SendMessageW(g_app.hwndEdit, EM_SETREADONLY, TRUE, 0);
+    int len = GetWindowTextLengthW(g_app.hwndEdit);
+    SendMessageW(g_app.hwndEdit, EM_SETSEL, len, len);
+    SendMessageW(g_app.hwndEdit, EM_SCROLLCARET, 0, 0);
+    SetTimer(hwnd, FOLLOW_TIMER_ID, FOLLOW_POLL_MS, NULL);
+}
+
+// SetWindowTextW and EM_REPLACESEL stop at a U+0000, so text with NULs
+// in it ends up shorter in the control than it was decoded. The baseline
+// and line index describe the decoded text; kept, a save would copy file
+// bytes for a "clean" prefix that is not what the control shows.
+static void DropMismatchedDocumentState(void) {
+    size_t shown = (size_t)GetWindowTextLengthW(g_app.hwndEdit);
+    if (g_app.baseline && SaveBaselineLength(g_app.baseline) != shown) {
+        FreeSaveBaseline(g_app.baseline);
+        g_app.baseline = NULL;
+    }
+    if (g_app.lines.complete && g_app.lines.units != shown) TextLineIndexFree(&g_app.lines);
+}
+
+// Settles a document whose text, baseline and line index are all in place.
+static void FinishDocumentLoad(HWND hwnd, TextEncoding enc, UINT codePage) {
+    DropMismatchedDocumentState();
+    CheckLineIndexBreaks();
+    g_app.linesStale = FALSE; // the load brought its own index, or none is wanted
     g_app.encoding = enc;
+    g_app.codePage = codePage;
+    SendMessageW(g_app.hwndEdit, EM_EMPTYUNDOBUFFER, 0, 0);
     SendMessageW(g_app.hwndEdit, EM_SETMODIFY, FALSE, 0);
     g_app.modified = FALSE;
+    StopJournal();
+    if (g_app.compressed) g_app.followTail = FALSE; // appended bytes are not text
+    if (g_app.followTail) StartFollowing(hwnd);
     UpdateTitle(hwnd);
     UpdateStatusBar(hwnd);
+    FinishRecovery(hwnd, TRUE);
+}
+
+// Patches the edit control from its current text to `text` (NUL-terminated,
+// `length` units) one changed stretch at a time, back to front so earlier
+// offsets hold, then puts the selection and top line back where they were.
+// Many stretches are patched as one: each replacement moves all the text
+// after it.
+static void ApplyReloadedText(WCHAR *text, size_t length) {
+    HWND edit = g_app.hwndEdit;
+    int len = GetWindowTextLengthW(edit);
+    HLOCAL handle = (HLOCAL)SendMessageW(edit, EM_GETHANDLE, 0, 0);
+    const WCHAR *current = handle ? (const WCHAR *)LocalLock(handle) : NULL;
+    TextDiff diff;
+    TextDiffInit(&diff);
+    BOOL diffed = current && TextDiffLines(&diff, (const uint16_t *)current, (size_t)len, (const uint16_t *)text,
+                                           length, RELOAD_MAX_EDITS);
+    if (current) LocalUnlock(handle);
+    if (!diffed) {
+        TextDiffFree(&diff);
+        SetWindowTextW(edit, text);
+        return;
+    }
+
+    DWORD selStart = 0, selEnd = 0;
+    SendMessageW(edit, EM_GETSEL, (WPARAM)&selStart, (LPARAM)&selEnd);
+    int firstLine = (int)SendMessageW(edit, EM_GETFIRSTVISIBLELINE, 0, 0);
+    size_t firstChar = (size_t)SendMessageW(edit, EM_LINEINDEX, firstLine, 0);
+    size_t mappedStart = TextDiffMapOffset(&diff, selStart);
+    size_t mappedEnd = TextDiffMapOffset(&diff, selEnd);
+    size_t mappedTop = TextDiffMapOffset(&diff, firstChar);
+    size_t hunks = diff.count;
+    if (hunks > RELOAD_MAX_HUNKS) TextDiffJoin(&diff);
+    SendMessageW(edit, WM_SETREDRAW, FALSE, 0);
+    for (size_t i = diff.count; i-- > 0;) {
+        const TextDiffHunk *hunk = &diff.hunks[i];
+        WCHAR saved = text[hunk->newEnd];
+        text[hunk->newEnd] = L'\0';
+        SendMessageW(edit, EM_SETSEL, (WPARAM)hunk->oldStart, (LPARAM)hunk->oldEnd);
+        SendMessageW(edit, EM_REPLACESEL, FALSE, (LPARAM)(text + hunk->newStart));
+        text[hunk->newEnd] = saved;
+    }
+    SendMessageW(edit, EM_SETSEL, (WPARAM)mappedStart, (LPARAM)mappedEnd);
+    int topLine = (int)SendMessageW(edit, EM_LINEFROMCHAR, (WPARAM)mappedTop, 0);
+    int nowLine = (int)SendMessageW(edit, EM_GETFIRSTVISIBLELINE, 0, 0);
+    SendMessageW(edit, EM_LINESCROLL, 0, topLine - nowLine);
+    SendMessageW(edit, WM_SETREDRAW, TRUE, 0);
+    InvalidateRect(edit, NULL, TRUE);
+
+    WCHAR line[96];
+    StringCchPrintfW(line, ARRAYSIZE(line), L"Reload: %Iu hunks%s", hunks,
+                     diff.exact ? L"" : L" (diff gave up)");
+    DebugLog(line);
+    TextDiffFree(&diff);
+}
+
+// Ends a reload: diffs the new text in on success, leaves the document as
+// it was otherwise.
+static void FinishReload(HWND hwnd, LoadJob *job) {
+    TextEncoding enc = ENC_UTF8;
+    ULONGLONG fileBytes = LoadTextFileSize(job);
+    BOOL compressed = LoadTextFileCompressed(job);
+    UINT codePage = LoadTextFileCodePage(job);
+    FileFingerprint fingerprint;
+    LoadTextFileFingerprint(job, &fingerprint);
+    SaveBaseline *baseline = NULL;
+    TextLineIndex lines;
+    BOOL ok = EndLoadTextFile(hwnd, job, &enc, &baseline, &lines);
+    g_app.loadJob = NULL;
+    SendMessageW(g_app.hwndEdit, EM_SETREADONLY, FALSE, 0);
+    if (!ok) {
+        g_app.reloading = FALSE;
+        FreeReloadText();
+        UpdateStatusBar(hwnd);
+        return;
+    }
+    // The patches are not edits: nothing tracks them, and the new file's
+    // baseline and line index take over afterwards.
+    FreeSaveBaseline(g_app.baseline);
+    g_app.baseline = NULL;
+    TextLineIndexFree(&g_app.lines);
+    ApplyReloadedText(g_app.reloadText ? g_app.reloadText : L"", g_app.reloadLength);
+    g_app.reloading = FALSE;
+    FreeReloadText();
+    g_app.baseline = baseline;
+    g_app.lines = lines;
+    g_app.fileBytes = fileBytes;
+    g_app.compressed = compressed;
+    g_app.fingerprint = fingerprint;
+    FinishDocumentLoad(hwnd, enc, codePage);
+}
+
+static void OnLoadDone(HWND hwnd, LoadJob *job) {
+    if (g_app.reloading) {
+        FinishReload(hwnd, job);
+        return;
+    }
+    TextEncoding enc = ENC_UTF8;
+    g_app.fileBytes = LoadTextFileSize(job);
+    g_app.compressed = LoadTextFileCompressed(job);
+    UINT codePage = LoadTextFileCodePage(job);
+    LoadTextFileFingerprint(job, &g_app.fingerprint);
+    BOOL ok = EndLoadTextFile(hwnd, job, &enc, &g_app.baseline, &g_app.lines);
+    g_app.loadJob = NULL;
+    SendMessageW(g_app.hwndEdit, EM_SETREADONLY, FALSE, 0);
+    if (!ok) {
+        // Failed or cancelled: a partial document is not worth keeping.
+        ResetToUntitled(hwnd);
+        FinishRecovery(hwnd, FALSE);
+        return;
+    }
+    FinishDocumentLoad(hwnd, enc, codePage);
+}
+
+// Shows a document from the cache when the file has not changed since it
+// was last decoded: no reading, detection or decoding at all.
+static BOOL OpenCachedDocument(HWND hwnd, LPCWSTR path) {
+    CachedDocument doc;
+    SaveBaseline *baseline = NULL;
+    TextLineIndex lines;
+    BOOL hit = LookupCachedDocument(path, &doc, &baseline, &lines);
+    DocumentCacheStats stats;
+    GetDocumentCacheStats(&stats);
+    WCHAR line[160];
+    StringCchPrintfW(line, ARRAYSIZE(line), L"Cache: %s hits=%llu misses=%llu evictions=%llu entries=%u used=%IuKB",
+                     hit ? L"hit" : L"miss", stats.hits, stats.misses, stats.evictions, stats.entries, stats.bytesUsed / 1024);
+    DebugLog(line);
+    if (!hit) return FALSE;
+
+    ClosePagedDocument();
+    StringCchCopyW(g_app.currentPath, ARRAYSIZE(g_app.currentPath), path);
+    SetWindowTextW(g_app.hwndEdit, doc.text);
+    // Set after the text, which resets whatever tracks edits.
+    FreeSaveBaseline(g_app.baseline);
+    g_app.baseline = baseline;
+    TextLineIndexFree(&g_app.lines);
+    g_app.lines = lines;
+    g_app.fileBytes = doc.fingerprint.size;
+    g_app.fingerprint = doc.fingerprint;
+    g_app.compressed = doc.compressed;
+    FinishDocumentLoad(hwnd, doc.encoding, doc.codePage);
     return TRUE;
 }
 
+// Adds text the followed file gained. A caret already at the end stays
+// there, tail -f style; otherwise the caret and scroll position stay put.
+static void AppendFollowedText(HWND hwnd, const WCHAR *text, size_t length) {
+    HWND edit = g_app.hwndEdit;
+    int len = GetWindowTextLengthW(edit);
+    DWORD selStart = 0, selEnd = 0;
+    SendMessageW(edit, EM_GETSEL, (WPARAM)&selStart, (LPARAM)&selEnd);
+    BOOL atEnd = selEnd >= (DWORD)len;
+    int firstLine = (int)SendMessageW(edit, EM_GETFIRSTVISIBLELINE, 0, 0);
+
+    // The index is extended below rather than cut back by edit tracking.
+    TextLineIndex lines = g_app.lines;
+    ZeroMemory(&g_app.lines, sizeof(g_app.lines));
+    SendMessageW(edit, WM_SETREDRAW, FALSE, 0);
+    SendMessageW(edit, EM_SETSEL, len, len);
+    SendMessageW(edit, EM_REPLACESEL, FALSE, (LPARAM)text);
+    if (atEnd) {
+        SendMessageW(edit, EM_SCROLLCARET, 0, 0);
+    } else {
+        SendMessageW(edit, EM_SETSEL, selStart, selEnd);
+        int nowLine = (int)SendMessageW(edit, EM_GETFIRSTVISIBLELINE, 0, 0);
+        SendMessageW(edit, EM_LINESCROLL, 0, firstLine - nowLine);
+    }
+    SendMessageW(edit, WM_SETREDRAW, TRUE, 0);
+    InvalidateRect(edit, NULL, TRUE);
+
+    // New lone CRs or LFs may not break lines in the control; see OnLoadDone.
+    uint64_t bareBefore = lines.bareBreaks;
+    if (TextLineIndexExtend(&lines, (const uint16_t *)text, length) && lines.bareBreaks == bareBefore) {
+        g_app.lines = lines;
+    } else {
+        TextLineIndexFree(&lines);
+    }
+    SendMessageW(edit, EM_SETMODIFY, FALSE, 0);
+    UpdateStatusBar(hwnd);
+}
+
+static void OnFollowTimer(HWND hwnd) {
+    if (!g_app.followed) return;
+    WCHAR *text = NULL;
+    size_t length = 0;
+    switch (PollFollowedFile(g_app.followed, &text, &length)) {
+    case FOLLOW_APPENDED:
+        AppendFollowedText(hwnd, text, length);
+        FreeFollowedText(text);
+        break;
+    case FOLLOW_RESTART: {
+        // Truncated or rotated: what is shown no longer matches the file.
+        WCHAR path[MAX_PATH_BUFFER];
+        StringCchCopyW(path, ARRAYSIZE(path), g_app.currentPath);
+        LoadDocumentFromPath(hwnd, path);
+        break;
+    }
+    case FOLLOW_IDLE:
+        break;
+    }
+}
+
+// Rereads the open file and patches only what changed into the edit
+// control, so the caret, selection and scroll position survive. A file that
+// now belongs in the paged view is opened from scratch instead.
+static BOOL ReloadDocument(HWND hwnd) {
+    WCHAR path[MAX_PATH_BUFFER];
+    StringCchCopyW(path, ARRAYSIZE(path), g_app.currentPath);
+    ULONGLONG size = 0;
+    if (g_app.pagedFile || g_app.followed ||
+        (g_app.pagedThreshold && QueryFileSize(path, &size) && size >= g_app.pagedThreshold && !IsGzipFile(path))) {
+        return LoadDocumentFromPath(hwnd, path);
+    }
+    AbortDocumentLoad(hwnd);
+    LoadJob *job = BeginLoadTextFile(hwnd, path);
+    if (!job) return FALSE;
+    g_app.loadJob = job;
+    g_app.reloading = TRUE;
+    g_app.loadBytesDone = 0;
+    g_app.loadBytesTotal = 0;
+    SendMessageW(g_app.hwndEdit, EM_SETREADONLY, TRUE, 0);
+    UpdateStatusBar(hwnd);
+    return TRUE;
+}
+
+// Runs when retropad is switched back to: offers to reload a file another
+// program changed meanwhile. Size and time settle almost every check; the
+// file is hashed only when its time moved but its size did not, so merely
+// touching it raises no prompt.
+static void CheckForExternalChange(HWND hwnd) {
+    static BOOL checking = FALSE; // the prompt itself deactivates the window
+    if (checking || !g_app.fingerprint.valid || g_app.loadJob || g_app.followed || g_app.pagedFile) return;
+    if (CheckFileFingerprint(g_app.currentPath, &g_app.fingerprint) != FILE_CHECK_CHANGED) return;
+    // Ask once per change; Save or a reload fingerprints the file again.
+    g_app.fingerprint.valid = FALSE;
+    // A journal kept against the file can no longer be replayed onto it.
+    if (g_app.journal) g_app.journalStale = TRUE;
+    checking = TRUE;
+    WCHAR msg[MAX_PATH_BUFFER + 128];
+    StringCchPrintfW(msg, ARRAYSIZE(msg),
+                     g_app.modified ? L"%s\n\nThis file has been changed by another program.\nReload it and lose your changes?"
+                                    : L"%s\n\nThis file has been changed by another program.\nDo you want to reload it?",
+                     g_app.currentPath);
+    if (MessageBoxW(hwnd, msg, APP_TITLE, MB_YESNO | MB_ICONWARNING) == IDYES) {
+        ReloadDocument(hwnd);
+    }
+    checking = FALSE;
+}
+
+// Shows a recovered document as unsaved changes and takes over journaling
+// it before the abandoned journal is deleted.
+static void ApplyRecoveredText(HWND hwnd, const AbandonedJournal *journal, const WCHAR *base, size_t baseLength) {
+    WCHAR *text = NULL;
+    size_t length = 0;
+    if (!ReplayAbandonedJournal(journal, base, baseLength, &text, &length)) {
+        MessageBoxW(hwnd, L"Unable to recover the unsaved changes.", APP_TITLE, MB_ICONERROR);
+        return;
+    }
+    if (!journal->fromFile) {
+        ResetToUntitled(hwnd);
+        StringCchCopyW(g_app.currentPath, ARRAYSIZE(g_app.currentPath), journal->path);
+        g_app.encoding = journal->encoding;
+        g_app.codePage = journal->codePage;
+        g_app.compressed = journal->compressed;
+    }
+    SetWindowTextW(g_app.hwndEdit, text);
+    FreeRecoveredText(text);
+    SendMessageW(g_app.hwndEdit, EM_SETMODIFY, TRUE, 0);
+    g_app.modified = TRUE;
+    StartJournal();
+    DiscardAbandonedJournal(journal);
+    UpdateTitle(hwnd);
+    UpdateStatusBar(hwnd);
+}
+
+// Replays a journal kept against a file once that file has loaded, if it
+// is still the file the edits were made to. A load that failed or was
+// cancelled leaves the journal for next time.
+static void FinishRecovery(HWND hwnd, BOOL loaded) {
+    AbandonedJournal *journal = g_app.recovery;
+    if (!journal) return;
+    g_app.recovery = NULL;
+    if (loaded) {
+        BOOL same = g_app.fingerprint.valid && g_app.fingerprint.size == journal->fileSize &&
+                    g_app.fingerprint.hash == journal->fileHash && g_app.encoding == journal->encoding &&
+                    (g_app.encoding != ENC_ANSI || g_app.codePage == journal->codePage);
+        WCHAR *base = NULL;
+        int length = 0;
+        if (!same) {
+            MessageBoxW(hwnd, L"The file has changed since, so the unsaved changes cannot be recovered.", APP_TITLE,
+                        MB_ICONWARNING);
+            DiscardAbandonedJournal(journal);
+        } else if (GetEditText(g_app.hwndEdit, &base, &length)) {
+            ApplyRecoveredText(hwnd, journal, base, (size_t)length);
+            HeapFree(GetProcessHeap(), 0, base);
+        }
+    }
+    HeapFree(GetProcessHeap(), 0, journal);
+}
+
+// Offers the unsaved changes of an instance that ended without saving or
+// discarding them. One document can be recovered into this window; No
+// deletes a journal and moves on, Cancel leaves the rest for next time.
+// TRUE once one is being recovered.
+static BOOL OfferRecovery(HWND hwnd) {
+    AbandonedJournal journal;
+    while (g_app.journalEnabled && FindAbandonedJournal(&journal)) {
+        WCHAR msg[JOURNAL_PATH_UNITS + 128];
+        StringCchPrintfW(msg, ARRAYSIZE(msg),
+                         L"retropad closed without saving the changes to %s.\n\nDo you want to recover them?",
+                         journal.path[0] ? journal.path : UNTITLED_NAME);
+        int answer = MessageBoxW(hwnd, msg, APP_TITLE, MB_YESNOCANCEL | MB_ICONWARNING);
+        if (answer == IDNO) {
+            DiscardAbandonedJournal(&journal);
+            continue;
+        }
+        if (answer != IDYES) return FALSE;
+        if (!journal.fromFile) {
+            ApplyRecoveredText(hwnd, &journal, NULL, 0);
+            return TRUE;
+        }
+        // The edits apply to the file as it was decoded then: load it the
+        // usual way and replay them once it is in (FinishRecovery).
+        g_app.recovery = (AbandonedJournal *)HeapAlloc(GetProcessHeap(), 0, sizeof(journal));
+        if (!g_app.recovery) return FALSE;
+        *g_app.recovery = journal;
+        if (!LoadDocumentFromPath(hwnd, journal.path) || g_app.pagedFile) FinishRecovery(hwnd, FALSE);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+// Remembers what is showing for the next launch; see RestoreSession. Only
+// a document identical to its file keeps its text: discarded changes are
+// not brought back, so the file is reopened from disk instead.
+static void SaveSessionSnapshot(void) {
+    SessionState state;
+    ZeroMemory(&state, sizeof(state));
+    StringCchCopyW(state.path, ARRAYSIZE(state.path), g_app.currentPath);
+    state.encoding = g_app.encoding;
+    state.codePage = g_app.codePage;
+    state.compressed = g_app.compressed;
+    state.fingerprint = g_app.fingerprint;
+    SendMessageW(g_app.hwndEdit, EM_GETSEL, (WPARAM)&state.selStart, (LPARAM)&state.selEnd);
+    state.firstLine = (int)SendMessageW(g_app.hwndEdit, EM_GETFIRSTVISIBLELINE, 0, 0);
+    state.wordWrap = g_app.wordWrap;
+    state.statusVisible = g_app.wordWrap ? g_app.statusBeforeWrap : g_app.statusVisible;
+    state.followTail = g_app.followTail;
+    state.marginsThousandths = g_app.marginsThousandths;
+    StringCchCopyW(state.headerText, ARRAYSIZE(state.headerText), g_app.headerText);
+    StringCchCopyW(state.footerText, ARRAYSIZE(state.footerText), g_app.footerText);
+
+    BOOL keepText = g_app.currentPath[0] && !g_app.modified && !g_app.loadJob && !g_app.pagedFile &&
+                    g_app.fingerprint.valid;
+    HLOCAL handle = NULL;
+    size_t length = 0;
+    const WCHAR *text = keepText ? LockEditText(&handle, &length) : NULL;
+    LARGE_INTEGER t0, t1, freq;
+    QueryPerformanceCounter(&t0);
+    BOOL ok = SaveSession(&state, text, length, &g_app.lines, g_app.baseline, g_app.hDevMode, g_app.hDevNames);
+    QueryPerformanceCounter(&t1);
+    if (text) LocalUnlock(handle);
+    QueryPerformanceFrequency(&freq);
+    WCHAR line[128];
+    StringCchPrintfW(line, ARRAYSIZE(line), L"Session: %s %Iu units in %.1fms", ok ? L"saved" : L"failed to save",
+                     length, (double)(t1.QuadPart - t0.QuadPart) * 1000.0 / (double)freq.QuadPart);
+    DebugLog(line);
+}
+
+// Brings back the last session. When the file has not changed since, the
+// snapshot's decoded text, line index and baseline go straight in, as on a
+// document cache hit; otherwise the file is opened the usual way.
+static void RestoreSession(HWND hwnd) {
+    LARGE_INTEGER t0, t1, freq;
+    QueryPerformanceCounter(&t0);
+    SessionState state;
+    Session *session = OpenSession(&state);
+    if (!session) return;
+    g_app.marginsThousandths = state.marginsThousandths;
+    StringCchCopyW(g_app.headerText, ARRAYSIZE(g_app.headerText), state.headerText);
+    StringCchCopyW(g_app.footerText, ARRAYSIZE(g_app.footerText), state.footerText);
+    HGLOBAL devMode = NULL, devNames = NULL;
+    TakeSessionPageSetup(session, &devMode, &devNames);
+    if (devMode && devNames) {
+        if (g_app.hDevMode) GlobalFree(g_app.hDevMode);
+        if (g_app.hDevNames) GlobalFree(g_app.hDevNames);
+        g_app.hDevMode = devMode;
+        g_app.hDevNames = devNames;
+    } else {
+        if (devMode) GlobalFree(devMode);
+        if (devNames) GlobalFree(devNames);
+    }
+    ToggleStatusBar(hwnd, state.statusVisible);
+    if (state.wordWrap) SetWordWrap(hwnd, TRUE);
+    if (!state.path[0]) {
+        CloseSession(session);
+        return;
+    }
+
+    size_t length = 0;
+    const WCHAR *text = SessionText(session, &length);
+    FileFingerprint fingerprint = state.fingerprint;
+    BOOL paged = g_app.pagedThreshold && fingerprint.size >= g_app.pagedThreshold && !state.compressed;
+    if (!text || paged || !fingerprint.valid || CheckFileFingerprint(state.path, &fingerprint) != FILE_CHECK_SAME) {
+        CloseSession(session);
+        g_app.followTail = state.followTail;
+        LoadDocumentFromPath(hwnd, state.path);
+        return;
+    }
+    StringCchCopyW(g_app.currentPath, ARRAYSIZE(g_app.currentPath), state.path);
+    SetWindowTextW(g_app.hwndEdit, text);
+    // Set after the text, which resets whatever tracks edits.
+    FreeSaveBaseline(g_app.baseline);
+    TextLineIndexFree(&g_app.lines);
+    TakeSessionDocument(session, state.path, &g_app.baseline, &g_app.lines);
+    CloseSession(session);
+    g_app.fileBytes = fingerprint.size;
+    g_app.fingerprint = fingerprint;
+    g_app.compressed = state.compressed;
+    g_app.followTail = state.followTail;
+    DWORD end = (DWORD)length;
+    SendMessageW(g_app.hwndEdit, EM_SETSEL, min(state.selStart, end), min(state.selEnd, end));
+    int nowLine = (int)SendMessageW(g_app.hwndEdit, EM_GETFIRSTVISIBLELINE, 0, 0);
+    SendMessageW(g_app.hwndEdit, EM_LINESCROLL, 0, state.firstLine - nowLine);
+    FinishDocumentLoad(hwnd, state.encoding, state.codePage);
+    QueryPerformanceCounter(&t1);
+    QueryPerformanceFrequency(&freq);
+    double ms = (double)(t1.QuadPart - t0.QuadPart) * 1000.0 / (double)freq.QuadPart;
+    WCHAR line[128];
+    StringCchPrintfW(line, ARRAYSIZE(line), L"Session: restored %Iu units in %.1fms%s", length, ms,
+                     ms > SESSION_RESTORE_TARGET_MS ? L" (over target)" : L"");
+    DebugLog(line);
+}
+
+static void ToggleFollowTail(HWND hwnd) {
+    if (g_app.followTail) {
+        g_app.followTail = FALSE;
+        StopFollowing(hwnd);
+        return;
+    }
+    if (g_app.currentPath[0] == L'\0' || g_app.loadJob || g_app.compressed) return;
+    if (!PromptSaveChanges(hwnd)) return;
+    g_app.followTail = TRUE;
+    if (g_app.modified) {
+        // Changes were discarded: start over from what is on disk.
+        WCHAR path[MAX_PATH_BUFFER];
+        StringCchCopyW(path, ARRAYSIZE(path), g_app.currentPath);
+        LoadDocumentFromPath(hwnd, path);
+        return;
+    }
+    StartFollowing(hwnd);
+}
+
 static BOOL DoFileOpen(HWND hwnd) {
     if (!PromptSaveChanges(hwnd)) return FALSE;
 
@@ -381,8 +1269,17 @@ static BOOL DoFileOpen(HWND hwnd) {
     return LoadDocumentFromPath(hwnd, path);
 }
 
+static BOOL HasGzipExtension(LPCWSTR path) {
+    size_t len = wcslen(path);
+    return len >= 3 && lstrcmpiW(path + len - 3, L".gz") == 0;
+}
+
 static BOOL DoFileSave(HWND hwnd, BOOL saveAs) {
+    if (g_app.loadJob) return FALSE; // the document is still streaming in
+    if (g_app.pagedFile) return FALSE; // paged documents are read-only
     WCHAR path[MAX_PATH_BUFFER];
+    // A gzip document stays compressed; Save As goes by the new name.
+    BOOL compress = g_app.compressed;
     if (saveAs || g_app.currentPath[0] == L'\0') {
         path[0] = L'\0';
         if (g_app.currentPath[0]) {
@@ -391,39 +1288,54 @@ static BOOL DoFileSave(HWND hwnd, BOOL saveAs) {
         if (!SaveFileDialog(hwnd, path, ARRAYSIZE(path))) {
             return FALSE;
         }
+        if (lstrcmpiW(path, g_app.currentPath) != 0) g_app.fingerprint.valid = FALSE;
         StringCchCopyW(g_app.currentPath, ARRAYSIZE(g_app.currentPath), path);
+        compress = HasGzipExtension(path);
     } else {
         StringCchCopyW(path, ARRAYSIZE(path), g_app.currentPath);
     }
 
+    // Save straight from the edit control's own buffer instead of copying
+    // the whole document out with GetWindowTextW.
     int len = GetWindowTextLengthW(g_app.hwndEdit);
-    WCHAR *buffer = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (len + 1) * sizeof(WCHAR));
-    if (!buffer) return FALSE;
-    GetWindowTextW(g_app.hwndEdit, buffer, len + 1);
-
-    BOOL ok = SaveTextFile(hwnd, path, buffer, len, g_app.encoding);
-    HeapFree(GetProcessHeap(), 0, buffer);
+    HLOCAL handle = (HLOCAL)SendMessageW(g_app.hwndEdit, EM_GETHANDLE, 0, 0);
+    const WCHAR *text = handle ? (const WCHAR *)LocalLock(handle) : NULL;
+    if (!text) return FALSE;
+
+    SaveTimings timings = {0};
+    BOOL ok = SaveTextFile(hwnd, path, text, (size_t)len, g_app.encoding, g_app.codePage, compress, g_app.saveDurability,
+                           &g_app.baseline, &g_app.fingerprint, &timings);
+    LocalUnlock(handle);
+    WCHAR line[192];
+    StringCchPrintfW(line, ARRAYSIZE(line), L"Save: %s write=%.1fms flush=%.1fms rename=%.1fms history=%lluKB",
+                     !ok ? L"failed" : timings.skipped ? L"skipped" : L"ok", timings.writeMs, timings.flushMs,
+                     timings.renameMs, timings.historyBytes / 1024);
+    DebugLog(line);
     if (ok) {
         SendMessageW(g_app.hwndEdit, EM_SETMODIFY, FALSE, 0);
         g_app.modified = FALSE;
+        g_app.compressed = compress;
+        if (compress) g_app.followTail = FALSE;
+        // Follow from the end of what was just written, at its new path.
+        StopFollowing(hwnd);
+        if (!QueryFileSize(path, &g_app.fileBytes)) g_app.fileBytes = 0;
+        if (g_app.followTail) StartFollowing(hwnd);
+        StopJournal();
         UpdateTitle(hwnd);
+    } else if (g_app.journal) {
+        g_app.journalStale = TRUE; // the file it was kept against may be half written
     }
     return ok;
 }
 
 static void DoFileNew(HWND hwnd) {
     if (!PromptSaveChanges(hwnd)) return;
-    SetWindowTextW(g_app.hwndEdit, L"");
-    g_app.currentPath[0] = L'\0';
-    g_app.encoding = ENC_UTF8;
-    SendMessageW(g_app.hwndEdit, EM_SETMODIFY, FALSE, 0);
-    g_app.modified = FALSE;
-    UpdateTitle(hwnd);
-    UpdateStatusBar(hwnd);
+    AbortDocumentLoad(hwnd);
+    ResetToUntitled(hwnd);
 }
 
 static void SetWordWrap(HWND hwnd, BOOL enabled) {
-    if (g_app.wordWrap == enabled) return;
+    if (g_app.wordWrap == enabled || g_app.loadJob) return;
     HWND edit = g_app.hwndEdit;
     WCHAR *text = NULL;
     int len = 0;
@@ -435,8 +1347,21 @@ static void SetWordWrap(HWND hwnd, BOOL enabled) {
 
     g_app.wordWrap = enabled;
     CreateEditControl(hwnd);
+    // Same text in a new control: not an edit as far as saving is concerned.
+    SaveBaseline *baseline = g_app.baseline;
+    TextLineIndex lines = g_app.lines;
+    BOOL journalStale = g_app.journalStale;
+    TextPieceTable pieces = g_app.pieces;
+    g_app.baseline = NULL;
+    ZeroMemory(&g_app.lines, sizeof(g_app.lines));
+    TextPieceTableInit(&g_app.pieces);
     SetWindowTextW(g_app.hwndEdit, text);
+    g_app.baseline = baseline;
+    g_app.lines = lines;
+    g_app.journalStale = journalStale;
+    g_app.pieces = pieces;
     SendMessageW(g_app.hwndEdit, EM_SETSEL, start, end);
+    if (g_app.followed) SendMessageW(g_app.hwndEdit, EM_SETREADONLY, TRUE, 0);
     HeapFree(GetProcessHeap(), 0, text);
 
     if (enabled) {
@@ -453,14 +1378,64 @@ static void SetWordWrap(HWND hwnd, BOOL enabled) {
     UpdateStatusBar(hwnd);
 }
 
+// Scans the control's text into a new line index after a rewrite (undo,
+// Replace All) dropped the old one. Posted rather than done on the spot, so
+// a load that sets the text and then its own index never pays for a scan.
+static void RebuildLineIndex(HWND hwnd) {
+    if (!g_app.linesStale) return;
+    g_app.linesStale = FALSE;
+    if (g_app.lines.lines > 0 || g_app.loadJob || g_app.reloading || g_app.pagedFile) return;
+    HLOCAL handle;
+    size_t length;
+    const WCHAR *text = LockEditText(&handle, &length);
+    if (!text) return;
+    TextLineIndexAppend(&g_app.lines, (const uint16_t *)text, length);
+    TextLineIndexFinish(&g_app.lines);
+    LocalUnlock(handle);
+    if (!g_app.lines.complete) {
+        TextLineIndexFree(&g_app.lines);
+        return;
+    }
+    CheckLineIndexBreaks();
+    UpdateStatusBar(hwnd);
+}
+
 static void UpdateStatusBar(HWND hwnd) {
     (void)hwnd;
     if (!g_app.statusVisible || !g_app.hwndStatus) return;
+    if (g_app.pagedFile) {
+        WCHAR position[128];
+        StringCchPrintfW(position, ARRAYSIZE(position), L"Read-only view    %u%%", PagerViewPercent(g_app.hwndPager));
+        SendMessageW(g_app.hwndStatus, SB_SETTEXT, SBT_NOBORDERS, (LPARAM)position);
+        return;
+    }
+    if (g_app.loadJob) {
+        WCHAR progress[128];
+        ULONGLONG pct = g_app.loadBytesTotal ? g_app.loadBytesDone * 100 / g_app.loadBytesTotal : 0;
+        StringCchPrintfW(progress, ARRAYSIZE(progress), L"Loading... %u%%    (Esc to cancel)", (UINT)pct);
+        SendMessageW(g_app.hwndStatus, SB_SETTEXT, SBT_NOBORDERS, (LPARAM)progress);
+        return;
+    }
     DWORD selStart = 0, selEnd = 0;
     SendMessageW(g_app.hwndEdit, EM_GETSEL, (WPARAM)&selStart, (LPARAM)&selEnd);
-    int line = (int)SendMessageW(g_app.hwndEdit, EM_LINEFROMCHAR, selStart, 0) + 1;
-    int col = (int)(selStart - SendMessageW(g_app.hwndEdit, EM_LINEINDEX, line - 1, 0)) + 1;
-    int lines = (int)SendMessageW(g_app.hwndEdit, EM_GETLINECOUNT, 0, 0);
+    // The line index answers without walking the control's text: edits
+    // keep it current, and only a rewrite drops it until it is rebuilt.
+    size_t indexLine = 0, lineCount = 0;
+    uint64_t lineStart = 0;
+    int line, col, lines;
+    if (TextLineIndexLineFromOffset(&g_app.lines, selStart, &indexLine) &&
+        TextLineIndexLineStart(&g_app.lines, indexLine, &lineStart)) {
+        line = (int)indexLine + 1;
+        col = (int)(selStart - lineStart) + 1;
+    } else {
+        line = (int)SendMessageW(g_app.hwndEdit, EM_LINEFROMCHAR, selStart, 0) + 1;
+        col = (int)(selStart - SendMessageW(g_app.hwndEdit, EM_LINEINDEX, line - 1, 0)) + 1;
+    }
+    if (TextLineIndexCount(&g_app.lines, &lineCount)) {
+        lines = (int)lineCount;
+    } else {
+        lines = (int)SendMessageW(g_app.hwndEdit, EM_GETLINECOUNT, 0, 0);
+    }
 
     WCHAR status[128];
     StringCchPrintfW(status, ARRAYSIZE(status), L"Ln %d, Col %d    Lines: %d", line, col, lines);
@@ -541,9 +1516,14 @@ static INT_PTR CALLBACK GoToDlgProc(HWND dlg, UINT msg, WPARAM wParam, LPARAM lP
                 MessageBoxW(dlg, L"Enter a valid line number.", APP_TITLE, MB_ICONWARNING);
                 return TRUE;
             }
-            int maxLine = (int)SendMessageW(g_app.hwndEdit, EM_GETLINECOUNT, 0, 0);
+            size_t lineCount = 0;
+            uint64_t lineStart = 0;
+            int maxLine = TextLineIndexCount(&g_app.lines, &lineCount) ? (int)lineCount
+                                                                      : (int)SendMessageW(g_app.hwndEdit, EM_GETLINECOUNT, 0, 0);
             if ((int)line > maxLine) line = (UINT)maxLine;
-            int charIndex = (int)SendMessageW(g_app.hwndEdit, EM_LINEINDEX, line - 1, 0);
+            int charIndex = TextLineIndexLineStart(&g_app.lines, line - 1, &lineStart)
+                                ? (int)lineStart
+                                : (int)SendMessageW(g_app.hwndEdit, EM_LINEINDEX, line - 1, 0);
             if (charIndex >= 0) {
                 SendMessageW(g_app.hwndEdit, EM_SETSEL, charIndex, charIndex);
                 SendMessageW(g_app.hwndEdit, EM_SCROLLCARET, 0, 0);
@@ -560,6 +1540,189 @@ static INT_PTR CALLBACK GoToDlgProc(HWND dlg, UINT msg, WPARAM wParam, LPARAM lP
     return FALSE;
 }
 
+// What File > Split asked for; kept between uses of the dialog.
+typedef struct SplitRequest {
+    TextSplitMode mode;
+    UINT sizeMB;
+    UINT lines;
+    WCHAR pattern[128];
+} SplitRequest;
+
+static SplitRequest g_splitRequest = {TEXT_SPLIT_BYTES, 100, 1000000, L""};
+
+static INT_PTR CALLBACK SplitDlgProc(HWND dlg, UINT msg, WPARAM wParam, LPARAM lParam) {
+    (void)lParam;
+    switch (msg) {
+    case WM_INITDIALOG:
+        SetDlgItemInt(dlg, IDC_SPLIT_SIZE, g_splitRequest.sizeMB, FALSE);
+        SetDlgItemInt(dlg, IDC_SPLIT_LINES, g_splitRequest.lines, FALSE);
+        SetDlgItemTextW(dlg, IDC_SPLIT_MATCH, g_splitRequest.pattern);
+        SendDlgItemMessageW(dlg, IDC_SPLIT_MATCH, EM_SETLIMITTEXT, ARRAYSIZE(g_splitRequest.pattern) - 1, 0);
+        CheckRadioButton(dlg, IDC_SPLIT_BY_SIZE, IDC_SPLIT_BY_MATCH,
+                         g_splitRequest.mode == TEXT_SPLIT_LINES   ? IDC_SPLIT_BY_LINES
+                         : g_splitRequest.mode == TEXT_SPLIT_MATCH ? IDC_SPLIT_BY_MATCH
+                                                                   : IDC_SPLIT_BY_SIZE);
+        return TRUE;
+    case WM_COMMAND:
+        switch (LOWORD(wParam)) {
+        case IDOK: {
+            SplitRequest request = g_splitRequest;
+            BOOL ok = FALSE;
+            if (IsDlgButtonChecked(dlg, IDC_SPLIT_BY_LINES) == BST_CHECKED) {
+                request.mode = TEXT_SPLIT_LINES;
+                request.lines = GetDlgItemInt(dlg, IDC_SPLIT_LINES, &ok, FALSE);
+                ok = ok && request.lines > 0;
+            } else if (IsDlgButtonChecked(dlg, IDC_SPLIT_BY_MATCH) == BST_CHECKED) {
+                request.mode = TEXT_SPLIT_MATCH;
+                GetDlgItemTextW(dlg, IDC_SPLIT_MATCH, request.pattern, ARRAYSIZE(request.pattern));
+                ok = request.pattern[0] != L'\0';
+            } else {
+                request.mode = TEXT_SPLIT_BYTES;
+                request.sizeMB = GetDlgItemInt(dlg, IDC_SPLIT_SIZE, &ok, FALSE);
+                ok = ok && request.sizeMB > 0;
+            }
+            if (!ok) {
+                MessageBoxW(dlg, L"Enter a size, a line count or text to split at.", APP_TITLE, MB_ICONWARNING);
+                return TRUE;
+            }
+            g_splitRequest = request;
+            EndDialog(dlg, IDOK);
+            return TRUE;
+        }
+        case IDCANCEL:
+            EndDialog(dlg, IDCANCEL);
+            return TRUE;
+        }
+        break;
+    }
+    return FALSE;
+}
+
+// Split and join read the files from disk, not the document, so they work
+// on files far too large to open.
+static void DoSplitFile(HWND hwnd) {
+    if (g_app.splitJob) return;
+    WCHAR path[MAX_PATH_BUFFER];
+    if (!OpenFileDialog(hwnd, path, ARRAYSIZE(path))) return;
+    if (DialogBoxW(g_hInst, MAKEINTRESOURCE(IDD_SPLIT), hwnd, SplitDlgProc) != IDOK) return;
+    ULONGLONG limit = g_splitRequest.mode == TEXT_SPLIT_LINES ? g_splitRequest.lines
+                                                              : (ULONGLONG)g_splitRequest.sizeMB * 1024 * 1024;
+    g_app.splitJob = BeginSplitTextFile(hwnd, path, g_splitRequest.mode, limit, g_splitRequest.pattern);
+    g_app.splitJoining = FALSE;
+}
+
+static void DoJoinFiles(HWND hwnd) {
+    if (g_app.splitJob) return;
+    WCHAR **parts = (WCHAR **)HeapAlloc(GetProcessHeap(), 0, JOIN_MAX_PARTS * sizeof(WCHAR *));
+    if (!parts) return;
+    UINT count = OpenFilesDialog(hwnd, parts, JOIN_MAX_PARTS);
+    WCHAR target[MAX_PATH_BUFFER] = L"";
+    if (count > 0 && SaveFileDialog(hwnd, target, ARRAYSIZE(target))) {
+        g_app.splitJob = BeginJoinTextFiles(hwnd, (LPCWSTR const *)parts, count, target);
+        g_app.splitJoining = TRUE;
+    }
+    FreeFileList(parts, count);
+    HeapFree(GetProcessHeap(), 0, parts);
+}
+
+static void OnSplitDone(HWND hwnd, SplitJob *job) {
+    if (job != g_app.splitJob) return;
+    g_app.splitJob = NULL;
+    UINT count = 0;
+    ULONGLONG bytes = 0;
+    if (!EndSplitJob(hwnd, job, &count, &bytes)) return;
+    WCHAR message[128];
+    StringCchPrintfW(message, ARRAYSIZE(message), g_app.splitJoining ? L"Joined %u files (%llu MB)."
+                                                                     : L"Split into %u files (%llu MB).",
+                     count, (bytes + 512 * 1024) / (1024 * 1024));
+    MessageBoxW(hwnd, message, APP_TITLE, MB_ICONINFORMATION);
+}
+
+static void AbortSplitJob(HWND hwnd) {
+    if (!g_app.splitJob) return;
+    CancelSplitJob(g_app.splitJob);
+    EndSplitJob(hwnd, g_app.splitJob, NULL, NULL);
+    g_app.splitJob = NULL;
+}
+
+typedef struct HistoryDialog {
+    const FileVersion *versions;
+    UINT count;
+    UINT chosen;
+} HistoryDialog;
+
+static INT_PTR CALLBACK HistoryDlgProc(HWND dlg, UINT msg, WPARAM wParam, LPARAM lParam) {
+    HistoryDialog *dialog = (HistoryDialog *)GetWindowLongPtrW(dlg, DWLP_USER);
+    switch (msg) {
+    case WM_INITDIALOG: {
+        dialog = (HistoryDialog *)lParam;
+        SetWindowLongPtrW(dlg, DWLP_USER, (LONG_PTR)dialog);
+        HWND list = GetDlgItem(dlg, IDC_HISTORY_LIST);
+        for (UINT i = dialog->count; i-- > 0;) { // newest first
+            const FileVersion *version = &dialog->versions[i];
+            SYSTEMTIME utc, local;
+            WCHAR date[64] = L"", time[64] = L"", row[192];
+            if (FileTimeToSystemTime(&version->saved, &utc) && SystemTimeToTzSpecificLocalTime(NULL, &utc, &local)) {
+                GetDateFormatW(LOCALE_USER_DEFAULT, DATE_SHORTDATE, &local, NULL, date, ARRAYSIZE(date));
+                GetTimeFormatW(LOCALE_USER_DEFAULT, 0, &local, NULL, time, ARRAYSIZE(time));
+            }
+            StringCchPrintfW(row, ARRAYSIZE(row), L"%s %s    %llu KB%s", date, time, (version->size + 1023) / 1024,
+                             version->compressed ? L" (gzip)" : L"");
+            LRESULT item = SendMessageW(list, LB_ADDSTRING, 0, (LPARAM)row);
+            if (item >= 0) SendMessageW(list, LB_SETITEMDATA, (WPARAM)item, (LPARAM)i);
+        }
+        SendMessageW(list, LB_SETCURSEL, 0, 0);
+        return TRUE;
+    }
+    case WM_COMMAND:
+        switch (LOWORD(wParam)) {
+        case IDC_HISTORY_LIST:
+            if (HIWORD(wParam) != LBN_DBLCLK) break;
+            // fall through
+        case IDOK: {
+            LRESULT item = SendDlgItemMessageW(dlg, IDC_HISTORY_LIST, LB_GETCURSEL, 0, 0);
+            if (item == LB_ERR) return TRUE;
+            dialog->chosen = (UINT)SendDlgItemMessageW(dlg, IDC_HISTORY_LIST, LB_GETITEMDATA, (WPARAM)item, 0);
+            EndDialog(dlg, IDOK);
+            return TRUE;
+        }
+        case IDCANCEL:
+            EndDialog(dlg, IDCANCEL);
+            return TRUE;
+        }
+        break;
+    }
+    return FALSE;
+}
+
+// Lists the saved versions of the current file and writes the chosen one
+// out, over the file itself (reloading it) or anywhere else.
+static void DoFileHistory(HWND hwnd) {
+    if (g_app.currentPath[0] == L'\0' || g_app.loadJob) return;
+    WCHAR path[MAX_PATH_BUFFER];
+    StringCchCopyW(path, ARRAYSIZE(path), g_app.currentPath);
+    FileVersion *versions = NULL;
+    HistoryDialog dialog = {NULL, 0, 0};
+    dialog.count = ListFileVersions(path, &versions);
+    dialog.versions = versions;
+    if (dialog.count == 0) {
+        MessageBoxW(hwnd, L"No saved versions of this file yet.", APP_TITLE, MB_ICONINFORMATION);
+        return;
+    }
+    WCHAR target[MAX_PATH_BUFFER];
+    StringCchCopyW(target, ARRAYSIZE(target), path);
+    if (DialogBoxParamW(g_hInst, MAKEINTRESOURCE(IDD_HISTORY), hwnd, HistoryDlgProc, (LPARAM)&dialog) == IDOK &&
+        SaveFileDialog(hwnd, target, ARRAYSIZE(target))) {
+        BOOL current = lstrcmpiW(target, path) == 0;
+        if (!current || PromptSaveChanges(hwnd)) {
+            if (RestoreFileVersion(hwnd, path, &versions[dialog.chosen], target) && current) {
+                LoadDocumentFromPath(hwnd, target);
+            }
+        }
+    }
+    FreeFileVersions(versions);
+}
+
 static void DoSelectFont(HWND hwnd) {
     LOGFONTW lf = {0};
     if (g_app.hFont) {
@@ -582,6 +1745,7 @@ static void DoSelectFont(HWND hwnd) {
             g_app.fontIsDefault = FALSE;
             g_app.fontDpi = GetWindowDpi(hwnd);
             ApplyFontToEdit(g_app.hwndEdit, g_app.hFont);
+            if (g_app.hwndPager) PagerViewSetFont(g_app.hwndPager, g_app.hFont);
             UpdateLayout(hwnd);
         }
     }
@@ -665,6 +1829,8 @@ static void HandleFindReplace(LPFINDREPLACE lpfr) {
         } else {
             MessageBoxW(g_app.hwndMain, L"Cannot find the text.", APP_TITLE, MB_ICONINFORMATION);
         }
+    } else if (g_app.loadJob) {
+        return; // no replacing until the document has finished loading
     } else if (lpfr->Flags & FR_REPLACE) {
         DWORD start = 0, end = 0;
         SendMessageW(g_app.hwndEdit, EM_GETSEL, (WPARAM)&start, (LPARAM)&end);
@@ -694,6 +1860,9 @@ static void UpdateMenuStates(HWND hwnd) {
     UINT statusState = g_app.statusVisible ? MF_CHECKED : MF_UNCHECKED;
     CheckMenuItem(menu, IDM_FORMAT_WORD_WRAP, MF_BYCOMMAND | wrapState);
     CheckMenuItem(menu, IDM_VIEW_STATUS_BAR, MF_BYCOMMAND | statusState);
+    CheckMenuItem(menu, IDM_VIEW_FOLLOW_TAIL, MF_BYCOMMAND | (g_app.followTail ? MF_CHECKED : MF_UNCHECKED));
+    BOOL canFollow = g_app.currentPath[0] != L'\0' && !g_app.pagedFile && !g_app.compressed;
+    EnableMenuItem(menu, IDM_VIEW_FOLLOW_TAIL, MF_BYCOMMAND | (canFollow ? MF_ENABLED : MF_GRAYED));
 
     BOOL canGoTo = !g_app.wordWrap;
     EnableMenuItem(menu, IDM_EDIT_GOTO, MF_BYCOMMAND | (canGoTo ? MF_ENABLED : MF_GRAYED));
@@ -705,10 +1874,53 @@ static void UpdateMenuStates(HWND hwnd) {
 
     BOOL modified = (SendMessageW(g_app.hwndEdit, EM_GETMODIFY, 0, 0) != 0);
     EnableMenuItem(menu, IDM_FILE_SAVE, MF_BYCOMMAND | (modified ? MF_ENABLED : MF_GRAYED));
+
+    UINT idleState = (g_app.loadJob || g_app.pagedFile) ? MF_GRAYED : MF_ENABLED;
+    EnableMenuItem(menu, IDM_FILE_SAVE_AS, MF_BYCOMMAND | idleState);
+    EnableMenuItem(menu, IDM_FILE_PRINT, MF_BYCOMMAND | idleState);
+    EnableMenuItem(menu, IDM_FORMAT_WORD_WRAP, MF_BYCOMMAND | idleState);
+    UINT splitState = g_app.splitJob ? MF_GRAYED : MF_ENABLED;
+    EnableMenuItem(menu, IDM_FILE_SPLIT, MF_BYCOMMAND | splitState);
+    EnableMenuItem(menu, IDM_FILE_JOIN, MF_BYCOMMAND | splitState);
+    BOOL canHistory = g_app.currentPath[0] != L'\0' && !g_app.loadJob && !g_app.pagedFile;
+    EnableMenuItem(menu, IDM_FILE_HISTORY, MF_BYCOMMAND | (canHistory ? MF_ENABLED : MF_GRAYED));
+
+    static const UINT editCommands[] = {
+        IDM_EDIT_UNDO, IDM_EDIT_CUT, IDM_EDIT_COPY, IDM_EDIT_PASTE, IDM_EDIT_DELETE, IDM_EDIT_FIND,
+        IDM_EDIT_FIND_NEXT, IDM_EDIT_REPLACE, IDM_EDIT_SELECT_ALL, IDM_EDIT_TIME_DATE,
+    };
+    UINT editState = g_app.pagedFile ? MF_GRAYED : MF_ENABLED;
+    for (size_t i = 0; i < ARRAYSIZE(editCommands); ++i) {
+        EnableMenuItem(menu, editCommands[i], MF_BYCOMMAND | editState);
+    }
+    if (g_app.pagedFile) {
+        EnableMenuItem(menu, IDM_FILE_SAVE, MF_BYCOMMAND | MF_GRAYED);
+        EnableMenuItem(menu, IDM_EDIT_GOTO, MF_BYCOMMAND | MF_GRAYED);
+    }
+}
+
+// Commands that make sense while the read-only paged view is showing.
+static BOOL AllowedWhilePaged(UINT id) {
+    switch (id) {
+    case IDM_FILE_NEW:
+    case IDM_FILE_OPEN:
+    case IDM_FILE_PAGE_SETUP:
+    case IDM_FILE_SPLIT:
+    case IDM_FILE_JOIN:
+    case IDM_FILE_EXIT:
+    case IDM_FORMAT_FONT:
+    case IDM_VIEW_STATUS_BAR:
+    case IDM_HELP_VIEW_HELP:
+    case IDM_HELP_ABOUT:
+        return TRUE;
+    }
+    return FALSE;
 }
 
 static void HandleCommand(HWND hwnd, WPARAM wParam, LPARAM lParam) {
     (void)lParam;
+    // The hidden edit control must not pick up edits behind the viewer.
+    if (g_app.pagedFile && !AllowedWhilePaged(LOWORD(wParam))) return;
     switch (LOWORD(wParam)) {
     case IDM_FILE_NEW:
         DoFileNew(hwnd);
@@ -726,7 +1938,16 @@ static void HandleCommand(HWND hwnd, WPARAM wParam, LPARAM lParam) {
         DoPageSetup(hwnd);
         break;
     case IDM_FILE_PRINT:
-        DoPrint(hwnd);
+        if (!g_app.loadJob) DoPrint(hwnd);
+        break;
+    case IDM_FILE_SPLIT:
+        DoSplitFile(hwnd);
+        break;
+    case IDM_FILE_JOIN:
+        DoJoinFiles(hwnd);
+        break;
+    case IDM_FILE_HISTORY:
+        DoFileHistory(hwnd);
         break;
     case IDM_FILE_EXIT:
         PostMessageW(hwnd, WM_CLOSE, 0, 0);
@@ -781,6 +2002,10 @@ static void HandleCommand(HWND hwnd, WPARAM wParam, LPARAM lParam) {
         ToggleStatusBar(hwnd, !g_app.statusVisible);
         break;
 
+    case IDM_VIEW_FOLLOW_TAIL:
+        ToggleFollowTail(hwnd);
+        break;
+
     case IDM_HELP_VIEW_HELP:
         ShowHelp(hwnd);
         break;
@@ -820,10 +2045,12 @@ static LRESULT CALLBACK MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM l
         UpdateTitle(hwnd);
         UpdateStatusBar(hwnd);
         DragAcceptFiles(hwnd, TRUE);
+        if (g_app.journalEnabled) SetTimer(hwnd, JOURNAL_TIMER_ID, JOURNAL_CHECK_MS, NULL);
         return 0;
     }
     case WM_SETFOCUS:
-        if (g_app.hwndEdit) SetFocus(g_app.hwndEdit);
+        if (g_app.pagedFile) SetFocus(g_app.hwndPager);
+        else if (g_app.hwndEdit) SetFocus(g_app.hwndEdit);
         return 0;
     case WM_SIZE:
         UpdateLayout(hwnd);
@@ -864,6 +2091,7 @@ static LRESULT CALLBACK MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM l
         if (g_app.hwndEdit && g_app.hFont) {
             ApplyFontToEdit(g_app.hwndEdit, g_app.hFont);
         }
+        if (g_app.hwndPager) PagerViewSetFont(g_app.hwndPager, g_app.hFont);
         UpdateLayout(hwnd);
         UpdateStatusBar(hwnd);
         return 0;
@@ -871,6 +2099,13 @@ static LRESULT CALLBACK MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM l
     case WM_APP_TEST_PRINT:
         TriggerTest(hwnd);
         return 0;
+    case WM_APP_STARTUP:
+        // Recovered changes take the place of the last clean session.
+        if (!OfferRecovery(hwnd) && g_app.sessionEnabled) RestoreSession(hwnd);
+        return 0;
+    case WM_APP_REINDEX:
+        RebuildLineIndex(hwnd);
+        return 0;
     case WM_DROPFILES: {
         HDROP hDrop = (HDROP)wParam;
         WCHAR path[MAX_PATH_BUFFER];
@@ -882,8 +2117,23 @@ static LRESULT CALLBACK MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM l
         DragFinish(hDrop);
         return 0;
     }
+    case WM_APP_LOAD_CHUNK:
+        OnLoadChunk(hwnd, (LoadJob *)wParam, (LoadChunk *)lParam);
+        return 0;
+    case WM_APP_LOAD_DONE:
+        OnLoadDone(hwnd, (LoadJob *)lParam);
+        return 0;
+    case WM_APP_SPLIT_DONE:
+        OnSplitDone(hwnd, (SplitJob *)lParam);
+        return 0;
     case WM_COMMAND:
         if (HIWORD(wParam) == EN_CHANGE && (HWND)lParam == g_app.hwndEdit) {
+            if (g_app.loadJob || g_app.followed) return 0; // appends from the loader or follower are not edits
+            // The control changed its text without any message the edit
+            // tracking knows (an IME result inside WM_IME_COMPOSITION, say):
+            // the clean ranges, journal, pieces and line index can no longer
+            // be trusted. Saving verbatim bytes over the edit would lose it.
+            if (!g_app.editTracked && TracksEdits()) NoteDocumentRewrite();
             g_app.modified = (SendMessageW(g_app.hwndEdit, EM_GETMODIFY, 0, 0) != 0);
             UpdateTitle(hwnd);
             UpdateStatusBar(hwnd);
@@ -891,18 +2141,43 @@ static LRESULT CALLBACK MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM l
         } else if (HIWORD(wParam) == EN_UPDATE && (HWND)lParam == g_app.hwndEdit) {
             UpdateStatusBar(hwnd);
             return 0;
+        } else if (HIWORD(wParam) == PVN_SCROLL && (HWND)lParam == g_app.hwndPager) {
+            UpdateStatusBar(hwnd);
+            return 0;
         }
         HandleCommand(hwnd, wParam, lParam);
         return 0;
     case WM_INITMENUPOPUP:
         UpdateMenuStates(hwnd);
         return 0;
+    case WM_ACTIVATEAPP:
+        if (wParam) CheckForExternalChange(hwnd);
+        return 0;
     case WM_CLOSE:
         if (PromptSaveChanges(hwnd)) {
+            if (g_app.sessionEnabled && !g_app.testMode) SaveSessionSnapshot();
+            AbortDocumentLoad(hwnd);
             DestroyWindow(hwnd);
         }
         return 0;
+    case WM_TIMER:
+        if (wParam == FOLLOW_TIMER_ID) {
+            OnFollowTimer(hwnd);
+            return 0;
+        }
+        if (wParam == JOURNAL_TIMER_ID) {
+            OnJournalTimer();
+            return 0;
+        }
+        break;
     case WM_DESTROY:
+        KillTimer(hwnd, JOURNAL_TIMER_ID);
+        StopJournal(); // closing means the changes were saved or discarded
+        StopFollowing(hwnd);
+        AbortDocumentLoad(hwnd);
+        AbortSplitJob(hwnd);
+        ClosePagedDocument();
+        TextPieceTableFree(&g_app.pieces);
         if (g_app.hDevMode) GlobalFree(g_app.hDevMode);
         if (g_app.hDevNames) GlobalFree(g_app.hDevNames);
         if (g_app.hFont) DeleteObject(g_app.hFont);
@@ -913,10 +2188,58 @@ static LRESULT CALLBACK MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM l
     return DefWindowProcW(hwnd, msg, wParam, lParam);
 }
 
+// Lets an editing message through and records which stretch of text it
+// touched: the change always lies between the earlier of the old and new
+// selection starts and the new selection end.
+static LRESULT TrackEditMessage(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    DWORD startBefore = 0, endBefore = 0, startAfter = 0, endAfter = 0;
+    StartJournal();
+    size_t lengthBefore = (size_t)GetWindowTextLengthW(hwnd);
+    SendMessageW(hwnd, EM_GETSEL, (WPARAM)&startBefore, (LPARAM)&endBefore);
+    // EN_CHANGE arrives while the control handles the message; any other
+    // EN_CHANGE is a change nothing tracked.
+    BOOL outer = g_app.editTracked;
+    g_app.editTracked = TRUE;
+    LRESULT result = DefSubclassProc(hwnd, msg, wParam, lParam);
+    g_app.editTracked = outer;
+    SendMessageW(hwnd, EM_GETSEL, (WPARAM)&startAfter, (LPARAM)&endAfter);
+    DWORD lo = min(startBefore, startAfter);
+    size_t lengthAfter = (size_t)GetWindowTextLengthW(hwnd);
+    NoteBaselineEdit(g_app.baseline, lo, max(endAfter, lo), lengthAfter);
+    NoteDocumentEdit(lo, max(endAfter, lo), lengthBefore, lengthAfter);
+    return result;
+}
+
 static LRESULT CALLBACK EditSubclassProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam, UINT_PTR id, DWORD_PTR data) {
     (void)id;
     (void)data;
     switch (msg) {
+    case WM_KEYDOWN:
+        if (wParam == VK_ESCAPE && g_app.loadJob) {
+            CancelLoadTextFile(g_app.loadJob);
+            return 0;
+        }
+        if (TracksEdits() && (wParam == VK_DELETE || wParam == VK_INSERT)) {
+            return TrackEditMessage(hwnd, msg, wParam, lParam);
+        }
+        break;
+    case WM_CHAR:
+    case WM_IME_CHAR:
+    case WM_CUT:
+    case WM_PASTE:
+    case WM_CLEAR:
+    case EM_REPLACESEL:
+        if (!TracksEdits()) break;
+        if (msg == WM_CHAR && wParam == 0x1A) { // Ctrl+Z undoes inside the control
+            NoteDocumentRewrite();
+            break;
+        }
+        return TrackEditMessage(hwnd, msg, wParam, lParam);
+    case WM_SETTEXT:
+    case WM_UNDO:
+    case EM_UNDO:
+        NoteDocumentRewrite();
+        break;
     case WM_KEYUP:
     case WM_LBUTTONUP:
     case WM_RBUTTONUP:
@@ -928,7 +2251,7 @@ static LRESULT CALLBACK EditSubclassProc(HWND hwnd, UINT msg, WPARAM wParam, LPA
     case WM_KILLFOCUS:
     case EM_SETSEL: {
         HWND parent = GetParent(hwnd);
-        if (parent) UpdateStatusBar(parent);
+        if (parent && !g_app.reloading) UpdateStatusBar(parent); // once at the end, not per patch
         break;
     }
     }
@@ -943,6 +2266,31 @@ static void ParseTestFlag(void) {
     for (int i = 0; i < argc; ++i) {
         if (_wcsicmp(argv[i], L"/test") == 0 || _wcsicmp(argv[i], L"-test") == 0 || _wcsicmp(argv[i], L"--test") == 0) {
             g_app.testMode = TRUE;
+        } else if (_wcsicmp(argv[i], L"/durability:inplace") == 0) {
+            g_app.saveDurability = SAVE_DURABILITY_IN_PLACE;
+        } else if (_wcsicmp(argv[i], L"/durability:atomic") == 0) {
+            g_app.saveDurability = SAVE_DURABILITY_ATOMIC;
+        } else if (_wcsicmp(argv[i], L"/durability:flushed") == 0) {
+            g_app.saveDurability = SAVE_DURABILITY_FLUSHED;
+        } else if (_wcsnicmp(argv[i], L"/pagedview:", 11) == 0) {
+            // Size in MB from which files open in the read-only paged view; 0 turns it off.
+            g_app.pagedThreshold = (ULONGLONG)_wtoi(argv[i] + 11) * 1024 * 1024;
+        } else if (_wcsnicmp(argv[i], L"/doccache:", 10) == 0) {
+            // Memory in MB for recently decoded documents; 0 turns the cache off.
+            SetDocumentCacheBudget((SIZE_T)_wtoi(argv[i] + 10) * 1024 * 1024);
+        } else if (_wcsnicmp(argv[i], L"/codepage:", 10) == 0) {
+            // Code page for ANSI files, e.g. 1252 or 28592 (ISO-8859-2); 0 is the system's.
+            UINT codePage = (UINT)_wtoi(argv[i] + 10);
+            if (codePage == 0 || TextCodePageKnown(codePage) || IsValidCodePage(codePage)) SetAnsiCodePage(codePage);
+        } else if (_wcsicmp(argv[i], L"/history:off") == 0) {
+            // Saves are not recorded in the version history.
+            SetHistoryEnabled(FALSE);
+        } else if (_wcsicmp(argv[i], L"/journal:off") == 0) {
+            // Unsaved changes are not journaled for crash recovery.
+            g_app.journalEnabled = FALSE;
+        } else if (_wcsicmp(argv[i], L"/session:off") == 0) {
+            // Start empty and do not keep the session on exit.
+            g_app.sessionEnabled = FALSE;
         }
     }
     LocalFree(argv);
@@ -969,12 +2317,17 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
     g_app.statusVisible = TRUE;
     g_app.statusBeforeWrap = TRUE;
     g_app.encoding = ENC_UTF8;
+    g_app.saveDurability = SAVE_DURABILITY_FLUSHED;
+    g_app.pagedThreshold = PAGED_THRESHOLD_DEFAULT;
+    SetDocumentCacheBudget(DOC_CACHE_DEFAULT_BYTES);
     g_app.findFlags = FR_DOWN;
     g_app.marginsThousandths.left = g_app.marginsThousandths.right = 500;   // 0.50"
     g_app.marginsThousandths.top = g_app.marginsThousandths.bottom = 750;   // 0.75"
     StringCchCopyW(g_app.headerText, ARRAYSIZE(g_app.headerText), L"&f");
     StringCchCopyW(g_app.footerText, ARRAYSIZE(g_app.footerText), L"Page &p of &P");
     g_app.testMode = FALSE;
+    g_app.journalEnabled = TRUE;
+    g_app.sessionEnabled = TRUE;
     ParseTestFlag();
 
     WNDCLASSEXW wc = {0};
@@ -1008,6 +2361,8 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
     UpdateWindow(hwnd);
     if (g_app.testMode) {
         PostMessageW(hwnd, WM_APP_TEST_PRINT, 0, 0);
+    } else {
+        PostMessageW(hwnd, WM_APP_STARTUP, 0, 0);
     }
 
     HACCEL accel = LoadAcceleratorsW(hInstance, MAKEINTRESOURCE(IDC_RETROPAD));
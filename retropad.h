@@ -2,6 +2,7 @@
 
 #include <windows.h>
 #include "file_io.h"
+#include "text_piece.h"
 
 #define APP_TITLE      L"retropad"
 #define UNTITLED_NAME  L"Untitled"
@@ -28,6 +29,35 @@ typedef struct AppState {
     BOOL statusBeforeWrap;
     BOOL modified;
     TextEncoding encoding;
+    UINT codePage;              // ANSI code page the document was read with
+    SaveDurability saveDurability;
+    LoadJob *loadJob;           // non-NULL while a document streams in
+    BOOL reloading;             // it rereads the open file; see ReloadDocument
+    WCHAR *reloadText;          // the reread text so far, diffed in once complete
+    size_t reloadLength;
+    size_t reloadCapacity;
+    ULONGLONG loadBytesDone;
+    ULONGLONG loadBytesTotal;
+    SaveBaseline *baseline;     // maps unedited text back to the file, or NULL
+    TextLineIndex lines;        // line starts, kept current through edits; see text_lines.h
+    BOOL linesStale;            // a rewrite dropped them; see RebuildLineIndex
+    BOOL editTracked;           // a tracked edit is under way; see TrackEditMessage
+    TextPieceTable pieces;      // the text searches read; valid once built, see DocumentPieces
+    HWND hwndPager;             // read-only view for files over pagedThreshold
+    PagedFile *pagedFile;       // non-NULL while that view is showing a file
+    ULONGLONG pagedThreshold;   // file size that switches to it; 0 never does
+    ULONGLONG fileBytes;        // size of the file the document last matched
+    FileFingerprint fingerprint; // that file's size, time and hash; see CheckForExternalChange
+    BOOL compressed;            // the file is gzip; Save writes it back compressed
+    BOOL followTail;            // View > Follow Tail is on
+    FollowedFile *followed;     // watcher while following, else NULL
+    SplitJob *splitJob;         // File > Split/Join running in the background
+    BOOL splitJoining;          // ...and which of the two it is
+    EditJournal *journal;       // unsaved changes, for crash recovery; see StartJournal
+    BOOL journalStale;          // it missed a change; edits wait for the next checkpoint
+    BOOL journalEnabled;
+    AbandonedJournal *recovery; // replayed once its file has loaded; see FinishRecovery
+    BOOL sessionEnabled;        // restore the last session on launch, keep this one on exit
     FINDREPLACEW find;
     HWND hFindDlg;
     HWND hReplaceDlg;
@@ -39,3 +69,7 @@ typedef struct AppState {
 
 extern AppState g_app;
 extern HINSTANCE g_hInst;
+
+// The document as it is now, for work that outlasts the next edit; see
+// text_piece.h. Release it on the UI thread. NULL if it cannot be had.
+TextPieceSnapshot *SnapshotDocument(void);
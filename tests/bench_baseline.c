@@ -0,0 +1,68 @@
+// Save cost against edit size: a save that copies the unedited head and
+// tail of the old file and encodes only the edited middle, against
+// re-encoding the whole document. The old file is in memory here, so the
+// copies cost a memcpy rather than disk reads.
+#include "check.h"
+#include "text_baseline.h"
+
+#define DOC_UNITS (64u * 1024u * 1024u)
+#define MARK_UNITS (4u * 1024u * 1024u)
+
+int main(void) {
+    uint16_t *text = (uint16_t *)CheckedAlloc((size_t)DOC_UNITS * 2);
+    static const uint16_t line[] = { 'c', 'a', 'f', 0xE9, ' ', 0x65E5, 0x672C, ' ', 'l', 'o', 'g', '\n' };
+    for (size_t i = 0; i < DOC_UNITS; ++i) text[i] = line[i % 12];
+
+    // The file as loaded, with a mark per MARK_UNITS like the loader's chunks.
+    uint8_t *file = (uint8_t *)CheckedAlloc((size_t)DOC_UNITS * 3 + 3);
+    uint8_t *out = (uint8_t *)CheckedAlloc((size_t)DOC_UNITS * 3 + 3);
+    memcpy(file, "\xEF\xBB\xBF", 3);
+    size_t fileSize = 3;
+    TextBaseline map;
+    TextBaselineInit(&map, ENC_UTF8);
+    TextBaselineAddMark(&map, 0, 3);
+    for (size_t pos = 0; pos < DOC_UNITS; pos += MARK_UNITS) {
+        fileSize += TextEncodeUtf8(text + pos, MARK_UNITS, file + fileSize);
+        TextBaselineAddMark(&map, pos + MARK_UNITS, fileSize);
+    }
+    TextBaselineSeal(&map, DOC_UNITS);
+
+    double t0 = NowSeconds();
+    memcpy(out, "\xEF\xBB\xBF", 3);
+    size_t fullSize = 3 + TextEncodeUtf8(text, DOC_UNITS, out + 3);
+    double full = NowSeconds() - t0;
+    CHECK(fullSize == fileSize);
+    printf("document: %u M units, %.0f MB as UTF-8; full re-encode %.1f ms\n", DOC_UNITS >> 20,
+           (double)fileSize / (1024.0 * 1024.0), full * 1e3);
+
+    static const size_t edits[] = { 1, 1000, 1000000, 10000000, 40000000 };
+    for (size_t e = 0; e < sizeof(edits) / sizeof(edits[0]); ++e) {
+        // Retype `edits[e]` units in the middle of the document.
+        size_t at = DOC_UNITS / 2 - edits[e] / 2;
+        TextBaseline edited;
+        TextBaselineCopy(&edited, &map);
+        TextBaselineNoteEdit(&edited, at, at + edits[e], DOC_UNITS);
+
+        t0 = NowSeconds();
+        TextBaselinePlan plan;
+        CHECK(TextBaselinePlanSave(&edited, 3, text, DOC_UNITS, &plan));
+        double planned = NowSeconds() - t0;
+        memcpy(out, file, plan.prefixBytes);
+        size_t size = plan.prefixBytes;
+        double e0 = NowSeconds();
+        size += TextEncodeUtf8(text + plan.middleStart, plan.middleEnd - plan.middleStart, out + size);
+        double encoded = NowSeconds() - e0;
+        memcpy(out + size, file + plan.suffixFrom, plan.suffixTo - plan.suffixFrom);
+        size += plan.suffixTo - plan.suffixFrom;
+        double total = NowSeconds() - t0;
+        CHECK(size == fileSize && memcmp(out, file, size) == 0);
+        printf("edit %9zu units: plan %6.3f ms, encode %8.2f ms (%9zu units), with copies %7.1f ms\n", edits[e],
+               planned * 1e3, encoded * 1e3, (size_t)(plan.middleEnd - plan.middleStart), total * 1e3);
+        TextBaselineFree(&edited);
+    }
+    TextBaselineFree(&map);
+    free(text);
+    free(file);
+    free(out);
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,96 @@
+// Reload diff and apply over a million-line document: a few scattered
+// edits, many, a grown log, and a rewrite that makes the search give up.
+// Apply replays the hunks back to front into one contiguous buffer, moving
+// the tail each time as EM_REPLACESEL does in the edit control, both hunk
+// by hunk and joined into one (what a reload does past RELOAD_MAX_HUNKS).
+// The full reload it replaces copies all of the text (and then re-lays it
+// out, which is not counted here).
+#include "check.h"
+#include "text_diff.h"
+
+#define LINES 1000000u
+#define MAX_EDITS 2000u // RELOAD_MAX_EDITS in retropad.c
+
+static size_t WriteLine(uint16_t *out, size_t line, unsigned version) {
+    char buf[96];
+    int len = snprintf(buf, sizeof(buf), "2024-05-01 12:00:00 INFO request %zu served in %u ms\r\n", line, version);
+    for (int i = 0; i < len; ++i) out[i] = (uint16_t)buf[i];
+    return (size_t)len;
+}
+
+// The document with every `every`-th line changed (none if 0) and `extra`
+// lines appended.
+static size_t MakeDocument(uint16_t *out, size_t every, size_t extra) {
+    size_t n = 0;
+    for (size_t line = 0; line < LINES + extra; ++line) {
+        n += WriteLine(out + n, line, every && line % every == every / 2 ? 1234u : 12u);
+    }
+    return n;
+}
+
+// Patches `old` in `buf` back to front, hunk by hunk; returns the time.
+static double Apply(const TextDiff *diff, const uint16_t *old, size_t oldUnits, const uint16_t *now, size_t units,
+                    uint16_t *buf) {
+    memcpy(buf, old, oldUnits * sizeof(uint16_t));
+    size_t length = oldUnits;
+    double t0 = NowSeconds();
+    for (size_t i = diff->count; i-- > 0;) {
+        const TextDiffHunk *h = &diff->hunks[i];
+        size_t added = h->newEnd - h->newStart;
+        memmove(buf + h->oldStart + added, buf + h->oldEnd, (length - h->oldEnd) * sizeof(uint16_t));
+        memcpy(buf + h->oldStart, now + h->newStart, added * sizeof(uint16_t));
+        length = length - (h->oldEnd - h->oldStart) + added;
+    }
+    double seconds = NowSeconds() - t0;
+    CHECK(length == units && memcmp(buf, now, units * sizeof(uint16_t)) == 0);
+    return seconds;
+}
+
+static void Run(const char *name, const uint16_t *old, size_t oldUnits, const uint16_t *now, size_t units,
+                uint16_t *buf) {
+    TextDiff diff;
+    TextDiffInit(&diff);
+    double t0 = NowSeconds();
+    CHECK(TextDiffLines(&diff, old, oldUnits, now, units, MAX_EDITS));
+    double diffTime = NowSeconds() - t0;
+
+    size_t hunks = diff.count;
+    double applyTime = Apply(&diff, old, oldUnits, now, units, buf);
+    TextDiffJoin(&diff);
+    double joinedTime = Apply(&diff, old, oldUnits, now, units, buf);
+
+    t0 = NowSeconds();
+    memcpy(buf, now, units * sizeof(uint16_t));
+    double fullTime = NowSeconds() - t0;
+    CHECK(buf[units - 1] == now[units - 1]);
+
+    printf("%-18s %5zu hunks %-7s diff %6.1f ms  apply %7.1f ms, joined %6.1f ms  | full copy %5.1f ms\n", name,
+           hunks, diff.exact ? "" : "gave up", diffTime * 1e3, applyTime * 1e3, joinedTime * 1e3, fullTime * 1e3);
+    TextDiffFree(&diff);
+}
+
+int main(void) {
+    size_t capacity = (size_t)(LINES + 10000) * 80;
+    uint16_t *old = (uint16_t *)CheckedAlloc(capacity * sizeof(uint16_t));
+    uint16_t *now = (uint16_t *)CheckedAlloc(capacity * sizeof(uint16_t));
+    uint16_t *buf = (uint16_t *)CheckedAlloc(capacity * sizeof(uint16_t));
+    memset(buf, 0, capacity * sizeof(uint16_t));
+    size_t oldUnits = MakeDocument(old, 0, 0);
+    printf("document: %u lines, %.0f MB as UTF-16\n", LINES, (double)oldUnits * 2 / (1024.0 * 1024.0));
+
+    size_t units = MakeDocument(now, LINES / 10, 0);
+    Run("10 lines changed", old, oldUnits, now, units, buf);
+    units = MakeDocument(now, LINES / 100, 0);
+    Run("100 lines changed", old, oldUnits, now, units, buf);
+    units = MakeDocument(now, LINES / 1000, 0);
+    Run("1000 lines changed", old, oldUnits, now, units, buf);
+    units = MakeDocument(now, 0, 10000);
+    Run("10000 lines added", old, oldUnits, now, units, buf);
+    units = MakeDocument(now, 2, 0);
+    Run("every other line", old, oldUnits, now, units, buf);
+
+    free(buf);
+    free(now);
+    free(old);
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,102 @@
+// Load and save throughput of gzip files against the same bytes stored
+// plainly: saving compresses one save chunk per call as file_io.c does,
+// loading inflates through the reader in loader-sized reads. Log-like text
+// shows the usual case, random bytes the stored-block fallback.
+#include "check.h"
+#include "text_gzip.h"
+
+#include <unistd.h>
+
+#define DATA_BYTES (64u * 1024u * 1024u)
+#define CHUNK_BYTES (4u * 1024u * 1024u)
+
+static size_t ReadStdio(void *context, uint8_t *buffer, size_t size) {
+    return fread(buffer, 1, size, (FILE *)context);
+}
+
+static void Run(const char *name, const uint8_t *data, const char *path) {
+    uint8_t *out = (uint8_t *)CheckedAlloc(TextGzipWriterBound(CHUNK_BYTES));
+    uint8_t *back = (uint8_t *)CheckedAlloc(DATA_BYTES);
+    memset(out, 0, TextGzipWriterBound(CHUNK_BYTES));
+    memset(back, 0, DATA_BYTES);
+
+    // Save, plain.
+    double t0 = NowSeconds();
+    FILE *f = fopen(path, "wb");
+    for (size_t at = 0; at < DATA_BYTES; at += CHUNK_BYTES) fwrite(data + at, 1, CHUNK_BYTES, f);
+    fclose(f);
+    double plainSave = NowSeconds() - t0;
+
+    // Load, plain.
+    t0 = NowSeconds();
+    f = fopen(path, "rb");
+    size_t got = fread(back, 1, DATA_BYTES, f);
+    fclose(f);
+    double plainLoad = NowSeconds() - t0;
+    CHECK(got == DATA_BYTES);
+
+    // Save, gzip.
+    t0 = NowSeconds();
+    f = fopen(path, "wb");
+    TextGzipWriter writer;
+    CHECK(TextGzipWriterInit(&writer));
+    size_t compressed = 0;
+    for (size_t at = 0; at < DATA_BYTES; at += CHUNK_BYTES) {
+        size_t n = TextGzipWriterCompress(&writer, data + at, CHUNK_BYTES, at + CHUNK_BYTES == DATA_BYTES, out);
+        fwrite(out, 1, n, f);
+        compressed += n;
+    }
+    TextGzipWriterFree(&writer);
+    fclose(f);
+    double gzipSave = NowSeconds() - t0;
+
+    // Load, gzip.
+    memset(back, 0, DATA_BYTES);
+    t0 = NowSeconds();
+    f = fopen(path, "rb");
+    TextGzipReader reader;
+    CHECK(TextGzipReaderInit(&reader, ReadStdio, f));
+    size_t total = 0, n;
+    while ((n = TextGzipReaderRead(&reader, back + total, DATA_BYTES - total < CHUNK_BYTES ? DATA_BYTES - total : CHUNK_BYTES)) > 0) {
+        total += n;
+    }
+    CHECK(!reader.failed);
+    TextGzipReaderFree(&reader);
+    fclose(f);
+    double gzipLoad = NowSeconds() - t0;
+    CHECK(total == DATA_BYTES && memcmp(back, data, DATA_BYTES) == 0);
+
+    printf("%-7s ratio %5.1f%%  save %6.0f MB/s (plain %6.0f)  load %6.0f MB/s (plain %6.0f)\n", name,
+           100.0 * (double)compressed / DATA_BYTES, MegabytesPerSecond(DATA_BYTES, gzipSave),
+           MegabytesPerSecond(DATA_BYTES, plainSave), MegabytesPerSecond(DATA_BYTES, gzipLoad),
+           MegabytesPerSecond(DATA_BYTES, plainLoad));
+    free(back);
+    free(out);
+}
+
+int main(void) {
+    char path[] = "/tmp/retropad-bench-gzip-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 2;
+    }
+    close(fd);
+    uint8_t *data = (uint8_t *)CheckedAlloc(DATA_BYTES);
+    uint32_t seed = 1;
+    for (size_t n = 0; n < DATA_BYTES;) {
+        char line[96];
+        int len = snprintf(line, sizeof(line), "2024-05-01 12:%02u:%02u INFO request %u served in %u ms\n",
+                           NextRandom(&seed) % 60, NextRandom(&seed) % 60, NextRandom(&seed) % 100000,
+                           NextRandom(&seed) % 500);
+        size_t take = (size_t)len < DATA_BYTES - n ? (size_t)len : DATA_BYTES - n;
+        memcpy(data + n, line, take);
+        n += take;
+    }
+    Run("text", data, path);
+    for (size_t i = 0; i < DATA_BYTES; ++i) data[i] = (uint8_t)(NextRandom(&seed) >> 24);
+    Run("random", data, path);
+    unlink(path);
+    free(data);
+    return g_failures ? 1 : 0;
+}
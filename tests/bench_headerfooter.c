@@ -0,0 +1,126 @@
+// Header/footer expansion: long formats packed with &f and &p tokens into
+// roomy segments, expanded the way rendering.c used to (wcslen on the
+// segment before every append, so O(n^2) in its length) and through
+// TextPrintExpandHeaderFooter, which tracks each segment's length. Both
+// must produce the same segments.
+#include "check.h"
+#include "text_print.h"
+
+#define SEGMENT_UNITS 65536u
+#define ROUNDS 20
+
+static size_t UnitLength(const uint16_t *s) {
+    size_t n = 0;
+    if (s) {
+        while (s[n]) n++;
+    }
+    return n;
+}
+
+// The old expansion, on uint16_t instead of WCHAR.
+static void OldExpand(const uint16_t *format, const TextPrintFields *fields, uint16_t *left, size_t cchLeft,
+                      uint16_t *center, size_t cchCenter, uint16_t *right, size_t cchRight) {
+    if (left && cchLeft) left[0] = 0;
+    if (center && cchCenter) center[0] = 0;
+    if (right && cchRight) right[0] = 0;
+    if (!format) return;
+    int seg = 1;
+    uint16_t *targets[3] = { left, center, right };
+    size_t sizes[3] = { cchLeft, cchCenter, cchRight };
+    for (const uint16_t *p = format; *p; ++p) {
+        if (*p == '&') {
+            uint16_t next = p[1];
+            if (next == 'l' || next == 'L') { seg = 0; p++; continue; }
+            if (next == 'c' || next == 'C') { seg = 1; p++; continue; }
+            if (next == 'r' || next == 'R') { seg = 2; p++; continue; }
+            const uint16_t *insert = NULL;
+            uint16_t tmp[2] = { 0, 0 };
+            uint16_t pageBuf[16];
+            switch (next) {
+            case '&': tmp[0] = '&'; insert = tmp; p++; break;
+            case 'f': case 'F': insert = fields->fileName; p++; break;
+            case 'p': {
+                char digits[16];
+                int n = snprintf(digits, sizeof(digits), "%d", fields->page);
+                for (int i = 0; i <= n; ++i) pageBuf[i] = (uint16_t)digits[i];
+                insert = pageBuf;
+                p++;
+                break;
+            }
+            default: tmp[0] = '&'; insert = tmp; break;
+            }
+            if (insert && insert[0] && targets[seg] && sizes[seg] > 0) {
+                size_t curLen = UnitLength(targets[seg]);
+                size_t remaining = sizes[seg] > curLen ? sizes[seg] - curLen - 1 : 0;
+                if (remaining > 0) {
+                    size_t len = UnitLength(insert);
+                    size_t toCopy = len < remaining ? len : remaining;
+                    memcpy(targets[seg] + curLen, insert, toCopy * sizeof(uint16_t));
+                    targets[seg][curLen + toCopy] = 0;
+                }
+            }
+        } else if (targets[seg] && sizes[seg] > 0) {
+            size_t curLen = UnitLength(targets[seg]);
+            if (curLen + 1 < sizes[seg]) {
+                targets[seg][curLen] = *p;
+                targets[seg][curLen + 1] = 0;
+            }
+        }
+    }
+}
+
+// A format of `units` units: literal text, &f and &p tokens in every
+// segment, and enough of them to fill each segment.
+static size_t BuildFormat(uint16_t *format, size_t units, uint32_t *seed) {
+    static const char *const pieces[] = { "&l", "&c", "&r", "&f", "&p", "&p", "&f", "Page ", " of ", "&&", "-" };
+    size_t n = 0;
+    while (n + 8 < units) {
+        const char *piece = pieces[NextRandom(seed) % (sizeof(pieces) / sizeof(pieces[0]))];
+        while (*piece) format[n++] = (uint16_t)*piece++;
+    }
+    format[n] = 0;
+    return n;
+}
+
+int main(void) {
+    static const char name[] = "a-rather-long-file-name-for-a-report.txt";
+    uint16_t fileName[sizeof(name)];
+    for (size_t i = 0; i < sizeof(name); ++i) fileName[i] = (uint16_t)name[i];
+    TextPrintFields fields = { fileName, NULL, NULL, 123456, 999999 };
+    static const size_t formatUnits[] = { 64, 1024, 16384 };
+    uint16_t *format = (uint16_t *)CheckedAlloc((16384 + 16) * sizeof(uint16_t));
+    uint16_t *segments = (uint16_t *)CheckedAlloc(6 * SEGMENT_UNITS * sizeof(uint16_t));
+    uint16_t *oldSeg[3], *newSeg[3];
+    for (int s = 0; s < 3; ++s) {
+        oldSeg[s] = segments + s * SEGMENT_UNITS;
+        newSeg[s] = segments + (3 + s) * SEGMENT_UNITS;
+    }
+    uint32_t seed = 21;
+    for (size_t f = 0; f < sizeof(formatUnits) / sizeof(formatUnits[0]); ++f) {
+        size_t length = BuildFormat(format, formatUnits[f], &seed);
+        size_t tokens = 0;
+        for (size_t i = 0; i + 1 < length; ++i) tokens += format[i] == '&' && (format[i + 1] == 'f' || format[i + 1] == 'p');
+        double t0 = NowSeconds();
+        for (int r = 0; r < ROUNDS; ++r) {
+            OldExpand(format, &fields, oldSeg[0], SEGMENT_UNITS, oldSeg[1], SEGMENT_UNITS, oldSeg[2], SEGMENT_UNITS);
+        }
+        double oldSeconds = (NowSeconds() - t0) / ROUNDS;
+        t0 = NowSeconds();
+        for (int r = 0; r < ROUNDS; ++r) {
+            TextPrintExpandHeaderFooter(format, &fields, newSeg[0], SEGMENT_UNITS, newSeg[1], SEGMENT_UNITS,
+                                        newSeg[2], SEGMENT_UNITS);
+        }
+        double newSeconds = (NowSeconds() - t0) / ROUNDS;
+        size_t out = 0;
+        for (int s = 0; s < 3; ++s) {
+            size_t n = UnitLength(newSeg[s]);
+            CHECK(n == UnitLength(oldSeg[s]) && memcmp(oldSeg[s], newSeg[s], (n + 1) * sizeof(uint16_t)) == 0);
+            out += n;
+        }
+        printf("format %6zu units, %5zu &f/&p tokens -> %6zu units: wcslen shape %9.3f ms, tracked %7.3f ms (%.0fx)\n",
+               length, tokens, out, oldSeconds * 1e3, newSeconds * 1e3, newSeconds > 0 ? oldSeconds / newSeconds : 0.0);
+    }
+    free(format);
+    free(segments);
+    return g_failures ? 1 : 0;
+}
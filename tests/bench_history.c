@@ -0,0 +1,76 @@
+// Version store throughput: content-defined chunking alone, a first save
+// of a 256 MB file (chunking, keying and storing every chunk), and saving
+// it again after a one-line edit, when all but the chunks around the edit
+// are found in the index and skipped. Chunks are "stored" into memory.
+#include "check.h"
+#include "text_history.h"
+
+#define FILE_BYTES (256u * 1024u * 1024u)
+#define SAVE_CHUNK (4u * 1024u * 1024u) // bytes handed over per call, as a save streams them
+
+typedef struct Blob {
+    uint8_t *data;
+    size_t size;
+} Blob;
+
+static bool StoreBlob(void *context, const uint8_t *data, size_t size, uint64_t *offsetOut) {
+    Blob *b = (Blob *)context;
+    memcpy(b->data + b->size, data, size);
+    *offsetOut = b->size;
+    b->size += size;
+    return true;
+}
+
+static double Save(TextChunkIndex *index, Blob *blob, const uint8_t *data, size_t size, TextVersionWriter *writer) {
+    double t0 = NowSeconds();
+    CHECK(TextVersionWriterInit(writer, index, StoreBlob, blob));
+    for (size_t at = 0; at < size; at += SAVE_CHUNK) {
+        CHECK(TextVersionWriterAdd(writer, data + at, size - at < SAVE_CHUNK ? size - at : SAVE_CHUNK));
+    }
+    CHECK(TextVersionWriterFinish(writer));
+    return NowSeconds() - t0;
+}
+
+int main(void) {
+    uint8_t *data = (uint8_t *)CheckedAlloc(FILE_BYTES + 64);
+    uint32_t seed = 21;
+    for (size_t n = 0; n < FILE_BYTES;) {
+        char line[128];
+        uint32_t r = NextRandom(&seed);
+        int len = snprintf(line, sizeof(line), "2024-05-01 12:00:%02u INFO request %u served in %u ms\r\n", r % 60,
+                           r % 1000000, r % 500);
+        size_t take = (size_t)len < FILE_BYTES - n ? (size_t)len : FILE_BYTES - n;
+        memcpy(data + n, line, take);
+        n += take;
+    }
+    Blob blob = { (uint8_t *)CheckedAlloc(2 * (size_t)FILE_BYTES + 64), 0 };
+    memset(blob.data, 0, 2 * (size_t)FILE_BYTES + 64);
+
+    double t0 = NowSeconds();
+    size_t chunks = 0;
+    for (size_t at = 0; at < FILE_BYTES; ++chunks) at += TextChunkCut(data + at, FILE_BYTES - at);
+    double cutTime = NowSeconds() - t0;
+    printf("chunking      %6.0f MB/s  (%zu chunks, %.1f KB average)\n", MegabytesPerSecond(FILE_BYTES, cutTime),
+           chunks, (double)FILE_BYTES / (double)chunks / 1024.0);
+
+    TextChunkIndex index;
+    TextChunkIndexInit(&index);
+    TextVersionWriter first, second;
+    double firstTime = Save(&index, &blob, data, FILE_BYTES, &first);
+    printf("first save    %6.0f MB/s  stored %6.1f MB\n", MegabytesPerSecond(FILE_BYTES, firstTime),
+           (double)first.newBytes / (1024.0 * 1024.0));
+
+    memmove(data + FILE_BYTES / 3 + 32, data + FILE_BYTES / 3, FILE_BYTES - FILE_BYTES / 3);
+    memcpy(data + FILE_BYTES / 3, "a line added between two saves\r\n", 32);
+    double secondTime = Save(&index, &blob, data, FILE_BYTES + 32, &second);
+    printf("after an edit %6.0f MB/s  stored %6.1f KB of %u MB\n", MegabytesPerSecond(FILE_BYTES, secondTime),
+           (double)second.newBytes / 1024.0, FILE_BYTES >> 20);
+    CHECK(second.newBytes < 4 * TEXT_CHUNK_MAX);
+
+    TextVersionWriterFree(&second);
+    TextVersionWriterFree(&first);
+    TextChunkIndexFree(&index);
+    free(blob.data);
+    free(data);
+    return g_failures ? 1 : 0;
+}
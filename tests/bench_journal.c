@@ -0,0 +1,72 @@
+// Journal replay speed, as recovery at launch pays it: a checkpoint of a
+// 64 MB document followed by a million keystrokes typed in bursts that
+// wander through the text, and then the same document with a thousand
+// edits scattered at random offsets: the worst case for the gap buffer,
+// where each edit moves the gap a third of the document on average.
+#include "check.h"
+#include "text_journal.h"
+
+#define DOC_UNITS (32u * 1024u * 1024u)
+#define KEYSTROKES 1000000u
+#define SCATTERED 1000u
+
+static void Replay(const char *name, const uint16_t *start, const TextJournalBuffer *log, size_t expectRecords,
+                   size_t expectLength) {
+    TextJournalDocument doc;
+    double t0 = NowSeconds();
+    CHECK(TextJournalDocumentInit(&doc, start, start ? DOC_UNITS : 0));
+    size_t records = 0;
+    CHECK(TextJournalReplay(&doc, log->data, log->size, &records) == TEXT_JOURNAL_OK);
+    size_t length = 0;
+    uint16_t *text = TextJournalDocumentDetach(&doc, &length);
+    double seconds = NowSeconds() - t0;
+    CHECK(records == expectRecords);
+    CHECK(length == expectLength);
+    printf("%-20s %8zu records, %5.1f MB log: %6.0f ms (%5.0f MB/s of log, %7.2f us a record)\n", name, records,
+           (double)log->size / (1024.0 * 1024.0), seconds * 1e3, MegabytesPerSecond(log->size, seconds),
+           seconds * 1e6 / (double)records);
+    free(text);
+}
+
+int main(void) {
+    uint16_t *text = (uint16_t *)CheckedAlloc(DOC_UNITS * sizeof(uint16_t));
+    for (size_t i = 0; i < DOC_UNITS; ++i) text[i] = (uint16_t)(i % 64 == 63 ? '\n' : 'a' + i % 26);
+    uint32_t seed = 11;
+
+    // Typing: bursts of 1-40 keys, the odd backspace, each burst a few
+    // lines from the last and one in a hundred somewhere else entirely.
+    TextJournalBuffer typing;
+    TextJournalBufferInit(&typing);
+    CHECK(TextJournalAppendText(&typing, text, DOC_UNITS));
+    size_t length = DOC_UNITS, cursor = 0, records = 1;
+    for (uint32_t keys = 0; keys < KEYSTROKES;) {
+        uint32_t r = NextRandom(&seed);
+        cursor = r % 100 == 0 ? r % (length + 1) : cursor + r % 1024 > 512 ? cursor + r % 1024 - 512 : 0;
+        if (cursor > length) cursor = length;
+        for (uint32_t burst = 1 + NextRandom(&seed) % 40; burst && keys < KEYSTROKES; --burst, ++keys, ++records) {
+            if (cursor && NextRandom(&seed) % 10 == 0) {
+                CHECK(TextJournalAppendEdit(&typing, --cursor, 1, NULL, 0));
+                length--;
+            } else {
+                uint16_t key = (uint16_t)('a' + keys % 26);
+                CHECK(TextJournalAppendEdit(&typing, cursor++, 0, &key, 1));
+                length++;
+            }
+        }
+    }
+    Replay("checkpoint + typing", NULL, &typing, records, length);
+
+    // Scattered: each edit lands far from the last, so each moves the gap.
+    TextJournalBuffer scattered;
+    TextJournalBufferInit(&scattered);
+    static const uint16_t line[] = { 'n', 'e', 'w', ' ', 'l', 'i', 'n', 'e', '\n' };
+    for (uint32_t e = 0; e < SCATTERED; ++e) {
+        CHECK(TextJournalAppendEdit(&scattered, NextRandom(&seed) % DOC_UNITS, 0, line, 9));
+    }
+    Replay("scattered edits", text, &scattered, SCATTERED, DOC_UNITS + 9u * SCATTERED);
+
+    TextJournalBufferFree(&scattered);
+    TextJournalBufferFree(&typing);
+    free(text);
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,160 @@
+// Line index build speed over a large document fed in load-sized chunks,
+// the cost of offset <-> line lookups against counting breaks from the
+// start of the text, which is what answering them without an index takes,
+// and keeping a million-line index current through edits against
+// rebuilding it. Only the index's work is timed, not editing the text.
+#include "check.h"
+#include "text_lines.h"
+
+#define DOC_UNITS (128u * 1024u * 1024u)
+#define CHUNK_UNITS (4u * 1024u * 1024u)
+#define LOOKUPS 1000000u
+#define NAIVE_LOOKUPS 20u
+#define EDIT_LINES 1000000u
+#define SWAPS 200000u     // two units become a break or stop being one
+#define RESIZES 2000u     // lines typed in or deleted, moving the text after them
+
+// Line of `offset`, by counting the breaks before it.
+static size_t NaiveLineFromOffset(const uint16_t *text, size_t offset) {
+    size_t line = 0;
+    for (size_t i = 0; i < offset; ++i) {
+        if (text[i] == 0x0A || (text[i] == 0x0D && (i + 1 >= offset || text[i + 1] != 0x0A))) line++;
+    }
+    return line;
+}
+
+// Edits that split or drop a block, and so rebuild the trees.
+typedef struct Restructures {
+    size_t count;
+    double seconds;
+    double worst;
+} Restructures;
+
+static double TimedEdit(TextLineIndex *index, uint64_t offset, uint64_t deleted, const uint16_t *text,
+                        size_t length, Restructures *restructures) {
+    size_t blocks = index->blockCount;
+    double t0 = NowSeconds();
+    CHECK(TextLineIndexEdit(index, offset, deleted, text, length, NULL));
+    double seconds = NowSeconds() - t0;
+    if (index->blockCount != blocks) {
+        restructures->count++;
+        restructures->seconds += seconds;
+        if (seconds > restructures->worst) restructures->worst = seconds;
+    }
+    return seconds;
+}
+
+static void BenchEdits(void) {
+    static const char line[] = "a line of twenty\r\n";
+    size_t units = EDIT_LINES * (sizeof(line) - 1);
+    uint16_t *text = (uint16_t *)CheckedAlloc((units + RESIZES * 2) * sizeof(uint16_t));
+    for (size_t i = 0; i < units; ++i) text[i] = (uint16_t)line[i % (sizeof(line) - 1)];
+    TextLineIndex index;
+    TextLineIndexInit(&index);
+    double t0 = NowSeconds();
+    CHECK(TextLineIndexAppend(&index, text, units));
+    TextLineIndexFinish(&index);
+    double build = NowSeconds() - t0;
+    size_t blocksBefore = index.blockCount;
+
+    uint32_t seed = 5;
+    double swaps = 0, resizes = 0;
+    Restructures restructures = { 0, 0, 0 };
+    for (size_t e = 0; e < SWAPS; ++e) {
+        size_t at = NextRandom(&seed) % (units - 1);
+        bool isBreak = text[at] == 0x0D || text[at] == 0x0A || text[at + 1] == 0x0D || text[at + 1] == 0x0A;
+        text[at] = isBreak ? 'x' : 0x0D;
+        text[at + 1] = isBreak ? 'y' : 0x0A;
+        swaps += TimedEdit(&index, at, 2, text, units, &restructures);
+    }
+    for (size_t e = 0; e < RESIZES; ++e) {
+        size_t at = NextRandom(&seed) % (units - 2);
+        if (e % 2) {
+            memmove(text + at + 2, text + at, (units - at) * sizeof(uint16_t));
+            text[at] = 0x0D;
+            text[at + 1] = 0x0A;
+            units += 2;
+            resizes += TimedEdit(&index, at, 0, text, units, &restructures);
+        } else {
+            memmove(text + at, text + at + 2, (units - at - 2) * sizeof(uint16_t));
+            units -= 2;
+            resizes += TimedEdit(&index, at, 2, text, units, &restructures);
+        }
+    }
+
+    TextLineIndex fresh;
+    TextLineIndexInit(&fresh);
+    CHECK(TextLineIndexAppend(&fresh, text, units));
+    TextLineIndexFinish(&fresh);
+    size_t lines = 0, expect = 0;
+    CHECK(TextLineIndexCount(&index, &lines) && TextLineIndexCount(&fresh, &expect) && lines == expect);
+    for (size_t k = 0; k < 1000; ++k) {
+        size_t at = NextRandom(&seed) % expect;
+        uint64_t a = 0, b = 0;
+        CHECK(TextLineIndexLineStart(&index, at, &a) && TextLineIndexLineStart(&fresh, at, &b) && a == b);
+    }
+    printf("edits on %.2f M lines: %.0f ns a break swapped, %.0f ns a line resized | rebuilding: %.1f ms\n",
+           (double)EDIT_LINES / 1e6, swaps / SWAPS * 1e9, resizes / RESIZES * 1e9, build * 1e3);
+    printf("  %zu of them split or dropped a block (%zu blocks, %zu after): %.1f us each, worst %.1f us\n",
+           restructures.count, blocksBefore, index.blockCount,
+           restructures.count ? restructures.seconds / (double)restructures.count * 1e6 : 0.0,
+           restructures.worst * 1e6);
+    TextLineIndexFree(&fresh);
+    TextLineIndexFree(&index);
+    free(text);
+}
+
+int main(void) {
+    uint16_t *text = (uint16_t *)CheckedAlloc(DOC_UNITS * sizeof(uint16_t));
+    static const char line[] = "2024-05-01 12:00:00 INFO served /index.html in 12 ms\r\n";
+    for (size_t i = 0; i < DOC_UNITS; ++i) text[i] = (uint16_t)line[i % (sizeof(line) - 1)];
+
+    TextLineIndex index;
+    TextLineIndexInit(&index);
+    double t0 = NowSeconds();
+    for (size_t at = 0; at < DOC_UNITS; at += CHUNK_UNITS) {
+        size_t n = DOC_UNITS - at < CHUNK_UNITS ? DOC_UNITS - at : CHUNK_UNITS;
+        CHECK(TextLineIndexAppend(&index, text + at, n));
+    }
+    TextLineIndexFinish(&index);
+    double build = NowSeconds() - t0;
+    size_t lines = 0;
+    CHECK(TextLineIndexCount(&index, &lines));
+    CHECK(lines == DOC_UNITS / (sizeof(line) - 1) + 1);
+    printf("build: %.2f M lines in %.1f ms (%.0f MB/s of UTF-16)\n", (double)lines / 1e6, build * 1e3,
+           MegabytesPerSecond((uint64_t)DOC_UNITS * 2, build));
+
+    uint32_t seed = 99;
+    uint64_t checksum = 0;
+    t0 = NowSeconds();
+    for (size_t k = 0; k < LOOKUPS; ++k) {
+        size_t got = 0;
+        TextLineIndexLineFromOffset(&index, NextRandom(&seed) % DOC_UNITS, &got);
+        checksum += got;
+    }
+    double fromOffset = NowSeconds() - t0;
+    t0 = NowSeconds();
+    for (size_t k = 0; k < LOOKUPS; ++k) {
+        uint64_t start = 0;
+        TextLineIndexLineStart(&index, NextRandom(&seed) % lines, &start);
+        checksum += start;
+    }
+    double lineStart = NowSeconds() - t0;
+    CHECK(checksum != 0);
+
+    double naive = 0;
+    for (size_t k = 0; k < NAIVE_LOOKUPS; ++k) {
+        size_t offset = NextRandom(&seed) % DOC_UNITS, got = 0;
+        t0 = NowSeconds();
+        size_t expect = NaiveLineFromOffset(text, offset);
+        naive += NowSeconds() - t0;
+        CHECK(TextLineIndexLineFromOffset(&index, offset, &got) && got == expect);
+    }
+    printf("line from offset: %.0f ns  line start: %.0f ns  | counting breaks: %.1f ms\n", fromOffset / LOOKUPS * 1e9,
+           lineStart / LOOKUPS * 1e9, naive / NAIVE_LOOKUPS * 1e3);
+
+    TextLineIndexFree(&index);
+    free(text);
+    BenchEdits();
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,71 @@
+// Time to first chunk and total load time for the progressive loader,
+// reading a file from disk, against reading the whole file and decoding it
+// before anything can be shown (the old synchronous load).
+#include "check.h"
+#include "text_loader.h"
+
+#include <unistd.h>
+
+#define FILE_BYTES (256u * 1024u * 1024u)
+
+static size_t ReadStdio(void *context, uint8_t *buffer, size_t size) {
+    return fread(buffer, 1, size, (FILE *)context);
+}
+
+static void Run(const char *name, const char *path, TextEncoding encoding, uint16_t *out) {
+    // Progressive: the first chunk is what the window shows first.
+    FILE *f = fopen(path, "rb");
+    double t0 = NowSeconds(), first = 0;
+    TextLoader loader;
+    CHECK(TextLoaderInit(&loader, encoding, FILE_BYTES, ReadStdio, f));
+    size_t total = 0, units = 0, chunks = 0;
+    while (TextLoaderNext(&loader, out + total, &units)) {
+        if (chunks++ == 0) first = NowSeconds() - t0;
+        total += units;
+    }
+    double progressive = NowSeconds() - t0;
+    TextLoaderFree(&loader);
+    fclose(f);
+
+    // Whole file: read it all, then decode it all.
+    f = fopen(path, "rb");
+    t0 = NowSeconds();
+    uint8_t *bytes = (uint8_t *)CheckedAlloc(FILE_BYTES);
+    CHECK(fread(bytes, 1, FILE_BYTES, f) == FILE_BYTES);
+    TextDecoder dec;
+    TextDecoderInit(&dec, encoding);
+    size_t whole = TextDecoderDecode(&dec, bytes, FILE_BYTES, true, out);
+    double blocking = NowSeconds() - t0;
+    free(bytes);
+    fclose(f);
+
+    CHECK(whole == total);
+    printf("%-9s first chunk %7.2f ms  all %zu chunks %7.0f ms (%5.0f MB/s)  | whole-file first text %7.0f ms\n", name,
+           first * 1e3, chunks, progressive * 1e3, MegabytesPerSecond(FILE_BYTES, progressive), blocking * 1e3);
+}
+
+int main(void) {
+    char path[] = "/tmp/retropad-bench-load-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 2;
+    }
+    FILE *f = fdopen(fd, "wb");
+    static const char line[] = "2024-05-01 12:00:00 INFO caf\xC3\xA9 served /index.html in 12 ms\n";
+    for (size_t n = 0; n < FILE_BYTES; n += sizeof(line) - 1) {
+        size_t take = FILE_BYTES - n < sizeof(line) - 1 ? FILE_BYTES - n : sizeof(line) - 1;
+        fwrite(line, 1, take, f);
+    }
+    fclose(f);
+
+    size_t outBytes = (TextDecoderMaxOutput(ENC_UTF8, FILE_BYTES) + 64) * 2;
+    uint16_t *out = (uint16_t *)CheckedAlloc(outBytes);
+    memset(out, 0, outBytes); // fault the pages in, so neither side pays for it
+    printf("file: %u MB\n", FILE_BYTES / (1024u * 1024u));
+    Run("utf-8", path, ENC_UTF8, out);
+    Run("utf-16le", path, ENC_UTF16LE, out); // same bytes read as UTF-16LE
+    unlink(path);
+    free(out);
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,211 @@
+// Heap allocations and peak memory of opening a file three times in a row,
+// the old way (read the whole file, allocate a wide buffer, decode or copy
+// it over) against the current one (TextLoader chunks, read in place for
+// UTF-16LE, drawn from the recycled block pool file_io.c keeps). The pool
+// and the four chunks in flight are modelled here with malloc; the edit
+// control's own copy of the text is the same both ways and is left out of
+// the heap figures. Peak resident memory is measured per run in a child.
+#include "check.h"
+#include "text_loader.h"
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define FILE_BYTES (128u * 1024u * 1024u)
+#define OPENS 3
+#define CHUNKS_IN_FLIGHT 4 // LOAD_CHUNKS_IN_FLIGHT in file_io.c
+
+static size_t g_allocs, g_live, g_peak;
+
+static void *CountedAlloc(size_t bytes) {
+    g_allocs++;
+    g_live += bytes;
+    if (g_live > g_peak) g_peak = g_live;
+    return CheckedAlloc(bytes);
+}
+
+static void CountedFree(void *p, size_t bytes) {
+    if (!p) return;
+    g_live -= bytes;
+    free(p);
+}
+
+// The chunk pool: freed blocks wait, smallest first, for the next chunk.
+typedef struct Block {
+    struct Block *next;
+    size_t capacity;
+} Block;
+
+static Block *g_idle;
+static int g_idleCount;
+
+static uint16_t *AllocChunk(size_t capacity) {
+    for (Block **link = &g_idle; *link; link = &(*link)->next) {
+        if ((*link)->capacity >= capacity) {
+            Block *block = *link;
+            *link = block->next;
+            g_idleCount--;
+            return (uint16_t *)(block + 1);
+        }
+    }
+    Block *block = (Block *)CountedAlloc(sizeof(Block) + (capacity + 1) * sizeof(uint16_t));
+    block->capacity = capacity;
+    return (uint16_t *)(block + 1);
+}
+
+static void FreeChunk(uint16_t *text) {
+    Block *block = (Block *)text - 1;
+    Block **link = &g_idle;
+    while (*link && (*link)->capacity < block->capacity) link = &(*link)->next;
+    block->next = *link;
+    *link = block;
+    if (++g_idleCount > CHUNKS_IN_FLIGHT) {
+        Block *evicted = g_idle;
+        g_idle = evicted->next;
+        g_idleCount--;
+        CountedFree(evicted, sizeof(Block) + (evicted->capacity + 1) * sizeof(uint16_t));
+    }
+}
+
+// Lets go of every idle block but the largest, as each load ends.
+static void TrimChunks(void) {
+    while (g_idle && g_idle->next) {
+        Block *block = g_idle;
+        g_idle = block->next;
+        g_idleCount--;
+        CountedFree(block, sizeof(Block) + (block->capacity + 1) * sizeof(uint16_t));
+    }
+}
+
+static size_t ReadStdio(void *context, uint8_t *buffer, size_t size) {
+    return fread(buffer, 1, size, (FILE *)context);
+}
+
+static size_t OldOpen(const char *path, TextEncoding encoding, uint16_t *control) {
+    FILE *f = fopen(path, "rb");
+    uint8_t *bytes = (uint8_t *)CountedAlloc(FILE_BYTES);
+    CHECK(fread(bytes, 1, FILE_BYTES, f) == FILE_BYTES);
+    fclose(f);
+    size_t bom = TextBomLength(bytes, FILE_BYTES, encoding);
+    size_t capacity = TextDecoderMaxOutput(encoding, FILE_BYTES);
+    uint16_t *wide = (uint16_t *)CountedAlloc((capacity + 1) * sizeof(uint16_t));
+    TextDecoder dec;
+    TextDecoderInit(&dec, encoding);
+    size_t units = TextDecoderDecode(&dec, bytes + bom, FILE_BYTES - bom, true, wide);
+    CountedFree(bytes, FILE_BYTES);
+    memcpy(control, wide, units * sizeof(uint16_t)); // SetWindowText
+    CountedFree(wide, (capacity + 1) * sizeof(uint16_t));
+    return units;
+}
+
+static size_t NewOpen(const char *path, TextEncoding encoding, uint16_t *control) {
+    FILE *f = fopen(path, "rb");
+    uint8_t bom[3];
+    size_t skip = TextBomLength(bom, fread(bom, 1, sizeof(bom), f), encoding);
+    fseek(f, (long)skip, SEEK_SET);
+    TextLoader loader;
+    CHECK(TextLoaderInit(&loader, encoding, FILE_BYTES - skip, ReadStdio, f));
+    if (loader.input) {
+        g_allocs++; // its scratch buffer
+        g_live += TEXT_LOADER_MAX_CHUNK;
+        if (g_live > g_peak) g_peak = g_live;
+    }
+    uint16_t *queue[CHUNKS_IN_FLIGHT];
+    size_t queued[CHUNKS_IN_FLIGHT], count = 0, total = 0;
+    for (;;) {
+        if (count == CHUNKS_IN_FLIGHT || loader.finished) {
+            // The UI appends the oldest chunk to the control.
+            if (count == 0) break;
+            memcpy(control + total, queue[0], queued[0] * sizeof(uint16_t));
+            total += queued[0];
+            FreeChunk(queue[0]);
+            memmove(queue, queue + 1, --count * sizeof(queue[0]));
+            memmove(queued, queued + 1, count * sizeof(queued[0]));
+            continue;
+        }
+        uint16_t *chunk = AllocChunk(TextLoaderChunkCapacity(&loader));
+        size_t units = 0;
+        if (!TextLoaderNext(&loader, chunk, &units)) {
+            FreeChunk(chunk);
+            continue;
+        }
+        queue[count] = chunk;
+        queued[count++] = units;
+    }
+    if (loader.input) g_live -= TEXT_LOADER_MAX_CHUNK;
+    TextLoaderFree(&loader);
+    fclose(f);
+    TrimChunks();
+    return total;
+}
+
+// Runs OPENS opens in a child; prints its heap counts and peak RSS.
+static void Measure(const char *name, const char *path, TextEncoding encoding, bool old) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        uint16_t *control = (uint16_t *)CheckedAlloc(FILE_BYTES * sizeof(uint16_t));
+        memset(control, 0, FILE_BYTES * sizeof(uint16_t));
+        size_t first = 0, firstAllocs = 0;
+        double t0 = NowSeconds();
+        for (int i = 0; i < OPENS; ++i) {
+            size_t units = old ? OldOpen(path, encoding, control) : NewOpen(path, encoding, control);
+            if (i == 0) first = units, firstAllocs = g_allocs;
+            CHECK(units == first && units > 0);
+        }
+        double seconds = NowSeconds() - t0;
+        printf("%-9s %-3s allocations %2zu then %2zu per open, heap peak %6.1f MB, %4.0f ms per open", name,
+               old ? "old" : "new", firstAllocs, (g_allocs - firstAllocs) / (OPENS - 1), (double)g_peak / (1024.0 * 1024.0), seconds / OPENS * 1e3);
+        fflush(stdout);
+        _exit(g_failures ? 1 : 0);
+    }
+    int status = 0;
+    struct rusage usage;
+    CHECK(pid > 0 && wait4(pid, &status, 0, &usage) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+#ifdef __APPLE__
+    double rss = (double)usage.ru_maxrss / (1024.0 * 1024.0); // bytes
+#else
+    double rss = (double)usage.ru_maxrss / 1024.0; // kilobytes
+#endif
+    printf(", peak RSS %6.1f MB (control %.0f MB)\n", rss, (double)FILE_BYTES * 2 / (1024.0 * 1024.0));
+}
+
+static void WriteFile(const char *path, TextEncoding encoding) {
+    FILE *f = fopen(path, "wb");
+    static const char line[] = "2024-05-01 12:00:00 INFO caf\xC3\xA9 served /index.html in 12 ms\n";
+    uint8_t *bytes = (uint8_t *)CheckedAlloc(FILE_BYTES);
+    size_t n = 0;
+    if (encoding == ENC_UTF16LE) {
+        bytes[n++] = 0xFF, bytes[n++] = 0xFE;
+        for (size_t i = 0; n + 1 < FILE_BYTES; ++i, n += 2) {
+            char c = line[i % (sizeof(line) - 1)];
+            bytes[n] = (uint8_t)(c < 0 ? 'e' : c);
+            bytes[n + 1] = 0;
+        }
+    } else {
+        for (; n < FILE_BYTES; ++n) bytes[n] = (uint8_t)line[n % (sizeof(line) - 1)];
+    }
+    fwrite(bytes, 1, FILE_BYTES, f);
+    free(bytes);
+    fclose(f);
+}
+
+int main(void) {
+    char path[] = "/tmp/retropad-bench-loadmem-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 2;
+    }
+    close(fd);
+    printf("%d opens of a %u MB file\n", OPENS, FILE_BYTES >> 20);
+    WriteFile(path, ENC_UTF16LE);
+    Measure("UTF-16LE", path, ENC_UTF16LE, true);
+    Measure("UTF-16LE", path, ENC_UTF16LE, false);
+    WriteFile(path, ENC_UTF8);
+    Measure("UTF-8", path, ENC_UTF8, true);
+    Measure("UTF-8", path, ENC_UTF8, false);
+    unlink(path);
+    return g_failures ? 1 : 0;
+}
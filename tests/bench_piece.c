@@ -0,0 +1,96 @@
+// Piece table edit throughput on a 64M-unit document: a million keystrokes
+// typed in bursts, a million inserts and deletes at random offsets, and
+// reading the whole text back span by span, as search and save do. The
+// random edits are set against the same edits on one flat array, which is
+// what the edit control's buffer costs (a thousand of them, scaled).
+#include "check.h"
+#include "text_piece.h"
+
+#define DOC_UNITS (64u * 1024u * 1024u)
+#define EDITS 1000000u
+#define FLAT_EDITS 1000u
+
+// Reads the whole text span by span, summing it as a search would touch
+// every unit; returns the seconds taken.
+static double ReadBySpans(const TextPieceTable *table) {
+    uint64_t sum = 0;
+    size_t read = 0;
+    double t0 = NowSeconds();
+    const uint16_t *units = NULL;
+    for (size_t n; (n = TextPieceTableSpan(table, read, &units)) != 0; read += n) {
+        for (size_t i = 0; i < n; ++i) sum += units[i];
+    }
+    double seconds = NowSeconds() - t0;
+    CHECK(read == TextPieceTableLength(table) && sum != 0);
+    return seconds;
+}
+
+int main(void) {
+    uint16_t *text = (uint16_t *)CheckedAlloc((DOC_UNITS + EDITS * 8u) * sizeof(uint16_t));
+    static const char line[] = "2024-05-01 12:00:00 INFO served /index.html in 12 ms\r\n";
+    for (size_t i = 0; i < DOC_UNITS; ++i) text[i] = (uint16_t)line[i % (sizeof(line) - 1)];
+    static const uint16_t word[] = { 'e', 'd', 'i', 't', 'e', 'd', ' ', '!' };
+
+    TextPieceTable table;
+    TextPieceTableInit(&table);
+    double t0 = NowSeconds();
+    CHECK(TextPieceTableReset(&table, text, DOC_UNITS));
+    double reset = NowSeconds() - t0;
+
+    uint32_t seed = 17;
+    size_t cursor = DOC_UNITS / 2;
+    t0 = NowSeconds();
+    for (uint32_t keys = 0; keys < EDITS;) {
+        uint32_t r = NextRandom(&seed);
+        if (r % 16 == 0) cursor = r % (TextPieceTableLength(&table) + 1);
+        for (uint32_t burst = 1 + r % 40; burst && keys < EDITS; --burst, ++keys) {
+            CHECK(TextPieceTableReplace(&table, cursor++, 0, &word[keys % 8], 1));
+        }
+    }
+    double typing = NowSeconds() - t0;
+    size_t typedPieces = TextPieceTablePieceCount(&table);
+    CHECK(TextPieceTableLength(&table) == DOC_UNITS + EDITS);
+    double typedWalk = ReadBySpans(&table);
+
+    t0 = NowSeconds();
+    for (uint32_t e = 0; e < EDITS; ++e) {
+        size_t length = TextPieceTableLength(&table);
+        size_t offset = NextRandom(&seed) % (length - 8);
+        if (e % 2) {
+            CHECK(TextPieceTableReplace(&table, offset, 0, word, 8));
+        } else {
+            CHECK(TextPieceTableReplace(&table, offset, 8, NULL, 0));
+        }
+    }
+    double random = NowSeconds() - t0;
+    CHECK(table.valid && TextPieceTableLength(&table) == DOC_UNITS + EDITS);
+
+    double randomWalk = ReadBySpans(&table);
+
+    size_t flatLength = DOC_UNITS;
+    t0 = NowSeconds();
+    for (uint32_t e = 0; e < FLAT_EDITS; ++e) {
+        size_t offset = NextRandom(&seed) % (flatLength - 8);
+        if (e % 2) {
+            memmove(text + offset + 8, text + offset, (flatLength - offset) * sizeof(uint16_t));
+            memcpy(text + offset, word, sizeof(word));
+            flatLength += 8;
+        } else {
+            memmove(text + offset, text + offset + 8, (flatLength - offset - 8) * sizeof(uint16_t));
+            flatLength -= 8;
+        }
+    }
+    double flat = NowSeconds() - t0;
+
+    printf("reset %u M units    %8.1f ms\n", DOC_UNITS >> 20, reset * 1e3);
+    printf("typing              %8.2f M edits/s  (%zu pieces after)\n", EDITS / typing / 1e6, typedPieces);
+    printf("random edits        %8.2f M edits/s  (%zu pieces after)\n", EDITS / random / 1e6,
+           TextPieceTablePieceCount(&table));
+    printf("flat array edits    %8.0f edits/s\n", FLAT_EDITS / flat);
+    uint64_t bytes = (uint64_t)(DOC_UNITS + EDITS) * 2;
+    printf("read by spans       %8.0f MB/s after typing, %.0f MB/s after random edits\n",
+           MegabytesPerSecond(bytes, typedWalk), MegabytesPerSecond(bytes, randomWalk));
+    TextPieceTableFree(&table);
+    free(text);
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,182 @@
+// Save throughput and memory per encoding. The streaming side mirrors
+// WriteEncodedText in file_io.c: SAVE_CHUNK_UNITS-unit chunks encoded into
+// two alternating buffers while a writer thread puts the other on disk. The
+// whole-document side is the old shape: encode everything into one buffer
+// sized for the document, then write it in one go. Memory is the encode
+// buffers each side holds at its peak; the document itself is the same for
+// both and not counted.
+#include "check.h"
+#include "text_codec.h"
+#include "text_codepage.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define DOC_UNITS (64u * 1024u * 1024u)
+#define SAVE_CHUNK_UNITS (256u * 1024u) // as in file_io.c
+
+typedef struct Codec {
+    const char *name;
+    int maxBytesPerUnit;
+    TextCodePageEncoder table;
+    size_t (*encode)(const struct Codec *codec, const uint16_t *text, size_t units, uint8_t *out);
+} Codec;
+
+static size_t EncodeUtf8(const Codec *codec, const uint16_t *text, size_t units, uint8_t *out) {
+    (void)codec;
+    return TextEncodeUtf8(text, units, out);
+}
+
+static size_t EncodeUtf16LE(const Codec *codec, const uint16_t *text, size_t units, uint8_t *out) {
+    (void)codec;
+    memcpy(out, text, units * 2);
+    return units * 2;
+}
+
+static size_t EncodeUtf16BE(const Codec *codec, const uint16_t *text, size_t units, uint8_t *out) {
+    (void)codec;
+    TextSwapBytes16(text, units, out);
+    return units * 2;
+}
+
+static size_t EncodeCodePage(const Codec *codec, const uint16_t *text, size_t units, uint8_t *out) {
+    return TextCodePageEncode(&codec->table, text, units, out, NULL);
+}
+
+static void WriteAll(int fd, const uint8_t *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n <= 0) {
+            perror("write");
+            exit(2);
+        }
+        data += n;
+        size -= (size_t)n;
+    }
+}
+
+typedef struct Writer {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int fd;
+    const uint8_t *chunk; // handed over, not yet written
+    size_t chunkBytes;
+    bool stop;
+} Writer;
+
+static void *WriterThread(void *param) {
+    Writer *w = (Writer *)param;
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (!w->chunk && !w->stop) pthread_cond_wait(&w->changed, &w->lock);
+        if (!w->chunk) break;
+        const uint8_t *chunk = w->chunk;
+        size_t bytes = w->chunkBytes;
+        pthread_mutex_unlock(&w->lock);
+        WriteAll(w->fd, chunk, bytes);
+        pthread_mutex_lock(&w->lock);
+        w->chunk = NULL;
+        pthread_cond_broadcast(&w->changed);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+static void WaitIdle(Writer *w) {
+    pthread_mutex_lock(&w->lock);
+    while (w->chunk) pthread_cond_wait(&w->changed, &w->lock);
+    pthread_mutex_unlock(&w->lock);
+}
+
+static size_t SaveStreaming(int fd, const Codec *codec, const uint16_t *text, size_t length) {
+    size_t capacity = (size_t)SAVE_CHUNK_UNITS * (size_t)codec->maxBytesPerUnit;
+    uint8_t *buffers[2] = { (uint8_t *)CheckedAlloc(capacity), (uint8_t *)CheckedAlloc(capacity) };
+    Writer w = { .fd = fd };
+    pthread_mutex_init(&w.lock, NULL);
+    pthread_cond_init(&w.changed, NULL);
+    pthread_t thread;
+    pthread_create(&thread, NULL, WriterThread, &w);
+    int active = 0;
+    for (size_t pos = 0; pos < length;) {
+        size_t units = length - pos < SAVE_CHUNK_UNITS ? length - pos : SAVE_CHUNK_UNITS;
+        if (pos + units < length && text[pos + units - 1] >= 0xD800 && text[pos + units - 1] <= 0xDBFF) units--;
+        size_t bytes = codec->encode(codec, text + pos, units, buffers[active]);
+        pos += units;
+        WaitIdle(&w); // only one chunk in flight, so the other buffer is free
+        pthread_mutex_lock(&w.lock);
+        w.chunk = buffers[active];
+        w.chunkBytes = bytes;
+        pthread_cond_broadcast(&w.changed);
+        pthread_mutex_unlock(&w.lock);
+        active ^= 1;
+    }
+    WaitIdle(&w);
+    pthread_mutex_lock(&w.lock);
+    w.stop = true;
+    pthread_cond_broadcast(&w.changed);
+    pthread_mutex_unlock(&w.lock);
+    pthread_join(thread, NULL);
+    free(buffers[0]);
+    free(buffers[1]);
+    return 2 * capacity;
+}
+
+static size_t SaveWhole(int fd, const Codec *codec, const uint16_t *text, size_t length) {
+    size_t capacity = length * (size_t)codec->maxBytesPerUnit;
+    uint8_t *out = (uint8_t *)CheckedAlloc(capacity);
+    size_t bytes = codec->encode(codec, text, length, out);
+    WriteAll(fd, out, bytes);
+    free(out);
+    return capacity;
+}
+
+typedef size_t (*SaveFn)(int fd, const Codec *codec, const uint16_t *text, size_t length);
+
+static void Measure(const char *label, SaveFn save, const Codec *codec, const uint16_t *text, size_t length,
+                    const char *path, uint64_t *bytesOut) {
+    double best = 1e9;
+    size_t memory = 0;
+    for (int round = 0; round < 3; ++round) {
+        int fd = open(path, O_WRONLY | O_TRUNC);
+        double t0 = NowSeconds();
+        memory = save(fd, codec, text, length);
+        double t = NowSeconds() - t0;
+        *bytesOut = (uint64_t)lseek(fd, 0, SEEK_END);
+        close(fd);
+        if (t < best) best = t;
+    }
+    printf("  %-10s %7.0f MB/s  %8.1f MB buffers\n", label, MegabytesPerSecond(*bytesOut, best),
+           (double)memory / (1024.0 * 1024.0));
+}
+
+int main(void) {
+    uint16_t *text = (uint16_t *)CheckedAlloc((size_t)DOC_UNITS * 2);
+    static const char line[] = "2024-05-01 12:00:00 INFO caf\xE9 order 1234 shipped to M\xFCnchen\r\n";
+    for (size_t i = 0; i < DOC_UNITS; ++i) text[i] = (uint8_t)line[i % (sizeof(line) - 1)];
+
+    char path[] = "/tmp/retropad-bench-save-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 2;
+    }
+    close(fd);
+
+    Codec codecs[] = { { "utf-8", 3, { 0 }, EncodeUtf8 },
+                       { "utf-16le", 2, { 0 }, EncodeUtf16LE },
+                       { "utf-16be", 2, { 0 }, EncodeUtf16BE },
+                       { "cp1252", 1, { 0 }, EncodeCodePage } };
+    TextCodePageEncoderInit(&codecs[3].table, 1252);
+    printf("document: %.0f MB of UTF-16\n", (double)DOC_UNITS * 2 / (1024.0 * 1024.0));
+    for (size_t c = 0; c < sizeof(codecs) / sizeof(codecs[0]); ++c) {
+        uint64_t streamed = 0, whole = 0;
+        printf("%s\n", codecs[c].name);
+        Measure("streaming", SaveStreaming, &codecs[c], text, DOC_UNITS, path, &streamed);
+        Measure("whole", SaveWhole, &codecs[c], text, DOC_UNITS, path, &whole);
+        CHECK(streamed == whole && streamed > 0);
+    }
+    unlink(path);
+    free(text);
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,157 @@
+// Startup with a restored session, for a 100 MB UTF-8 document: the
+// portable part of OpenSession and TakeSessionDocument (map the snapshot,
+// check it, copy the line index out, hand the text on) against what a
+// launch without it pays (read the file, decode it, index its lines). The
+// snapshot here has the layout file_io.c writes, minus the Windows state,
+// and the edit control taking the text is modelled as one copy of it.
+// Either is checked against SESSION_RESTORE_TARGET_MS in retropad.c.
+#include "check.h"
+#include "text_codec.h"
+#include "text_hash.h"
+#include "text_lines.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FILE_BYTES (100u * 1024u * 1024u)
+#define CHUNK_UNITS (4u * 1024u * 1024u)
+#define RESTORE_TARGET_MS 500.0 // SESSION_RESTORE_TARGET_MS
+
+typedef struct Section {
+    uint64_t offset;
+    uint64_t bytes;
+} Section;
+
+typedef struct Header {
+    uint64_t fileBytes;
+    Section text;
+    TextLineIndex lines; // scalars only; the arrays are sections
+    Section blocks;
+    Section deltas;
+    uint64_t contentCheck;
+} Header;
+
+static void Plan(Section *section, uint64_t *end, uint64_t bytes) {
+    section->offset = *end;
+    section->bytes = bytes;
+    *end += (bytes + 7) & ~(uint64_t)7;
+}
+
+static void WriteAt(int fd, const Section *section, const void *data) {
+    CHECK(pwrite(fd, data, (size_t)section->bytes, (off_t)section->offset) == (ssize_t)section->bytes);
+}
+
+static void WriteSession(const char *path, const uint16_t *text, size_t length, const TextLineIndex *lines) {
+    Header header;
+    memset(&header, 0, sizeof(header));
+    uint64_t end = sizeof(Header);
+    Plan(&header.text, &end, ((uint64_t)length + 1) * sizeof(uint16_t));
+    header.lines = *lines;
+    header.lines.deltas = NULL;
+    header.lines.blocks = NULL;
+    header.lines.lineSums = header.lines.unitSums = NULL;
+    header.lines.freeSlots = NULL;
+    header.lines.freeCount = header.lines.slotCapacity = header.lines.blockCapacity = 0;
+    Plan(&header.blocks, &end, lines->blockCount * sizeof(TextLineBlock));
+    Plan(&header.deltas, &end, lines->slotCount * TEXT_LINES_BLOCK * sizeof(uint32_t));
+    header.fileBytes = end;
+
+    uint8_t *image = (uint8_t *)CheckedAlloc((size_t)end);
+    memset(image, 0, (size_t)end);
+    memcpy(image + header.text.offset, text, (size_t)header.text.bytes - sizeof(uint16_t));
+    memcpy(image + header.blocks.offset, lines->blocks, (size_t)header.blocks.bytes);
+    memcpy(image + header.deltas.offset, lines->deltas, (size_t)header.deltas.bytes);
+    header.contentCheck = TextHash64(image + sizeof(Header), (size_t)(end - sizeof(Header)), 0);
+    memcpy(image, &header, sizeof(header));
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    CHECK(fd >= 0);
+    Section all = { 0, end };
+    WriteAt(fd, &all, image);
+    close(fd);
+    free(image);
+}
+
+int main(void) {
+    char filePath[] = "/tmp/retropad-bench-session-file-XXXXXX";
+    char sessionPath[] = "/tmp/retropad-bench-session-rps-XXXXXX";
+    int fd = mkstemp(filePath);
+    int sfd = mkstemp(sessionPath);
+    if (fd < 0 || sfd < 0) {
+        perror("mkstemp");
+        return 2;
+    }
+    close(sfd);
+    uint8_t *bytes = (uint8_t *)CheckedAlloc(FILE_BYTES);
+    static const char line[] = "2024-05-01 12:00:00 INFO caf\xC3\xA9 served /index.html in 12 ms\r\n";
+    for (size_t n = 0; n < FILE_BYTES; ++n) bytes[n] = (uint8_t)line[n % (sizeof(line) - 1)];
+    CHECK(write(fd, bytes, FILE_BYTES) == (ssize_t)FILE_BYTES);
+    close(fd);
+    free(bytes);
+
+    // Without a session: read, decode and index, as a load does.
+    double t0 = NowSeconds();
+    fd = open(filePath, O_RDONLY);
+    bytes = (uint8_t *)CheckedAlloc(FILE_BYTES);
+    CHECK(read(fd, bytes, FILE_BYTES) == (ssize_t)FILE_BYTES);
+    close(fd);
+    uint16_t *decoded = (uint16_t *)CheckedAlloc((TextDecoderMaxOutput(ENC_UTF8, FILE_BYTES) + 1) * sizeof(uint16_t));
+    TextDecoder dec;
+    TextDecoderInit(&dec, ENC_UTF8);
+    size_t length = TextDecoderDecode(&dec, bytes, FILE_BYTES, true, decoded);
+    TextLineIndex lines;
+    TextLineIndexInit(&lines);
+    for (size_t at = 0; at < length; at += CHUNK_UNITS) {
+        CHECK(TextLineIndexAppend(&lines, decoded + at, length - at < CHUNK_UNITS ? length - at : CHUNK_UNITS));
+    }
+    TextLineIndexFinish(&lines);
+    double cold = NowSeconds() - t0;
+    free(bytes);
+
+    WriteSession(sessionPath, decoded, length, &lines);
+
+    // With one: map it, check it, copy the lines out, hand the text over.
+    t0 = NowSeconds();
+    fd = open(sessionPath, O_RDONLY);
+    struct stat st;
+    CHECK(fstat(fd, &st) == 0);
+    const uint8_t *view = (const uint8_t *)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    CHECK(view != MAP_FAILED);
+    const Header *header = (const Header *)view;
+    CHECK(header->fileBytes == (uint64_t)st.st_size);
+    CHECK(TextHash64(view + sizeof(Header), (size_t)(header->fileBytes - sizeof(Header)), 0) == header->contentCheck);
+    double checked = NowSeconds() - t0;
+    TextLineIndex mapped = header->lines;
+    mapped.blocks = (TextLineBlock *)(view + header->blocks.offset);
+    mapped.deltas = (uint32_t *)(view + header->deltas.offset);
+    TextLineIndex restored;
+    CHECK(TextLineIndexCopy(&restored, &mapped));
+    size_t restoredLength = (size_t)(header->text.bytes / sizeof(uint16_t) - 1);
+    uint16_t *control = (uint16_t *)CheckedAlloc((restoredLength + 1) * sizeof(uint16_t));
+    memcpy(control, view + header->text.offset, (restoredLength + 1) * sizeof(uint16_t));
+    double warm = NowSeconds() - t0;
+    munmap((void *)view, (size_t)st.st_size);
+
+    CHECK(restoredLength == length);
+    CHECK(memcmp(control, decoded, length * sizeof(uint16_t)) == 0);
+    size_t want = 0, got = 0;
+    CHECK(TextLineIndexCount(&lines, &want) && TextLineIndexCount(&restored, &got) && want == got);
+    uint64_t a = 0, b = 0;
+    CHECK(TextLineIndexLineStart(&lines, want / 2, &a) && TextLineIndexLineStart(&restored, want / 2, &b) && a == b);
+
+    printf("document %u MB, session %.0f MB\n", FILE_BYTES >> 20, (double)st.st_size / (1024.0 * 1024.0));
+    printf("decode the file  %7.1f ms\n", cold * 1e3);
+    printf("restore session  %7.1f ms (%.1f ms of it checking the snapshot)%s\n", warm * 1e3, checked * 1e3,
+           warm * 1e3 > RESTORE_TARGET_MS ? "  over target" : "");
+    CHECK(warm * 1e3 <= RESTORE_TARGET_MS);
+
+    TextLineIndexFree(&restored);
+    TextLineIndexFree(&lines);
+    free(control);
+    free(decoded);
+    unlink(sessionPath);
+    unlink(filePath);
+    return g_failures ? 1 : 0;
+}
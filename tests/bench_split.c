@@ -0,0 +1,109 @@
+// Split and join throughput over a 256 MB log read from disk, by size, by
+// line count and by pattern, and a join of the pieces. Pieces are written
+// to /dev/null so the figures are the scanning and copying, not the disk.
+#include "check.h"
+#include "text_split.h"
+
+#include <unistd.h>
+
+#define FILE_BYTES (256u * 1024u * 1024u)
+
+typedef struct NullSink {
+    FILE *out;
+    uint64_t bytes;
+} NullSink;
+
+static size_t ReadStdio(void *context, uint8_t *buffer, size_t size) {
+    return fread(buffer, 1, size, (FILE *)context);
+}
+
+// The next `left` bytes of a file, standing in for one part file.
+typedef struct PartReader {
+    FILE *file;
+    size_t left;
+} PartReader;
+
+static size_t ReadPart(void *context, uint8_t *buffer, size_t size) {
+    PartReader *p = (PartReader *)context;
+    size_t n = fread(buffer, 1, size < p->left ? size : p->left, p->file);
+    p->left -= n;
+    return n;
+}
+
+static bool Begin(void *context, uint32_t index) {
+    (void)context;
+    (void)index;
+    return true;
+}
+
+static bool Write(void *context, const uint8_t *data, size_t size) {
+    NullSink *s = (NullSink *)context;
+    s->bytes += size;
+    return fwrite(data, 1, size, s->out) == size;
+}
+
+static bool End(void *context) {
+    (void)context;
+    return true;
+}
+
+static void RunSplit(const char *name, const TextSplitOptions *options, const char *path, FILE *null) {
+    FILE *f = fopen(path, "rb");
+    NullSink out = { null, 0 };
+    TextSplitSink sink = { Begin, Write, End, &out };
+    uint32_t pieces = 0;
+    double t0 = NowSeconds();
+    CHECK(TextSplit(options, ReadStdio, f, &sink, &pieces));
+    double seconds = NowSeconds() - t0;
+    fclose(f);
+    CHECK(out.bytes == FILE_BYTES);
+    printf("split %-12s %5u pieces  %6.0f MB/s\n", name, pieces, MegabytesPerSecond(FILE_BYTES, seconds));
+}
+
+int main(void) {
+    char path[] = "/tmp/retropad-bench-split-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 2;
+    }
+    FILE *f = fdopen(fd, "wb");
+    uint32_t seed = 3;
+    for (size_t n = 0; n < FILE_BYTES;) {
+        char line[128];
+        uint32_t r = NextRandom(&seed);
+        int len = snprintf(line, sizeof(line), "2024-05-01 12:00:%02u %s request %u served in %u ms\r\n", r % 60,
+                           r % 1000 == 0 ? "ERROR" : "INFO", r % 100000, r % 500);
+        size_t take = (size_t)len < FILE_BYTES - n ? (size_t)len : FILE_BYTES - n;
+        fwrite(line, 1, take, f);
+        n += take;
+    }
+    fclose(f);
+    FILE *null = fopen("/dev/null", "wb");
+
+    TextSplitOptions bySize = { TEXT_SPLIT_BYTES, 16u * 1024u * 1024u, NULL, 0, ENC_UTF8 };
+    TextSplitOptions byLines = { TEXT_SPLIT_LINES, 100000, NULL, 0, ENC_UTF8 };
+    TextSplitOptions byMatch = { TEXT_SPLIT_MATCH, 0, (const uint8_t *)"ERROR", 5, ENC_UTF8 };
+    RunSplit("16 MB", &bySize, path, null);
+    RunSplit("100k lines", &byLines, path, null);
+    RunSplit("\"ERROR\"", &byMatch, path, null);
+
+    // Join: the file read back as 16 parts of 16 MB.
+    TextJoiner joiner;
+    CHECK(TextJoinerInit(&joiner));
+    NullSink out = { null, 0 };
+    f = fopen(path, "rb");
+    double t0 = NowSeconds();
+    for (int i = 0; i < 16; ++i) {
+        PartReader part = { f, FILE_BYTES / 16 };
+        CHECK(TextJoinerAdd(&joiner, ReadPart, &part, Write, &out) == TEXT_JOIN_OK);
+    }
+    double seconds = NowSeconds() - t0;
+    CHECK(joiner.parts == 16 && out.bytes == FILE_BYTES);
+    printf("join  %-12s %5u parts   %6.0f MB/s\n", "16 x 16 MB", joiner.parts, MegabytesPerSecond(out.bytes, seconds));
+    fclose(f);
+    TextJoinerFree(&joiner);
+    fclose(null);
+    unlink(path);
+    return g_failures ? 1 : 0;
+}
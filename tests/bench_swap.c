@@ -0,0 +1,60 @@
+// UTF-16 byte swapping (UTF-16BE load and save): each kernel this CPU has
+// against the scalar loop, with memcpy of the same bytes as the ceiling.
+#include "check.h"
+#include "text_codec.h"
+
+#define UNITS (32u * 1024u * 1024u)
+
+static double TimeSwap(const uint8_t *src, uint8_t *dst) {
+    double best = 1e9;
+    for (int round = 0; round < 5; ++round) {
+        double t0 = NowSeconds();
+        TextSwapBytes16(src, UNITS, dst);
+        double t = NowSeconds() - t0;
+        if (t < best) best = t;
+    }
+    return best;
+}
+
+int main(void) {
+    static const struct {
+        TextCodecKernels kernels;
+        const char *name;
+    } variants[] = { { TEXT_KERNELS_SCALAR, "scalar" }, { TEXT_KERNELS_SSE2, "sse2" }, { TEXT_KERNELS_AVX2, "avx2" },
+                     { TEXT_KERNELS_NEON, "neon" } };
+    const size_t bytes = (size_t)UNITS * 2;
+    uint8_t *src = (uint8_t *)CheckedAlloc(bytes);
+    uint8_t *dst = (uint8_t *)CheckedAlloc(bytes);
+    uint8_t *expect = (uint8_t *)CheckedAlloc(bytes);
+    uint32_t seed = 5;
+    for (size_t i = 0; i < bytes; ++i) src[i] = (uint8_t)NextRandom(&seed);
+    TextCodecUseKernels(TEXT_KERNELS_SCALAR);
+    TextSwapBytes16(src, UNITS, expect);
+
+    double best = 1e9;
+    for (int round = 0; round < 5; ++round) {
+        double t0 = NowSeconds();
+        memcpy(dst, src, bytes);
+        double t = NowSeconds() - t0;
+        if (t < best) best = t;
+    }
+    printf("%-8s %8.0f MB/s\n", "memcpy", MegabytesPerSecond(bytes, best));
+
+    for (size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); ++v) {
+        if (!TextCodecUseKernels(variants[v].kernels)) continue;
+        double t = TimeSwap(src, dst);
+        CHECK(memcmp(dst, expect, bytes) == 0);
+        memcpy(dst, src, bytes);
+        double t0 = NowSeconds();
+        TextSwapBytes16(dst, UNITS, dst);
+        double inPlace = NowSeconds() - t0;
+        CHECK(memcmp(dst, expect, bytes) == 0);
+        printf("%-8s %8.0f MB/s  in place %8.0f MB/s\n", variants[v].name, MegabytesPerSecond(bytes, t),
+               MegabytesPerSecond(bytes, inPlace));
+    }
+    TextCodecUseKernels(TEXT_KERNELS_AUTO);
+    free(src);
+    free(dst);
+    free(expect);
+    return g_failures ? 1 : 0;
+}
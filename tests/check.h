@@ -0,0 +1,59 @@
+// Shared helpers for the headless tests and benchmarks of the portable
+// text_* modules. Everything is static: each program is one translation
+// unit plus the modules it exercises.
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static int g_failures;
+
+#define CHECK(cond)                                                                  \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            g_failures++;                                                            \
+        }                                                                            \
+    } while (0)
+
+// Ends main: prints the verdict and returns the exit status.
+static inline int CheckReport(const char *name) {
+    if (g_failures) {
+        fprintf(stderr, "%s: %d check(s) failed\n", name, g_failures);
+        return 1;
+    }
+    printf("%s: ok\n", name);
+    return 0;
+}
+
+static inline double NowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// xorshift32: deterministic inputs without depending on the libc generator.
+static inline uint32_t NextRandom(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static inline void *CheckedAlloc(size_t bytes) {
+    void *p = malloc(bytes ? bytes : 1);
+    if (!p) {
+        fprintf(stderr, "out of memory (%zu bytes)\n", bytes);
+        exit(2);
+    }
+    return p;
+}
+
+static inline double MegabytesPerSecond(uint64_t bytes, double seconds) {
+    return seconds > 0 ? (double)bytes / (1024.0 * 1024.0) / seconds : 0.0;
+}
@@ -0,0 +1,142 @@
+// Verbatim-save planning (text_baseline.c): a file assembled from the
+// planned copies and the encoded middle must equal a full save of the edited
+// document, for random edits in UTF-8 and UTF-16; files whose BOM differs
+// from what a full save writes, and rewrites, are never reused.
+#include "check.h"
+#include "text_baseline.h"
+
+#define MARK_UNITS 1000 // the loader marks every chunk; smaller here for coverage
+
+typedef struct Bytes {
+    uint8_t *data;
+    size_t size;
+} Bytes;
+
+static size_t Encode(TextEncoding encoding, const uint16_t *text, size_t units, uint8_t *out) {
+    if (encoding == ENC_UTF8) return TextEncodeUtf8(text, units, out);
+    if (encoding == ENC_UTF16BE) TextSwapBytes16(text, units, out);
+    else memcpy(out, text, units * 2);
+    return units * 2;
+}
+
+static const uint8_t *Bom(TextEncoding encoding, size_t *lengthOut) {
+    static const uint8_t utf8[] = { 0xEF, 0xBB, 0xBF }, le[] = { 0xFF, 0xFE }, be[] = { 0xFE, 0xFF };
+    *lengthOut = encoding == ENC_UTF8 ? 3 : 2;
+    return encoding == ENC_UTF8 ? utf8 : encoding == ENC_UTF16LE ? le : be;
+}
+
+// A full save: BOM, then the text in MARK_UNITS pieces, marking each.
+static Bytes SaveFull(TextEncoding encoding, const uint16_t *text, size_t units, bool withBom, TextBaseline *map) {
+    Bytes file = { (uint8_t *)CheckedAlloc(units * 3 + 3), 0 };
+    size_t bomLength = 0;
+    const uint8_t *bom = Bom(encoding, &bomLength);
+    if (!withBom) bomLength = 0;
+    memcpy(file.data, bom, bomLength);
+    file.size = bomLength;
+    TextBaselineInit(map, encoding);
+    TextBaselineAddMark(map, 0, file.size);
+    for (size_t pos = 0; pos < units;) {
+        size_t n = units - pos < MARK_UNITS ? units - pos : MARK_UNITS;
+        if (pos + n < units && text[pos + n - 1] >= 0xD800 && text[pos + n - 1] <= 0xDBFF) n--;
+        file.size += Encode(encoding, text + pos, n, file.data + file.size);
+        pos += n;
+        TextBaselineAddMark(map, pos, file.size);
+    }
+    TextBaselineSeal(map, units);
+    return file;
+}
+
+static void RandomText(uint16_t *text, size_t units, uint32_t *seed) {
+    for (size_t i = 0; i < units; ++i) {
+        uint32_t r = NextRandom(seed) % 8;
+        if (r < 5) text[i] = (uint16_t)('a' + NextRandom(seed) % 26);
+        else if (r < 6) text[i] = 0x00E9;
+        else if (r < 7) text[i] = 0x65E5;
+        else if (i + 1 < units) {
+            text[i++] = 0xD83D;
+            text[i] = 0xDE00;
+        } else text[i] = '\n';
+    }
+}
+
+static void TestPlannedSaves(TextEncoding encoding) {
+    enum { Units = 20000 };
+    uint32_t seed = 1 + (uint32_t)encoding;
+    uint16_t *text = (uint16_t *)CheckedAlloc(Units * 2);
+    uint16_t *edited = (uint16_t *)CheckedAlloc((Units + 600) * 2);
+    RandomText(text, Units, &seed);
+    size_t bomLength = 0;
+    Bom(encoding, &bomLength);
+
+    for (int round = 0; round < 200; ++round) {
+        TextBaseline map;
+        Bytes file = SaveFull(encoding, text, Units, true, &map);
+
+        // Replace [at, at + removed) with `added` fresh units.
+        size_t at = NextRandom(&seed) % Units;
+        size_t removed = NextRandom(&seed) % 500;
+        if (at + removed > Units) removed = Units - at;
+        size_t added = NextRandom(&seed) % 500;
+        memcpy(edited, text, at * 2);
+        RandomText(edited + at, added, &seed);
+        memcpy(edited + at + added, text + at + removed, (Units - at - removed) * 2);
+        size_t length = Units - removed + added;
+        TextBaselineNoteEdit(&map, at, at + added, length);
+
+        TextBaselinePlan plan;
+        if (TextBaselinePlanSave(&map, bomLength, edited, length, &plan)) {
+            CHECK(plan.middleStart <= at && plan.middleEnd >= at + added);
+            Bytes out = { (uint8_t *)CheckedAlloc(length * 3 + 3), 0 };
+            memcpy(out.data, file.data, plan.prefixBytes);
+            out.size = plan.prefixBytes;
+            out.size += Encode(encoding, edited + plan.middleStart, plan.middleEnd - plan.middleStart, out.data + out.size);
+            memcpy(out.data + out.size, file.data + plan.suffixFrom, plan.suffixTo - plan.suffixFrom);
+            out.size += plan.suffixTo - plan.suffixFrom;
+
+            TextBaseline fullMap;
+            Bytes full = SaveFull(encoding, edited, length, true, &fullMap);
+            CHECK(out.size == full.size);
+            CHECK(memcmp(out.data, full.data, full.size) == 0);
+            free(out.data);
+            free(full.data);
+            TextBaselineFree(&fullMap);
+        } else {
+            CHECK(at == 0 && at + removed == Units); // only a total rewrite has nothing to keep
+        }
+        TextBaselineFree(&map);
+        free(file.data);
+    }
+    free(text);
+    free(edited);
+}
+
+static void TestRefusals(void) {
+    uint16_t text[3000];
+    uint32_t seed = 3;
+    RandomText(text, 3000, &seed);
+    TextBaselinePlan plan;
+
+    // A UTF-8 file without a BOM: a full save would add one.
+    TextBaseline map;
+    Bytes file = SaveFull(ENC_UTF8, text, 3000, false, &map);
+    TextBaselineNoteEdit(&map, 1500, 1501, 3000);
+    CHECK(!TextBaselinePlanSave(&map, 3, text, 3000, &plan));
+    CHECK(TextBaselinePlanSave(&map, 0, text, 3000, &plan));
+    TextBaselineFree(&map);
+    free(file.data);
+
+    // Undo / Replace All: nothing is known to be clean.
+    file = SaveFull(ENC_UTF8, text, 3000, true, &map);
+    TextBaselineNoteRewrite(&map);
+    CHECK(!TextBaselinePlanSave(&map, 3, text, 3000, &plan));
+    TextBaselineFree(&map);
+    free(file.data);
+}
+
+int main(void) {
+    TestPlannedSaves(ENC_UTF8);
+    TestPlannedSaves(ENC_UTF16LE);
+    TestPlannedSaves(ENC_UTF16BE);
+    TestRefusals();
+    return CheckReport("test_baseline");
+}
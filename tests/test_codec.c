@@ -0,0 +1,271 @@
+// Decoding and vector kernels (text_codec.c): UTF-8 sequences with chunk
+// boundaries at every byte, error offsets, UTF-16BE, and each vector kernel
+// this CPU has against the scalar one.
+#include "check.h"
+#include "text_codec.h"
+
+static size_t DecodeAll(TextEncoding encoding, const uint8_t *data, size_t size, size_t step, uint16_t *out,
+                        TextDecoder *decOut) {
+    TextDecoder dec;
+    TextDecoderInit(&dec, encoding);
+    size_t produced = 0;
+    for (size_t at = 0; at < size || at == 0; at += step) {
+        size_t n = size - at < step ? size - at : step;
+        bool final = at + n >= size;
+        produced += TextDecoderDecode(&dec, data + at, n, final, out ? out + produced : NULL);
+        if (final) break;
+    }
+    if (decOut) *decOut = dec;
+    return produced;
+}
+
+static void TestKnownSequences(void) {
+    // "A", U+00E9, U+20AC, U+1F600 (a surrogate pair).
+    static const uint8_t text[] = { 'A', 0xC3, 0xA9, 0xE2, 0x82, 0xAC, 0xF0, 0x9F, 0x98, 0x80 };
+    static const uint16_t expect[] = { 'A', 0x00E9, 0x20AC, 0xD83D, 0xDE00 };
+    uint16_t out[16];
+    TextDecoder dec;
+    for (size_t step = 1; step <= sizeof(text); ++step) {
+        size_t n = DecodeAll(ENC_UTF8, text, sizeof(text), step, out, &dec);
+        CHECK(n == 5);
+        CHECK(memcmp(out, expect, sizeof(expect)) == 0);
+        CHECK(dec.invalidCount == 0 && dec.firstInvalidOffset == UINT64_MAX);
+        CHECK(dec.surrogateCount == 0);
+    }
+    CHECK(DecodeAll(ENC_UTF8, text, sizeof(text), sizeof(text), NULL, NULL) == 5);
+}
+
+static void TestInvalidInput(void) {
+    // 40 ASCII bytes so the bad byte lands past the first vector block, then
+    // a stray continuation byte, an overlong form and a truncated sequence.
+    uint8_t text[64];
+    memset(text, 'x', 40);
+    size_t size = 40;
+    text[size++] = 0x80;
+    text[size++] = 0xC0;
+    text[size++] = 0xAF;
+    text[size++] = 'y';
+    text[size++] = 0xE2;
+    text[size++] = 0x82;
+    uint16_t out[64];
+    TextDecoder dec;
+    for (size_t step = 1; step <= size; ++step) {
+        size_t n = DecodeAll(ENC_UTF8, text, size, step, out, &dec);
+        CHECK(n == 40 + 3 + 1 + 1);
+        CHECK(dec.invalidCount == 4);
+        CHECK(dec.firstInvalidOffset == 40);
+        CHECK(out[40] == 0xFFFD && out[43] == 'y' && out[44] == 0xFFFD);
+    }
+}
+
+static void TestEncodedSurrogates(void) {
+    // ED A0 80 is U+D800: passed through and reported, not replaced.
+    static const uint8_t text[] = { 'a', 'b', 0xED, 0xA0, 0x80, 'c' };
+    uint16_t out[8];
+    TextDecoder dec;
+    size_t n = DecodeAll(ENC_UTF8, text, sizeof(text), 1, out, &dec);
+    CHECK(n == 4);
+    CHECK(out[2] == 0xD800);
+    CHECK(dec.invalidCount == 0);
+    CHECK(dec.surrogateCount == 1 && dec.firstSurrogateOffset == 2);
+}
+
+// Random mixes of ASCII runs and multi-byte characters, decoded with the
+// vector kernels and with the scalar decoder in uneven chunks.
+static void TestVectorMatchesScalar(void) {
+    static const char *const pieces[] = { "plain ascii text that fills a vector or two ", "\xC3\xA9", "\xE6\x97\xA5\xE6\x9C\xAC",
+                                          "\xF0\x9F\x98\x80", "\n", "\xFF", "\xE2\x82" };
+    const size_t size = 1 << 16;
+    uint8_t *text = (uint8_t *)CheckedAlloc(size);
+    uint32_t seed = 12345;
+    size_t used = 0;
+    while (used < size) {
+        const char *piece = pieces[NextRandom(&seed) % (sizeof(pieces) / sizeof(pieces[0]))];
+        size_t n = strlen(piece);
+        if (used + n > size) n = size - used;
+        memcpy(text + used, piece, n);
+        used += n;
+    }
+
+    uint16_t *fast = (uint16_t *)CheckedAlloc(TextDecoderMaxOutput(ENC_UTF8, size) * 2);
+    uint16_t *slow = (uint16_t *)CheckedAlloc(TextDecoderMaxOutput(ENC_UTF8, size) * 2);
+    TextDecoder a, b;
+    size_t steps[] = { 1, 7, 33, 4096, size };
+    for (size_t s = 0; s < sizeof(steps) / sizeof(steps[0]); ++s) {
+        TextCodecUseKernels(TEXT_KERNELS_AUTO);
+        size_t n = DecodeAll(ENC_UTF8, text, size, steps[s], fast, &a);
+        TextCodecUseKernels(TEXT_KERNELS_SCALAR);
+        size_t m = DecodeAll(ENC_UTF8, text, size, size, slow, &b);
+        TextCodecUseKernels(TEXT_KERNELS_AUTO);
+        CHECK(n == m);
+        CHECK(memcmp(fast, slow, n * 2) == 0);
+        CHECK(a.invalidCount == b.invalidCount && a.firstInvalidOffset == b.firstInvalidOffset);
+        CHECK(a.invalidCount > 0);
+    }
+    free(text);
+    free(fast);
+    free(slow);
+}
+
+static void TestBom(void) {
+    static const uint8_t utf8[] = { 0xEF, 0xBB, 0xBF, 'a' };
+    static const uint8_t le[] = { 0xFF, 0xFE, 'a', 0 };
+    static const uint8_t be[] = { 0xFE, 0xFF, 0, 'a' };
+    TextEncoding encoding = ENC_ANSI;
+    CHECK(TextDetectBom(utf8, sizeof(utf8), &encoding) && encoding == ENC_UTF8);
+    CHECK(TextDetectBom(le, sizeof(le), &encoding) && encoding == ENC_UTF16LE);
+    CHECK(TextDetectBom(be, sizeof(be), &encoding) && encoding == ENC_UTF16BE);
+    CHECK(!TextDetectBom(utf8, 2, &encoding));
+    CHECK(TextBomLength(utf8, sizeof(utf8), ENC_UTF8) == 3);
+    CHECK(TextBomLength(utf8, sizeof(utf8), ENC_UTF16LE) == 0);
+}
+
+static const TextCodecKernels g_vectorKernels[] = { TEXT_KERNELS_SSE2, TEXT_KERNELS_AVX2, TEXT_KERNELS_NEON };
+
+static void ReferenceSwap(const uint8_t *src, size_t units, uint8_t *dst) {
+    for (size_t k = 0; k < units; ++k) {
+        dst[2 * k] = src[2 * k + 1];
+        dst[2 * k + 1] = src[2 * k];
+    }
+}
+
+// Odd lengths around every vector width, misaligned source and target, and
+// the in-place form the UTF-16BE decoder relies on.
+static void TestSwapBytes(void) {
+    enum { MaxUnits = 100, Slack = 8 };
+    uint8_t src[2 * MaxUnits + Slack], dst[2 * MaxUnits + Slack], expect[2 * MaxUnits + Slack];
+    uint32_t seed = 99;
+    for (size_t i = 0; i < sizeof(src); ++i) src[i] = (uint8_t)NextRandom(&seed);
+
+    for (size_t v = 0; v < sizeof(g_vectorKernels) / sizeof(g_vectorKernels[0]); ++v) {
+        if (!TextCodecUseKernels(g_vectorKernels[v])) continue;
+        for (size_t units = 0; units <= MaxUnits; ++units) {
+            for (size_t from = 0; from < 4; ++from) {
+                for (size_t to = 0; to < 4; ++to) {
+                    ReferenceSwap(src + from, units, expect);
+                    memset(dst, 0xAA, sizeof(dst));
+                    TextSwapBytes16(src + from, units, dst + to);
+                    CHECK(memcmp(dst + to, expect, 2 * units) == 0);
+                    CHECK(dst[to + 2 * units] == 0xAA); // nothing written past the end
+                    if (to > 0) CHECK(dst[to - 1] == 0xAA);
+                }
+                memcpy(dst + from, src + from, 2 * units);
+                TextSwapBytes16(dst + from, units, dst + from);
+                ReferenceSwap(src + from, units, expect);
+                CHECK(memcmp(dst + from, expect, 2 * units) == 0);
+            }
+        }
+    }
+    TextCodecUseKernels(TEXT_KERNELS_AUTO);
+}
+
+// The other kernels, each against the scalar one over the same inputs.
+static void TestKernelsAgree(void) {
+    enum { Units = 300 };
+    uint8_t bytes[Units];
+    uint16_t text[Units], wideA[Units], wideB[Units];
+    uint8_t narrowA[Units], narrowB[Units];
+    uint32_t seed = 7;
+    for (int round = 0; round < 200; ++round) {
+        // Mostly ASCII with an occasional high byte / break at a random spot.
+        for (size_t i = 0; i < Units; ++i) {
+            bytes[i] = (uint8_t)('a' + NextRandom(&seed) % 26);
+            text[i] = bytes[i];
+        }
+        size_t spot = NextRandom(&seed) % Units;
+        bytes[spot] = 0xC3;
+        text[spot] = (round & 1) ? 0x0A : 0x0100;
+        size_t len = Units - NextRandom(&seed) % 40;
+
+        TextCodecUseKernels(TEXT_KERNELS_SCALAR);
+        size_t lineBreak = TextFindLineBreak(text, len);
+        size_t pair = TextFindUnitPair(text, len - 3, text[spot], text[spot < Units - 3 ? spot + 3 : 0], 3);
+        for (size_t v = 0; v < sizeof(g_vectorKernels) / sizeof(g_vectorKernels[0]); ++v) {
+            if (!TextCodecUseKernels(g_vectorKernels[v])) continue;
+            CHECK(TextFindLineBreak(text, len) == lineBreak);
+            CHECK(TextFindUnitPair(text, len - 3, text[spot], text[spot < Units - 3 ? spot + 3 : 0], 3) == pair);
+            // Widen/narrow may stop early (whole vectors only) but never
+            // past the first non-ASCII unit, and what they did convert must
+            // be right.
+            size_t w = TextWidenAscii(bytes, len, wideA);
+            CHECK(w <= (spot < len ? spot : len));
+            for (size_t i = 0; i < w; ++i) wideB[i] = bytes[i];
+            CHECK(memcmp(wideA, wideB, w * 2) == 0);
+            size_t n = TextNarrowAscii(text, len, narrowA);
+            CHECK(n <= len);
+            for (size_t i = 0; i < n; ++i) {
+                CHECK(text[i] < 0x80);
+                narrowB[i] = (uint8_t)text[i];
+            }
+            CHECK(memcmp(narrowA, narrowB, n) == 0);
+        }
+    }
+    TextCodecUseKernels(TEXT_KERNELS_AUTO);
+}
+
+static void TestUtf16BigEndian(void) {
+    uint8_t data[2 * 70 + 1];
+    uint16_t expect[70], out[80];
+    for (size_t k = 0; k < 70; ++k) {
+        expect[k] = (uint16_t)(0x3000 + k * 7);
+        data[2 * k] = (uint8_t)(expect[k] >> 8);
+        data[2 * k + 1] = (uint8_t)expect[k];
+    }
+    data[140] = 0x12; // dangling odd byte: dropped
+    for (size_t step = 1; step <= sizeof(data); step += 4) {
+        size_t n = DecodeAll(ENC_UTF16BE, data, sizeof(data), step, out, NULL);
+        CHECK(n == 70);
+        CHECK(memcmp(out, expect, sizeof(expect)) == 0);
+    }
+}
+
+// Encoding then decoding gives the text back, and a lone surrogate comes
+// back as U+FFFD; with every kernel set.
+static void TestEncodeUtf8(void) {
+    enum { Units = 5000 };
+    uint16_t *text = (uint16_t *)CheckedAlloc(Units * 2);
+    uint16_t *back = (uint16_t *)CheckedAlloc((Units + 8) * 2);
+    uint8_t *bytes = (uint8_t *)CheckedAlloc(Units * 3);
+    uint32_t seed = 31;
+    for (size_t i = 0; i < Units; ++i) {
+        uint32_t r = NextRandom(&seed) % 10;
+        if (r < 6) text[i] = (uint16_t)(' ' + NextRandom(&seed) % 90);
+        else if (r < 7) text[i] = (uint16_t)(0x80 + NextRandom(&seed) % 0x780);
+        else if (r < 9) text[i] = (uint16_t)(0x800 + NextRandom(&seed) % 0xD000);
+        else if (i + 1 < Units) {
+            text[i++] = (uint16_t)(0xD800 + NextRandom(&seed) % 0x400);
+            text[i] = (uint16_t)(0xDC00 + NextRandom(&seed) % 0x400);
+        } else text[i] = 'z';
+    }
+    static const TextCodecKernels all[] = { TEXT_KERNELS_SCALAR, TEXT_KERNELS_SSE2, TEXT_KERNELS_AVX2, TEXT_KERNELS_NEON };
+    for (size_t v = 0; v < sizeof(all) / sizeof(all[0]); ++v) {
+        if (!TextCodecUseKernels(all[v])) continue;
+        size_t n = TextEncodeUtf8(text, Units, bytes);
+        TextDecoder dec;
+        CHECK(DecodeAll(ENC_UTF8, bytes, n, n, back, &dec) == Units);
+        CHECK(memcmp(back, text, Units * 2) == 0);
+        CHECK(dec.invalidCount == 0 && dec.surrogateCount == 0);
+    }
+    TextCodecUseKernels(TEXT_KERNELS_AUTO);
+
+    static const uint16_t lone[] = { 'a', 0xDC00, 'b', 0xD800 };
+    static const uint8_t expect[] = { 'a', 0xEF, 0xBF, 0xBD, 'b', 0xEF, 0xBF, 0xBD };
+    CHECK(TextEncodeUtf8(lone, 4, bytes) == sizeof(expect));
+    CHECK(memcmp(bytes, expect, sizeof(expect)) == 0);
+    free(text);
+    free(back);
+    free(bytes);
+}
+
+int main(void) {
+    TestKnownSequences();
+    TestInvalidInput();
+    TestEncodedSurrogates();
+    TestVectorMatchesScalar();
+    TestBom();
+    TestSwapBytes();
+    TestKernelsAgree();
+    TestUtf16BigEndian();
+    TestEncodeUtf8();
+    return CheckReport("test_codec");
+}
@@ -0,0 +1,252 @@
+// Single-byte code pages (text_codepage.c): every byte of every page
+// decodes to a distinct character and encodes back, at unaligned starts
+// and lengths; characters a page lacks, and each half of a surrogate pair,
+// become counted '?'; undefined bytes use the U+F780..U+F7FF placeholders
+// only where U+0080..U+00FF is taken; and the ASCII widen/narrow kernels
+// agree with the scalar code on every vector implementation this CPU has.
+#include "check.h"
+#include "text_codec.h"
+#include "text_codepage.h"
+
+static const TextCodecKernels g_vectorKernels[] = { TEXT_KERNELS_SSE2, TEXT_KERNELS_AVX2, TEXT_KERNELS_NEON };
+
+// Every page the module knows: Windows-125x and ISO-8859-n.
+static size_t ListPages(unsigned *pages) {
+    size_t count = 0;
+    for (unsigned cp = 1250; cp <= 1258; ++cp) {
+        if (TextCodePageKnown(cp)) pages[count++] = cp;
+    }
+    for (unsigned cp = 28591; cp <= 28606; ++cp) {
+        if (TextCodePageKnown(cp)) pages[count++] = cp;
+    }
+    return count;
+}
+
+// One table of all 256 characters per page, decoded a byte at a time.
+static void PageTable(unsigned cp, uint16_t table[256]) {
+    for (unsigned b = 0; b < 256; ++b) {
+        uint8_t byte = (uint8_t)b;
+        CHECK(TextCodePageDecode(cp, &byte, 1, &table[b]) == 1);
+    }
+}
+
+static void TestRoundTrip(void) {
+    unsigned pages[32];
+    size_t count = ListPages(pages);
+    CHECK(count == 24);
+    CHECK(!TextCodePageKnown(28602) && !TextCodePageKnown(1249));
+    uint8_t zero = 0;
+    uint16_t unit = 0;
+    CHECK(TextCodePageDecode(1249, &zero, 1, &unit) == 0);
+
+    // ASCII runs long enough for the vectors, broken by high bytes, at
+    // every start alignment and lengths that end mid-vector.
+    enum { SIZE = 4096 + 64 };
+    uint8_t *bytes = (uint8_t *)CheckedAlloc(SIZE + 8);
+    uint16_t *text = (uint16_t *)CheckedAlloc((SIZE + 8) * 2);
+    uint8_t *back = (uint8_t *)CheckedAlloc(SIZE + 8);
+    uint32_t seed = 99;
+    for (size_t i = 0; i < SIZE + 8; ++i) {
+        uint32_t r = NextRandom(&seed);
+        bytes[i] = (uint8_t)(r % 8 == 0 ? 0x80 + (r >> 8) % 0x80 : 0x20 + (r >> 8) % 0x5F);
+    }
+    // And each of the 256 bytes somewhere.
+    for (unsigned b = 0; b < 256; ++b) bytes[1000 + 3 * b] = (uint8_t)b;
+
+    for (size_t p = 0; p < count; ++p) {
+        CHECK(TextCodePageName(pages[p]) != NULL);
+        uint16_t table[256];
+        PageTable(pages[p], table);
+        for (unsigned b = 0; b < 0x80; ++b) CHECK(table[b] == b);
+        for (unsigned a = 0x80; a < 256; ++a) {
+            for (unsigned b = a + 1; b < 256; ++b) CHECK(table[a] != table[b]);
+        }
+        TextCodePageEncoder encoder;
+        CHECK(TextCodePageEncoderInit(&encoder, pages[p]));
+        for (unsigned b = 0; b < 256; ++b) {
+            uint8_t out = 0;
+            uint64_t unmapped = 0;
+            TextCodePageEncode(&encoder, &table[b], 1, &out, &unmapped);
+            CHECK(out == b && unmapped == 0);
+        }
+        static const size_t lengths[] = { 0, 1, 15, 16, 17, 31, 33, 255, 1000 + 3 * 256, SIZE };
+        for (size_t start = 0; start < 4; ++start) {
+            for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); ++l) {
+                size_t n = lengths[l];
+                CHECK(TextCodePageDecode(pages[p], bytes + start, n, text + start) == n);
+                bool same = true;
+                for (size_t i = 0; i < n; ++i) same = same && text[start + i] == table[bytes[start + i]];
+                CHECK(same);
+                uint64_t unmapped = 0;
+                CHECK(TextCodePageEncode(&encoder, text + start, n, back + start, &unmapped) == n);
+                CHECK(unmapped == 0);
+                CHECK(n == 0 || memcmp(back + start, bytes + start, n) == 0);
+            }
+        }
+    }
+    free(bytes);
+    free(text);
+    free(back);
+}
+
+static void TestUnmapped(void) {
+    unsigned pages[32];
+    size_t count = ListPages(pages);
+    // 40 ASCII units so the misses land after a vector's worth, then a CJK
+    // character, a surrogate pair, a lone low surrogate and U+FFFD.
+    uint16_t text[64];
+    size_t units = 0;
+    for (; units < 40; ++units) text[units] = (uint16_t)('a' + units % 26);
+    text[units++] = 0x4E2D;
+    text[units++] = 0xD83D;
+    text[units++] = 0xDE00;
+    text[units++] = 'z';
+    text[units++] = 0xDC00;
+    text[units++] = 0xFFFD;
+    uint8_t out[64];
+    for (size_t p = 0; p < count; ++p) {
+        TextCodePageEncoder encoder;
+        CHECK(TextCodePageEncoderInit(&encoder, pages[p]));
+        uint64_t unmapped = 7; // added to, not replaced
+        CHECK(TextCodePageEncode(&encoder, text, units, out, &unmapped) == units);
+        CHECK(unmapped == 7 + 5);
+        CHECK(out[39] == 'n' && out[40] == '?' && out[41] == '?' && out[42] == '?');
+        CHECK(out[43] == 'z' && out[44] == '?' && out[45] == '?');
+        // Without a counter the output is the same.
+        uint8_t again[64];
+        TextCodePageEncode(&encoder, text, units, again, NULL);
+        CHECK(memcmp(out, again, units) == 0);
+    }
+}
+
+// An undefined byte b decodes to U+00b when no other byte of the page
+// does, and to U+F700 + b otherwise; placeholders from another page (or
+// from another byte) are unmapped.
+static void TestPlaceholders(void) {
+    unsigned pages[32];
+    size_t count = ListPages(pages);
+    size_t placeholders = 0;
+    for (size_t p = 0; p < count; ++p) {
+        uint16_t table[256];
+        PageTable(pages[p], table);
+        bool produced[0x80] = { false };
+        for (unsigned b = 0x80; b < 256; ++b) {
+            if (table[b] < 0xF780 || table[b] > 0xF7FF) continue;
+            CHECK(table[b] == 0xF700 + b);
+            produced[b - 0x80] = true;
+            placeholders++;
+            // Used only because U+00b is some other byte's character.
+            bool taken = false;
+            for (unsigned c = 0x80; c < 256; ++c) taken = taken || table[c] == b;
+            CHECK(taken);
+        }
+        TextCodePageEncoder encoder;
+        CHECK(TextCodePageEncoderInit(&encoder, pages[p]));
+        for (unsigned b = 0x80; b < 256; ++b) {
+            uint16_t ch = (uint16_t)(0xF700 + b);
+            uint8_t out = 0;
+            uint64_t unmapped = 0;
+            TextCodePageEncode(&encoder, &ch, 1, &out, &unmapped);
+            if (produced[b - 0x80]) CHECK(out == b && unmapped == 0);
+            else CHECK(out == '?' && unmapped == 1);
+        }
+    }
+    // ISO-8859-8 has one (0xD7, whose U+00D7 sits at 0xAA).
+    CHECK(placeholders > 0);
+    uint8_t byte = 0xD7;
+    uint16_t unit = 0;
+    TextCodePageDecode(28598, &byte, 1, &unit);
+    CHECK(unit == 0xF7D7);
+}
+
+// The ASCII prefix each kernel converts: whole vectors up to the first
+// non-ASCII one, so it may stop short of the scalar run, but never past it
+// and never with different output.
+static size_t AsciiRun(const uint8_t *bytes, size_t size) {
+    size_t i = 0;
+    while (i < size && bytes[i] < 0x80) i++;
+    return i;
+}
+
+static void TestKernels(void) {
+    enum { SIZE = 1024 };
+    uint8_t *bytes = (uint8_t *)CheckedAlloc(SIZE + 8);
+    uint16_t *units = (uint16_t *)CheckedAlloc((SIZE + 8) * 2);
+    uint16_t *wide = (uint16_t *)CheckedAlloc((SIZE + 8) * 2);
+    uint8_t *narrow = (uint8_t *)CheckedAlloc(SIZE + 8);
+    uint16_t *pageText = (uint16_t *)CheckedAlloc((SIZE + 8) * 2);
+    uint16_t *scalarText = (uint16_t *)CheckedAlloc((SIZE + 8) * 2);
+    uint8_t *pageBytes = (uint8_t *)CheckedAlloc(SIZE + 8);
+    uint8_t *scalarBytes = (uint8_t *)CheckedAlloc(SIZE + 8);
+    TextCodePageEncoder encoder;
+    CHECK(TextCodePageEncoderInit(&encoder, 1252));
+
+    CHECK(TextCodecUseKernels(TEXT_KERNELS_SCALAR));
+    CHECK(TextWidenAscii((const uint8_t *)"abc", 3, wide) == 0);
+    CHECK(TextNarrowAscii((const uint16_t *)u"abc", 3, narrow) == 0);
+
+    for (size_t k = 0; k < sizeof(g_vectorKernels) / sizeof(g_vectorKernels[0]); ++k) {
+        if (!TextCodecUseKernels(g_vectorKernels[k])) continue;
+        // One non-ASCII byte (or unit above 0x7F) at each position in turn,
+        // and none at all, over unaligned starts and ragged lengths.
+        for (size_t start = 0; start < 4; ++start) {
+            for (size_t size = 0; size <= 200; size += 1 + size / 16) {
+                for (size_t bad = 0; bad <= size; ++bad) {
+                    for (size_t i = 0; i < size; ++i) {
+                        bytes[start + i] = (uint8_t)(0x20 + i % 0x5F);
+                        units[start + i] = bytes[start + i];
+                    }
+                    if (bad < size) {
+                        bytes[start + bad] = 0x80 | (uint8_t)bad;
+                        units[start + bad] = bad % 2 ? 0x0100 : 0x0080;
+                    }
+                    size_t run = AsciiRun(bytes + start, size);
+                    size_t w = TextWidenAscii(bytes + start, size, wide + start);
+                    CHECK(w <= run);
+                    bool same = true;
+                    for (size_t i = 0; i < w; ++i) same = same && wide[start + i] == bytes[start + i];
+                    CHECK(same);
+                    CHECK(TextWidenAscii(bytes + start, size, NULL) == w);
+                    size_t n = TextNarrowAscii(units + start, size, narrow + start);
+                    CHECK(n <= run);
+                    CHECK(n == 0 || memcmp(narrow + start, bytes + start, n) == 0);
+                    if (bad == size && size >= 64) CHECK(w > 0 && n > 0);
+                }
+            }
+        }
+        // Whole conversions through each kernel match the scalar ones.
+        uint32_t seed = 7;
+        for (size_t i = 0; i < SIZE; ++i) {
+            uint32_t r = NextRandom(&seed);
+            bytes[i] = (uint8_t)(r % 50 == 0 ? 0x80 + (r >> 8) % 0x80 : 0x20 + (r >> 8) % 0x5F);
+        }
+        TextCodePageDecode(1252, bytes, SIZE, pageText);
+        uint64_t fastMisses = 0, slowMisses = 0;
+        pageText[SIZE / 2] = 0x4E2D;
+        TextCodePageEncode(&encoder, pageText, SIZE, pageBytes, &fastMisses);
+        CHECK(TextCodecUseKernels(TEXT_KERNELS_SCALAR));
+        TextCodePageDecode(1252, bytes, SIZE, scalarText);
+        scalarText[SIZE / 2] = 0x4E2D;
+        CHECK(memcmp(pageText, scalarText, SIZE * 2) == 0);
+        TextCodePageEncode(&encoder, scalarText, SIZE, scalarBytes, &slowMisses);
+        CHECK(memcmp(pageBytes, scalarBytes, SIZE) == 0);
+        CHECK(fastMisses == 1 && slowMisses == 1);
+    }
+    TextCodecUseKernels(TEXT_KERNELS_AUTO);
+    free(bytes);
+    free(units);
+    free(wide);
+    free(narrow);
+    free(pageText);
+    free(scalarText);
+    free(pageBytes);
+    free(scalarBytes);
+}
+
+int main(void) {
+    TestRoundTrip();
+    TestUnmapped();
+    TestPlaceholders();
+    TestKernels();
+    return CheckReport("test_codepage");
+}
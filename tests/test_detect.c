@@ -0,0 +1,274 @@
+// Encoding detection (text_detect.c): sample plans for sizes around the
+// whole-file limit, BOM-less UTF-16LE/BE for Latin and CJK text, ASCII,
+// UTF-8 with sparse multibyte characters, CP1252, files holding NULs, and
+// strided samples that begin or end inside a sequence or surrogate pair.
+#include "check.h"
+#include "text_detect.h"
+
+// Mirrors text_detect.c: head + tail + 8 strided samples, 256 KiB.
+#define WHOLE_FILE_BYTES (64u * 1024u + 64u * 1024u + 8u * 16u * 1024u)
+#define BIG_FILE (3u * 1024u * 1024u + 7u)
+
+static void TestPlan(void) {
+    TextSampleSpan spans[TEXT_DETECT_MAX_SAMPLES];
+    CHECK(TextPlanSamples(0, spans, TEXT_DETECT_MAX_SAMPLES) == 0);
+    CHECK(TextPlanSamples(100, spans, 0) == 0);
+
+    static const uint64_t small[] = { 1, 2, WHOLE_FILE_BYTES - 1, WHOLE_FILE_BYTES };
+    for (size_t i = 0; i < sizeof(small) / sizeof(small[0]); ++i) {
+        CHECK(TextPlanSamples(small[i], spans, TEXT_DETECT_MAX_SAMPLES) == 1);
+        CHECK(spans[0].offset == 0 && spans[0].size == small[i]);
+    }
+    // Too few spans to sample: just the first WHOLE_FILE_BYTES.
+    CHECK(TextPlanSamples(BIG_FILE, spans, TEXT_DETECT_MAX_SAMPLES - 1) == 1);
+    CHECK(spans[0].offset == 0 && spans[0].size == WHOLE_FILE_BYTES);
+
+    static const uint64_t large[] = { WHOLE_FILE_BYTES + 1, WHOLE_FILE_BYTES + 2, WHOLE_FILE_BYTES + 3,
+                                      WHOLE_FILE_BYTES + 5, BIG_FILE, (uint64_t)5 << 32 | 3 };
+    for (size_t i = 0; i < sizeof(large) / sizeof(large[0]); ++i) {
+        uint64_t size = large[i];
+        size_t n = TextPlanSamples(size, spans, TEXT_DETECT_MAX_SAMPLES);
+        CHECK(n == TEXT_DETECT_MAX_SAMPLES);
+        CHECK(spans[0].offset == 0 && spans[0].size == 64u * 1024u);
+        for (size_t k = 1; k < n; ++k) {
+            // In file order, 4-byte aligned so UTF-16 stays in phase, and
+            // inside the file.
+            CHECK(spans[k].offset >= spans[k - 1].offset);
+            CHECK(spans[k].offset % 4 == 0);
+            CHECK(spans[k].offset + spans[k].size <= size);
+        }
+        for (size_t k = 1; k + 1 < n; ++k) CHECK(spans[k].size == 16u * 1024u);
+        // With room to spare, no two spans overlap.
+        for (size_t k = 1; size >= 2 * WHOLE_FILE_BYTES && k < n; ++k) {
+            CHECK(spans[k - 1].offset + spans[k - 1].size <= spans[k].offset);
+        }
+        // The tail reaches the last byte: the aligned start adds up to three.
+        const TextSampleSpan *tail = &spans[n - 1];
+        CHECK(tail->offset + tail->size == size);
+        CHECK(tail->size >= 64u * 1024u && tail->size < 64u * 1024u + 4);
+    }
+}
+
+// Runs detection the way the loader does: plan, read each span, score.
+static void Detect(const uint8_t *data, size_t size, EncodingGuess *guess) {
+    TextSampleSpan spans[TEXT_DETECT_MAX_SAMPLES];
+    TextSample samples[TEXT_DETECT_MAX_SAMPLES];
+    size_t n = TextPlanSamples(size, spans, TEXT_DETECT_MAX_SAMPLES);
+    for (size_t i = 0; i < n; ++i) {
+        samples[i].data = data + spans[i].offset;
+        samples[i].size = spans[i].size;
+        samples[i].offset = spans[i].offset;
+    }
+    TextDetectEncoding(samples, n, size, 1252, guess);
+    CHECK(guess->count == 4);
+    CHECK(guess->bomLength == 0);
+    CHECK(guess->sampledWholeFile == (size <= WHOLE_FILE_BYTES));
+    for (size_t i = 1; i < guess->count; ++i) {
+        CHECK(guess->candidates[i - 1].confidence >= guess->candidates[i].confidence);
+    }
+}
+
+static void PutUnit(uint8_t *p, uint16_t u, bool bigEndian) {
+    p[bigEndian ? 1 : 0] = (uint8_t)u;
+    p[bigEndian ? 0 : 1] = (uint8_t)(u >> 8);
+}
+
+// Fills `units` UTF-16 units: English prose, or CJK ideographs with a
+// surrogate pair now and then and a space or line break between phrases.
+static void FillUtf16(uint8_t *p, size_t units, bool bigEndian, bool cjk) {
+    static const char prose[] = "The quick brown fox jumps over the lazy dog.\r\n";
+    uint32_t seed = 5;
+    size_t k = 0;
+    while (k < units) {
+        uint16_t u;
+        if (!cjk) {
+            u = (uint16_t)prose[k % (sizeof(prose) - 1)];
+        } else {
+            uint32_t r = NextRandom(&seed);
+            if (r % 29 == 0 && k + 1 < units) {
+                PutUnit(p + 2 * k++, (uint16_t)(0xD840 + (r >> 8) % 0x40), bigEndian);
+                u = (uint16_t)(0xDC00 + (r >> 16) % 0x400);
+            } else if (r % 13 == 0) {
+                u = r % 2 ? 0x0020 : 0x000A;
+            } else {
+                u = (uint16_t)(0x4E00 + (r >> 8) % 0x5200);
+            }
+        }
+        PutUnit(p + 2 * k++, u, bigEndian);
+    }
+}
+
+static TextEncoding Top(const EncodingGuess *guess) {
+    return guess->candidates[0].encoding;
+}
+
+static void TestUtf16(void) {
+    uint8_t *data = (uint8_t *)CheckedAlloc(BIG_FILE + 1);
+    // Whole-file and sampled sizes; odd ones leave a stray last byte.
+    static const size_t sizes[] = { 4097, WHOLE_FILE_BYTES, BIG_FILE };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        for (int cjk = 0; cjk < 2; ++cjk) {
+            for (int bigEndian = 0; bigEndian < 2; ++bigEndian) {
+                FillUtf16(data, sizes[s] / 2, bigEndian, cjk);
+                if (sizes[s] % 2) data[sizes[s] - 1] = 'x';
+                EncodingGuess guess;
+                Detect(data, sizes[s], &guess);
+                CHECK(Top(&guess) == (bigEndian ? ENC_UTF16BE : ENC_UTF16LE));
+                CHECK(guess.candidates[0].confidence >= (cjk ? 75 : TEXT_DETECT_CONFIDENT));
+                // Byte-oriented readings are pushed well down.
+                for (size_t i = 1; i < guess.count; ++i) CHECK(guess.candidates[i].confidence < 60);
+            }
+        }
+    }
+    free(data);
+}
+
+static void FillAscii(uint8_t *p, size_t size) {
+    static const char prose[] = "Plain ASCII text, line after line.\n";
+    for (size_t i = 0; i < size; ++i) p[i] = (uint8_t)prose[i % (sizeof(prose) - 1)];
+}
+
+static const EncodingCandidate *Find(const EncodingGuess *guess, TextEncoding encoding) {
+    for (size_t i = 0; i < guess->count; ++i) {
+        if (guess->candidates[i].encoding == encoding) return &guess->candidates[i];
+    }
+    return NULL;
+}
+
+static void TestAscii(void) {
+    uint8_t *data = (uint8_t *)CheckedAlloc(BIG_FILE);
+    FillAscii(data, BIG_FILE);
+    EncodingGuess guess;
+    // Read whole, ASCII is certainly UTF-8.
+    Detect(data, WHOLE_FILE_BYTES, &guess);
+    CHECK(Top(&guess) == ENC_UTF8 && guess.candidates[0].confidence == 100);
+    // Sampled, it leads but is not trusted: an unread region may decide.
+    Detect(data, BIG_FILE, &guess);
+    CHECK(Top(&guess) == ENC_UTF8);
+    CHECK(guess.candidates[0].confidence < TEXT_DETECT_CONFIDENT);
+    CHECK(Find(&guess, ENC_ANSI)->codePage == 1252);
+    CHECK(Find(&guess, ENC_UTF16LE)->confidence == 0 && Find(&guess, ENC_UTF16BE)->confidence == 0);
+    free(data);
+}
+
+static void TestUtf8Sparse(void) {
+    uint8_t *data = (uint8_t *)CheckedAlloc(BIG_FILE);
+    FillAscii(data, BIG_FILE);
+    // One e-acute (C3 A9) every 3000 bytes: a handful per sample.
+    for (size_t i = 1500; i + 2 < BIG_FILE; i += 3000) {
+        data[i] = 0xC3;
+        data[i + 1] = 0xA9;
+    }
+    EncodingGuess guess;
+    Detect(data, BIG_FILE, &guess);
+    CHECK(Top(&guess) == ENC_UTF8);
+    CHECK(guess.candidates[0].confidence >= TEXT_DETECT_CONFIDENT);
+    CHECK(Find(&guess, ENC_ANSI)->confidence <= 1);
+    // Just one, in the head: still enough.
+    FillAscii(data, BIG_FILE);
+    data[100] = 0xE2;
+    data[101] = 0x82;
+    data[102] = 0xAC;
+    Detect(data, BIG_FILE, &guess);
+    CHECK(Top(&guess) == ENC_UTF8 && guess.candidates[0].confidence >= TEXT_DETECT_CONFIDENT);
+    free(data);
+}
+
+static void TestCp1252(void) {
+    uint8_t *data = (uint8_t *)CheckedAlloc(BIG_FILE);
+    // "café", "naïve", curly quotes: lone high bytes between ASCII.
+    static const uint8_t highs[] = { 0xE9, 0xEF, 0x93, 0x94, 0xE0, 0xFC };
+    for (size_t s = 0; s < 2; ++s) {
+        size_t size = s ? BIG_FILE : 20000;
+        FillAscii(data, size);
+        for (size_t i = 50, k = 0; i < size; i += 700, ++k) data[i] = highs[k % sizeof(highs)];
+        EncodingGuess guess;
+        Detect(data, size, &guess);
+        CHECK(Top(&guess) == ENC_ANSI && guess.candidates[0].codePage == 1252);
+        CHECK(guess.candidates[0].confidence >= TEXT_DETECT_CONFIDENT);
+        CHECK(Find(&guess, ENC_UTF8)->confidence < 10);
+    }
+    free(data);
+}
+
+static void TestNuls(void) {
+    uint8_t *data = (uint8_t *)CheckedAlloc(BIG_FILE);
+    // ASCII with NULs at both parities: nothing is trusted outright.
+    FillAscii(data, WHOLE_FILE_BYTES);
+    for (size_t i = 1000; i < WHOLE_FILE_BYTES; i += 997) data[i] = 0;
+    EncodingGuess guess;
+    Detect(data, WHOLE_FILE_BYTES, &guess);
+    CHECK(Top(&guess) == ENC_UTF8);
+    CHECK(guess.candidates[0].confidence < TEXT_DETECT_CONFIDENT);
+    CHECK(Find(&guess, ENC_UTF16LE)->confidence < 80 && Find(&guess, ENC_UTF16BE)->confidence < 80);
+    // UTF-16 holding a few U+0000 units is still UTF-16.
+    FillUtf16(data, BIG_FILE / 2, false, false);
+    for (size_t k = 333; k < BIG_FILE / 2; k += 4001) PutUnit(data + 2 * k, 0, false);
+    Detect(data, BIG_FILE, &guess);
+    CHECK(Top(&guess) == ENC_UTF16LE && guess.candidates[0].confidence >= TEXT_DETECT_CONFIDENT);
+    free(data);
+}
+
+static void TestCutSequences(void) {
+    // UTF-8 made only of 2-, 3- and 4-byte sequences: every strided span
+    // starts and ends inside one.
+    static const uint8_t pieces[][4] = { { 0xC3, 0xA9 }, { 0xE2, 0x82, 0xAC }, { 0xF0, 0x9F, 0x98, 0x80 } };
+    static const size_t lengths[] = { 2, 3, 4 };
+    uint8_t *data = (uint8_t *)CheckedAlloc(BIG_FILE + 4);
+    size_t size = 0;
+    for (size_t k = 0; size + 4 <= BIG_FILE; ++k) {
+        memcpy(data + size, pieces[k % 3], lengths[k % 3]);
+        size += lengths[k % 3];
+    }
+    TextSampleSpan spans[TEXT_DETECT_MAX_SAMPLES];
+    size_t n = TextPlanSamples(size, spans, TEXT_DETECT_MAX_SAMPLES);
+    size_t cut = 0;
+    for (size_t i = 1; i < n; ++i) cut += (data[spans[i].offset] & 0xC0) == 0x80;
+    CHECK(cut > 0);
+    EncodingGuess guess;
+    Detect(data, size, &guess);
+    CHECK(Top(&guess) == ENC_UTF8 && guess.candidates[0].confidence >= TEXT_DETECT_CONFIDENT);
+
+    // Hand-cut samples: one opening on a continuation byte, one stopping
+    // mid-sequence short of the end of the file.
+    TextSample samples[2] = { { data, 9, 0 }, { data, 21, 0 } };
+    for (size_t skip = 0; skip < 4; ++skip) {
+        samples[1].data = data + 1000 + skip;
+        samples[1].offset = 1000 + skip;
+        TextDetectEncoding(samples, 2, size, 1252, &guess);
+        CHECK(Top(&guess) == ENC_UTF8);
+        CHECK(Find(&guess, ENC_ANSI)->confidence <= 1);
+    }
+
+    // UTF-16 spans that open on the low half of a surrogate pair, or stop
+    // after a high half, are not bad surrogates.
+    for (int bigEndian = 0; bigEndian < 2; ++bigEndian) {
+        size_t units = BIG_FILE / 2;
+        for (size_t k = 0; k + 1 < units; k += 2) {
+            bool pair = k % 16 != 0;
+            PutUnit(data + 2 * k, pair ? 0xD83D : 0x0020, bigEndian);
+            PutUnit(data + 2 * k + 2, (uint16_t)(pair ? 0xDE01 + k / 2 % 0x3F : 0x4E01), bigEndian);
+        }
+        // Shift by one unit so each 4-aligned span starts on a low half.
+        memmove(data, data + 2, units * 2 - 2);
+        PutUnit(data + units * 2 - 2, 0x000A, bigEndian);
+        samples[0] = (TextSample){ data + 4096, 2, 4096 };
+        samples[1] = (TextSample){ data + 8192, 4096, 8192 };
+        TextDetectEncoding(samples, 2, units * 2, 1252, &guess);
+        CHECK(Find(&guess, bigEndian ? ENC_UTF16BE : ENC_UTF16LE)->confidence > 0);
+        Detect(data, units * 2, &guess);
+        CHECK(Top(&guess) == (bigEndian ? ENC_UTF16BE : ENC_UTF16LE));
+    }
+    free(data);
+}
+
+int main(void) {
+    TestPlan();
+    TestUtf16();
+    TestAscii();
+    TestUtf8Sparse();
+    TestCp1252();
+    TestNuls();
+    TestCutSequences();
+    return CheckReport("test_detect");
+}
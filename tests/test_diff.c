@@ -0,0 +1,183 @@
+// Line diff (text_diff.c): applying the hunks back to front, as a reload
+// does, turns the old text into the new one for random line edits, break
+// style changes and appends; hunks are ordered and apart, unchanged text
+// stays outside them, a search that gives up still yields a correct single
+// hunk, joined hunks apply as well, and offsets map across the changes.
+#include "check.h"
+#include "text_diff.h"
+
+typedef struct Text {
+    uint16_t *units;
+    size_t length;
+} Text;
+
+// Random lines of a few words, each ended by LF, CRLF or (rarely) CR.
+static size_t MakeLines(uint16_t *out, size_t lines, uint32_t *seed) {
+    size_t n = 0;
+    for (size_t i = 0; i < lines; ++i) {
+        size_t len = NextRandom(seed) % 12;
+        for (size_t k = 0; k < len; ++k) out[n++] = (uint16_t)('a' + NextRandom(seed) % 4);
+        uint32_t r = NextRandom(seed) % 20;
+        if (r == 0) {
+            out[n++] = 0x0D;
+        } else if (r < 10) {
+            out[n++] = 0x0D;
+            out[n++] = 0x0A;
+        } else {
+            out[n++] = 0x0A;
+        }
+    }
+    return n;
+}
+
+// Applies `diff` to a copy of `old` the way ApplyReloadedText does.
+static bool AppliesTo(const TextDiff *diff, const uint16_t *old, size_t oldUnits, const uint16_t *text, size_t units) {
+    size_t room = oldUnits + units + 1;
+    uint16_t *buf = (uint16_t *)CheckedAlloc(room * sizeof(uint16_t));
+    memcpy(buf, old, oldUnits * sizeof(uint16_t));
+    size_t length = oldUnits;
+    for (size_t i = diff->count; i-- > 0;) {
+        const TextDiffHunk *h = &diff->hunks[i];
+        size_t removed = h->oldEnd - h->oldStart, added = h->newEnd - h->newStart;
+        memmove(buf + h->oldStart + added, buf + h->oldEnd, (length - h->oldEnd) * sizeof(uint16_t));
+        memcpy(buf + h->oldStart, text + h->newStart, added * sizeof(uint16_t));
+        length = length - removed + added;
+    }
+    bool same = length == units && memcmp(buf, text, units * sizeof(uint16_t)) == 0;
+    free(buf);
+    return same;
+}
+
+static void CheckShape(const TextDiff *diff, size_t oldUnits, size_t newUnits) {
+    for (size_t i = 0; i < diff->count; ++i) {
+        const TextDiffHunk *h = &diff->hunks[i];
+        CHECK(h->oldStart <= h->oldEnd && h->oldEnd <= oldUnits);
+        CHECK(h->newStart <= h->newEnd && h->newEnd <= newUnits);
+        CHECK(h->oldEnd > h->oldStart || h->newEnd > h->newStart);
+        if (i > 0) {
+            CHECK(h->oldStart > diff->hunks[i - 1].oldEnd);
+            CHECK(h->newStart > diff->hunks[i - 1].newEnd);
+            // Text between hunks is shared, so it shifts by a constant.
+            CHECK(h->oldStart - diff->hunks[i - 1].oldEnd == h->newStart - diff->hunks[i - 1].newEnd);
+        }
+    }
+}
+
+// Copies `old` with `edits` random line-sized edits applied.
+static size_t EditLines(const uint16_t *old, size_t oldUnits, uint16_t *out, size_t edits, uint32_t *seed) {
+    size_t n = 0, at = 0;
+    for (size_t e = 0; e < edits && at < oldUnits; ++e) {
+        size_t keep = NextRandom(seed) % (oldUnits / (edits + 1) + 1);
+        if (keep > oldUnits - at) keep = oldUnits - at;
+        memcpy(out + n, old + at, keep * sizeof(uint16_t));
+        n += keep;
+        at += keep;
+        switch (NextRandom(seed) % 3) {
+        case 0: // insert lines
+            n += MakeLines(out + n, 1 + NextRandom(seed) % 3, seed);
+            break;
+        case 1: // delete up to a few lines' worth
+            at += NextRandom(seed) % 30;
+            if (at > oldUnits) at = oldUnits;
+            break;
+        default: // change a unit
+            if (at < oldUnits) {
+                out[n++] = 'z';
+                at++;
+            }
+            break;
+        }
+    }
+    memcpy(out + n, old + at, (oldUnits - at) * sizeof(uint16_t));
+    return n + oldUnits - at;
+}
+
+static void TestRandomEdits(void) {
+    uint32_t seed = 31337;
+    uint16_t *old = (uint16_t *)CheckedAlloc(200000 * sizeof(uint16_t));
+    uint16_t *now = (uint16_t *)CheckedAlloc(400000 * sizeof(uint16_t));
+    for (int round = 0; round < 200; ++round) {
+        size_t oldUnits = MakeLines(old, 1 + NextRandom(&seed) % 2000, &seed);
+        size_t edits = NextRandom(&seed) % 40;
+        size_t units = EditLines(old, oldUnits, now, edits, &seed);
+        TextDiff diff;
+        TextDiffInit(&diff);
+        CHECK(TextDiffLines(&diff, old, oldUnits, now, units, 4096));
+        CHECK(diff.exact);
+        if (edits == 0) CHECK(diff.count == 0);
+        CheckShape(&diff, oldUnits, units);
+        CHECK(AppliesTo(&diff, old, oldUnits, now, units));
+        TextDiffJoin(&diff);
+        CHECK(diff.count <= 1 && AppliesTo(&diff, old, oldUnits, now, units));
+        TextDiffFree(&diff);
+    }
+    free(now);
+    free(old);
+}
+
+static void TestCases(void) {
+    static const uint16_t a[] = { 'o', 'n', 'e', 0x0D, 0x0A, 't', 'w', 'o', 0x0D };
+    static const uint16_t b[] = { 'o', 'n', 'e', 0x0D, 0x0A, 't', 'w', 'o', 0x0D, 0x0A, 'x', 0x0A };
+    static const uint16_t c[] = { 'o', 'n', 'e', 0x0A, 't', 'w', 'o', 0x0D };
+    TextDiff diff;
+    TextDiffInit(&diff);
+
+    // Identical: nothing to do.
+    CHECK(TextDiffLines(&diff, a, 9, a, 9, 16) && diff.count == 0 && diff.exact);
+    CHECK(TextDiffMapOffset(&diff, 7) == 7);
+    // The file grew, and its trailing CR became a CRLF.
+    CHECK(TextDiffLines(&diff, a, 9, b, 12, 16) && diff.count == 1);
+    CHECK(AppliesTo(&diff, a, 9, b, 12));
+    CHECK(TextDiffMapOffset(&diff, 2) == 2);
+    // Only the break style of one line changed.
+    CHECK(TextDiffLines(&diff, a, 9, c, 8, 16) && diff.count == 1);
+    CHECK(AppliesTo(&diff, a, 9, c, 8));
+    CHECK(diff.hunks[0].oldStart <= 3 && diff.hunks[0].oldEnd >= 5);
+    // Empty to text and back.
+    CHECK(TextDiffLines(&diff, a, 0, b, 12, 16) && diff.count == 1 && AppliesTo(&diff, a, 0, b, 12));
+    CHECK(TextDiffLines(&diff, b, 12, a, 0, 16) && diff.count == 1 && AppliesTo(&diff, b, 12, a, 0));
+    TextDiffFree(&diff);
+}
+
+static void TestGiveUpAndMapping(void) {
+    uint32_t seed = 5;
+    size_t lines = 3000;
+    uint16_t *old = (uint16_t *)CheckedAlloc(lines * 20 * sizeof(uint16_t));
+    uint16_t *now = (uint16_t *)CheckedAlloc(lines * 40 * sizeof(uint16_t));
+    size_t oldUnits = MakeLines(old, lines, &seed);
+    // Keep 100 units at each end; rewrite everything between.
+    memcpy(now, old, 100 * sizeof(uint16_t));
+    size_t units = 100 + MakeLines(now + 100, lines, &seed);
+    memcpy(now + units, old + oldUnits - 100, 100 * sizeof(uint16_t));
+    units += 100;
+
+    TextDiff diff;
+    TextDiffInit(&diff);
+    CHECK(TextDiffLines(&diff, old, oldUnits, now, units, 10));
+    CHECK(!diff.exact && diff.count == 1);
+    CHECK(AppliesTo(&diff, old, oldUnits, now, units));
+    const TextDiffHunk *h = &diff.hunks[0];
+    // Offsets outside the hunk keep their place relative to the text.
+    CHECK(TextDiffMapOffset(&diff, 0) == 0);
+    CHECK(TextDiffMapOffset(&diff, oldUnits) == units);
+    CHECK(TextDiffMapOffset(&diff, oldUnits - 1) == units - 1);
+    // Inside it, the column is kept where the new text is long enough.
+    size_t inside = h->oldStart + 5;
+    size_t mapped = TextDiffMapOffset(&diff, inside);
+    CHECK(mapped >= h->newStart && mapped <= h->newEnd);
+    CHECK(mapped == h->newStart + 5 || h->newEnd - h->newStart < 5);
+
+    // Given enough room, the same change is found exactly.
+    CHECK(TextDiffLines(&diff, old, oldUnits, now, units, 8192) && diff.exact);
+    CHECK(AppliesTo(&diff, old, oldUnits, now, units));
+    TextDiffFree(&diff);
+    free(now);
+    free(old);
+}
+
+int main(void) {
+    TestCases();
+    TestRandomEdits();
+    TestGiveUpAndMapping();
+    return CheckReport("test_diff");
+}
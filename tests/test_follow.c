@@ -0,0 +1,167 @@
+// Follow mode core (text_follow.c) against a real file that another writer
+// appends to, polled the way PollFollowedFile does: bytes arriving one at a
+// time (a BOM and multi-byte characters split between polls) decode to the
+// same text as the whole file, and truncation, rotation to a new file and
+// an in-place rewrite that regrew are each told apart from growth.
+#include "check.h"
+#include "text_follow.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct Followed {
+    const char *path;
+    TextFollower follower;
+    uint16_t text[4096];
+    size_t units;
+} Followed;
+
+static uint64_t FileId(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 ? (uint64_t)st.st_ino : 0;
+}
+
+// Opens the followed path and reads its size, identity and first bytes.
+static int Look(const char *path, uint64_t *size, uint64_t *id, uint8_t *head, size_t *headLen) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    CHECK(fstat(fd, &st) == 0);
+    *size = (uint64_t)st.st_size;
+    *id = (uint64_t)st.st_ino;
+    ssize_t got = pread(fd, head, TEXT_FOLLOW_HEAD_BYTES, 0);
+    *headLen = got > 0 ? (size_t)got : 0;
+    return fd;
+}
+
+static void Begin(Followed *f, const char *path, TextEncoding encoding) {
+    uint64_t size = 0, id = 0;
+    uint8_t head[TEXT_FOLLOW_HEAD_BYTES];
+    size_t headLen = 0;
+    int fd = Look(path, &size, &id, head, &headLen);
+    CHECK(fd >= 0);
+    close(fd);
+    f->path = path;
+    f->units = 0;
+    TextFollowerInit(&f->follower, encoding, size, id, head, headLen);
+}
+
+// One poll; appends any new text to f->text.
+static TextFollowChange Poll(Followed *f) {
+    uint64_t size = 0, id = 0;
+    uint8_t head[TEXT_FOLLOW_HEAD_BYTES], input[256];
+    size_t headLen = 0;
+    int fd = Look(f->path, &size, &id, head, &headLen);
+    if (fd < 0) return TEXT_FOLLOW_UNCHANGED;
+    TextFollowChange change = TextFollowerCheck(&f->follower, size, id, head, headLen);
+    if (change == TEXT_FOLLOW_GREW) {
+        size_t want = size - f->follower.offset < sizeof(input) ? (size_t)(size - f->follower.offset) : sizeof(input);
+        ssize_t got = pread(fd, input, want, (off_t)f->follower.offset);
+        CHECK(got > 0);
+        size_t capacity = TextFollowerMaxOutput(&f->follower, (size_t)got);
+        CHECK(f->units + capacity <= sizeof(f->text) / sizeof(f->text[0]));
+        f->units += TextFollowerDecode(&f->follower, input, (size_t)got, f->text + f->units);
+    }
+    close(fd);
+    return change;
+}
+
+static void Append(const char *path, const void *data, size_t size) {
+    int fd = open(path, O_WRONLY | O_APPEND);
+    CHECK(fd >= 0 && write(fd, data, size) == (ssize_t)size);
+    close(fd);
+}
+
+static void TestByteByByte(const char *path, TextEncoding encoding, const uint8_t *bytes, size_t size) {
+    int fd = open(path, O_WRONLY | O_TRUNC);
+    close(fd);
+    Followed f;
+    Begin(&f, path, encoding);
+    CHECK(Poll(&f) == TEXT_FOLLOW_UNCHANGED && f.units == 0);
+    for (size_t i = 0; i < size; ++i) {
+        Append(path, bytes + i, 1);
+        CHECK(Poll(&f) == TEXT_FOLLOW_GREW);
+        CHECK(Poll(&f) == TEXT_FOLLOW_UNCHANGED);
+    }
+    uint16_t expect[256];
+    TextDecoder dec;
+    TextDecoderInit(&dec, encoding);
+    size_t bom = TextBomLength(bytes, size, encoding);
+    size_t units = TextDecoderDecode(&dec, bytes + bom, size - bom, true, expect);
+    CHECK(f.units == units && memcmp(f.text, expect, units * sizeof(uint16_t)) == 0);
+    CHECK(f.follower.offset == size);
+}
+
+static void TestAppends(const char *path) {
+    static const uint8_t utf8Bom[] = "\xEF\xBB\xBF" "caf\xC3\xA9 \xE4\xB8\xAD \xF0\x9F\x98\x80\r\n";
+    static const uint8_t utf8Plain[] = "\xEF\xBB" "x"; // looks like a BOM, then is not
+    static const uint8_t utf8Short[] = "\xC3\xA9";
+    static const uint8_t le16Bom[] = { 0xFF, 0xFE, 'h', 0, 'i', 0, 0x3D, 0xD8, 0x00, 0xDE };
+    static const uint8_t le16Plain[] = { 'h', 0, 0xFF, 0xFE };
+    static const uint8_t be16Bom[] = { 0xFE, 0xFF, 0, 'o', 0, 'k' };
+    TestByteByByte(path, ENC_UTF8, utf8Bom, sizeof(utf8Bom) - 1);
+    TestByteByByte(path, ENC_UTF8, utf8Plain, sizeof(utf8Plain) - 1);
+    TestByteByByte(path, ENC_UTF8, utf8Short, sizeof(utf8Short) - 1);
+    TestByteByByte(path, ENC_UTF16LE, le16Bom, sizeof(le16Bom));
+    TestByteByByte(path, ENC_UTF16LE, le16Plain, sizeof(le16Plain));
+    TestByteByByte(path, ENC_UTF16BE, be16Bom, sizeof(be16Bom));
+
+    // Following from the end of text already shown: nothing is skipped.
+    int fd = open(path, O_WRONLY | O_TRUNC);
+    CHECK(write(fd, "\xEF\xBB\xBF" "old\n", 7) == 7);
+    close(fd);
+    Followed f;
+    Begin(&f, path, ENC_UTF8);
+    Append(path, "\xEF\xBB\xBFnew", 6);
+    CHECK(Poll(&f) == TEXT_FOLLOW_GREW && f.units == 4 && f.text[0] == 0xFEFF && f.text[1] == 'n');
+}
+
+static void TestChanges(const char *path) {
+    int fd = open(path, O_WRONLY | O_TRUNC);
+    CHECK(write(fd, "first line\nsecond line\n", 23) == 23);
+    close(fd);
+    Followed f;
+    Begin(&f, path, ENC_UTF8);
+    CHECK(Poll(&f) == TEXT_FOLLOW_UNCHANGED);
+
+    // Truncated in place.
+    CHECK(truncate(path, 5) == 0);
+    CHECK(Poll(&f) == TEXT_FOLLOW_TRUNCATED);
+
+    // Rewritten in place and regrown past the followed offset.
+    fd = open(path, O_WRONLY | O_TRUNC);
+    CHECK(write(fd, "other text, and longer than before\n", 35) == 35);
+    close(fd);
+    CHECK(Poll(&f) == TEXT_FOLLOW_REPLACED);
+
+    // Rotated: renamed away and a new file created under the name.
+    Begin(&f, path, ENC_UTF8);
+    char rotated[64];
+    snprintf(rotated, sizeof(rotated), "%s.1", path);
+    CHECK(rename(path, rotated) == 0);
+    CHECK(Poll(&f) == TEXT_FOLLOW_UNCHANGED); // nothing there yet
+    fd = open(rotated, O_RDONLY);
+    uint64_t oldId = FileId(fd);
+    close(fd);
+    fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    CHECK(fd >= 0 && FileId(fd) != oldId);
+    CHECK(write(fd, "other text, and longer than before\nmore\n", 40) == 40);
+    close(fd);
+    CHECK(Poll(&f) == TEXT_FOLLOW_REPLACED);
+    unlink(rotated);
+}
+
+int main(void) {
+    char path[] = "/tmp/retropad-test-follow-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 2;
+    }
+    close(fd);
+    TestAppends(path);
+    TestChanges(path);
+    unlink(path);
+    return CheckReport("test_follow");
+}
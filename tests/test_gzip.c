@@ -0,0 +1,176 @@
+// gzip streams (text_gzip.c): text and incompressible bytes written in
+// chunks of any size read back unchanged, incompressible input is stored
+// rather than expanded, and the output is readable by the system gzip
+// (when there is one), whose own -9 output reads back too.
+#include "check.h"
+#include "text_gzip.h"
+
+#include <unistd.h>
+
+typedef struct MemoryReader {
+    const uint8_t *data;
+    size_t size;
+    size_t at;
+} MemoryReader;
+
+static size_t ReadMemory(void *context, uint8_t *buffer, size_t size) {
+    MemoryReader *r = (MemoryReader *)context;
+    size_t n = r->size - r->at < size ? r->size - r->at : size;
+    memcpy(buffer, r->data + r->at, n);
+    r->at += n;
+    return n;
+}
+
+// Compresses `data` in random-sized calls; returns the stream's length.
+static size_t Compress(const uint8_t *data, size_t size, uint8_t *out, uint32_t *seed) {
+    TextGzipWriter writer;
+    CHECK(TextGzipWriterInit(&writer));
+    size_t len = 0;
+    for (size_t at = 0;;) {
+        size_t n = 1 + NextRandom(seed) % 300000;
+        if (n > size - at) n = size - at;
+        bool finish = at + n == size;
+        len += TextGzipWriterCompress(&writer, data + at, n, finish, out + len);
+        at += n;
+        if (finish) break;
+    }
+    TextGzipWriterFree(&writer);
+    return len;
+}
+
+static bool Decompress(const uint8_t *stream, size_t len, uint8_t *out, size_t size) {
+    MemoryReader r = { stream, len, 0 };
+    TextGzipReader reader;
+    CHECK(TextGzipReaderInit(&reader, ReadMemory, &r));
+    size_t total = 0, n;
+    while ((n = TextGzipReaderRead(&reader, out + total, size + 1 - total < 70000 ? size + 1 - total : 70000)) > 0) {
+        total += n;
+    }
+    bool ok = !reader.failed && total == size;
+    TextGzipReaderFree(&reader);
+    return ok;
+}
+
+static void FillText(uint8_t *data, size_t size, uint32_t *seed) {
+    static const char *const words[] = { "retropad ", "line ", "text ", "gzip ", "window ", "\r\n" };
+    for (size_t n = 0; n < size;) {
+        const char *w = words[NextRandom(seed) % 6];
+        size_t len = strlen(w) < size - n ? strlen(w) : size - n;
+        memcpy(data + n, w, len);
+        n += len;
+    }
+}
+
+static void FillRandom(uint8_t *data, size_t size, uint32_t *seed) {
+    for (size_t i = 0; i < size; ++i) data[i] = (uint8_t)(NextRandom(seed) >> 24);
+}
+
+// Round trip; returns the compressed length.
+static size_t RoundTrip(const uint8_t *data, size_t size, uint8_t **streamOut, uint32_t *seed) {
+    uint8_t *stream = (uint8_t *)CheckedAlloc(TextGzipWriterBound(size) + 64 * TextGzipWriterBound(0));
+    size_t len = Compress(data, size, stream, seed);
+    uint8_t *back = (uint8_t *)CheckedAlloc(size + 1);
+    CHECK(Decompress(stream, len, back, size));
+    CHECK(memcmp(back, data, size) == 0);
+    free(back);
+    *streamOut = stream;
+    return len;
+}
+
+// Pipes a stream through the system gzip; false if it rejects it.
+static bool SystemGunzipMatches(const uint8_t *stream, size_t len, const uint8_t *data, size_t size) {
+    char path[] = "/tmp/retropad-test-gzip-XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0 && write(fd, stream, len) == (ssize_t)len);
+    close(fd);
+    char command[128];
+    snprintf(command, sizeof(command), "gzip -dc < %s", path);
+    FILE *p = popen(command, "r");
+    uint8_t *back = (uint8_t *)CheckedAlloc(size + 1);
+    size_t got = p ? fread(back, 1, size + 1, p) : 0;
+    bool ok = p && pclose(p) == 0 && got == size && memcmp(back, data, size) == 0;
+    free(back);
+    unlink(path);
+    return ok;
+}
+
+static void TestRoundTrips(bool haveGzip) {
+    uint32_t seed = 2024;
+    size_t size = 3u * 1024u * 1024u + 17u;
+    uint8_t *data = (uint8_t *)CheckedAlloc(size);
+    uint8_t *stream;
+
+    FillText(data, size, &seed);
+    size_t len = RoundTrip(data, size, &stream, &seed);
+    CHECK(len < size / 4);
+    if (haveGzip) CHECK(SystemGunzipMatches(stream, len, data, size));
+    free(stream);
+
+    // Random bytes: stored, a few bytes a block over the input at most.
+    FillRandom(data, size, &seed);
+    len = RoundTrip(data, size, &stream, &seed);
+    CHECK(len <= size + 5 * (size / 65535 + 64) + 18);
+    if (haveGzip) CHECK(SystemGunzipMatches(stream, len, data, size));
+    free(stream);
+
+    // Random bytes (stored), text, then the random bytes again: the
+    // repeat matches back into the stored block.
+    FillRandom(data, 10000, &seed);
+    FillText(data + 10000, 20000, &seed);
+    memcpy(data + 30000, data, 10000);
+    size_t total = 40000;
+    TextGzipWriter writer;
+    CHECK(TextGzipWriterInit(&writer));
+    stream = (uint8_t *)CheckedAlloc(3 * TextGzipWriterBound(total));
+    len = TextGzipWriterCompress(&writer, data, 10000, false, stream);
+    CHECK(len >= 10000 && len <= 10000 + 16);
+    len += TextGzipWriterCompress(&writer, data + 10000, 20000, false, stream + len);
+    size_t before = len;
+    len += TextGzipWriterCompress(&writer, data + 30000, 10000, true, stream + len);
+    CHECK(len - before < 500);
+    TextGzipWriterFree(&writer);
+    uint8_t *back = (uint8_t *)CheckedAlloc(total + 1);
+    CHECK(Decompress(stream, len, back, total) && memcmp(back, data, total) == 0);
+    if (haveGzip) CHECK(SystemGunzipMatches(stream, len, data, total));
+    free(back);
+    free(stream);
+
+    // Empty input.
+    len = RoundTrip(data, 0, &stream, &seed);
+    if (haveGzip) CHECK(SystemGunzipMatches(stream, len, data, 0));
+    free(stream);
+    free(data);
+}
+
+static void TestSystemStream(void) {
+    // Dynamic Huffman blocks, as real gzip files use.
+    uint32_t seed = 7;
+    size_t size = 1u << 20;
+    uint8_t *data = (uint8_t *)CheckedAlloc(size);
+    FillText(data, size, &seed);
+    char path[] = "/tmp/retropad-test-gzip-XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0 && write(fd, data, size) == (ssize_t)size);
+    close(fd);
+    char command[128];
+    snprintf(command, sizeof(command), "gzip -9c < %s", path);
+    FILE *p = popen(command, "r");
+    uint8_t *stream = (uint8_t *)CheckedAlloc(size);
+    size_t len = p ? fread(stream, 1, size, p) : 0;
+    CHECK(p && pclose(p) == 0 && len > 0);
+    CHECK(TextGzipDetect(stream, len));
+    uint8_t *back = (uint8_t *)CheckedAlloc(size + 1);
+    CHECK(Decompress(stream, len, back, size) && memcmp(back, data, size) == 0);
+    unlink(path);
+    free(back);
+    free(stream);
+    free(data);
+}
+
+int main(void) {
+    bool haveGzip = system("gzip --version > /dev/null 2>&1") == 0;
+    if (!haveGzip) printf("test_gzip: no system gzip, skipping interoperability checks\n");
+    TestRoundTrips(haveGzip);
+    if (haveGzip) TestSystemStream();
+    return CheckReport("test_gzip");
+}
@@ -0,0 +1,143 @@
+// Version store core (text_history.c): chunks stay within their size
+// bounds, cuts do not depend on how the bytes are fed in, a version
+// rebuilt from its chunk list equals what was saved, an edit stores only
+// the chunks around it, the index finds and truncates, and a failed store
+// leaves the index as it was.
+#include "check.h"
+#include "text_history.h"
+
+typedef struct Blob {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    size_t failAfter; // stores allowed before one fails; SIZE_MAX never
+} Blob;
+
+static bool StoreBlob(void *context, const uint8_t *data, size_t size, uint64_t *offsetOut) {
+    Blob *b = (Blob *)context;
+    if (b->failAfter == 0) return false;
+    if (b->failAfter != SIZE_MAX) b->failAfter--;
+    if (b->size + size > b->capacity) {
+        b->capacity = (b->size + size) * 2;
+        b->data = (uint8_t *)realloc(b->data, b->capacity);
+        if (!b->data) return false;
+    }
+    memcpy(b->data + b->size, data, size);
+    *offsetOut = b->size;
+    b->size += size;
+    return true;
+}
+
+static void FillText(uint8_t *data, size_t size, uint32_t *seed) {
+    for (size_t i = 0; i < size; ++i) {
+        uint32_t r = NextRandom(seed);
+        data[i] = (uint8_t)(r % 50 == 0 ? '\n' : 'a' + r % 26);
+    }
+}
+
+// Saves `data` fed in random-sized pieces; the writer is left finished.
+static void SaveVersion(TextVersionWriter *writer, TextChunkIndex *index, Blob *blob, const uint8_t *data, size_t size,
+                        uint32_t *seed) {
+    CHECK(TextVersionWriterInit(writer, index, StoreBlob, blob));
+    for (size_t at = 0; at < size;) {
+        size_t n = *seed ? 1 + NextRandom(seed) % 200000 : size;
+        if (n > size - at) n = size - at;
+        CHECK(TextVersionWriterAdd(writer, data + at, n));
+        at += n;
+    }
+    CHECK(TextVersionWriterFinish(writer));
+}
+
+static bool Rebuilds(const TextVersionWriter *writer, const TextChunkIndex *index, const Blob *blob, const uint8_t *data,
+                     size_t size) {
+    size_t at = 0;
+    for (size_t i = 0; i < writer->count; ++i) {
+        const TextChunkRecord *r = &index->records[writer->chunks[i]];
+        if (at + r->length > size || memcmp(blob->data + r->offset, data + at, r->length) != 0) return false;
+        at += r->length;
+    }
+    return at == size;
+}
+
+static void TestCuts(void) {
+    uint32_t seed = 11;
+    size_t size = 4u * 1024u * 1024u;
+    uint8_t *data = (uint8_t *)CheckedAlloc(size);
+    FillText(data, size, &seed);
+    size_t chunks = 0;
+    for (size_t at = 0; at < size; ++chunks) {
+        size_t cut = TextChunkCut(data + at, size - at);
+        CHECK(cut > 0 && cut <= TEXT_CHUNK_MAX);
+        CHECK(cut >= TEXT_CHUNK_MIN || at + cut == size);
+        at += cut;
+    }
+    // Normalised cuts keep the average near its target.
+    size_t average = size / chunks;
+    CHECK(average > TEXT_CHUNK_AVG / 2 && average < TEXT_CHUNK_AVG * 2);
+    // Fewer bytes than a chunk and no cut in them: all of them.
+    CHECK(TextChunkCut(data, TEXT_CHUNK_MIN - 1) == TEXT_CHUNK_MIN - 1);
+    // Runs of one byte (no content to cut on) end at the maximum.
+    memset(data, 'x', 3 * TEXT_CHUNK_MAX);
+    CHECK(TextChunkCut(data, 3 * TEXT_CHUNK_MAX) == TEXT_CHUNK_MAX);
+    free(data);
+}
+
+static void TestVersions(void) {
+    uint32_t seed = 12;
+    size_t size = 8u * 1024u * 1024u;
+    uint8_t *data = (uint8_t *)CheckedAlloc(size + 100);
+    FillText(data, size, &seed);
+    TextChunkIndex index;
+    TextChunkIndexInit(&index);
+    Blob blob = { NULL, 0, 0, SIZE_MAX };
+
+    TextVersionWriter first, again, edited;
+    uint32_t whole = 0;
+    SaveVersion(&first, &index, &blob, data, size, &whole);
+    CHECK(Rebuilds(&first, &index, &blob, data, size));
+    CHECK(first.bytes == size && first.newBytes <= size);
+
+    // The same bytes in other pieces: the same chunks, nothing new.
+    SaveVersion(&again, &index, &blob, data, size, &seed);
+    CHECK(again.count == first.count && memcmp(again.chunks, first.chunks, first.count * sizeof(uint32_t)) == 0);
+    CHECK(again.newBytes == 0);
+
+    // Insert a line in the middle: only the chunks around it are new.
+    memmove(data + size / 2 + 40, data + size / 2, size / 2);
+    memcpy(data + size / 2, "an inserted line, forty bytes long.....\n", 40);
+    SaveVersion(&edited, &index, &blob, data, size + 40, &seed);
+    CHECK(Rebuilds(&edited, &index, &blob, data, size + 40));
+    CHECK(edited.newBytes > 0 && edited.newBytes <= 3 * TEXT_CHUNK_MAX);
+
+    // Every record can be found by its key.
+    for (size_t i = 0; i < index.count; ++i) {
+        uint32_t ordinal = 0;
+        CHECK(TextChunkIndexFind(&index, index.records[i].key, &ordinal) && ordinal == i);
+    }
+    size_t before = index.count;
+
+    // A store failing part way: the chunks this version added are dropped.
+    FillText(data, size, &seed);
+    blob.failAfter = 10;
+    TextVersionWriter failed;
+    CHECK(TextVersionWriterInit(&failed, &index, StoreBlob, &blob));
+    bool ok = TextVersionWriterAdd(&failed, data, size) && TextVersionWriterFinish(&failed);
+    CHECK(!ok && failed.failed && index.count == before);
+    uint32_t ordinal = 0;
+    CHECK(!TextChunkIndexFind(&index, TextChunkKeyOf(data, TextChunkCut(data, size)), &ordinal));
+    CHECK(TextChunkIndexFind(&index, index.records[before - 1].key, &ordinal) && ordinal == before - 1);
+
+    TextVersionWriterFree(&failed);
+    TextVersionWriterFree(&edited);
+    TextVersionWriterFree(&again);
+    TextVersionWriterFree(&first);
+    TextChunkIndexFree(&index);
+    free(blob.data);
+    free(data);
+}
+
+int main(void) {
+    TestCuts();
+    TestVersions();
+    return CheckReport("test_history");
+}
@@ -0,0 +1,197 @@
+// Edit journal: random edit logs replay to the same text as applying the
+// edits directly, checkpoints replace the text, a log cut at any byte
+// replays up to its last whole record, and a damaged or impossible record
+// stops the replay.
+#include "check.h"
+#include "text_journal.h"
+
+typedef struct Model {
+    uint16_t *units;
+    size_t length;
+    size_t capacity;
+} Model;
+
+static void ModelEdit(Model *m, size_t offset, size_t deleted, const uint16_t *inserted, size_t count) {
+    if (!m->units || m->length - deleted + count > m->capacity) {
+        m->capacity = (m->length - deleted + count) * 2 + 16;
+        uint16_t *grown = (uint16_t *)realloc(m->units, m->capacity * sizeof(uint16_t));
+        if (!grown) exit(2);
+        m->units = grown;
+    }
+    memmove(m->units + offset + count, m->units + offset + deleted,
+            (m->length - offset - deleted) * sizeof(uint16_t));
+    memcpy(m->units + offset, inserted, count * sizeof(uint16_t));
+    m->length = m->length - deleted + count;
+}
+
+static bool Matches(TextJournalDocument *doc, const Model *m) {
+    size_t length = 0;
+    uint16_t *text = TextJournalDocumentDetach(doc, &length);
+    bool same = text && length == m->length && text[length] == 0 &&
+                memcmp(text, m->units, length * sizeof(uint16_t)) == 0;
+    free(text);
+    return same;
+}
+
+// A burst of typing at one place, or a delete or paste anywhere.
+static void RandomEdit(uint32_t *seed, const Model *m, size_t *offset, size_t *deleted, uint16_t *inserted,
+                       size_t *count, size_t *cursor) {
+    uint32_t r = NextRandom(seed);
+    if (r % 4 != 0 && *cursor <= m->length) {
+        *offset = *cursor;
+        *deleted = 0;
+        *count = 1;
+    } else {
+        *offset = m->length ? NextRandom(seed) % (m->length + 1) : 0;
+        *deleted = m->length - *offset ? NextRandom(seed) % ((m->length - *offset) < 40 ? m->length - *offset + 1 : 40) : 0;
+        *count = NextRandom(seed) % 60;
+    }
+    for (size_t i = 0; i < *count; ++i) inserted[i] = (uint16_t)('a' + NextRandom(seed) % 26);
+    if (*count && r % 7 == 0) inserted[0] = 0xD83D; // units are replayed as they are, pairs or not
+    *cursor = *offset + *count;
+}
+
+static void TestReplayMatchesEdits(void) {
+    uint32_t seed = 7;
+    for (int round = 0; round < 20; ++round) {
+        Model m = { NULL, 0, 0 };
+        uint16_t start[300];
+        size_t startLength = NextRandom(&seed) % 300;
+        for (size_t i = 0; i < startLength; ++i) start[i] = (uint16_t)('A' + i % 26);
+        ModelEdit(&m, 0, 0, start, startLength);
+
+        TextJournalBuffer log;
+        TextJournalBufferInit(&log);
+        uint16_t inserted[64];
+        size_t cursor = 0, edits = 2000 + NextRandom(&seed) % 2000;
+        for (size_t e = 0; e < edits; ++e) {
+            size_t offset, deleted, count;
+            RandomEdit(&seed, &m, &offset, &deleted, inserted, &count, &cursor);
+            CHECK(TextJournalAppendEdit(&log, offset, deleted, inserted, count));
+            ModelEdit(&m, offset, deleted, inserted, count);
+        }
+
+        TextJournalDocument doc;
+        CHECK(TextJournalDocumentInit(&doc, start, startLength));
+        size_t records = 0;
+        CHECK(TextJournalReplay(&doc, log.data, log.size, &records) == TEXT_JOURNAL_OK);
+        CHECK(records == edits);
+        CHECK(TextJournalDocumentLength(&doc) == m.length);
+        CHECK(Matches(&doc, &m));
+        TextJournalBufferFree(&log);
+        free(m.units);
+    }
+}
+
+static void TestCheckpoint(void) {
+    static const uint16_t before[] = { 'o', 'l', 'd' };
+    static const uint16_t text[] = { 'n', 'e', 'w', ' ', 't', 'e', 'x', 't' };
+    static const uint16_t bang[] = { '!' };
+    TextJournalBuffer log;
+    TextJournalBufferInit(&log);
+    CHECK(TextJournalAppendEdit(&log, 3, 0, bang, 1));
+    CHECK(TextJournalAppendText(&log, text, 8));
+    CHECK(TextJournalAppendEdit(&log, 3, 5, bang, 1));
+
+    TextJournalDocument doc;
+    CHECK(TextJournalDocumentInit(&doc, before, 3));
+    CHECK(TextJournalReplay(&doc, log.data, log.size, NULL) == TEXT_JOURNAL_OK);
+    Model expected = { NULL, 0, 0 };
+    ModelEdit(&expected, 0, 0, (const uint16_t[]){ 'n', 'e', 'w', '!' }, 4);
+    CHECK(Matches(&doc, &expected));
+
+    // A checkpoint larger than anything before it still fits.
+    uint16_t *big = (uint16_t *)CheckedAlloc(100000 * sizeof(uint16_t));
+    for (size_t i = 0; i < 100000; ++i) big[i] = (uint16_t)i;
+    TextJournalBuffer grow;
+    TextJournalBufferInit(&grow);
+    CHECK(TextJournalAppendText(&grow, big, 100000));
+    CHECK(TextJournalDocumentInit(&doc, NULL, 0));
+    CHECK(TextJournalReplay(&doc, grow.data, grow.size, NULL) == TEXT_JOURNAL_OK);
+    free(expected.units);
+    expected = (Model){ NULL, 0, 0 };
+    ModelEdit(&expected, 0, 0, big, 100000);
+    CHECK(Matches(&doc, &expected));
+    free(expected.units);
+    free(big);
+    TextJournalBufferFree(&grow);
+    TextJournalBufferFree(&log);
+}
+
+// Wherever the crash cut the log, replay ends at the last whole record.
+static void TestTornLog(void) {
+    static const uint16_t start[] = { 'a', 'b', 'c', 'd' };
+    Model m = { NULL, 0, 0 };
+    ModelEdit(&m, 0, 0, start, 4);
+    TextJournalBuffer log;
+    TextJournalBufferInit(&log);
+    Model states[9];
+    size_t ends[9];
+    uint32_t seed = 3;
+    uint16_t inserted[64];
+    size_t cursor = 0;
+    for (int e = 0; e < 9; ++e) {
+        size_t offset, deleted, count;
+        RandomEdit(&seed, &m, &offset, &deleted, inserted, &count, &cursor);
+        CHECK(TextJournalAppendEdit(&log, offset, deleted, inserted, count));
+        ModelEdit(&m, offset, deleted, inserted, count);
+        states[e] = (Model){ NULL, 0, 0 };
+        ModelEdit(&states[e], 0, 0, m.units, m.length);
+        ends[e] = log.size;
+    }
+    for (size_t cut = 0; cut <= log.size; ++cut) {
+        size_t whole = 0;
+        while (whole < 9 && ends[whole] <= cut) whole++;
+        TextJournalDocument doc;
+        CHECK(TextJournalDocumentInit(&doc, start, 4));
+        size_t records = 0;
+        TextJournalStatus status = TextJournalReplay(&doc, log.data, cut, &records);
+        bool atBoundary = cut == 0 || (whole && ends[whole - 1] == cut);
+        CHECK(status == (atBoundary ? TEXT_JOURNAL_OK : TEXT_JOURNAL_TORN));
+        CHECK(records == whole);
+        Model none = { (uint16_t *)start, 4, 4 };
+        CHECK(Matches(&doc, whole ? &states[whole - 1] : &none));
+    }
+
+    // A flipped byte anywhere in a record stops replay before it.
+    for (size_t at = ends[3]; at < ends[4]; ++at) {
+        log.data[at] ^= 0x10;
+        TextJournalDocument doc;
+        CHECK(TextJournalDocumentInit(&doc, start, 4));
+        size_t records = 0;
+        CHECK(TextJournalReplay(&doc, log.data, log.size, &records) == TEXT_JOURNAL_TORN);
+        CHECK(records == 4);
+        CHECK(Matches(&doc, &states[3]));
+        log.data[at] ^= 0x10;
+    }
+    for (int e = 0; e < 9; ++e) free(states[e].units);
+    free(m.units);
+    TextJournalBufferFree(&log);
+}
+
+static void TestInvalidEdit(void) {
+    static const uint16_t start[] = { 'a', 'b', 'c' };
+    static const uint16_t x[] = { 'x' };
+    TextJournalBuffer log;
+    TextJournalBufferInit(&log);
+    CHECK(TextJournalAppendEdit(&log, 3, 0, x, 1));
+    CHECK(TextJournalAppendEdit(&log, 2, 3, x, 1)); // only two units follow offset 2
+    TextJournalDocument doc;
+    CHECK(TextJournalDocumentInit(&doc, start, 3));
+    size_t records = 0;
+    CHECK(TextJournalReplay(&doc, log.data, log.size, &records) == TEXT_JOURNAL_INVALID);
+    CHECK(records == 1);
+    Model expected = { NULL, 0, 0 };
+    ModelEdit(&expected, 0, 0, (const uint16_t[]){ 'a', 'b', 'c', 'x' }, 4);
+    CHECK(Matches(&doc, &expected));
+    free(expected.units);
+    TextJournalBufferFree(&log);
+}
+
+int main(void) {
+    TestReplayMatchesEdits();
+    TestCheckpoint();
+    TestTornLog();
+    TestInvalidEdit();
+    return CheckReport("test_journal");
+}
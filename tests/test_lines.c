@@ -0,0 +1,206 @@
+// Line-start index (text_lines.c): built from chunks split anywhere, even
+// inside a CRLF, it agrees with a naive scan for every offset and line;
+// copies are independent, Extend picks up a trailing CR's LF, Truncate
+// keeps only what comes before the edit, and random edits (breaks typed and
+// deleted, CRLFs split and joined, blocks filled and emptied, pastes big
+// enough to rescan) keep it in step with the text.
+#include "check.h"
+#include "text_lines.h"
+
+// Line starts of text[0, units), the slow way; returns how many.
+static size_t NaiveStarts(const uint16_t *text, size_t units, uint64_t *starts) {
+    size_t count = 0;
+    starts[count++] = 0;
+    for (size_t i = 0; i < units; ++i) {
+        if (text[i] == 0x0D && i + 1 < units && text[i + 1] == 0x0A) continue;
+        if (text[i] == 0x0D || text[i] == 0x0A) starts[count++] = i + 1;
+    }
+    return count;
+}
+
+// Random text, mostly short lines, with every kind of break.
+static void FillText(uint16_t *text, size_t units, uint32_t *seed) {
+    static const uint16_t alphabet[] = { 'a', 'b', ' ', 0x00E9, 0x4E2D, 0 };
+    for (size_t i = 0; i < units; ++i) {
+        uint32_t r = NextRandom(seed) % 64;
+        if (r == 0) text[i] = 0x0D;
+        else if (r < 3) text[i] = 0x0A;
+        else text[i] = alphabet[r % (sizeof(alphabet) / sizeof(alphabet[0]))];
+    }
+}
+
+static void AppendChunks(TextLineIndex *index, const uint16_t *text, size_t units, uint32_t *seed) {
+    for (size_t at = 0; at < units;) {
+        size_t n = 1 + NextRandom(seed) % 9000;
+        if (n > units - at) n = units - at;
+        CHECK(TextLineIndexAppend(index, text + at, n));
+        at += n;
+    }
+}
+
+// Every line start and every offset agree with the naive scan.
+static void CheckAgainst(const TextLineIndex *index, const uint16_t *text, size_t units) {
+    uint64_t *starts = (uint64_t *)CheckedAlloc((units + 1) * sizeof(uint64_t));
+    size_t count = NaiveStarts(text, units, starts);
+    size_t lines = 0;
+    CHECK(TextLineIndexCount(index, &lines));
+    CHECK(lines == count);
+    for (size_t line = 0; line < count; ++line) {
+        uint64_t start = 0;
+        CHECK(TextLineIndexLineStart(index, line, &start) && start == starts[line]);
+    }
+    uint64_t start = 0;
+    CHECK(!TextLineIndexLineStart(index, count, &start));
+    size_t line = 0;
+    for (uint64_t offset = 0; offset <= units; ++offset) {
+        while (line + 1 < count && starts[line + 1] <= offset) line++;
+        size_t got = SIZE_MAX;
+        if (!TextLineIndexLineFromOffset(index, offset, &got) || got != line) {
+            CHECK(got == line);
+            break;
+        }
+    }
+    free(starts);
+}
+
+static void TestBuild(void) {
+    uint32_t seed = 12345;
+    static const size_t sizes[] = { 0, 1, 100, 70000, 3000000 };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        size_t units = sizes[s];
+        uint16_t *text = (uint16_t *)CheckedAlloc((units + 1) * sizeof(uint16_t));
+        FillText(text, units, &seed);
+        TextLineIndex index;
+        TextLineIndexInit(&index);
+        AppendChunks(&index, text, units, &seed);
+        size_t lines = 0;
+        CHECK(!TextLineIndexCount(&index, &lines)); // not finished yet
+        TextLineIndexFinish(&index);
+        CHECK(index.complete && index.units == units);
+        CheckAgainst(&index, text, units);
+
+        TextLineIndex copy;
+        CHECK(TextLineIndexCopy(&copy, &index));
+        TextLineIndexFree(&index);
+        CheckAgainst(&copy, text, units);
+        TextLineIndexFree(&copy);
+        free(text);
+    }
+}
+
+static void TestSplitCrlf(void) {
+    // "a\r" + "\nb": one break, known only once the LF arrives.
+    static const uint16_t text[] = { 'a', 0x0D, 0x0A, 'b', 0x0D };
+    TextLineIndex index;
+    TextLineIndexInit(&index);
+    CHECK(TextLineIndexAppend(&index, text, 2));
+    size_t line = 0;
+    CHECK(TextLineIndexLineFromOffset(&index, 1, &line) && line == 0);
+    CHECK(!TextLineIndexLineFromOffset(&index, 2, &line));
+    CHECK(TextLineIndexAppend(&index, text + 2, 2));
+    CHECK(TextLineIndexLineFromOffset(&index, 3, &line) && line == 1);
+    CHECK(index.bareBreaks == 0);
+    // A trailing CR counts as a bare break once the text is finished.
+    CHECK(TextLineIndexAppend(&index, text + 4, 1));
+    TextLineIndexFinish(&index);
+    CHECK(index.trailingCR && index.bareBreaks == 1);
+    CheckAgainst(&index, text, 5);
+
+    // A followed file grows by an LF: the trailing CR becomes a CRLF.
+    static const uint16_t grown[] = { 'a', 0x0D, 0x0A, 'b', 0x0D, 0x0A, 'c' };
+    CHECK(TextLineIndexExtend(&index, grown + 5, 2));
+    CHECK(!index.trailingCR && index.bareBreaks == 0);
+    CheckAgainst(&index, grown, 7);
+    TextLineIndexFree(&index);
+}
+
+static void TestTruncate(void) {
+    uint32_t seed = 777;
+    size_t units = 200000;
+    uint16_t *text = (uint16_t *)CheckedAlloc(units * sizeof(uint16_t));
+    FillText(text, units, &seed);
+    uint64_t *starts = (uint64_t *)CheckedAlloc((units + 1) * sizeof(uint64_t));
+    size_t count = NaiveStarts(text, units, starts);
+    static const uint64_t cuts[] = { 150000, 60000, 1, 0 };
+    TextLineIndex index;
+    TextLineIndexInit(&index);
+    AppendChunks(&index, text, units, &seed);
+    TextLineIndexFinish(&index);
+    for (size_t c = 0; c < sizeof(cuts) / sizeof(cuts[0]); ++c) {
+        TextLineIndexTruncate(&index, cuts[c]);
+        size_t lines = 0;
+        CHECK(!TextLineIndexCount(&index, &lines));
+        uint64_t known = cuts[c] ? cuts[c] - 1 : 0;
+        size_t line = 0, expect = 0;
+        while (expect + 1 < count && starts[expect + 1] <= known) expect++;
+        CHECK(TextLineIndexLineFromOffset(&index, known, &line) && line == expect);
+        CHECK(!TextLineIndexLineFromOffset(&index, known + 1, &line));
+        uint64_t start = 0;
+        CHECK(TextLineIndexLineStart(&index, expect, &start) && start == starts[expect]);
+        CHECK(!TextLineIndexLineStart(&index, expect + 1, &start));
+    }
+    TextLineIndexFree(&index);
+    free(starts);
+    free(text);
+}
+
+// Replaces text[offset, offset + deleted) with `inserted`, in place.
+static size_t EditText(uint16_t *text, size_t units, size_t offset, size_t deleted, const uint16_t *inserted,
+                       size_t count) {
+    memmove(text + offset + count, text + offset + deleted, (units - offset - deleted) * sizeof(uint16_t));
+    memcpy(text + offset, inserted, count * sizeof(uint16_t));
+    return units - deleted + count;
+}
+
+static void TestEdits(void) {
+    uint32_t seed = 4242;
+    size_t units = 60000, capacity = 400000;
+    uint16_t *text = (uint16_t *)CheckedAlloc(capacity * sizeof(uint16_t));
+    FillText(text, units, &seed);
+    TextLineIndex index;
+    TextLineIndexInit(&index);
+    AppendChunks(&index, text, units, &seed);
+    TextLineIndexFinish(&index);
+    uint16_t inserted[3000];
+    for (int e = 1; e <= 3000; ++e) {
+        uint32_t kind = NextRandom(&seed) % 16;
+        size_t offset = NextRandom(&seed) % (units + 1), deleted = 0, count = 0;
+        if (kind < 6) {
+            // A keystroke: a letter, a CR, an LF or Enter.
+            static const uint16_t keys[][2] = { { 'x', 0 }, { 0x0D, 0 }, { 0x0A, 0 }, { 0x0D, 0x0A } };
+            uint32_t key = NextRandom(&seed) % 4;
+            count = key == 3 ? 2 : 1;
+            memcpy(inserted, keys[key], count * sizeof(uint16_t));
+        } else if (kind < 11) {
+            deleted = NextRandom(&seed) % 8; // backspaces, through breaks and half CRLFs
+        } else if (kind < 15) {
+            deleted = NextRandom(&seed) % 3000; // a selection, possibly a whole block of lines
+            count = NextRandom(&seed) % 600;
+            FillText(inserted, count, &seed);
+        } else {
+            count = 1000 + NextRandom(&seed) % 2000; // a paste with more lines than an edit patches
+            for (size_t i = 0; i < count; ++i) inserted[i] = i % 3 ? 'p' : 0x0A;
+        }
+        if (deleted > units - offset) deleted = units - offset;
+        if (units - deleted + count > capacity) deleted = count = 0;
+        units = EditText(text, units, offset, deleted, inserted, count);
+        CHECK(TextLineIndexEdit(&index, offset, deleted, text, units, NULL));
+        if (e % 300 == 0) CheckAgainst(&index, text, units);
+    }
+    // Empty it and start again from nothing.
+    CHECK(TextLineIndexEdit(&index, 0, units, text, 0, NULL));
+    CheckAgainst(&index, text, 0);
+    CHECK(TextLineIndexEdit(&index, 0, 0, (const uint16_t[]){ 0x0A, 0x0D }, 2, NULL));
+    CheckAgainst(&index, (const uint16_t[]){ 0x0A, 0x0D }, 2);
+    CHECK(index.trailingCR);
+    TextLineIndexFree(&index);
+    free(text);
+}
+
+int main(void) {
+    TestBuild();
+    TestSplitCrlf();
+    TestTruncate();
+    TestEdits();
+    return CheckReport("test_lines");
+}
@@ -0,0 +1,178 @@
+// Progressive chunked decoding (text_loader.c): chunks joined back together
+// match a one-shot decode whatever the reads return, chunk sizes grow from
+// TEXT_LOADER_FIRST_CHUNK, UTF-16LE is read in place, a custom decoder is
+// used when set, and the first U+0000 is reported wherever it falls, since
+// the edit control would show each chunk only up to it.
+#include "check.h"
+#include "text_loader.h"
+
+typedef struct MemoryReader {
+    const uint8_t *data;
+    size_t size;
+    size_t at;
+    uint32_t seed; // 0: full reads; otherwise random short ones
+} MemoryReader;
+
+static size_t ReadMemory(void *context, uint8_t *buffer, size_t size) {
+    MemoryReader *r = (MemoryReader *)context;
+    size_t n = r->size - r->at < size ? r->size - r->at : size;
+    if (r->seed && n > 1) n = 1 + NextRandom(&r->seed) % (n < 5000 ? n : 5000);
+    memcpy(buffer, r->data + r->at, n);
+    r->at += n;
+    return n;
+}
+
+// Runs the loader to the end; returns the units and checks the chunk plan.
+// `shownOut` (optional) receives the units a NUL-terminated consumer such
+// as SetWindowTextW/EM_REPLACESEL keeps: each chunk up to its first U+0000.
+static size_t LoadAll(TextEncoding encoding, MemoryReader *reader, uint16_t *out, size_t *chunksOut,
+                      TextLoaderDecode decode, void *decodeContext, uint64_t *firstNulOut, size_t *shownOut) {
+    TextLoader loader;
+    CHECK(TextLoaderInit(&loader, encoding, reader->size, ReadMemory, reader));
+    if (decode) TextLoaderSetDecoder(&loader, decode, decodeContext);
+    CHECK((encoding == ENC_UTF16LE) == (loader.input == NULL));
+    size_t total = 0, chunks = 0, shown = 0, expectBytes = TEXT_LOADER_FIRST_CHUNK;
+    for (;;) {
+        CHECK(loader.chunkBytes == expectBytes);
+        size_t capacity = TextLoaderChunkCapacity(&loader);
+        size_t units = 0;
+        if (!TextLoaderNext(&loader, out + total, &units)) break;
+        CHECK(units <= capacity);
+        size_t kept = 0;
+        while (kept < units && out[total + kept] != 0) kept++;
+        shown += kept;
+        total += units;
+        chunks++;
+        expectBytes = expectBytes * 4 > TEXT_LOADER_MAX_CHUNK ? TEXT_LOADER_MAX_CHUNK : expectBytes * 4;
+    }
+    CHECK(loader.finished);
+    CHECK(loader.bytesDone == reader->size);
+    CHECK(loader.unitsDone == total);
+    CHECK((loader.firstNul == TEXT_LOADER_NO_NUL) == (shown == total));
+    if (firstNulOut) *firstNulOut = loader.firstNul;
+    if (shownOut) *shownOut = shown;
+    TextLoaderFree(&loader);
+    if (chunksOut) *chunksOut = chunks;
+    return total;
+}
+
+static void TestUtf8(void) {
+    const size_t size = 9 * 1024 * 1024 + 3;
+    uint8_t *data = (uint8_t *)CheckedAlloc(size);
+    static const char pattern[] = "line \xC3\xA9\xE6\x97\xA5\xF0\x9F\x98\x80 text\n";
+    for (size_t i = 0; i < size; ++i) data[i] = (uint8_t)pattern[i % (sizeof(pattern) - 1)];
+    uint16_t *whole = (uint16_t *)CheckedAlloc(TextDecoderMaxOutput(ENC_UTF8, size) * 2);
+    TextDecoder dec;
+    TextDecoderInit(&dec, ENC_UTF8);
+    size_t expect = TextDecoderDecode(&dec, data, size, true, whole);
+
+    uint16_t *out = (uint16_t *)CheckedAlloc((TextDecoderMaxOutput(ENC_UTF8, size) + 64) * 2);
+    for (uint32_t seed = 0; seed < 3; ++seed) {
+        MemoryReader reader = { data, size, 0, seed * 7919 };
+        size_t chunks = 0;
+        size_t units = LoadAll(ENC_UTF8, &reader, out, &chunks, NULL, NULL, NULL, NULL);
+        CHECK(units == expect);
+        CHECK(memcmp(out, whole, expect * 2) == 0);
+        // 64K, 256K, 1M, 4M, and the last 3.9M.
+        CHECK(chunks == 5);
+    }
+    free(data);
+    free(whole);
+    free(out);
+}
+
+static void TestUtf16InPlace(void) {
+    const size_t size = 300001; // odd: the dangling byte is dropped
+    uint8_t *data = (uint8_t *)CheckedAlloc(size);
+    for (size_t i = 0; i < size; ++i) data[i] = (uint8_t)(i * 31);
+    uint16_t *out = (uint16_t *)CheckedAlloc(size + 64);
+    MemoryReader reader = { data, size, 0, 17 };
+    size_t units = LoadAll(ENC_UTF16LE, &reader, out, NULL, NULL, NULL, NULL, NULL);
+    CHECK(units == size / 2);
+    CHECK(memcmp(out, data, units * 2) == 0);
+    free(data);
+    free(out);
+}
+
+static size_t DecodeLatin1(void *context, const uint8_t *data, size_t size, bool final, uint16_t *out) {
+    (void)final;
+    ++*(int *)context;
+    for (size_t i = 0; i < size; ++i) out[i] = data[i];
+    return size;
+}
+
+static void TestCustomDecoder(void) {
+    uint8_t data[200000];
+    for (size_t i = 0; i < sizeof(data); ++i) data[i] = (uint8_t)(0x80 + i % 128);
+    uint16_t *out = (uint16_t *)CheckedAlloc(sizeof(data) * 2 + 64);
+    MemoryReader reader = { data, sizeof(data), 0, 0 };
+    int calls = 0;
+    size_t units = LoadAll(ENC_ANSI, &reader, out, NULL, DecodeLatin1, &calls, NULL, NULL);
+    CHECK(units == sizeof(data));
+    CHECK(calls == 2); // 64K, then the remaining 136K
+    CHECK(out[0] == 0x80 && out[sizeof(data) - 1] == data[sizeof(data) - 1]);
+    free(out);
+}
+
+static void TestEmpty(void) {
+    MemoryReader reader = { NULL, 0, 0, 0 };
+    uint16_t out[8];
+    size_t chunks = 0;
+    CHECK(LoadAll(ENC_UTF8, &reader, out, &chunks, NULL, NULL, NULL, NULL) == 0);
+    CHECK(chunks == 1); // one empty, final chunk
+}
+
+// The first U+0000 is found in whichever chunk holds it, at any position
+// including a chunk's first and last unit, on both decode paths.
+static void TestNul(void) {
+    const size_t units = 400000;
+    uint8_t *data = (uint8_t *)CheckedAlloc(units * 2);
+    uint16_t *out = (uint16_t *)CheckedAlloc((TextDecoderMaxOutput(ENC_UTF8, units * 2) + 64) * 2);
+    static const size_t spots[] = { 0, 1, 32767, 32768, 65535, 65536, 131072, 399999 };
+    for (size_t k = 0; k < sizeof(spots) / sizeof(spots[0]); ++k) {
+        for (int utf16 = 0; utf16 < 2; ++utf16) {
+            size_t size = utf16 ? units * 2 : units;
+            for (size_t i = 0; i < units; ++i) {
+                if (utf16) {
+                    data[2 * i] = (uint8_t)('a' + i % 26);
+                    data[2 * i + 1] = 0;
+                } else {
+                    data[i] = (uint8_t)('a' + i % 26);
+                }
+            }
+            // The NUL, and another later that must not move the first.
+            if (utf16) {
+                data[2 * spots[k]] = 0;
+                data[2 * (units - 1)] = 0;
+            } else {
+                data[spots[k]] = 0;
+                data[units - 1] = 0;
+            }
+            MemoryReader reader = { data, size, 0, (uint32_t)k };
+            uint64_t firstNul = 0;
+            size_t shown = 0;
+            TextEncoding encoding = utf16 ? ENC_UTF16LE : ENC_UTF8;
+            CHECK(LoadAll(encoding, &reader, out, NULL, NULL, NULL, &firstNul, &shown) == units);
+            CHECK(firstNul == spots[k]);
+            CHECK(shown < units);
+        }
+    }
+    // None at all: the whole text is kept.
+    for (size_t i = 0; i < units; ++i) data[i] = (uint8_t)('a' + i % 26);
+    MemoryReader reader = { data, units, 0, 0 };
+    uint64_t firstNul = 0;
+    size_t shown = 0;
+    CHECK(LoadAll(ENC_UTF8, &reader, out, NULL, NULL, NULL, &firstNul, &shown) == units);
+    CHECK(firstNul == TEXT_LOADER_NO_NUL && shown == units);
+    free(out);
+    free(data);
+}
+
+int main(void) {
+    TestUtf8();
+    TestUtf16InPlace();
+    TestCustomDecoder();
+    TestEmpty();
+    TestNul();
+    return CheckReport("test_loader");
+}
@@ -0,0 +1,234 @@
+// Paging engine behind the large-file viewer (text_pager.c; pager_view.c
+// only paints what these calls return): pages joined back together match a
+// one-shot decode with characters straddling the seams, line walks forward
+// and back cross page boundaries (a CRLF split by one too), seeks land on
+// line starts, and the cache stays within its budget, evicting the least
+// recently used page and decoding it again when it is next needed.
+#include "check.h"
+#include "text_pager.h"
+
+#define PAGE TEXT_PAGER_PAGE_BYTES
+
+typedef struct MemoryFile {
+    const uint8_t *data;
+    size_t size;
+    size_t reads;
+} MemoryFile;
+
+static size_t ReadMemory(void *context, uint64_t offset, uint8_t *buffer, size_t size) {
+    MemoryFile *f = (MemoryFile *)context;
+    if (offset >= f->size) return 0;
+    size_t n = f->size - (size_t)offset < size ? f->size - (size_t)offset : size;
+    memcpy(buffer, f->data + offset, n);
+    f->reads++;
+    return n;
+}
+
+// Lines of random length (never a whole page) mixing 1-4 byte characters,
+// with a CRLF split across the first seam.
+static size_t MakeUtf8(uint8_t *out, size_t size, uint32_t *seed) {
+    static const char *const pieces[] = { "a", "bc", " ", "\xC3\xA9", "\xE4\xB8\xAD", "\xF0\x9F\x98\x80" };
+    static const char *const breaks[] = { "\n", "\r\n", "\r" };
+    size_t n = 0;
+    while (n + 1000 < size) {
+        if (n < PAGE - 1 && n + 1000 >= PAGE - 1) {
+            memset(out + n, 'x', PAGE - 1 - n);
+            n = PAGE - 1;
+            memcpy(out + n, "\r\n", 2);
+            n += 2;
+            continue;
+        }
+        size_t len = NextRandom(seed) % 200;
+        for (size_t k = 0; k < len; ++k) {
+            const char *p = pieces[NextRandom(seed) % 6];
+            memcpy(out + n, p, strlen(p));
+            n += strlen(p);
+        }
+        const char *b = breaks[NextRandom(seed) % 3];
+        memcpy(out + n, b, strlen(b));
+        n += strlen(b);
+    }
+    return n;
+}
+
+// Splits decoded text into its lines (without breaks); returns the count.
+static size_t SplitLines(const uint16_t *text, size_t units, size_t *starts, size_t *lengths) {
+    size_t count = 0, start = 0;
+    for (size_t i = 0; i <= units; ++i) {
+        if (i < units && text[i] != 0x0D && text[i] != 0x0A) continue;
+        starts[count] = start;
+        lengths[count++] = i - start;
+        if (i < units && text[i] == 0x0D && i + 1 < units && text[i + 1] == 0x0A) i++;
+        start = i + 1;
+    }
+    return count;
+}
+
+static bool SameLine(TextPager *pager, TextPagerPos pos, const uint16_t *expect, size_t length, uint16_t *scratch) {
+    size_t got = TextPagerCopyLine(pager, pos, scratch, PAGE);
+    return got == length && memcmp(scratch, expect, length * sizeof(uint16_t)) == 0;
+}
+
+static void TestUtf8Walk(void) {
+    uint32_t seed = 4242;
+    size_t capacity = 5 * PAGE + 1000;
+    uint8_t *file = (uint8_t *)CheckedAlloc(capacity);
+    size_t size = MakeUtf8(file, capacity, &seed);
+    uint16_t *text = (uint16_t *)CheckedAlloc(size * sizeof(uint16_t));
+    TextDecoder dec;
+    TextDecoderInit(&dec, ENC_UTF8);
+    size_t units = TextDecoderDecode(&dec, file, size, true, text);
+    size_t *starts = (size_t *)CheckedAlloc((units + 1) * sizeof(size_t));
+    size_t *lengths = (size_t *)CheckedAlloc((units + 1) * sizeof(size_t));
+    size_t lines = SplitLines(text, units, starts, lengths);
+    uint16_t *scratch = (uint16_t *)CheckedAlloc(PAGE * sizeof(uint16_t));
+
+    MemoryFile mf = { file, size, 0 };
+    TextPager pager;
+    CHECK(TextPagerInit(&pager, ENC_UTF8, size, 0, 0, ReadMemory, &mf));
+    CHECK(pager.slotCount == TEXT_PAGER_MIN_PAGES && pager.pageCount == (size + PAGE - 1) / PAGE);
+
+    // Seams move to character boundaries: the pages tile the text.
+    size_t joined = 0;
+    uint64_t byteEnd = 0;
+    for (uint64_t p = 0; p < pager.pageCount; ++p) {
+        const TextPage *pg = TextPagerGetPage(&pager, p);
+        CHECK(pg && pg->byteStart == byteEnd);
+        if (!pg) return;
+        CHECK(joined + pg->units <= units && memcmp(text + joined, pg->text, pg->units * sizeof(uint16_t)) == 0);
+        joined += pg->units;
+        byteEnd = pg->byteEnd;
+    }
+    CHECK(joined == units && byteEnd == size);
+
+    // Forward, then back from the last line: every line, in order.
+    TextPagerPos pos;
+    CHECK(TextPagerSeek(&pager, 0, &pos) && pos.page == 0 && pos.unit == 0);
+    size_t line = 0;
+    do {
+        CHECK(line < lines && SameLine(&pager, pos, text + starts[line], lengths[line], scratch));
+        line++;
+    } while (line <= lines && TextPagerNextLine(&pager, &pos));
+    CHECK(line == lines);
+    TextPagerPos last;
+    CHECK(TextPagerLastLine(&pager, &last) && last.page == pos.page && last.unit == pos.unit);
+    for (line = lines - 1; line > 0; --line) {
+        CHECK(TextPagerPrevLine(&pager, &pos));
+        if (!SameLine(&pager, pos, text + starts[line - 1], lengths[line - 1], scratch)) {
+            CHECK(!"previous line");
+            break;
+        }
+    }
+    CHECK(!TextPagerPrevLine(&pager, &pos));
+
+    // The CRLF split across the first seam is one break.
+    CHECK(TextPagerSeek(&pager, PAGE - 2, &pos) && pos.page == 0);
+    CHECK(TextPagerNextLine(&pager, &pos) && pos.page == 1 && pos.unit == 1);
+    CHECK(TextPagerPrevLine(&pager, &pos) && pos.page == 0);
+    CHECK(TextPagerCopyLine(&pager, pos, scratch, PAGE) > 0 && scratch[0] != 0x0A);
+
+    // A seek anywhere lands on a line start.
+    for (int k = 0; k < 200; ++k) {
+        TextPagerPos at, again;
+        CHECK(TextPagerSeek(&pager, NextRandom(&seed) % (size + 10), &at));
+        again = at;
+        if (TextPagerNextLine(&pager, &again)) {
+            CHECK(TextPagerPrevLine(&pager, &again) && again.page == at.page && again.unit == at.unit);
+        }
+        uint64_t offset = TextPagerByteOffset(&pager, at);
+        CHECK(offset <= size);
+    }
+
+    TextPagerFree(&pager);
+    free(scratch);
+    free(lengths);
+    free(starts);
+    free(text);
+    free(file);
+}
+
+static void TestUtf16Seam(void) {
+    // A surrogate pair across the first seam stays whole on the first page.
+    size_t size = 2 * PAGE + 2;
+    uint8_t *file = (uint8_t *)CheckedAlloc(size);
+    for (size_t i = 0; i < size; i += 2) {
+        file[i] = (i / 2) % 50 == 49 ? '\n' : 'a';
+        file[i + 1] = 0;
+    }
+    file[PAGE - 2] = 0x3D, file[PAGE - 1] = 0xD8; // U+1F600
+    file[PAGE] = 0x00, file[PAGE + 1] = 0xDE;
+    MemoryFile mf = { file, size, 0 };
+    TextPager pager;
+    CHECK(TextPagerInit(&pager, ENC_UTF16LE, size, 0, 4, ReadMemory, &mf));
+    const TextPage *pg = TextPagerGetPage(&pager, 0);
+    CHECK(pg && pg->byteEnd == PAGE + 2 && pg->units == PAGE / 2 + 1);
+    CHECK(pg && pg->text[PAGE / 2 - 1] == 0xD83D && pg->text[PAGE / 2] == 0xDE00);
+    pg = TextPagerGetPage(&pager, 1);
+    CHECK(pg && pg->byteStart == PAGE + 2 && pg->units == PAGE / 2 - 1);
+    TextPagerFree(&pager);
+    free(file);
+}
+
+static void TestNoBreaks(void) {
+    // A page with no break at all is cut at the page start.
+    size_t size = 3 * PAGE;
+    uint8_t *file = (uint8_t *)CheckedAlloc(size);
+    memset(file, 'z', size);
+    MemoryFile mf = { file, size, 0 };
+    TextPager pager;
+    CHECK(TextPagerInit(&pager, ENC_UTF8, size, 0, 4, ReadMemory, &mf));
+    TextPagerPos pos;
+    CHECK(TextPagerSeek(&pager, PAGE + 100, &pos) && pos.page == 1 && pos.unit == 0);
+    uint16_t *scratch = (uint16_t *)CheckedAlloc(2 * PAGE * sizeof(uint16_t));
+    CHECK(TextPagerCopyLine(&pager, pos, scratch, 2 * PAGE) == PAGE);
+    CHECK(TextPagerNextLine(&pager, &pos) && pos.page == 2 && pos.unit == 0);
+    CHECK(!TextPagerNextLine(&pager, &pos));
+    CHECK(TextPagerPrevLine(&pager, &pos) && pos.page == 1 && pos.unit == 0);
+    TextPagerFree(&pager);
+    free(scratch);
+    free(file);
+}
+
+static size_t CachedPages(const TextPager *pager) {
+    size_t cached = 0;
+    for (size_t i = 0; i < pager->slotCount; ++i) cached += pager->slots[i].page != UINT64_MAX;
+    return cached;
+}
+
+static void TestEviction(void) {
+    size_t size = 10 * PAGE;
+    uint8_t *file = (uint8_t *)CheckedAlloc(size);
+    for (size_t i = 0; i < size; ++i) file[i] = (uint8_t)('a' + (i / PAGE)); // page p is all one letter
+    MemoryFile mf = { file, size, 0 };
+    TextPager pager;
+    CHECK(TextPagerInit(&pager, ENC_UTF8, size, 0, 4, ReadMemory, &mf));
+    for (uint64_t p = 0; p < 4; ++p) CHECK(TextPagerGetPage(&pager, p) != NULL);
+    CHECK(pager.misses == 4 && pager.hits == 0);
+    CHECK(TextPagerGetPage(&pager, 0) != NULL && pager.hits == 1); // 1 is now the oldest
+
+    size_t reads = mf.reads;
+    const TextPage *pg = TextPagerGetPage(&pager, 4);
+    CHECK(pg && pg->text[0] == 'e' && pager.misses == 5 && mf.reads > reads);
+    CHECK(CachedPages(&pager) == 4);
+    CHECK(TextPagerGetPage(&pager, 0) && pager.hits == 2);
+    pg = TextPagerGetPage(&pager, 1); // evicted: read and decoded again
+    CHECK(pg && pg->text[0] == 'b' && pg->units == PAGE && pager.misses == 6);
+
+    // A sweep over the whole file never holds more than the budget.
+    for (uint64_t p = 0; p < pager.pageCount; ++p) {
+        pg = TextPagerGetPage(&pager, p);
+        CHECK(pg && pg->text[0] == 'a' + p && pg->text[pg->units - 1] == 'a' + p);
+        CHECK(CachedPages(&pager) <= 4);
+    }
+    CHECK(TextPagerGetPage(&pager, pager.pageCount) == NULL);
+    TextPagerFree(&pager);
+    free(file);
+}
+
+int main(void) {
+    TestUtf8Walk();
+    TestUtf16Seam();
+    TestNoBreaks();
+    TestEviction();
+    return CheckReport("test_pager");
+}
@@ -0,0 +1,155 @@
+// Piece table: random inserts and deletes leave the same text as editing a
+// flat array, read back through spans and copies; typing at one place
+// does not grow the piece count; snapshots keep the text they were taken
+// with through later edits, a reset and the table being freed.
+#include "check.h"
+#include "text_piece.h"
+
+typedef struct Flat {
+    uint16_t *units;
+    size_t length;
+    size_t capacity;
+} Flat;
+
+static void FlatReplace(Flat *f, size_t offset, size_t deleted, const uint16_t *inserted, size_t count) {
+    if (!f->units || f->length - deleted + count > f->capacity) {
+        f->capacity = (f->length - deleted + count) * 2 + 16;
+        uint16_t *grown = (uint16_t *)realloc(f->units, f->capacity * sizeof(uint16_t));
+        if (!grown) exit(2);
+        f->units = grown;
+    }
+    memmove(f->units + offset + count, f->units + offset + deleted, (f->length - offset - deleted) * sizeof(uint16_t));
+    memcpy(f->units + offset, inserted, count * sizeof(uint16_t));
+    f->length = f->length - deleted + count;
+}
+
+// Walks the spans and copies random ranges, checking both against `f`.
+static bool TableMatches(const TextPieceTable *table, const Flat *f, uint32_t *seed) {
+    if (TextPieceTableLength(table) != f->length) return false;
+    size_t at = 0;
+    while (at < f->length) {
+        const uint16_t *units = NULL;
+        size_t n = TextPieceTableSpan(table, at, &units);
+        if (n == 0 || n > f->length - at || memcmp(units, f->units + at, n * sizeof(uint16_t)) != 0) return false;
+        at += n;
+    }
+    const uint16_t *none = NULL;
+    if (TextPieceTableSpan(table, f->length, &none) != 0) return false;
+    uint16_t out[300];
+    for (int k = 0; k < 20; ++k) {
+        size_t offset = NextRandom(seed) % (f->length + 1), length = NextRandom(seed) % 300;
+        size_t want = length < f->length - offset ? length : f->length - offset;
+        if (TextPieceTableCopy(table, offset, length, out) != want) return false;
+        if (memcmp(out, f->units + offset, want * sizeof(uint16_t)) != 0) return false;
+    }
+    return true;
+}
+
+static void TestRandomEdits(void) {
+    uint32_t seed = 5;
+    for (int round = 0; round < 10; ++round) {
+        Flat f = { NULL, 0, 0 };
+        uint16_t start[500];
+        size_t startLength = NextRandom(&seed) % 500;
+        for (size_t i = 0; i < startLength; ++i) start[i] = (uint16_t)('A' + i % 26);
+        FlatReplace(&f, 0, 0, start, startLength);
+        TextPieceTable table;
+        TextPieceTableInit(&table);
+        CHECK(TextPieceTableReset(&table, start, startLength));
+        uint16_t inserted[80];
+        for (int e = 0; e < 3000; ++e) {
+            size_t offset = NextRandom(&seed) % (f.length + 1);
+            size_t room = f.length - offset;
+            size_t deleted = NextRandom(&seed) % 3 == 0 && room ? NextRandom(&seed) % (room < 60 ? room + 1 : 60) : 0;
+            size_t count = NextRandom(&seed) % 80;
+            for (size_t i = 0; i < count; ++i) inserted[i] = (uint16_t)NextRandom(&seed);
+            CHECK(TextPieceTableReplace(&table, offset, deleted, inserted, count));
+            FlatReplace(&f, offset, deleted, inserted, count);
+            if (e % 500 == 0) CHECK(TableMatches(&table, &f, &seed));
+        }
+        CHECK(table.valid);
+        CHECK(TableMatches(&table, &f, &seed));
+        TextPieceTableFree(&table);
+        free(f.units);
+    }
+}
+
+static void TestTyping(void) {
+    static const uint16_t start[] = { 'h', 'e', 'l', 'l', 'o', ' ', 'w', 'o', 'r', 'l', 'd' };
+    TextPieceTable table;
+    TextPieceTableInit(&table);
+    CHECK(TextPieceTableReset(&table, start, 11));
+    CHECK(TextPieceTablePieceCount(&table) == 1);
+    for (size_t i = 0; i < 1000; ++i) {
+        uint16_t key = (uint16_t)('a' + i % 26);
+        CHECK(TextPieceTableReplace(&table, 5 + i, 0, &key, 1));
+    }
+    CHECK(TextPieceTablePieceCount(&table) == 3); // "hello", the typing, " world"
+    CHECK(TextPieceTableLength(&table) == 1011);
+    uint16_t tail[6];
+    CHECK(TextPieceTableCopy(&table, 1005, 6, tail) == 6 && memcmp(tail, start + 5, sizeof(tail)) == 0);
+
+    // Out of range leaves the table invalid; Reset brings it back.
+    CHECK(!TextPieceTableReplace(&table, 1012, 0, start, 1));
+    CHECK(!table.valid);
+    CHECK(TextPieceTableReset(&table, NULL, 0));
+    CHECK(table.valid && TextPieceTableLength(&table) == 0 && TextPieceTablePieceCount(&table) == 0);
+    TextPieceTableFree(&table);
+}
+
+static void TestSnapshots(void) {
+    uint32_t seed = 9;
+    Flat f = { NULL, 0, 0 };
+    uint16_t text[4000];
+    for (size_t i = 0; i < 4000; ++i) text[i] = (uint16_t)NextRandom(&seed);
+    FlatReplace(&f, 0, 0, text, 4000);
+    TextPieceTable table;
+    TextPieceTableInit(&table);
+    CHECK(TextPieceTableReset(&table, text, 4000));
+
+    TextPieceSnapshot *snaps[8];
+    Flat copies[8];
+    uint16_t inserted[40];
+    for (int s = 0; s < 8; ++s) {
+        snaps[s] = TextPieceTableSnapshot(&table);
+        CHECK(snaps[s] != NULL);
+        copies[s] = (Flat){ NULL, 0, 0 };
+        FlatReplace(&copies[s], 0, 0, f.units, f.length);
+        for (int e = 0; e < 200; ++e) {
+            size_t offset = NextRandom(&seed) % (f.length + 1);
+            size_t deleted = f.length - offset ? NextRandom(&seed) % ((f.length - offset) < 20 ? f.length - offset + 1 : 20) : 0;
+            size_t count = NextRandom(&seed) % 40;
+            for (size_t i = 0; i < count; ++i) inserted[i] = (uint16_t)NextRandom(&seed);
+            CHECK(TextPieceTableReplace(&table, offset, deleted, inserted, count));
+            FlatReplace(&f, offset, deleted, inserted, count);
+        }
+    }
+    CHECK(TableMatches(&table, &f, &seed));
+    CHECK(TextPieceTableReset(&table, text, 10));
+    TextPieceTableFree(&table);
+
+    // Every snapshot still reads as the text it was taken from.
+    uint16_t *out = (uint16_t *)CheckedAlloc(20000 * sizeof(uint16_t));
+    for (int s = 0; s < 8; ++s) {
+        CHECK(TextPieceSnapshotLength(snaps[s]) == copies[s].length);
+        CHECK(TextPieceSnapshotCopy(snaps[s], 0, 20000, out) == copies[s].length);
+        CHECK(memcmp(out, copies[s].units, copies[s].length * sizeof(uint16_t)) == 0);
+        size_t at = 0;
+        const uint16_t *units = NULL;
+        for (size_t n; (n = TextPieceSnapshotSpan(snaps[s], at, &units)) != 0; at += n) {
+            CHECK(memcmp(units, copies[s].units + at, n * sizeof(uint16_t)) == 0);
+        }
+        CHECK(at == copies[s].length);
+        TextPieceSnapshotRelease(snaps[s]);
+        free(copies[s].units);
+    }
+    free(out);
+    free(f.units);
+}
+
+int main(void) {
+    TestRandomEdits();
+    TestTyping();
+    TestSnapshots();
+    return CheckReport("test_piece");
+}
@@ -0,0 +1,284 @@
+// Print layout (text_print.c): header/footer tokens, segments and
+// truncation; lines wrapped, tab-expanded and broken at CR, LF and CRLF;
+// page counts against the pages the renderer printed before; the same lines
+// from flat text and from a snapshot split into many spans; and documents
+// holding NULs laid out, and counted, to their full length.
+#include "check.h"
+#include "text_print.h"
+
+static size_t Widen(const char *s, uint16_t *out) {
+    size_t n = 0;
+    for (; s[n]; ++n) out[n] = (uint16_t)(unsigned char)s[n];
+    out[n] = 0;
+    return n;
+}
+
+static bool SameUnits(const uint16_t *units, const char *expect) {
+    size_t n = 0;
+    for (; expect[n]; ++n) {
+        if (units[n] != (uint16_t)(unsigned char)expect[n]) return false;
+    }
+    return units[n] == 0;
+}
+
+static void Expand(const char *format, const TextPrintFields *fields, uint16_t *left, uint16_t *center,
+                   uint16_t *right, size_t capacity) {
+    uint16_t wide[256];
+    Widen(format, wide);
+    TextPrintExpandHeaderFooter(wide, fields, left, capacity, center, capacity, right, capacity);
+}
+
+static void TestHeaderFooter(void) {
+    uint16_t name[16], date[16], time[16];
+    Widen("notes.txt", name);
+    Widen("5/1/2024", date);
+    Widen("12:00", time);
+    TextPrintFields fields = { name, date, time, 7, 12 };
+    uint16_t left[64], center[64], right[64];
+
+    Expand("&f", &fields, left, center, right, 64);
+    CHECK(SameUnits(left, "") && SameUnits(center, "notes.txt") && SameUnits(right, ""));
+    Expand("&lPage &p of &P&c&F&r&d &t", &fields, left, center, right, 64);
+    CHECK(SameUnits(left, "Page 7 of 12") && SameUnits(center, "notes.txt") && SameUnits(right, "5/1/2024 12:00"));
+    // && is an ampersand; an unknown or trailing & is kept, and so is the
+    // character after it.
+    Expand("a&&b &x c&", &fields, left, center, right, 64);
+    CHECK(SameUnits(center, "a&b &x c&"));
+    // Segments can be revisited; later text appends.
+    Expand("&lone&rtwo&lthree&C&D", &fields, left, center, right, 64);
+    CHECK(SameUnits(left, "onethree") && SameUnits(right, "two") && SameUnits(center, "5/1/2024"));
+    // At least one page; negative pages print as they are.
+    fields.totalPages = 0;
+    fields.page = -3;
+    Expand("&p/&P", &fields, left, center, right, 64);
+    CHECK(SameUnits(center, "-3/1"));
+    fields.page = 2147483647;
+    Expand("&p", &fields, left, center, right, 64);
+    CHECK(SameUnits(center, "2147483647"));
+    // NULL fields expand to nothing.
+    TextPrintFields empty = { NULL, NULL, NULL, 1, 1 };
+    Expand("[&f&d&t]", &empty, left, center, right, 64);
+    CHECK(SameUnits(center, "[]"));
+
+    // Cut to capacity, tokens and all, and always terminated.
+    fields.page = 7;
+    Expand("&l12345678&c&f&f&r&p&p&p&p&p&p", &fields, left, center, right, 5);
+    CHECK(SameUnits(left, "1234") && SameUnits(center, "note") && SameUnits(right, "7777"));
+    // A NULL or empty segment is skipped; the others are still filled.
+    uint16_t wide[64];
+    Widen("&lL&cC&rR", wide);
+    TextPrintExpandHeaderFooter(wide, &fields, NULL, 64, center, 64, right, 0);
+    CHECK(SameUnits(center, "C"));
+    right[0] = 'x';
+    TextPrintExpandHeaderFooter(NULL, &fields, left, 64, center, 64, right, 64);
+    CHECK(left[0] == 0 && center[0] == 0 && right[0] == 0);
+}
+
+// The pages RenderInternal printed before the walk moved here, on flat
+// text. (Its ComputeTotalPages peeked from the unit a wrap had just
+// counted, so it could report a page that was never printed; the shared
+// layout cannot disagree with itself.)
+static int OldRenderedPages(const uint16_t *text, size_t length, int charsPerLine, int linesPerPage) {
+    if (charsPerLine < 1) charsPerLine = 1;
+    if (linesPerPage < 1) linesPerPage = 1;
+    const int tabWidth = 8;
+    int lineOnPage = 0;
+    int pageNumber = 1;
+    const uint16_t *p = text, *end = text + length;
+    while (p < end) {
+        int col = 0;
+        while (p < end && *p != '\r' && *p != '\n') {
+            uint16_t ch = *p++;
+            if (ch == '\t') {
+                int spaces = tabWidth - (col % tabWidth);
+                for (int i = 0; i < spaces; ++i) {
+                    col++;
+                    if (col >= charsPerLine) break;
+                }
+            } else {
+                col++;
+            }
+            if (col >= charsPerLine) {
+                lineOnPage++;
+                col = 0;
+                if (lineOnPage >= linesPerPage) {
+                    const uint16_t *peek = p;
+                    while (peek < end && (*peek == '\r' || *peek == '\n')) peek++;
+                    if (peek < end) {
+                        pageNumber++;
+                        lineOnPage = 0;
+                    }
+                }
+            }
+        }
+        lineOnPage++;
+        if (lineOnPage >= linesPerPage) {
+            const uint16_t *peek = p;
+            while (peek < end && (*peek == '\r' || *peek == '\n')) peek++;
+            if (peek < end) {
+                pageNumber++;
+                lineOnPage = 0;
+            }
+        }
+        if (p < end && *p == '\r') {
+            p++;
+            if (p < end && *p == '\n') p++;
+        } else if (p < end && *p == '\n') {
+            p++;
+        }
+    }
+    return pageNumber;
+}
+
+// Lays out text[0, length) and checks each line against `expect` (lines
+// separated by '|', each with the page it lands on as a leading digit).
+static void CheckLines(const char *text, int charsPerLine, int linesPerPage, const char *expect) {
+    uint16_t wide[256];
+    size_t length = Widen(text, wide);
+    TextPrintLayout layout;
+    TextPrintLayoutInit(&layout, NULL, wide, length, charsPerLine, linesPerPage);
+    const char *e = expect;
+    bool same = true;
+    while (TextPrintLayoutNext(&layout)) {
+        if (!*e || *e - '0' != layout.page) {
+            same = false;
+            break;
+        }
+        e++;
+        int n = 0;
+        while (e[n] && e[n] != '|') n++;
+        same = same && n == layout.lineLength;
+        for (int i = 0; same && i < n; ++i) same = layout.line[i] == (uint16_t)e[i];
+        e += n;
+        if (*e == '|') e++;
+    }
+    CHECK(same && *e == 0);
+    CHECK(TextPrintCountPages(NULL, wide, length, charsPerLine, linesPerPage) == layout.page);
+}
+
+static void TestLines(void) {
+    CheckLines("", 10, 10, "");
+    CheckLines("a\r\nb\rc\nd", 10, 10, "1a|1b|1c|1d");
+    CheckLines("a\n\n", 10, 10, "1a|1");
+    // A line that fills its width wraps and leaves an empty remainder.
+    CheckLines("abcdef\nx", 3, 10, "1abc|1def|1|1x");
+    CheckLines("\tx\ty", 12, 10, "1        x   |1y");
+    // Page breaks only where text follows.
+    CheckLines("a\nb\nc", 10, 1, "1a|2b|3c");
+    CheckLines("a\nb\n\n\n", 10, 2, "1a|1b|1|1");
+    CheckLines("abcdefg", 2, 2, "1ab|1cd|2ef|2g");
+    // Zero or negative sizes act as 1.
+    CheckLines("ab", 0, -5, "1a|2b|2");
+
+    // A line longer than the buffer keeps its first TEXT_PRINT_LINE_UNITS.
+    enum { LONG = TEXT_PRINT_LINE_UNITS + 100 };
+    uint16_t *text = (uint16_t *)CheckedAlloc(LONG * sizeof(uint16_t));
+    for (size_t i = 0; i < LONG; ++i) text[i] = (uint16_t)('a' + i % 26);
+    TextPrintLayout layout;
+    TextPrintLayoutInit(&layout, NULL, text, LONG, LONG, 10);
+    CHECK(TextPrintLayoutNext(&layout) && layout.lineLength == (int)TEXT_PRINT_LINE_UNITS);
+    CHECK(layout.line[TEXT_PRINT_LINE_UNITS - 1] == text[TEXT_PRINT_LINE_UNITS - 1]);
+    free(text);
+}
+
+static void TestPageCounts(void) {
+    static const char alphabet[] = "abc \t\r\n\n";
+    enum { MAX = 3000 };
+    uint16_t *text = (uint16_t *)CheckedAlloc(MAX * sizeof(uint16_t));
+    uint32_t seed = 3;
+    for (int round = 0; round < 2000; ++round) {
+        size_t length = NextRandom(&seed) % MAX;
+        for (size_t i = 0; i < length; ++i) text[i] = (uint16_t)alphabet[NextRandom(&seed) % (sizeof(alphabet) - 1)];
+        int charsPerLine = (int)(NextRandom(&seed) % 40);
+        int linesPerPage = (int)(NextRandom(&seed) % 20);
+        int pages = TextPrintCountPages(NULL, text, length, charsPerLine, linesPerPage);
+        CHECK(pages == OldRenderedPages(text, length, charsPerLine, linesPerPage));
+    }
+    free(text);
+}
+
+// Lays out the whole document, hashing every line and the page it lands
+// on; returns the line count and the units laid out.
+static size_t LayoutAll(const TextPieceSnapshot *snapshot, const uint16_t *text, size_t length, int charsPerLine,
+                        int linesPerPage, uint64_t *hashOut, size_t *unitsOut) {
+    TextPrintLayout layout;
+    TextPrintLayoutInit(&layout, snapshot, text, length, charsPerLine, linesPerPage);
+    uint64_t hash = 0xCBF29CE484222325ull;
+    size_t lines = 0, units = 0;
+    while (TextPrintLayoutNext(&layout)) {
+        hash = (hash ^ (uint64_t)layout.page) * 0x100000001B3ull;
+        for (int i = 0; i < layout.lineLength; ++i) hash = (hash ^ layout.line[i]) * 0x100000001B3ull;
+        hash = (hash ^ 0xFFFFu) * 0x100000001B3ull;
+        units += (size_t)layout.lineLength;
+        lines++;
+    }
+    *hashOut = hash;
+    *unitsOut = units;
+    return lines;
+}
+
+static void TestNulsAndSpans(void) {
+    // Lines of 'x' and NUL, no tabs and none as wide as the page, so every
+    // unit but the breaks is printed as is.
+    enum { UNITS = 200000 };
+    uint16_t *text = (uint16_t *)CheckedAlloc(UNITS * sizeof(uint16_t));
+    uint32_t seed = 11;
+    size_t breaks = 0, nuls = 0;
+    for (size_t i = 0; i < UNITS; ++i) {
+        uint32_t r = NextRandom(&seed) % 40;
+        text[i] = r == 0 ? '\n' : r < 8 ? 0 : 'x';
+        breaks += text[i] == '\n';
+        nuls += text[i] == 0;
+    }
+    text[0] = 0;
+    text[UNITS - 1] = 0;
+    CHECK(nuls > UNITS / 8);
+    uint64_t hash = 0;
+    size_t units = 0;
+    size_t lines = LayoutAll(NULL, text, UNITS, 1000, 60, &hash, &units);
+    CHECK(units == UNITS - breaks);
+    CHECK(lines == breaks + 1);
+    int pages = TextPrintCountPages(NULL, text, UNITS, 1000, 60);
+    CHECK(pages == (int)((lines + 59) / 60));
+    CHECK(pages == OldRenderedPages(text, UNITS, 1000, 60));
+
+    // The same text through a snapshot of a table edited into many pieces
+    // (inserts that split CRLFs and lines apart) gives the same lines.
+    TextPieceTable table;
+    TextPieceTableInit(&table);
+    CHECK(TextPieceTableReset(&table, text, UNITS / 2));
+    for (size_t at = UNITS / 2; at < UNITS;) {
+        size_t n = 1 + NextRandom(&seed) % 700;
+        if (n > UNITS - at) n = UNITS - at;
+        CHECK(TextPieceTableReplace(&table, at, 0, text + at, n));
+        at += n;
+    }
+    for (int k = 0; k < 300; ++k) {
+        // Delete a stretch and put it back: more piece boundaries.
+        size_t at = NextRandom(&seed) % (UNITS - 64);
+        size_t n = 1 + NextRandom(&seed) % 63;
+        CHECK(TextPieceTableReplace(&table, at, n, text + at, n));
+    }
+    CHECK(TextPieceTablePieceCount(&table) > 300);
+    TextPieceSnapshot *snapshot = TextPieceTableSnapshot(&table);
+    CHECK(snapshot != NULL);
+    for (int width = 1; width <= 1000; width = width * 3 + 1) {
+        uint64_t flatHash = 0, spanHash = 0;
+        size_t flatUnits = 0, spanUnits = 0;
+        size_t flatLines = LayoutAll(NULL, text, UNITS, width, 25, &flatHash, &flatUnits);
+        size_t spanLines = LayoutAll(snapshot, NULL, 0, width, 25, &spanHash, &spanUnits);
+        CHECK(flatLines == spanLines && flatUnits == spanUnits && flatHash == spanHash);
+        CHECK(TextPrintCountPages(snapshot, NULL, 0, width, 25) == OldRenderedPages(text, UNITS, width, 25));
+    }
+    TextPieceSnapshotRelease(snapshot);
+    TextPieceTableFree(&table);
+    free(text);
+}
+
+int main(void) {
+    TestHeaderFooter();
+    TestLines();
+    TestPageCounts();
+    TestNulsAndSpans();
+    return CheckReport("test_print");
+}
@@ -0,0 +1,112 @@
+// Substring search (text_search.c) against a naive scan, with each vector
+// kernel behind TextFindUnitPair: NULs in text and needle, needles as long
+// as the text, the `before` clamp of TextFindLast, matches at every offset
+// across vector blocks from unaligned starts, and random text.
+#include "check.h"
+#include "text_codec.h"
+#include "text_search.h"
+
+static size_t NaiveFind(const uint16_t *text, size_t length, const uint16_t *needle, size_t n) {
+    if (n == 0 || n > length) return length;
+    for (size_t pos = 0; pos + n <= length; ++pos) {
+        if (memcmp(text + pos, needle, n * sizeof(uint16_t)) == 0) return pos;
+    }
+    return length;
+}
+
+static size_t NaiveFindLast(const uint16_t *text, size_t length, const uint16_t *needle, size_t n, size_t before) {
+    if (n == 0 || n > length) return length;
+    size_t found = length;
+    for (size_t pos = 0; pos + n <= length && pos < before; ++pos) {
+        if (memcmp(text + pos, needle, n * sizeof(uint16_t)) == 0) found = pos;
+    }
+    return found;
+}
+
+static void CheckBoth(const uint16_t *text, size_t length, const uint16_t *needle, size_t n) {
+    CHECK(TextFind(text, length, needle, n) == NaiveFind(text, length, needle, n));
+    static const size_t befores[] = { 0, 1, 7, 33, SIZE_MAX };
+    for (size_t b = 0; b < sizeof(befores) / sizeof(befores[0]); ++b) {
+        CHECK(TextFindLast(text, length, needle, n, befores[b]) == NaiveFindLast(text, length, needle, n, befores[b]));
+    }
+    CHECK(TextFindLast(text, length, needle, n, length) == NaiveFindLast(text, length, needle, n, length));
+}
+
+static void TestEdges(void) {
+    static const uint16_t text[] = { 'a', 0, 'b', 0, 0, 'a', 0, 'b' };
+    static const uint16_t nulB[] = { 0, 'b' };
+    static const uint16_t nuls[] = { 0, 0 };
+    size_t length = sizeof(text) / sizeof(text[0]);
+    // NULs are ordinary units.
+    CHECK(TextFind(text, length, nulB, 2) == 1);
+    CHECK(TextFind(text, length, nuls, 2) == 3);
+    CHECK(TextFindLast(text, length, nulB, 2, length) == 6);
+    // A needle exactly as long as the text, matching or not, and longer.
+    CHECK(TextFind(text, length, text, length) == 0);
+    CHECK(TextFindLast(text, length, text, length, length) == 0);
+    CHECK(TextFind(text, length - 1, text + 1, length - 1) == length - 1);
+    CHECK(TextFind(text, length, text, length + 1) == length);
+    CHECK(TextFind(text, 0, text, 1) == 0);
+    // An empty needle matches nothing.
+    CHECK(TextFind(text, length, text, 0) == length);
+    CHECK(TextFindLast(text, length, text, 0, length) == length);
+    // `before` bounds where a match starts, not where it ends.
+    CHECK(TextFindLast(text, length, nulB, 2, 7) == 6);
+    CHECK(TextFindLast(text, length, nulB, 2, 6) == 1);
+    CHECK(TextFindLast(text, length, nulB, 2, 1) == length);
+    CHECK(TextFindLast(text, length, nulB, 2, 0) == length);
+    CHECK(TextFindLast(text, length, nulB, 2, SIZE_MAX) == 6);
+    CHECK(TextFindLast(text, length, text, length, 1) == 0);
+    CHECK(TextFindLast(text, length, text, length, 0) == length);
+}
+
+static void TestBlockSeams(void) {
+    // One match of each length at each offset, in filler that shares its
+    // first or last unit, from unaligned starts.
+    uint16_t buffer[200], needle[48];
+    for (size_t n = 1; n <= 40; ++n) {
+        for (size_t i = 0; i < n; ++i) needle[i] = (uint16_t)(0x4E00 + i);
+        for (size_t shift = 0; shift < 3; ++shift) {
+            uint16_t *text = buffer + shift;
+            size_t length = 150;
+            for (size_t at = 0; at + n <= length; ++at) {
+                for (size_t i = 0; i < length; ++i) text[i] = i % 3 ? needle[0] : needle[n - 1];
+                memcpy(text + at, needle, n * sizeof(uint16_t));
+                CHECK(TextFind(text, length, needle, n) == NaiveFind(text, length, needle, n));
+                CHECK(TextFind(text, length, needle, n) <= at);
+                CHECK(TextFindLast(text, length, needle, n, length) >= at);
+                CHECK(TextFindLast(text, length, needle, n, length) ==
+                      NaiveFindLast(text, length, needle, n, length));
+            }
+        }
+    }
+}
+
+static void TestRandom(void) {
+    uint32_t seed = 8675309;
+    uint16_t text[300], needle[20];
+    for (int round = 0; round < 20000; ++round) {
+        size_t length = NextRandom(&seed) % 300;
+        size_t n = NextRandom(&seed) % 8;
+        unsigned alphabet = 1 + NextRandom(&seed) % 3;
+        for (size_t i = 0; i < length; ++i) text[i] = (uint16_t)(NextRandom(&seed) % alphabet);
+        for (size_t i = 0; i < n; ++i) needle[i] = (uint16_t)(NextRandom(&seed) % alphabet);
+        CheckBoth(text, length, needle, n);
+    }
+}
+
+int main(void) {
+    static const TextCodecKernels kernels[] = { TEXT_KERNELS_SCALAR, TEXT_KERNELS_SSE2, TEXT_KERNELS_AVX2,
+                                                TEXT_KERNELS_NEON };
+    static const char *const names[] = { "scalar", "SSE2", "AVX2", "NEON" };
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+        if (!TextCodecUseKernels(kernels[k])) continue;
+        int before = g_failures;
+        TestEdges();
+        TestBlockSeams();
+        TestRandom();
+        if (g_failures != before) fprintf(stderr, "test_search: failures with %s kernels\n", names[k]);
+    }
+    TextCodecUseKernels(TEXT_KERNELS_AUTO);
+    return CheckReport("test_search");
+}
@@ -0,0 +1,159 @@
+// Piece table snapshots read on other threads while the table is edited,
+// as print preview does: each reader walks its snapshot span by span and
+// copies it out, and must see exactly the text the snapshot was taken
+// with. Snapshots are taken and released on the editing thread only. Run
+// it under ThreadSanitizer too: make -C tests tsan.
+#include "check.h"
+#include "text_piece.h"
+
+#include <pthread.h>
+
+#define READERS 4
+#define SNAPSHOTS 400
+#define DOC_UNITS 50000u
+
+typedef struct Job {
+    TextPieceSnapshot *snapshot;
+    uint64_t expectHash;
+    size_t expectLength;
+    bool ok;
+} Job;
+
+// Jobs go out to the readers through `pending` and come back, read,
+// through `done`, for the editing thread to release.
+typedef struct Queue {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    Job *pending[SNAPSHOTS];
+    size_t pendingHead, pendingTail;
+    Job *done[SNAPSHOTS];
+    size_t doneCount;
+    bool closed;
+} Queue;
+
+static uint64_t HashUnits(uint64_t hash, const uint16_t *units, size_t count) {
+    for (size_t i = 0; i < count; ++i) hash = (hash ^ units[i]) * 0x100000001B3ull;
+    return hash;
+}
+
+static uint64_t HashTable(const TextPieceTable *table) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    const uint16_t *units = NULL;
+    size_t at = 0;
+    for (size_t n; (n = TextPieceTableSpan(table, at, &units)) != 0; at += n) hash = HashUnits(hash, units, n);
+    return hash;
+}
+
+static bool ReadSnapshot(const Job *job, uint16_t *scratch) {
+    const TextPieceSnapshot *snapshot = job->snapshot;
+    size_t length = TextPieceSnapshotLength(snapshot);
+    uint64_t hash = 0xCBF29CE484222325ull;
+    const uint16_t *units = NULL;
+    size_t at = 0;
+    for (size_t n; (n = TextPieceSnapshotSpan(snapshot, at, &units)) != 0; at += n) hash = HashUnits(hash, units, n);
+    size_t copied = TextPieceSnapshotCopy(snapshot, 0, length + 10, scratch);
+    uint64_t copyHash = HashUnits(0xCBF29CE484222325ull, scratch, copied);
+    return length == job->expectLength && at == length && copied == length && hash == job->expectHash &&
+           copyHash == job->expectHash;
+}
+
+static void *Reader(void *context) {
+    Queue *queue = (Queue *)context;
+    uint16_t *scratch = (uint16_t *)CheckedAlloc((DOC_UNITS * 4 + 10) * sizeof(uint16_t));
+    pthread_mutex_lock(&queue->lock);
+    for (;;) {
+        while (queue->pendingHead == queue->pendingTail && !queue->closed) pthread_cond_wait(&queue->wake, &queue->lock);
+        if (queue->pendingHead == queue->pendingTail) break;
+        Job *job = queue->pending[queue->pendingHead++];
+        pthread_mutex_unlock(&queue->lock);
+        job->ok = ReadSnapshot(job, scratch);
+        pthread_mutex_lock(&queue->lock);
+        queue->done[queue->doneCount++] = job;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    free(scratch);
+    return NULL;
+}
+
+// Releases whatever the readers have finished with; returns how many.
+static size_t ReleaseDone(Queue *queue, size_t *failures) {
+    Job *done[SNAPSHOTS];
+    pthread_mutex_lock(&queue->lock);
+    size_t count = queue->doneCount;
+    memcpy(done, queue->done, count * sizeof(Job *));
+    queue->doneCount = 0;
+    pthread_mutex_unlock(&queue->lock);
+    for (size_t i = 0; i < count; ++i) {
+        if (!done[i]->ok) ++*failures;
+        TextPieceSnapshotRelease(done[i]->snapshot);
+    }
+    return count;
+}
+
+int main(void) {
+    static Job jobs[SNAPSHOTS];
+    static Queue queue;
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.wake, NULL);
+
+    uint32_t seed = 2024;
+    uint16_t *text = (uint16_t *)CheckedAlloc(DOC_UNITS * sizeof(uint16_t));
+    for (size_t i = 0; i < DOC_UNITS; ++i) text[i] = (uint16_t)NextRandom(&seed);
+    TextPieceTable table;
+    TextPieceTableInit(&table);
+    CHECK(TextPieceTableReset(&table, text, DOC_UNITS));
+    free(text);
+
+    pthread_t readers[READERS];
+    for (int r = 0; r < READERS; ++r) CHECK(pthread_create(&readers[r], NULL, Reader, &queue) == 0);
+
+    size_t released = 0, failures = 0;
+    uint16_t inserted[64];
+    for (size_t s = 0; s < SNAPSHOTS; ++s) {
+        Job *job = &jobs[s];
+        job->snapshot = TextPieceTableSnapshot(&table);
+        CHECK(job->snapshot != NULL);
+        job->expectHash = HashTable(&table);
+        job->expectLength = TextPieceTableLength(&table);
+        pthread_mutex_lock(&queue.lock);
+        queue.pending[queue.pendingTail++] = job;
+        pthread_cond_signal(&queue.wake);
+        pthread_mutex_unlock(&queue.lock);
+
+        // Edit while the readers read: typing, deletes, pastes anywhere.
+        for (int e = 0; e < 50; ++e) {
+            size_t length = TextPieceTableLength(&table);
+            size_t offset = NextRandom(&seed) % (length + 1);
+            size_t room = length - offset;
+            size_t deleted = room ? NextRandom(&seed) % (room < 64 ? room + 1 : 64) : 0;
+            size_t count = NextRandom(&seed) % 64;
+            if (length > DOC_UNITS * 2) count = 0;
+            for (size_t i = 0; i < count; ++i) inserted[i] = (uint16_t)NextRandom(&seed);
+            CHECK(TextPieceTableReplace(&table, offset, deleted, inserted, count));
+        }
+        released += ReleaseDone(&queue, &failures);
+        if (s % 100 == 99) {
+            // A reset under the readers' feet: the snapshots keep the old store.
+            size_t length = TextPieceTableLength(&table);
+            uint16_t *flat = (uint16_t *)CheckedAlloc((length + 1) * sizeof(uint16_t));
+            CHECK(TextPieceTableCopy(&table, 0, length, flat) == length);
+            CHECK(TextPieceTableReset(&table, flat, length));
+            CHECK(TextPieceTablePieceCount(&table) == (length ? 1u : 0u));
+            free(flat);
+        }
+    }
+
+    pthread_mutex_lock(&queue.lock);
+    queue.closed = true;
+    pthread_cond_broadcast(&queue.wake);
+    pthread_mutex_unlock(&queue.lock);
+    for (int r = 0; r < READERS; ++r) pthread_join(readers[r], NULL);
+    released += ReleaseDone(&queue, &failures);
+    CHECK(released == SNAPSHOTS);
+    CHECK(failures == 0);
+    CHECK(table.valid);
+    TextPieceTableFree(&table);
+    pthread_cond_destroy(&queue.wake);
+    pthread_mutex_destroy(&queue.lock);
+    return CheckReport("test_snapshot");
+}
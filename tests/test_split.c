@@ -0,0 +1,241 @@
+// Split and join (text_split.c) through memory readers and sinks: pieces
+// joined back give the input for each mode and encoding, every piece but
+// the last ends at a line break (never inside a CRLF or a UTF-16 unit),
+// byte, line and pattern limits hold, each piece repeats the BOM, lines
+// longer than the buffer pass through whole, and a join refuses a part in
+// another encoding.
+#include "check.h"
+#include "text_split.h"
+
+#define MAX_PIECES 4096
+
+typedef struct Pieces {
+    uint8_t *data[MAX_PIECES];
+    size_t size[MAX_PIECES];
+    size_t capacity[MAX_PIECES];
+    uint32_t count;
+    bool open;
+} Pieces;
+
+typedef struct MemoryReader {
+    const uint8_t *data;
+    size_t size;
+    size_t at;
+    uint32_t seed; // 0: full reads; otherwise random short ones
+} MemoryReader;
+
+static size_t ReadMemory(void *context, uint8_t *buffer, size_t size) {
+    MemoryReader *r = (MemoryReader *)context;
+    size_t n = r->size - r->at < size ? r->size - r->at : size;
+    if (r->seed && n > 1) n = 1 + NextRandom(&r->seed) % n;
+    memcpy(buffer, r->data + r->at, n);
+    r->at += n;
+    return n;
+}
+
+static bool BeginPiece(void *context, uint32_t index) {
+    Pieces *p = (Pieces *)context;
+    if (p->open || index != p->count || index == MAX_PIECES) return false;
+    p->data[index] = NULL;
+    p->size[index] = p->capacity[index] = 0;
+    p->open = true;
+    return true;
+}
+
+static bool WritePiece(void *context, const uint8_t *data, size_t size) {
+    Pieces *p = (Pieces *)context;
+    if (!p->open) return false;
+    uint32_t i = p->count;
+    if (p->size[i] + size > p->capacity[i]) {
+        p->capacity[i] = (p->size[i] + size) * 2;
+        p->data[i] = (uint8_t *)realloc(p->data[i], p->capacity[i]);
+        if (!p->data[i]) return false;
+    }
+    memcpy(p->data[i] + p->size[i], data, size);
+    p->size[i] += size;
+    return true;
+}
+
+static bool EndPiece(void *context) {
+    Pieces *p = (Pieces *)context;
+    if (!p->open) return false;
+    p->open = false;
+    p->count++;
+    return true;
+}
+
+static void FreePieces(Pieces *p) {
+    for (uint32_t i = 0; i < p->count; ++i) free(p->data[i]);
+    p->count = 0;
+}
+
+typedef struct Output {
+    uint8_t *data;
+    size_t size;
+} Output;
+
+static bool WriteOutput(void *context, const uint8_t *data, size_t size) {
+    Output *o = (Output *)context;
+    memcpy(o->data + o->size, data, size);
+    o->size += size;
+    return true;
+}
+
+// Splits `data`; returns the piece count (0 on failure).
+static uint32_t Split(const TextSplitOptions *options, const uint8_t *data, size_t size, Pieces *pieces, uint32_t seed) {
+    MemoryReader r = { data, size, 0, seed };
+    TextSplitSink sink = { BeginPiece, WritePiece, EndPiece, pieces };
+    uint32_t count = 0;
+    memset(pieces, 0, sizeof(*pieces));
+    CHECK(TextSplit(options, ReadMemory, &r, &sink, &count));
+    CHECK(count == pieces->count && !pieces->open);
+    return count;
+}
+
+// Joins the pieces back together and compares with `data`.
+static void CheckJoin(const Pieces *pieces, const uint8_t *data, size_t size) {
+    TextJoiner joiner;
+    CHECK(TextJoinerInit(&joiner));
+    Output out = { (uint8_t *)CheckedAlloc(size + 1), 0 };
+    for (uint32_t i = 0; i < pieces->count; ++i) {
+        MemoryReader r = { pieces->data[i], pieces->size[i], 0, i };
+        CHECK(TextJoinerAdd(&joiner, ReadMemory, &r, WriteOutput, &out) == TEXT_JOIN_OK);
+    }
+    CHECK(joiner.parts == pieces->count);
+    CHECK(out.size == size && memcmp(out.data, data, size) == 0);
+    TextJoinerFree(&joiner);
+    free(out.data);
+}
+
+// Whether the unit at data[at] is `value` (one byte, or two for UTF-16).
+static bool IsUnit(const uint8_t *data, size_t at, size_t unit, size_t low, uint8_t value) {
+    return data[at + low] == value && (unit == 1 || data[at + 1 - low] == 0);
+}
+
+// Lines of random length in `encoding`, with every kind of break.
+static size_t MakeText(uint8_t *out, size_t lines, TextEncoding encoding, bool bom, uint32_t *seed) {
+    size_t n = 0, unit = encoding == ENC_UTF8 ? 1 : 2, low = encoding == ENC_UTF16BE ? 1 : 0;
+    if (bom) {
+        static const uint8_t utf8[] = { 0xEF, 0xBB, 0xBF }, le[] = { 0xFF, 0xFE }, be[] = { 0xFE, 0xFF };
+        const uint8_t *b = encoding == ENC_UTF8 ? utf8 : encoding == ENC_UTF16LE ? le : be;
+        memcpy(out, b, encoding == ENC_UTF8 ? 3 : 2);
+        n = encoding == ENC_UTF8 ? 3 : 2;
+    }
+    for (size_t line = 0; line < lines; ++line) {
+        size_t len = NextRandom(seed) % 80;
+        uint8_t units[84];
+        for (size_t k = 0; k < len; ++k) units[k] = (uint8_t)('a' + NextRandom(seed) % 20);
+        if (len > 3 && NextRandom(seed) % 40 == 0) units[3] = 'E'; // the pattern, now and then
+        uint32_t r = NextRandom(seed) % 4;
+        size_t count = len;
+        if (r == 0) units[count++] = 0x0D;
+        else if (r == 1) units[count++] = 0x0A;
+        else units[count++] = 0x0D, units[count++] = 0x0A;
+        for (size_t k = 0; k < count; ++k) {
+            if (unit == 1) {
+                out[n++] = units[k];
+            } else {
+                out[n + low] = units[k];
+                out[n + 1 - low] = (k % 5 == 4) ? 0x0D : 0; // CR bytes that are not CR units
+                n += 2;
+            }
+        }
+    }
+    return n;
+}
+
+static void TestModes(TextEncoding encoding, bool bom) {
+    uint32_t seed = 99 + (uint32_t)encoding;
+    size_t unit = encoding == ENC_UTF8 ? 1 : 2, low = encoding == ENC_UTF16BE ? 1 : 0;
+    size_t lines = 20000;
+    uint8_t *data = (uint8_t *)CheckedAlloc(lines * 170 + 4);
+    size_t size = MakeText(data, lines, encoding, bom, &seed);
+    size_t bomLength = TextBomLength(data, size, encoding);
+    uint8_t pattern[2] = { 0, 0 };
+    pattern[low] = 'E';
+    TextSplitOptions modes[] = {
+        { TEXT_SPLIT_BYTES, 10000, NULL, 0, encoding },
+        { TEXT_SPLIT_LINES, 777, NULL, 0, encoding },
+        { TEXT_SPLIT_MATCH, 0, pattern, unit, encoding },
+    };
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m) {
+        Pieces pieces;
+        uint32_t count = Split(&modes[m], data, size, &pieces, (uint32_t)m + 1);
+        CHECK(count > 1);
+        for (uint32_t i = 0; i < count; ++i) {
+            const uint8_t *p = pieces.data[i];
+            size_t n = pieces.size[i];
+            CHECK(n > bomLength && memcmp(p, data, bomLength) == 0);
+            if (i + 1 < count) {
+                // It ends with a break, and a CR there is not half of a CRLF.
+                CHECK(IsUnit(p, n - unit, unit, low, 0x0A) || IsUnit(p, n - unit, unit, low, 0x0D));
+                CHECK(!IsUnit(p, n - unit, unit, low, 0x0D) || !IsUnit(pieces.data[i + 1], bomLength, unit, low, 0x0A));
+            }
+            if (modes[m].mode == TEXT_SPLIT_BYTES) CHECK(n - bomLength <= modes[m].limit);
+            if (modes[m].mode == TEXT_SPLIT_LINES && i + 1 < count) {
+                size_t breaks = 0;
+                for (size_t k = bomLength; k < n; k += unit) {
+                    bool crlf = IsUnit(p, k, unit, low, 0x0D) && k + unit < n && IsUnit(p, k + unit, unit, low, 0x0A);
+                    breaks += IsUnit(p, k, unit, low, 0x0A) || (IsUnit(p, k, unit, low, 0x0D) && !crlf);
+                }
+                CHECK(breaks == modes[m].limit);
+            }
+        }
+        // Joining drops the repeated BOMs.
+        CheckJoin(&pieces, data, size);
+        FreePieces(&pieces);
+    }
+    free(data);
+}
+
+static void TestLongLineAndEdges(void) {
+    // One line longer than the buffer, between short ones: never cut.
+    size_t longLine = TEXT_SPLIT_BUFFER + TEXT_SPLIT_BUFFER / 2;
+    size_t size = longLine + 20;
+    uint8_t *data = (uint8_t *)CheckedAlloc(size);
+    memcpy(data, "short\r\n", 7);
+    memset(data + 7, 'x', longLine);
+    data[7 + longLine - 1] = 0x0D; // ...ending in a CRLF
+    memcpy(data + 7 + longLine, "\nafter\r\nend", 11);
+    size = 7 + longLine + 11;
+    TextSplitOptions options = { TEXT_SPLIT_BYTES, 100, NULL, 0, ENC_UTF8 };
+    Pieces pieces;
+    CHECK(Split(&options, data, size, &pieces, 0) == 3);
+    CHECK(pieces.size[0] == 7 && pieces.size[1] == longLine + 1 && pieces.size[2] == 10);
+    CheckJoin(&pieces, data, size);
+    FreePieces(&pieces);
+
+    // Empty input or a bare BOM makes no pieces; bad options fail.
+    TextSplitOptions lines = { TEXT_SPLIT_LINES, 1, NULL, 0, ENC_UTF8 };
+    CHECK(Split(&lines, data, 0, &pieces, 0) == 0);
+    CHECK(Split(&lines, (const uint8_t *)"\xEF\xBB\xBF", 3, &pieces, 0) == 0);
+    TextSplitOptions bad = { TEXT_SPLIT_LINES, 0, NULL, 0, ENC_UTF8 };
+    MemoryReader r = { data, size, 0, 0 };
+    TextSplitSink sink = { BeginPiece, WritePiece, EndPiece, &pieces };
+    uint32_t count = 7;
+    CHECK(!TextSplit(&bad, ReadMemory, &r, &sink, &count) && count == 0);
+    free(data);
+
+    // A part with another BOM stops the join.
+    TextJoiner joiner;
+    CHECK(TextJoinerInit(&joiner));
+    uint8_t outBuf[64];
+    Output out = { outBuf, 0 };
+    MemoryReader first = { (const uint8_t *)"\xFF\xFEh\0", 4, 0, 0 };
+    MemoryReader second = { (const uint8_t *)"\xEF\xBB\xBFhi", 5, 0, 0 };
+    MemoryReader plain = { (const uint8_t *)"i\0", 2, 0, 0 };
+    CHECK(TextJoinerAdd(&joiner, ReadMemory, &first, WriteOutput, &out) == TEXT_JOIN_OK);
+    CHECK(TextJoinerAdd(&joiner, ReadMemory, &second, WriteOutput, &out) == TEXT_JOIN_MISMATCH);
+    CHECK(TextJoinerAdd(&joiner, ReadMemory, &plain, WriteOutput, &out) == TEXT_JOIN_OK);
+    CHECK(out.size == 6 && memcmp(outBuf, "\xFF\xFEh\0i\0", 6) == 0 && joiner.parts == 2);
+    TextJoinerFree(&joiner);
+}
+
+int main(void) {
+    TestModes(ENC_UTF8, false);
+    TestModes(ENC_UTF8, true);
+    TestModes(ENC_UTF16LE, true);
+    TestModes(ENC_UTF16BE, true);
+    TestLongLineAndEdges();
+    return CheckReport("test_split");
+}
@@ -0,0 +1,159 @@
+// Unit/byte offset map and clean-region tracking for verbatim saves.
+#include "text_baseline.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static bool IsHighSurrogate(uint16_t u) { return u >= 0xD800 && u <= 0xDBFF; }
+static bool IsLowSurrogate(uint16_t u) { return u >= 0xDC00 && u <= 0xDFFF; }
+
+static uint64_t Min64(uint64_t a, uint64_t b) { return a < b ? a : b; }
+
+void TextBaselineInit(TextBaseline *baseline, TextEncoding encoding) {
+    memset(baseline, 0, sizeof(*baseline));
+    baseline->encoding = encoding;
+    baseline->valid = (encoding == ENC_UTF8 || encoding == ENC_UTF16LE || encoding == ENC_UTF16BE);
+}
+
+void TextBaselineFree(TextBaseline *baseline) {
+    free(baseline->marks);
+    memset(baseline, 0, sizeof(*baseline));
+}
+
+bool TextBaselineCopy(TextBaseline *copy, const TextBaseline *baseline) {
+    *copy = *baseline;
+    copy->marks = NULL;
+    copy->markCount = 0;
+    copy->markCapacity = 0;
+    if (baseline->markCount == 0) return true;
+    copy->marks = (TextBaselineMark *)malloc(baseline->markCount * sizeof(TextBaselineMark));
+    if (!copy->marks) {
+        copy->valid = false;
+        return false;
+    }
+    memcpy(copy->marks, baseline->marks, baseline->markCount * sizeof(TextBaselineMark));
+    copy->markCount = baseline->markCount;
+    copy->markCapacity = baseline->markCount;
+    return true;
+}
+
+bool TextBaselineAddMark(TextBaseline *baseline, uint64_t units, uint64_t bytes) {
+    if (!baseline->valid) return false;
+    if (baseline->markCount > 0) {
+        const TextBaselineMark *last = &baseline->marks[baseline->markCount - 1];
+        if (units <= last->units) return true; // nothing new
+    }
+    if (baseline->markCount == baseline->markCapacity) {
+        size_t capacity = baseline->markCapacity ? baseline->markCapacity * 2 : 64;
+        TextBaselineMark *marks = (TextBaselineMark *)realloc(baseline->marks, capacity * sizeof(TextBaselineMark));
+        if (!marks) {
+            baseline->valid = false;
+            return false;
+        }
+        baseline->marks = marks;
+        baseline->markCapacity = capacity;
+    }
+    baseline->marks[baseline->markCount].units = units;
+    baseline->marks[baseline->markCount].bytes = bytes;
+    baseline->markCount++;
+    return true;
+}
+
+void TextBaselineSeal(TextBaseline *baseline, uint64_t units) {
+    baseline->units = units;
+    baseline->cleanPrefix = units;
+    baseline->cleanSuffix = units;
+    if (baseline->markCount == 0 || baseline->marks[baseline->markCount - 1].units != units) {
+        baseline->valid = false;
+    }
+}
+
+void TextBaselineNoteEdit(TextBaseline *baseline, uint64_t editStart, uint64_t editEnd, uint64_t newLength) {
+    if (editEnd > newLength) editEnd = newLength;
+    if (editStart > editEnd) editStart = editEnd;
+    baseline->cleanPrefix = Min64(baseline->cleanPrefix, editStart);
+    baseline->cleanSuffix = Min64(baseline->cleanSuffix, newLength - editEnd);
+}
+
+void TextBaselineNoteRewrite(TextBaseline *baseline) {
+    baseline->cleanPrefix = 0;
+    baseline->cleanSuffix = 0;
+}
+
+uint64_t TextEncodedLength(TextEncoding encoding, const uint16_t *text, size_t units) {
+    if (encoding != ENC_UTF8) return (uint64_t)units * 2;
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < units; ++i) {
+        uint16_t u = text[i];
+        if (u < 0x80) {
+            bytes += 1;
+        } else if (u < 0x800) {
+            bytes += 2;
+        } else if (IsHighSurrogate(u) && i + 1 < units && IsLowSurrogate(text[i + 1])) {
+            bytes += 4;
+            i++;
+        } else {
+            bytes += 3;
+        }
+    }
+    return bytes;
+}
+
+// Index of the last mark at or before `units`.
+static size_t MarkAtOrBefore(const TextBaseline *baseline, uint64_t units) {
+    size_t lo = 0, hi = baseline->markCount;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (baseline->marks[mid].units <= units) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+bool TextBaselinePlanSave(const TextBaseline *baseline, uint64_t bomLength, const uint16_t *text, uint64_t length,
+                          TextBaselinePlan *plan) {
+    if (!baseline->valid || baseline->markCount < 2 || baseline->marks[0].bytes != bomLength) return false;
+    uint64_t shortest = Min64(length, baseline->units);
+    uint64_t prefix = Min64(baseline->cleanPrefix, shortest);
+    uint64_t suffix = Min64(baseline->cleanSuffix, shortest - prefix);
+    // Never split a surrogate pair between copied and encoded bytes.
+    if (prefix > 0 && IsHighSurrogate(text[prefix - 1])) prefix--;
+    if (suffix > 0 && IsLowSurrogate(text[length - suffix])) suffix--;
+    if (prefix == 0 && suffix == 0) return false;
+
+    const TextBaselineMark *start = &baseline->marks[MarkAtOrBefore(baseline, prefix)];
+    plan->prefixBytes = start->bytes + TextEncodedLength(baseline->encoding, text + start->units, (size_t)(prefix - start->units));
+    plan->middleStart = prefix;
+    plan->middleEnd = length - suffix;
+    plan->suffixUnits = baseline->units - suffix;
+
+    // The suffix start is measured back from the next mark; the units in
+    // between are unedited, so the document's copy of them is as good.
+    size_t k = MarkAtOrBefore(baseline, plan->suffixUnits);
+    if (baseline->marks[k].units < plan->suffixUnits) k++;
+    const TextBaselineMark *end = &baseline->marks[k];
+    uint64_t span = end->units - plan->suffixUnits;
+    plan->suffixFrom = end->bytes - TextEncodedLength(baseline->encoding, text + plan->middleEnd, (size_t)span);
+    plan->suffixTo = baseline->marks[baseline->markCount - 1].bytes;
+    return true;
+}
+
+bool TextBaselineCarryPrefix(TextBaseline *next, const TextBaseline *old, const TextBaselinePlan *plan) {
+    for (size_t i = 0; i < old->markCount && old->marks[i].units < plan->middleStart; ++i) {
+        if (!TextBaselineAddMark(next, old->marks[i].units, old->marks[i].bytes)) return false;
+    }
+    return TextBaselineAddMark(next, plan->middleStart, plan->prefixBytes);
+}
+
+bool TextBaselineCarrySuffix(TextBaseline *next, const TextBaseline *old, const TextBaselinePlan *plan, uint64_t suffixStart, uint64_t length) {
+    if (!TextBaselineAddMark(next, plan->middleEnd, suffixStart)) return false;
+    for (size_t i = 0; i < old->markCount; ++i) {
+        const TextBaselineMark *m = &old->marks[i];
+        if (m->units <= plan->suffixUnits) continue;
+        if (!TextBaselineAddMark(next, m->units - plan->suffixUnits + plan->middleEnd, m->bytes - plan->suffixFrom + suffixStart)) {
+            return false;
+        }
+    }
+    TextBaselineSeal(next, length);
+    return next->valid;
+}
@@ -0,0 +1,83 @@
+// Platform-neutral map from a document back to the file it was loaded from
+// (or last saved to). Sparse marks pair UTF-16 unit offsets with byte
+// offsets, and edit tracking keeps how many units at each end are still
+// untouched, so a save can copy those bytes verbatim and only encode the
+// edited middle. file_io.c does the actual I/O.
+#pragma once
+
+#include "text_codec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct TextBaselineMark {
+    uint64_t units;
+    uint64_t bytes;
+} TextBaselineMark;
+
+typedef struct TextBaseline {
+    TextEncoding encoding;   // ENC_UTF8, ENC_UTF16LE or ENC_UTF16BE
+    bool valid;              // false: bytes cannot be reused (e.g. lossy decode)
+    uint64_t units;          // document length the marks describe
+    TextBaselineMark *marks; // ascending; first is {0, BOM length}, last {units, end}
+    size_t markCount;
+    size_t markCapacity;
+    uint64_t cleanPrefix;    // units at the start still identical to the file
+    uint64_t cleanSuffix;    // units at the end still identical to the file
+} TextBaseline;
+
+// What a save can reuse: file bytes [0, prefixBytes) hold document units
+// [0, middleStart); units [middleStart, middleEnd) need encoding; file bytes
+// [suffixFrom, suffixTo) hold units [middleEnd, length), which the file has
+// at [suffixUnits, baseline->units).
+typedef struct TextBaselinePlan {
+    uint64_t prefixBytes;
+    uint64_t middleStart;
+    uint64_t middleEnd;
+    uint64_t suffixUnits;
+    uint64_t suffixFrom;
+    uint64_t suffixTo;
+} TextBaselinePlan;
+
+void TextBaselineInit(TextBaseline *baseline, TextEncoding encoding);
+void TextBaselineFree(TextBaseline *baseline);
+// Fills `copy` with an independent duplicate; on failure it is invalid.
+bool TextBaselineCopy(TextBaseline *copy, const TextBaseline *baseline);
+
+// Appends a mark; marks must arrive in increasing unit order.
+bool TextBaselineAddMark(TextBaseline *baseline, uint64_t units, uint64_t bytes);
+
+// Closes a freshly built map over `units` units and marks it all clean.
+void TextBaselineSeal(TextBaseline *baseline, uint64_t units);
+
+// Records that units [editStart, editEnd) of the edited document (now
+// `newLength` units long) may differ from before; everything else moved
+// at most as a block.
+void TextBaselineNoteEdit(TextBaseline *baseline, uint64_t editStart, uint64_t editEnd, uint64_t newLength);
+
+// Records a change that cannot be located (undo, replace all).
+void TextBaselineNoteRewrite(TextBaseline *baseline);
+
+// Bytes `units` UTF-16 units take in `encoding` (UTF-8 or UTF-16 only).
+// Lone surrogates count as U+FFFD, matching the Windows encoder.
+uint64_t TextEncodedLength(TextEncoding encoding, const uint16_t *text, size_t units);
+
+// Works out which parts of `text` can be copied from the file. `bomLength`
+// is the BOM a full save writes: a file that starts with any other (a UTF-8
+// file without one, say) is not reused, so what a save writes never depends
+// on how the document was edited. Returns false when nothing is reusable.
+bool TextBaselinePlanSave(const TextBaseline *baseline, uint64_t bomLength, const uint16_t *text, uint64_t length,
+                          TextBaselinePlan *plan);
+
+// Seeds `next` (initialised, empty) with the marks that survive into the
+// file `plan` produces, up to the start of the middle.
+bool TextBaselineCarryPrefix(TextBaseline *next, const TextBaseline *old, const TextBaselinePlan *plan);
+
+// Adds the suffix marks once the middle is written and the suffix starts at
+// byte `suffixStart` of the new file, then seals `next` over `length` units.
+bool TextBaselineCarrySuffix(TextBaseline *next, const TextBaseline *old, const TextBaselinePlan *plan, uint64_t suffixStart, uint64_t length);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,645 @@
+// Platform-neutral UTF-8 / UTF-16 decoding used by the chunked file loader.
+// UTF-8 is validated and transcoded in a single pass: ASCII runs go through
+// SSE2/AVX2 (x86) or NEON (ARM64) widening, everything else through the
+// scalar sequence decoder.
+#include "text_codec.h"
+
+#include <string.h>
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define TEXT_CODEC_SSE2 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+#define TEXT_CODEC_AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define TEXT_CODEC_AVX2_TARGET
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define TEXT_CODEC_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define UTF8_INVALID 0xFFFFFFFFu
+#define REPLACEMENT_CHAR 0xFFFDu
+
+// Widens the leading run of ASCII bytes in src (whole vectors only) into
+// dst, or just measures it when dst is NULL. Returns the bytes consumed;
+// the scalar loop picks up whatever is left.
+typedef size_t (*WidenAsciiFn)(const uint8_t *src, size_t size, uint16_t *dst);
+// The reverse: narrows the leading run of units below 0x80 (whole vectors
+// only) into dst and returns the units consumed.
+typedef size_t (*NarrowAsciiFn)(const uint16_t *src, size_t units, uint8_t *dst);
+// Byte-swaps `units` 16-bit units from src into dst (may be the same buffer).
+typedef void (*SwapBytes16Fn)(const uint8_t *src, size_t units, uint8_t *dst);
+// Index of the first CR or LF unit in text, or `units` if there is none.
+typedef size_t (*FindLineBreakFn)(const uint16_t *text, size_t units);
+// First k below `starts` with text[k] == first and text[k + gap] == last, or
+// `starts` if there is none. Reads text[0, starts + gap).
+typedef size_t (*FindUnitPairFn)(const uint16_t *text, size_t starts, uint16_t first, uint16_t last, size_t gap);
+
+typedef struct CodecKernels {
+    WidenAsciiFn widenAscii;
+    NarrowAsciiFn narrowAscii;
+    SwapBytes16Fn swapBytes16;
+    FindLineBreakFn findLineBreak;
+    FindUnitPairFn findUnitPair;
+} CodecKernels;
+
+static size_t WidenAsciiScalar(const uint8_t *src, size_t size, uint16_t *dst) {
+    (void)src;
+    (void)size;
+    (void)dst;
+    return 0;
+}
+
+static size_t NarrowAsciiScalar(const uint16_t *src, size_t units, uint8_t *dst) {
+    (void)src;
+    (void)units;
+    (void)dst;
+    return 0;
+}
+
+static void SwapBytes16Scalar(const uint8_t *src, size_t units, uint8_t *dst) {
+    for (size_t k = 0; k < units; ++k) {
+        uint8_t lo = src[2 * k];
+        dst[2 * k] = src[2 * k + 1];
+        dst[2 * k + 1] = lo;
+    }
+}
+
+static size_t FindLineBreakScalar(const uint16_t *text, size_t units) {
+    size_t k = 0;
+    while (k < units && text[k] != 0x0A && text[k] != 0x0D) k++;
+    return k;
+}
+
+static size_t FindUnitPairScalar(const uint16_t *text, size_t starts, uint16_t first, uint16_t last, size_t gap) {
+    size_t k = 0;
+    while (k < starts && (text[k] != first || text[k + gap] != last)) k++;
+    return k;
+}
+
+static const CodecKernels g_scalarKernels = { WidenAsciiScalar, NarrowAsciiScalar, SwapBytes16Scalar, FindLineBreakScalar,
+                                              FindUnitPairScalar };
+
+#if defined(TEXT_CODEC_SSE2)
+static size_t WidenAsciiSse2(const uint8_t *src, size_t size, uint16_t *dst) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        if (_mm_movemask_epi8(v)) break;
+        if (dst) {
+            _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi8(v, zero));
+            _mm_storeu_si128((__m128i *)(dst + i + 8), _mm_unpackhi_epi8(v, zero));
+        }
+    }
+    return i;
+}
+
+static size_t NarrowAsciiSse2(const uint16_t *src, size_t units, uint8_t *dst) {
+    const __m128i high = _mm_set1_epi16((short)0xFF80);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= units; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 8));
+        __m128i over = _mm_and_si128(_mm_or_si128(a, b), high);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(over, zero)) != 0xFFFF) break;
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(a, b));
+    }
+    return i;
+}
+
+static void SwapBytes16Sse2(const uint8_t *src, size_t units, uint8_t *dst) {
+    size_t k = 0;
+    for (; k + 8 <= units; k += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + 2 * k));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i *)(dst + 2 * k), v);
+    }
+    SwapBytes16Scalar(src + 2 * k, units - k, dst + 2 * k);
+}
+
+static unsigned LowestSetBit(unsigned mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned)index;
+#else
+    return (unsigned)__builtin_ctz(mask);
+#endif
+}
+
+static size_t FindLineBreakSse2(const uint16_t *text, size_t units) {
+    const __m128i lf = _mm_set1_epi16(0x0A);
+    const __m128i cr = _mm_set1_epi16(0x0D);
+    size_t k = 0;
+    for (; k + 8 <= units; k += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(text + k));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi16(v, lf), _mm_cmpeq_epi16(v, cr)));
+        if (mask) return k + LowestSetBit(mask) / 2;
+    }
+    return k + FindLineBreakScalar(text + k, units - k);
+}
+
+// Matching both ends of the needle at once filters out nearly every
+// candidate a first-unit scan would stop at.
+static size_t FindUnitPairSse2(const uint16_t *text, size_t starts, uint16_t first, uint16_t last, size_t gap) {
+    const __m128i a = _mm_set1_epi16((short)first);
+    const __m128i b = _mm_set1_epi16((short)last);
+    size_t k = 0;
+    for (; k + 8 <= starts; k += 8) {
+        __m128i x = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)(text + k)), a);
+        __m128i y = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)(text + k + gap)), b);
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(x, y));
+        if (mask) return k + LowestSetBit(mask) / 2;
+    }
+    return k + FindUnitPairScalar(text + k, starts - k, first, last, gap);
+}
+
+TEXT_CODEC_AVX2_TARGET
+static size_t WidenAsciiAvx2(const uint8_t *src, size_t size, uint16_t *dst) {
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        if (_mm256_movemask_epi8(v)) break;
+        if (dst) {
+            _mm256_storeu_si256((__m256i *)(dst + i), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+            _mm256_storeu_si256((__m256i *)(dst + i + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+        }
+    }
+    _mm256_zeroupper(); // the SSE2 tail is legacy-encoded: avoid the AVX-SSE transition stall
+    return i + WidenAsciiSse2(src + i, size - i, dst ? dst + i : NULL);
+}
+
+TEXT_CODEC_AVX2_TARGET
+static size_t NarrowAsciiAvx2(const uint16_t *src, size_t units, uint8_t *dst) {
+    const __m256i high = _mm256_set1_epi16((short)0xFF80);
+    size_t i = 0;
+    for (; i + 32 <= units; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + i + 16));
+        if (!_mm256_testz_si256(_mm256_or_si256(a, b), high)) break;
+        // packus works per 128-bit lane; put the quarters back in order.
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8));
+    }
+    _mm256_zeroupper();
+    return i + NarrowAsciiSse2(src + i, units - i, dst + i);
+}
+
+TEXT_CODEC_AVX2_TARGET
+static void SwapBytes16Avx2(const uint8_t *src, size_t units, uint8_t *dst) {
+    size_t k = 0;
+    for (; k + 16 <= units; k += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + 2 * k));
+        v = _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8));
+        _mm256_storeu_si256((__m256i *)(dst + 2 * k), v);
+    }
+    _mm256_zeroupper();
+    SwapBytes16Sse2(src + 2 * k, units - k, dst + 2 * k);
+}
+
+TEXT_CODEC_AVX2_TARGET
+static size_t FindLineBreakAvx2(const uint16_t *text, size_t units) {
+    const __m256i lf = _mm256_set1_epi16(0x0A);
+    const __m256i cr = _mm256_set1_epi16(0x0D);
+    size_t k = 0;
+    for (; k + 16 <= units; k += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(text + k));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi16(v, lf), _mm256_cmpeq_epi16(v, cr)));
+        if (mask) return k + LowestSetBit(mask) / 2;
+    }
+    _mm256_zeroupper();
+    return k + FindLineBreakSse2(text + k, units - k);
+}
+
+TEXT_CODEC_AVX2_TARGET
+static size_t FindUnitPairAvx2(const uint16_t *text, size_t starts, uint16_t first, uint16_t last, size_t gap) {
+    const __m256i a = _mm256_set1_epi16((short)first);
+    const __m256i b = _mm256_set1_epi16((short)last);
+    size_t k = 0;
+    for (; k + 16 <= starts; k += 16) {
+        __m256i x = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)(text + k)), a);
+        __m256i y = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)(text + k + gap)), b);
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(x, y));
+        if (mask) return k + LowestSetBit(mask) / 2;
+    }
+    _mm256_zeroupper();
+    return k + FindUnitPairSse2(text + k, starts - k, first, last, gap);
+}
+
+static const CodecKernels g_sse2Kernels = { WidenAsciiSse2, NarrowAsciiSse2, SwapBytes16Sse2, FindLineBreakSse2,
+                                            FindUnitPairSse2 };
+static const CodecKernels g_avx2Kernels = { WidenAsciiAvx2, NarrowAsciiAvx2, SwapBytes16Avx2, FindLineBreakAvx2,
+                                            FindUnitPairAvx2 };
+
+static bool CpuHasAvx2(void) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    const int osxsave = 1 << 27, avx = 1 << 28;
+    if ((info[2] & (osxsave | avx)) != (osxsave | avx)) return false;
+    if ((_xgetbv(0) & 6) != 6) return false; // OS saves YMM state
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+#if defined(TEXT_CODEC_NEON)
+static size_t WidenAsciiNeon(const uint8_t *src, size_t size, uint16_t *dst) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t v = vld1q_u8(src + i);
+        if (vmaxvq_u8(v) >= 0x80) break;
+        if (dst) {
+            vst1q_u16(dst + i, vmovl_u8(vget_low_u8(v)));
+            vst1q_u16(dst + i + 8, vmovl_high_u8(v));
+        }
+    }
+    return i;
+}
+
+static size_t NarrowAsciiNeon(const uint16_t *src, size_t units, uint8_t *dst) {
+    size_t i = 0;
+    for (; i + 16 <= units; i += 16) {
+        uint16x8_t a = vld1q_u16(src + i);
+        uint16x8_t b = vld1q_u16(src + i + 8);
+        if (vmaxvq_u16(vorrq_u16(a, b)) >= 0x80) break;
+        vst1q_u8(dst + i, vcombine_u8(vmovn_u16(a), vmovn_u16(b)));
+    }
+    return i;
+}
+
+static void SwapBytes16Neon(const uint8_t *src, size_t units, uint8_t *dst) {
+    size_t k = 0;
+    for (; k + 8 <= units; k += 8) {
+        vst1q_u8(dst + 2 * k, vrev16q_u8(vld1q_u8(src + 2 * k)));
+    }
+    SwapBytes16Scalar(src + 2 * k, units - k, dst + 2 * k);
+}
+
+static size_t FindLineBreakNeon(const uint16_t *text, size_t units) {
+    const uint16x8_t lf = vdupq_n_u16(0x0A);
+    const uint16x8_t cr = vdupq_n_u16(0x0D);
+    size_t k = 0;
+    for (; k + 8 <= units; k += 8) {
+        uint16x8_t v = vld1q_u16(text + k);
+        if (vmaxvq_u16(vorrq_u16(vceqq_u16(v, lf), vceqq_u16(v, cr)))) break;
+    }
+    return k + FindLineBreakScalar(text + k, units - k);
+}
+
+static size_t FindUnitPairNeon(const uint16_t *text, size_t starts, uint16_t first, uint16_t last, size_t gap) {
+    const uint16x8_t a = vdupq_n_u16(first);
+    const uint16x8_t b = vdupq_n_u16(last);
+    size_t k = 0;
+    for (; k + 8 <= starts; k += 8) {
+        uint16x8_t x = vceqq_u16(vld1q_u16(text + k), a);
+        uint16x8_t y = vceqq_u16(vld1q_u16(text + k + gap), b);
+        if (vmaxvq_u16(vandq_u16(x, y))) break;
+    }
+    return k + FindUnitPairScalar(text + k, starts - k, first, last, gap);
+}
+
+static const CodecKernels g_neonKernels = { WidenAsciiNeon, NarrowAsciiNeon, SwapBytes16Neon, FindLineBreakNeon,
+                                            FindUnitPairNeon };
+#endif
+
+static const CodecKernels *g_kernels = NULL;
+
+static const CodecKernels *ResolveKernels(void) {
+    // Racing initialisations store the same pointer, so no locking is needed.
+    const CodecKernels *kernels = g_kernels;
+    if (kernels) return kernels;
+#if defined(TEXT_CODEC_SSE2)
+    kernels = CpuHasAvx2() ? &g_avx2Kernels : &g_sse2Kernels;
+#elif defined(TEXT_CODEC_NEON)
+    kernels = &g_neonKernels;
+#else
+    kernels = &g_scalarKernels;
+#endif
+    g_kernels = kernels;
+    return kernels;
+}
+
+bool TextCodecUseKernels(TextCodecKernels kernels) {
+    switch (kernels) {
+    case TEXT_KERNELS_AUTO:
+        g_kernels = NULL;
+        return true;
+    case TEXT_KERNELS_SCALAR:
+        g_kernels = &g_scalarKernels;
+        return true;
+#if defined(TEXT_CODEC_SSE2)
+    case TEXT_KERNELS_SSE2:
+        g_kernels = &g_sse2Kernels;
+        return true;
+    case TEXT_KERNELS_AVX2:
+        if (!CpuHasAvx2()) return false;
+        g_kernels = &g_avx2Kernels;
+        return true;
+#elif defined(TEXT_CODEC_NEON)
+    case TEXT_KERNELS_NEON:
+        g_kernels = &g_neonKernels;
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+size_t TextWidenAscii(const uint8_t *src, size_t size, uint16_t *dst) {
+    return ResolveKernels()->widenAscii(src, size, dst);
+}
+
+size_t TextNarrowAscii(const uint16_t *src, size_t units, uint8_t *dst) {
+    return ResolveKernels()->narrowAscii(src, units, dst);
+}
+
+void TextSwapBytes16(const void *src, size_t units, void *dst) {
+    ResolveKernels()->swapBytes16((const uint8_t *)src, units, (uint8_t *)dst);
+}
+
+size_t TextFindLineBreak(const uint16_t *text, size_t units) {
+    return ResolveKernels()->findLineBreak(text, units);
+}
+
+size_t TextFindUnitPair(const uint16_t *text, size_t starts, uint16_t first, uint16_t last, size_t gap) {
+    return ResolveKernels()->findUnitPair(text, starts, first, last, gap);
+}
+
+size_t TextEncodeUtf8(const uint16_t *text, size_t units, uint8_t *out) {
+    NarrowAsciiFn narrowAscii = ResolveKernels()->narrowAscii;
+    size_t i = 0, n = 0;
+    while (i < units) {
+        uint32_t u = text[i];
+        if (u < 0x80) {
+            size_t run = narrowAscii(text + i, units - i, out + n);
+            i += run;
+            n += run;
+            while (i < units && text[i] < 0x80) out[n++] = (uint8_t)text[i++];
+            continue;
+        }
+        i++;
+        if (u < 0x800) {
+            out[n++] = (uint8_t)(0xC0 | (u >> 6));
+            out[n++] = (uint8_t)(0x80 | (u & 0x3F));
+            continue;
+        }
+        if (u >= 0xD800 && u <= 0xDFFF) {
+            if (u <= 0xDBFF && i < units && text[i] >= 0xDC00 && text[i] <= 0xDFFF) {
+                uint32_t cp = 0x10000 + ((u - 0xD800) << 10) + (text[i++] - 0xDC00u);
+                out[n++] = (uint8_t)(0xF0 | (cp >> 18));
+                out[n++] = (uint8_t)(0x80 | ((cp >> 12) & 0x3F));
+                out[n++] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+                out[n++] = (uint8_t)(0x80 | (cp & 0x3F));
+                continue;
+            }
+            u = REPLACEMENT_CHAR;
+        }
+        out[n++] = (uint8_t)(0xE0 | (u >> 12));
+        out[n++] = (uint8_t)(0x80 | ((u >> 6) & 0x3F));
+        out[n++] = (uint8_t)(0x80 | (u & 0x3F));
+    }
+    return n;
+}
+
+void TextDecoderInit(TextDecoder *dec, TextEncoding encoding) {
+    memset(dec, 0, sizeof(*dec));
+    dec->encoding = encoding;
+    dec->firstInvalidOffset = UINT64_MAX;
+    dec->firstSurrogateOffset = UINT64_MAX;
+}
+
+size_t TextDecoderMaxOutput(TextEncoding encoding, size_t size) {
+    switch (encoding) {
+    case ENC_UTF16LE:
+    case ENC_UTF16BE:
+        return size / 2 + 1;
+    case ENC_UTF8:
+    default:
+        // Every input byte yields at most one unit; a carried partial
+        // sequence (up to 3 bytes) can add at most that many more.
+        return size + 4;
+    }
+}
+
+size_t TextBomLength(const uint8_t *data, size_t size, TextEncoding encoding) {
+    switch (encoding) {
+    case ENC_UTF16LE:
+        return (size >= 2 && data[0] == 0xFF && data[1] == 0xFE) ? 2 : 0;
+    case ENC_UTF16BE:
+        return (size >= 2 && data[0] == 0xFE && data[1] == 0xFF) ? 2 : 0;
+    case ENC_UTF8:
+        return (size >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF) ? 3 : 0;
+    default:
+        return 0;
+    }
+}
+
+bool TextDetectBom(const uint8_t *data, size_t size, TextEncoding *encodingOut) {
+    static const TextEncoding candidates[] = { ENC_UTF16LE, ENC_UTF16BE, ENC_UTF8 };
+    for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); ++i) {
+        if (TextBomLength(data, size, candidates[i])) {
+            *encodingOut = candidates[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+// Decodes one UTF-8 sequence. Returns the bytes consumed, or 0 when the
+// sequence is a valid prefix truncated by `avail`. Malformed input yields
+// UTF8_INVALID and consumes the maximal valid prefix (at least one byte).
+static size_t Utf8Sequence(const uint8_t *s, size_t avail, uint32_t *cp) {
+    uint8_t b0 = s[0];
+    if (b0 < 0x80) {
+        *cp = b0;
+        return 1;
+    }
+
+    size_t need;
+    uint32_t value;
+    uint8_t lo = 0x80, hi = 0xBF;
+    if (b0 >= 0xC2 && b0 <= 0xDF) {
+        need = 1;
+        value = b0 & 0x1F;
+    } else if (b0 >= 0xE0 && b0 <= 0xEF) {
+        // ED A0..BF encodes a surrogate; it is let through (WTF-8 style)
+        // and reported separately from malformed input.
+        need = 2;
+        value = b0 & 0x0F;
+        if (b0 == 0xE0) lo = 0xA0;
+    } else if (b0 >= 0xF0 && b0 <= 0xF4) {
+        need = 3;
+        value = b0 & 0x07;
+        if (b0 == 0xF0) lo = 0x90;
+        else if (b0 == 0xF4) hi = 0x8F;
+    } else {
+        *cp = UTF8_INVALID;
+        return 1;
+    }
+
+    for (size_t i = 1; i <= need; ++i) {
+        if (i >= avail) return 0;
+        uint8_t b = s[i];
+        if (b < lo || b > hi) {
+            *cp = UTF8_INVALID;
+            return i;
+        }
+        lo = 0x80;
+        hi = 0xBF;
+        value = (value << 6) | (b & 0x3F);
+    }
+    *cp = value;
+    return need + 1;
+}
+
+static size_t EmitCodePoint(TextDecoder *dec, uint32_t cp, uint64_t offset, uint16_t *out) {
+    if (cp == UTF8_INVALID) {
+        if (dec->invalidCount++ == 0) dec->firstInvalidOffset = offset;
+        cp = REPLACEMENT_CHAR;
+    } else if (cp >= 0xD800 && cp <= 0xDFFF) {
+        if (dec->surrogateCount++ == 0) dec->firstSurrogateOffset = offset;
+    }
+    if (cp < 0x10000) {
+        if (out) out[0] = (uint16_t)cp;
+        return 1;
+    }
+    cp -= 0x10000;
+    if (out) {
+        out[0] = (uint16_t)(0xD800 + (cp >> 10));
+        out[1] = (uint16_t)(0xDC00 + (cp & 0x3FF));
+    }
+    return 2;
+}
+
+static size_t DecodeUtf8(TextDecoder *dec, const uint8_t *data, size_t size, bool final, uint16_t *out) {
+    size_t produced = 0;
+    size_t i = 0;
+    uint32_t cp;
+
+    // Finish a sequence carried over from the previous chunk.
+    while (dec->pendingLen > 0) {
+        uint8_t tmp[8];
+        size_t take = size < 4 ? size : 4;
+        memcpy(tmp, dec->pending, dec->pendingLen);
+        memcpy(tmp + dec->pendingLen, data, take);
+        size_t avail = dec->pendingLen + take;
+        size_t used = Utf8Sequence(tmp, avail, &cp);
+        if (used == 0) {
+            if (!final) {
+                memcpy(dec->pending + dec->pendingLen, data, take);
+                dec->pendingLen += take;
+                dec->bytesSeen += take;
+                return produced;
+            }
+            cp = UTF8_INVALID;
+            used = avail;
+        }
+        uint64_t seqOffset = dec->bytesSeen - dec->pendingLen;
+        produced += EmitCodePoint(dec, cp, seqOffset, out ? out + produced : NULL);
+        if (used >= dec->pendingLen) {
+            i = used - dec->pendingLen;
+            dec->pendingLen = 0;
+        } else {
+            // Malformed prefix shorter than what was carried; re-scan the rest.
+            memmove(dec->pending, dec->pending + used, dec->pendingLen - used);
+            dec->pendingLen -= used;
+        }
+    }
+
+    WidenAsciiFn widenAscii = ResolveKernels()->widenAscii;
+    while (i < size) {
+        // Only an ASCII byte can start a run worth a vector call; text with
+        // few of them (CJK) would otherwise pay for a call per character.
+        if (data[i] < 0x80) {
+            size_t run = widenAscii(data + i, size - i, out ? out + produced : NULL);
+            i += run;
+            produced += run;
+            if (out) {
+                while (i < size && data[i] < 0x80) out[produced++] = data[i++];
+            } else {
+                size_t start = i;
+                while (i < size && data[i] < 0x80) i++;
+                produced += i - start;
+            }
+            if (i >= size) break;
+        }
+
+        size_t used = Utf8Sequence(data + i, size - i, &cp);
+        if (used == 0) {
+            if (!final) {
+                dec->pendingLen = size - i;
+                memcpy(dec->pending, data + i, dec->pendingLen);
+                break;
+            }
+            cp = UTF8_INVALID;
+            used = size - i;
+        }
+        produced += EmitCodePoint(dec, cp, dec->bytesSeen + i, out ? out + produced : NULL);
+        i += used;
+    }
+
+    dec->bytesSeen += size;
+    return produced;
+}
+
+// Supported targets (x86, x64, ARM64) are little-endian, so UTF-16LE is a
+// straight copy and UTF-16BE a byte swap.
+static size_t DecodeUtf16(TextDecoder *dec, const uint8_t *data, size_t size, bool final, uint16_t *out) {
+    bool bigEndian = (dec->encoding == ENC_UTF16BE);
+    size_t produced = 0;
+    size_t i = 0;
+
+    if (dec->pendingLen == 1 && size > 0) {
+        uint8_t first = dec->pending[0], second = data[0];
+        if (out) out[produced] = bigEndian ? (uint16_t)((first << 8) | second) : (uint16_t)((second << 8) | first);
+        produced++;
+        dec->pendingLen = 0;
+        i = 1;
+    }
+
+    size_t pairs = (size - i) / 2;
+    if (out && pairs) {
+        if (bigEndian) {
+            TextSwapBytes16(data + i, pairs, out + produced);
+        } else {
+            memcpy(out + produced, data + i, pairs * 2);
+        }
+    }
+    produced += pairs;
+    i += pairs * 2;
+
+    if (i < size) {
+        dec->pending[0] = data[i];
+        dec->pendingLen = 1;
+    }
+    if (final) {
+        dec->pendingLen = 0; // a dangling odd byte is not a character
+    }
+    dec->bytesSeen += size;
+    return produced;
+}
+
+size_t TextDecoderDecode(TextDecoder *dec, const uint8_t *data, size_t size, bool final, uint16_t *out) {
+    switch (dec->encoding) {
+    case ENC_UTF8:
+        return DecodeUtf8(dec, data, size, final, out);
+    case ENC_UTF16LE:
+    case ENC_UTF16BE:
+        return DecodeUtf16(dec, data, size, final, out);
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,94 @@
+// Platform-neutral text decoding core for retropad.
+// Kept free of <windows.h> so the loader's hot loops can be built and
+// measured on any host; file_io.c drives it over mapped file views.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum TextEncoding {
+    ENC_UTF8 = 1,
+    ENC_UTF16LE = 2,
+    ENC_UTF16BE = 3,
+    ENC_ANSI = 4
+} TextEncoding;
+
+// Incremental decoder: bytes may be fed in arbitrarily sized chunks, and
+// sequences split across chunk boundaries are carried to the next call.
+typedef struct TextDecoder {
+    TextEncoding encoding;
+    uint8_t pending[4];
+    size_t pendingLen;
+    uint64_t bytesSeen;
+    uint64_t invalidCount;         // malformed UTF-8 sequences (decoded as U+FFFD)
+    uint64_t firstInvalidOffset;   // byte offset of the first one, UINT64_MAX if none
+    uint64_t surrogateCount;       // UTF-8 encoded surrogates, passed through as-is
+    uint64_t firstSurrogateOffset; // byte offset of the first one, UINT64_MAX if none
+} TextDecoder;
+
+void TextDecoderInit(TextDecoder *dec, TextEncoding encoding);
+
+// Upper bound on UTF-16 units produced by one TextDecoderDecode call fed
+// `size` bytes (includes room for any carried partial sequence).
+size_t TextDecoderMaxOutput(TextEncoding encoding, size_t size);
+
+// Decodes `size` bytes into `out` and returns the number of UTF-16 units
+// written. Pass out == NULL to only count. When `final` is true any
+// incomplete trailing sequence is flushed as U+FFFD (UTF-8) or dropped
+// (UTF-16 odd byte). ENC_ANSI is not handled here; see file_io.c.
+size_t TextDecoderDecode(TextDecoder *dec, const uint8_t *data, size_t size, bool final, uint16_t *out);
+
+typedef enum TextCodecKernels {
+    TEXT_KERNELS_AUTO,   // the best the CPU supports
+    TEXT_KERNELS_SCALAR,
+    TEXT_KERNELS_SSE2,
+    TEXT_KERNELS_AVX2,
+    TEXT_KERNELS_NEON
+} TextCodecKernels;
+
+// Pins every vector kernel below (and the decoder's) to one implementation,
+// so tests and benchmarks can hold each against the scalar code. Returns
+// false, changing nothing, when this build or CPU does not have it.
+bool TextCodecUseKernels(TextCodecKernels kernels);
+
+// Vector kernels for single-byte code pages (see text_codepage.h): widen
+// the leading run of ASCII bytes to UTF-16, or narrow the leading run of
+// units below 0x80 to bytes. Whole vectors only; each returns how far it
+// got and the caller converts the rest.
+size_t TextWidenAscii(const uint8_t *src, size_t size, uint16_t *dst);
+size_t TextNarrowAscii(const uint16_t *src, size_t units, uint8_t *dst);
+
+// Encodes `units` UTF-16 units as UTF-8 into `out` (room for units * 3
+// bytes) in one pass and returns the byte count. A surrogate without its
+// other half becomes U+FFFD, as WideCharToMultiByte does; the caller keeps
+// pairs within one call.
+size_t TextEncodeUtf8(const uint16_t *text, size_t units, uint8_t *out);
+
+// Byte-swaps `units` UTF-16 code units from src into dst, converting between
+// UTF-16LE and UTF-16BE. src and dst may be the same buffer but must not
+// otherwise overlap.
+void TextSwapBytes16(const void *src, size_t units, void *dst);
+
+// Index of the first CR or LF among `units` UTF-16 units, or `units` when
+// there is none. Uses the same vector kernels as the decoder.
+size_t TextFindLineBreak(const uint16_t *text, size_t units);
+
+// First k below `starts` where text[k] == first and text[k + gap] == last,
+// or `starts` when there is none; text must hold starts + gap units. The
+// candidate filter behind TextFind (text_search.h).
+size_t TextFindUnitPair(const uint16_t *text, size_t starts, uint16_t first, uint16_t last, size_t gap);
+
+// Length of the byte order mark at the start of `data` for `encoding`, or 0.
+size_t TextBomLength(const uint8_t *data, size_t size, TextEncoding encoding);
+
+// Reports the encoding implied by a leading BOM; false if there is none.
+bool TextDetectBom(const uint8_t *data, size_t size, TextEncoding *encodingOut);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,48 @@
+// Platform-neutral single-byte code pages for retropad.
+// Built-in 128-entry tables for the upper half of Windows-1250..1258 and
+// ISO-8859-1..16, so ANSI text converts the same way on every machine
+// instead of through whatever CP_ACP happens to be. Bytes below 0x80 are
+// ASCII in all of them and go through the vector kernels in text_codec.h;
+// the rest are one table lookup each. Bytes a code page leaves undefined
+// map to U+0080..U+00FF (or U+F780..U+F7FF where that character is taken),
+// so every file round-trips byte for byte.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Code pages are named by their Windows identifiers: 1250..1258, and
+// 28590 + n for ISO-8859-n.
+bool TextCodePageKnown(unsigned codePage);
+// Display name such as "Western European (Windows-1252)", or NULL.
+const char *TextCodePageName(unsigned codePage);
+
+// Decodes `size` bytes into exactly `size` UTF-16 units. Unknown code pages
+// decode nothing and return 0.
+size_t TextCodePageDecode(unsigned codePage, const uint8_t *data, size_t size, uint16_t *out);
+
+// Reverse lookup for one code page.
+typedef struct TextCodePageEncoder {
+    unsigned codePage;
+    uint8_t latin[256];  // byte for U+0080..U+00FF, 0 if there is none
+    uint16_t chars[128]; // characters above U+00FF, sorted...
+    uint8_t bytes[128];  // ...and their bytes
+    size_t count;
+} TextCodePageEncoder;
+
+bool TextCodePageEncoderInit(TextCodePageEncoder *encoder, unsigned codePage);
+
+// Encodes `units` UTF-16 units into exactly `units` bytes. Characters the
+// code page lacks (including each half of a surrogate pair) become '?' and
+// are counted in *unmappedOut when it is given.
+size_t TextCodePageEncode(const TextCodePageEncoder *encoder, const uint16_t *text, size_t units, uint8_t *out,
+                          uint64_t *unmappedOut);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,245 @@
+// Sampling-based encoding detection: statistics over a handful of file
+// regions are turned into ranked, scored candidates.
+#include "text_detect.h"
+
+#include <string.h>
+
+#define HEAD_SAMPLE_BYTES (64u * 1024u)
+#define TAIL_SAMPLE_BYTES (64u * 1024u)
+#define STRIDE_SAMPLE_BYTES (16u * 1024u)
+#define STRIDE_SAMPLES 8u
+#define WHOLE_FILE_BYTES (HEAD_SAMPLE_BYTES + TAIL_SAMPLE_BYTES + STRIDE_SAMPLES * STRIDE_SAMPLE_BYTES)
+
+typedef struct SampleStats {
+    uint64_t bytes;
+    uint64_t nulBytes;
+    uint64_t evenZero;     // zero bytes at even file offsets
+    uint64_t oddZero;      // zero bytes at odd file offsets
+    uint64_t units;        // whole 16-bit units seen
+    uint64_t badSurrogatesLE;
+    uint64_t badSurrogatesBE;
+    uint64_t plausibleLE;  // units in commonly used BMP blocks when read LE
+    uint64_t plausibleBE;
+    uint8_t seenEven[256]; // byte values seen at even / odd file offsets
+    uint8_t seenOdd[256];
+    uint64_t utf8Multibyte; // well-formed non-ASCII sequences
+    uint64_t utf8Invalid;
+} SampleStats;
+
+size_t TextPlanSamples(uint64_t fileSize, TextSampleSpan *spans, size_t maxSpans) {
+    if (maxSpans == 0 || fileSize == 0) return 0;
+    if (fileSize <= WHOLE_FILE_BYTES || maxSpans < STRIDE_SAMPLES + 2) {
+        spans[0].offset = 0;
+        spans[0].size = (size_t)(fileSize < WHOLE_FILE_BYTES ? fileSize : WHOLE_FILE_BYTES);
+        return 1;
+    }
+
+    // Keep offsets 4-byte aligned so UTF-16 units stay in phase, and spread
+    // the strided samples between the head and the tail so the spans stay
+    // in file order even when the file is barely over WHOLE_FILE_BYTES.
+    uint64_t tail = (fileSize - TAIL_SAMPLE_BYTES) & ~(uint64_t)3;
+    size_t n = 0;
+    spans[n].offset = 0;
+    spans[n].size = HEAD_SAMPLE_BYTES;
+    n++;
+    for (uint64_t i = 1; i <= STRIDE_SAMPLES; ++i) {
+        spans[n].offset = HEAD_SAMPLE_BYTES + (((tail - HEAD_SAMPLE_BYTES) * i / (STRIDE_SAMPLES + 1)) & ~(uint64_t)3);
+        spans[n].size = STRIDE_SAMPLE_BYTES;
+        n++;
+    }
+    spans[n].offset = tail;
+    spans[n].size = (size_t)(fileSize - tail);
+    n++;
+    return n;
+}
+
+static bool IsHighSurrogate(unsigned u) { return u >= 0xD800 && u <= 0xDBFF; }
+static bool IsLowSurrogate(unsigned u) { return u >= 0xDC00 && u <= 0xDFFF; }
+
+// Latin, CJK punctuation/kana, CJK ideographs, Hangul, surrogates and
+// fullwidth forms: where nearly all real UTF-16 text lives.
+static bool IsPlausibleUnit(unsigned u) {
+    return u <= 0x024F || (u >= 0x2000 && u <= 0x206F) || (u >= 0x3000 && u <= 0x30FF) ||
+           (u >= 0x4E00 && u <= 0x9FFF) || (u >= 0xAC00 && u <= 0xDFFF) || (u >= 0xFF00 && u <= 0xFFEF);
+}
+
+// Counts plausible units and surrogates that cannot be part of a pair. A low surrogate at the
+// very start may belong to a pair split by the sample boundary.
+static void CountUnits(const uint8_t *p, size_t units, bool bigEndian, uint64_t *bad, uint64_t *plausible) {
+    bool expectLow = false;
+    for (size_t k = 0; k < units; ++k) {
+        unsigned u = bigEndian ? (unsigned)((p[2 * k] << 8) | p[2 * k + 1]) : (unsigned)((p[2 * k + 1] << 8) | p[2 * k]);
+        if (IsPlausibleUnit(u)) (*plausible)++;
+        if (IsLowSurrogate(u)) {
+            if (!expectLow && k > 0) (*bad)++;
+            expectLow = false;
+        } else {
+            if (expectLow) (*bad)++;
+            expectLow = IsHighSurrogate(u);
+        }
+    }
+}
+
+static void AccumulateSample(const TextSample *sample, uint64_t fileSize, SampleStats *stats) {
+    const uint8_t *data = sample->data;
+    size_t size = sample->size;
+    stats->bytes += size;
+
+    for (size_t i = 0; i < size; ++i) {
+        bool even = ((sample->offset + i) & 1) == 0;
+        if (even) stats->seenEven[data[i]] = 1;
+        else stats->seenOdd[data[i]] = 1;
+        if (data[i] != 0) continue;
+        stats->nulBytes++;
+        if (even) stats->evenZero++;
+        else stats->oddZero++;
+    }
+
+    size_t phase = (size_t)(sample->offset & 1);
+    if (size > phase) {
+        size_t units = (size - phase) / 2;
+        stats->units += units;
+        CountUnits(data + phase, units, false, &stats->badSurrogatesLE, &stats->plausibleLE);
+        CountUnits(data + phase, units, true, &stats->badSurrogatesBE, &stats->plausibleBE);
+    }
+
+    // A strided sample may begin mid-sequence; skip stray continuation bytes.
+    size_t skip = 0;
+    if (sample->offset > 0) {
+        while (skip < 3 && skip < size && (data[skip] & 0xC0) == 0x80) skip++;
+    }
+    bool atEnd = (sample->offset + size >= fileSize);
+    TextDecoder dec;
+    TextDecoderInit(&dec, ENC_UTF8);
+    TextDecoderDecode(&dec, data + skip, size - skip, atEnd, NULL);
+    uint64_t leads = 0;
+    for (size_t i = skip; i < size; ++i) {
+        if (data[i] >= 0xC2 && data[i] <= 0xF4) leads++;
+    }
+    stats->utf8Invalid += dec.invalidCount;
+    stats->utf8Multibyte += leads > dec.invalidCount ? leads - dec.invalidCount : 0;
+}
+
+static int ClampScore(int64_t score) {
+    if (score < 0) return 0;
+    if (score > 100) return 100;
+    return (int)score;
+}
+
+static int CountDistinct(const uint8_t *seen) {
+    int n = 0;
+    for (int i = 0; i < 256; ++i) n += seen[i];
+    return n;
+}
+
+static int ScoreUtf16(const SampleStats *stats, bool bigEndian) {
+    uint64_t wideZero = bigEndian ? stats->evenZero : stats->oddZero;
+    uint64_t narrowZero = bigEndian ? stats->oddZero : stats->evenZero;
+    uint64_t bad = bigEndian ? stats->badSurrogatesBE : stats->badSurrogatesLE;
+    uint64_t plausible = bigEndian ? stats->plausibleBE : stats->plausibleLE;
+    int highDistinct = CountDistinct(bigEndian ? stats->seenEven : stats->seenOdd);
+    int lowDistinct = CountDistinct(bigEndian ? stats->seenOdd : stats->seenEven);
+    if (stats->units < 8 || bad > 0) return 0;
+
+    // Latin text in UTF-16 leaves the high byte of most units zero, so
+    // zeros cluster at one parity and rarely appear at the other.
+    if (wideZero > 0 && narrowZero * 10 <= wideZero) {
+        uint64_t zeroPct = wideZero * 100 / stats->units;
+        if (zeroPct >= 30) {
+            return 80 + (int)(zeroPct >= 60 ? 19 : (zeroPct - 30) * 19 / 30);
+        }
+    }
+
+    // Few telltale zeros (e.g. CJK): the units must land in common blocks,
+    // and high bytes (the block) must vary far less than low bytes. Byte-
+    // oriented text has the same spread at both parities. DBCS text such as
+    // Shift-JIS can pass this too, so only trust it when the odd space or
+    // line break puts zeros at the right parity alone.
+    uint64_t plausiblePct = plausible * 100 / stats->units;
+    if (highDistinct * 2 <= lowDistinct && plausiblePct >= 90) {
+        if (plausiblePct >= 97 && wideZero > 0 && narrowZero * 10 <= wideZero) return 92;
+        return 75;
+    }
+    return wideZero > 0 ? 20 : 0;
+}
+
+static int ScoreUtf8(const SampleStats *stats, bool wholeFile) {
+    int score;
+    if (stats->utf8Invalid == 0) {
+        if (wholeFile) {
+            score = 100;
+        } else if (stats->utf8Multibyte > 0) {
+            // Random high bytes rarely form valid sequences; each one seen is
+            // strong evidence.
+            score = 95 + (int)(stats->utf8Multibyte >= 32 ? 4 : stats->utf8Multibyte / 8);
+        } else {
+            score = 60; // plain ASCII so far: unsampled regions decide
+        }
+    } else {
+        uint64_t total = stats->utf8Multibyte + stats->utf8Invalid * 4;
+        score = (int)(stats->utf8Multibyte * 70 / total);
+    }
+    if (stats->nulBytes > 0) score -= 30;
+    return ClampScore(score);
+}
+
+static int ScoreAnsi(const SampleStats *stats, int utf8Score) {
+    int score;
+    if (stats->utf8Invalid > 0) {
+        score = 100 - utf8Score;
+        if (score > 95) score = 95;
+    } else if (stats->utf8Multibyte > 0) {
+        score = 1;
+    } else {
+        score = 100 - utf8Score - 10;
+    }
+    if (stats->nulBytes > 0) score -= 30;
+    return ClampScore(score);
+}
+
+static void AddCandidate(EncodingGuess *guess, TextEncoding encoding, unsigned codePage, int confidence) {
+    if (guess->count >= TEXT_DETECT_MAX_CANDIDATES) return;
+    // Insertion sort, best first; ties keep insertion order.
+    size_t pos = guess->count;
+    while (pos > 0 && guess->candidates[pos - 1].confidence < confidence) {
+        guess->candidates[pos] = guess->candidates[pos - 1];
+        pos--;
+    }
+    guess->candidates[pos].encoding = encoding;
+    guess->candidates[pos].codePage = codePage;
+    guess->candidates[pos].confidence = confidence;
+    guess->count++;
+}
+
+void TextDetectEncoding(const TextSample *samples, size_t count, uint64_t fileSize, unsigned ansiCodePage, EncodingGuess *guess) {
+    memset(guess, 0, sizeof(*guess));
+
+    TextEncoding bomEncoding;
+    if (count > 0 && samples[0].offset == 0 && TextDetectBom(samples[0].data, samples[0].size, &bomEncoding)) {
+        guess->bomLength = TextBomLength(samples[0].data, samples[0].size, bomEncoding);
+        AddCandidate(guess, bomEncoding, 0, 100);
+        return;
+    }
+
+    SampleStats stats;
+    memset(&stats, 0, sizeof(stats));
+    for (size_t i = 0; i < count; ++i) {
+        AccumulateSample(&samples[i], fileSize, &stats);
+    }
+    guess->sampledWholeFile = (stats.bytes >= fileSize);
+
+    int le = ScoreUtf16(&stats, false);
+    int be = ScoreUtf16(&stats, true);
+    int utf8 = ScoreUtf8(&stats, guess->sampledWholeFile);
+    int ansi = ScoreAnsi(&stats, utf8);
+    if (le >= 80 || be >= 80) {
+        // Interleaved zeros make byte-oriented readings implausible.
+        utf8 = ClampScore(utf8 - 50);
+        ansi = ClampScore(ansi - 50);
+    }
+
+    AddCandidate(guess, ENC_UTF8, 0, utf8);
+    AddCandidate(guess, ENC_ANSI, ansiCodePage, ansi);
+    AddCandidate(guess, ENC_UTF16LE, 0, le);
+    AddCandidate(guess, ENC_UTF16BE, 0, be);
+}
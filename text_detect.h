@@ -0,0 +1,52 @@
+// Sampling-based encoding detection for retropad.
+// Looks at the head, tail and a few strided chunks of a file instead of the
+// whole thing and ranks the plausible encodings with a confidence score.
+// Platform-neutral: the caller reads the planned samples however it likes.
+#pragma once
+
+#include "text_codec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TEXT_DETECT_MAX_SAMPLES 10
+#define TEXT_DETECT_MAX_CANDIDATES 4
+// Guesses at or above this score are trusted without a full-file check.
+#define TEXT_DETECT_CONFIDENT 90
+
+typedef struct TextSampleSpan {
+    uint64_t offset;
+    size_t size;
+} TextSampleSpan;
+
+typedef struct TextSample {
+    const uint8_t *data;
+    size_t size;
+    uint64_t offset; // absolute position of data[0] in the file
+} TextSample;
+
+typedef struct EncodingCandidate {
+    TextEncoding encoding;
+    unsigned codePage; // ANSI code page for ENC_ANSI, 0 otherwise
+    int confidence;    // 0..100
+} EncodingCandidate;
+
+typedef struct EncodingGuess {
+    EncodingCandidate candidates[TEXT_DETECT_MAX_CANDIDATES]; // best first
+    size_t count;
+    size_t bomLength;      // non-zero when a BOM decided the encoding
+    bool sampledWholeFile; // samples covered every byte
+} EncodingGuess;
+
+// Fills `spans` with the regions of a `fileSize`-byte file worth reading
+// (whole file when small) and returns how many were written.
+size_t TextPlanSamples(uint64_t fileSize, TextSampleSpan *spans, size_t maxSpans);
+
+// Scores UTF-8, BOM-less UTF-16LE/BE and the ANSI code page `ansiCodePage`
+// against the samples (as planned by TextPlanSamples, in file order).
+void TextDetectEncoding(const TextSample *samples, size_t count, uint64_t fileSize, unsigned ansiCodePage, EncodingGuess *guess);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,250 @@
+// Line diff between two UTF-16 texts.
+#include "text_diff.h"
+
+#include "text_codec.h"
+#include "text_hash.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct DiffLine {
+    size_t start;  // units from the start of the text
+    size_t length; // including the line break
+    uint64_t hash;
+} DiffLine;
+
+typedef struct DiffSide {
+    const uint16_t *text;
+    DiffLine *lines;
+    size_t count;
+    bool *changed; // per line: not part of the common subsequence
+} DiffSide;
+
+static bool AddHunk(TextDiff *diff, size_t oldStart, size_t oldEnd, size_t newStart, size_t newEnd) {
+    if (diff->count == diff->capacity) {
+        size_t capacity = diff->capacity ? diff->capacity * 2 : 16;
+        TextDiffHunk *hunks = (TextDiffHunk *)realloc(diff->hunks, capacity * sizeof(TextDiffHunk));
+        if (!hunks) return false;
+        diff->hunks = hunks;
+        diff->capacity = capacity;
+    }
+    TextDiffHunk *hunk = &diff->hunks[diff->count++];
+    hunk->oldStart = oldStart;
+    hunk->oldEnd = oldEnd;
+    hunk->newStart = newStart;
+    hunk->newEnd = newEnd;
+    return true;
+}
+
+// Units the two texts share at the start, compared a block at a time.
+static size_t CommonPrefix(const uint16_t *a, const uint16_t *b, size_t units) {
+    const size_t block = 1024;
+    size_t pos = 0;
+    while (units - pos >= block && memcmp(a + pos, b + pos, block * sizeof(uint16_t)) == 0) pos += block;
+    while (pos < units && a[pos] == b[pos]) pos++;
+    return pos;
+}
+
+// Units shared at the end, given pointers just past each text.
+static size_t CommonSuffix(const uint16_t *aEnd, const uint16_t *bEnd, size_t units) {
+    const size_t block = 1024;
+    size_t n = 0;
+    while (units - n >= block && memcmp(aEnd - n - block, bEnd - n - block, block * sizeof(uint16_t)) == 0) n += block;
+    while (n < units && aEnd[-1 - (ptrdiff_t)n] == bEnd[-1 - (ptrdiff_t)n]) n++;
+    return n;
+}
+
+// Whether a line starts at `pos`, judging only by text[from, limit): the
+// break before it, and for a CR the unit after, must lie in that range.
+static bool LineStartsAt(const uint16_t *text, size_t pos, size_t from, size_t limit) {
+    if (pos == 0) return true;
+    if (pos - 1 < from) return false;
+    if (text[pos - 1] == '\n') return true;
+    return text[pos - 1] == '\r' && pos < limit && text[pos] != '\n';
+}
+
+// Splits text[from, to) into lines; `to` must be a line start or the end.
+static bool SplitLines(DiffSide *side, const uint16_t *text, size_t from, size_t to) {
+    side->text = text;
+    side->count = 0;
+    size_t capacity = 64;
+    side->lines = (DiffLine *)malloc(capacity * sizeof(DiffLine));
+    if (!side->lines) return false;
+    size_t pos = from;
+    while (pos < to) {
+        size_t end = pos + TextFindLineBreak(text + pos, to - pos);
+        if (end < to) {
+            end += (text[end] == '\r' && end + 1 < to && text[end + 1] == '\n') ? 2 : 1;
+        }
+        if (side->count == capacity) {
+            capacity *= 2;
+            DiffLine *lines = (DiffLine *)realloc(side->lines, capacity * sizeof(DiffLine));
+            if (!lines) return false;
+            side->lines = lines;
+        }
+        DiffLine *line = &side->lines[side->count++];
+        line->start = pos;
+        line->length = end - pos;
+        line->hash = TextHash64(text + pos, line->length * sizeof(uint16_t), 0);
+        pos = end;
+    }
+    side->changed = (bool *)calloc(side->count + 1, sizeof(bool));
+    return side->changed != NULL;
+}
+
+static bool SameLine(const DiffSide *a, size_t i, const DiffSide *b, size_t j) {
+    const DiffLine *x = &a->lines[i];
+    const DiffLine *y = &b->lines[j];
+    return x->hash == y->hash && x->length == y->length &&
+           memcmp(a->text + x->start, b->text + y->start, x->length * sizeof(uint16_t)) == 0;
+}
+
+// Myers' greedy search for the shortest edit script, keeping each round's
+// furthest-reaching x per diagonal so the path can be walked back. Marks
+// the lines off the common subsequence; false when it needs more than
+// `maxEdits` edits (or memory).
+static bool MarkChangedLines(DiffSide *a, DiffSide *b, size_t maxEdits) {
+    const int32_t n = (int32_t)a->count;
+    const int32_t m = (int32_t)b->count;
+    int32_t limit = n + m;
+    if (maxEdits < (size_t)limit) limit = (int32_t)maxEdits;
+    // Round d keeps diagonals -d..d, stored from trace[d * d].
+    int32_t *trace = (int32_t *)malloc(((size_t)limit + 1) * ((size_t)limit + 1) * sizeof(int32_t));
+    if (!trace) return false;
+
+    int32_t found = -1;
+    for (int32_t d = 0; d <= limit && found < 0; ++d) {
+        const int32_t *prev = d > 0 ? trace + (size_t)(d - 1) * (size_t)(d - 1) + (size_t)(d - 1) : NULL;
+        int32_t *row = trace + (size_t)d * (size_t)d + (size_t)d; // row[k] for k in -d..d
+        for (int32_t k = -d; k <= d; k += 2) {
+            int32_t x;
+            if (d == 0) {
+                x = 0;
+            } else if (k == -d || (k != d && prev[k - 1] < prev[k + 1])) {
+                x = prev[k + 1]; // down: a line of b inserted
+            } else {
+                x = prev[k - 1] + 1; // right: a line of a deleted
+            }
+            int32_t y = x - k;
+            while (x < n && y < m && SameLine(a, (size_t)x, b, (size_t)y)) {
+                x++;
+                y++;
+            }
+            row[k] = x;
+            if (x >= n && y >= m) {
+                found = d;
+                break;
+            }
+        }
+    }
+    if (found < 0) {
+        free(trace);
+        return false;
+    }
+
+    int32_t x = n, y = m;
+    for (int32_t d = found; d > 0; --d) {
+        const int32_t *prev = trace + (size_t)(d - 1) * (size_t)(d - 1) + (size_t)(d - 1);
+        int32_t k = x - y;
+        if (k == -d || (k != d && prev[k - 1] < prev[k + 1])) {
+            int32_t px = prev[k + 1];
+            b->changed[px - (k + 1)] = true;
+            x = px;
+            y = px - (k + 1);
+        } else {
+            int32_t px = prev[k - 1];
+            a->changed[px] = true;
+            x = px;
+            y = px - (k - 1);
+        }
+    }
+    free(trace);
+    return true;
+}
+
+void TextDiffInit(TextDiff *diff) {
+    memset(diff, 0, sizeof(*diff));
+}
+
+void TextDiffFree(TextDiff *diff) {
+    free(diff->hunks);
+    memset(diff, 0, sizeof(*diff));
+}
+
+bool TextDiffLines(TextDiff *diff, const uint16_t *oldText, size_t oldUnits, const uint16_t *newText,
+                   size_t newUnits, size_t maxEdits) {
+    diff->count = 0;
+    diff->exact = true;
+    size_t shorter = oldUnits < newUnits ? oldUnits : newUnits;
+
+    // Trim the common head back to a line start...
+    size_t head = CommonPrefix(oldText, newText, shorter);
+    if (head == oldUnits && head == newUnits) return true;
+    while (!LineStartsAt(oldText, head, 0, head)) head--;
+    // ...and the common tail forward to one, so both are whole lines.
+    size_t tail = CommonSuffix(oldText + oldUnits, newText + newUnits, shorter - head);
+    size_t oldEnd = oldUnits - tail;
+    size_t newEnd = newUnits - tail;
+    while (oldEnd < oldUnits && !(LineStartsAt(oldText, oldEnd, oldUnits - tail, oldUnits) &&
+                                  LineStartsAt(newText, newEnd, newUnits - tail, newUnits))) {
+        oldEnd++;
+        newEnd++;
+    }
+
+    DiffSide a, b;
+    memset(&a, 0, sizeof(a));
+    memset(&b, 0, sizeof(b));
+    bool ok = true;
+    if (oldEnd > head && newEnd > head && SplitLines(&a, oldText, head, oldEnd) &&
+        SplitLines(&b, newText, head, newEnd) && a.count + b.count < (size_t)INT32_MAX &&
+        MarkChangedLines(&a, &b, maxEdits)) {
+        // Walk both sides together: unchanged lines pair up in order, and
+        // each run of changed lines between them is one hunk.
+        size_t i = 0, j = 0;
+        while (ok && (i < a.count || j < b.count)) {
+            if (i < a.count && j < b.count && !a.changed[i] && !b.changed[j]) {
+                i++;
+                j++;
+                continue;
+            }
+            size_t oldFrom = i < a.count ? a.lines[i].start : oldEnd;
+            size_t newFrom = j < b.count ? b.lines[j].start : newEnd;
+            while (i < a.count && a.changed[i]) i++;
+            while (j < b.count && b.changed[j]) j++;
+            ok = AddHunk(diff, oldFrom, i < a.count ? a.lines[i].start : oldEnd, newFrom,
+                         j < b.count ? b.lines[j].start : newEnd);
+        }
+    } else {
+        // One side is empty between head and tail, or the search gave up.
+        diff->exact = oldEnd == head || newEnd == head;
+        ok = AddHunk(diff, head, oldEnd, head, newEnd);
+    }
+    free(a.lines);
+    free(a.changed);
+    free(b.lines);
+    free(b.changed);
+    if (!ok) diff->count = 0;
+    return ok;
+}
+
+size_t TextDiffMapOffset(const TextDiff *diff, size_t offset) {
+    size_t shifted = offset;
+    for (size_t i = 0; i < diff->count; ++i) {
+        const TextDiffHunk *hunk = &diff->hunks[i];
+        if (offset < hunk->oldStart) break;
+        if (offset < hunk->oldEnd) {
+            size_t column = offset - hunk->oldStart;
+            size_t room = hunk->newEnd - hunk->newStart;
+            return hunk->newStart + (column < room ? column : room);
+        }
+        shifted = offset - hunk->oldEnd + hunk->newEnd;
+    }
+    return shifted;
+}
+
+void TextDiffJoin(TextDiff *diff) {
+    if (diff->count < 2) return;
+    diff->hunks[0].oldEnd = diff->hunks[diff->count - 1].oldEnd;
+    diff->hunks[0].newEnd = diff->hunks[diff->count - 1].newEnd;
+    diff->count = 1;
+}
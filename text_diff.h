@@ -0,0 +1,55 @@
+// Platform-neutral line diff for retropad.
+// Compares the open document with a freshly decoded copy of its file and
+// lists the stretches that differ, so a reload can patch only those into
+// the edit control and carry the caret, selection and scroll position
+// across. Common leading and trailing text is trimmed first; the lines in
+// between are matched with Myers' O(ND) algorithm on line hashes. CR, LF
+// and CRLF each end a line, as in text_lines.h.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct TextDiffHunk {
+    size_t oldStart; // units [oldStart, oldEnd) of the old text...
+    size_t oldEnd;
+    size_t newStart; // ...become units [newStart, newEnd) of the new one
+    size_t newEnd;
+} TextDiffHunk;
+
+typedef struct TextDiff {
+    TextDiffHunk *hunks; // in order; neither overlapping nor touching
+    size_t count;
+    size_t capacity;
+    bool exact;          // false when the lines between the common head and
+                         // tail differed too much and became one hunk
+} TextDiff;
+
+void TextDiffInit(TextDiff *diff);
+void TextDiffFree(TextDiff *diff);
+
+// Fills `diff` with the changes from `oldText` to `newText`. Past `maxEdits`
+// inserted plus deleted lines the search stops and everything between the
+// common head and tail is one hunk, which bounds the time and the memory
+// (about 4 * maxEdits^2 bytes). False if memory ran out.
+bool TextDiffLines(TextDiff *diff, const uint16_t *oldText, size_t oldUnits, const uint16_t *newText,
+                   size_t newUnits, size_t maxEdits);
+
+// Where `offset` in the old text lands in the new one. Offsets inside a
+// changed stretch keep their column where the replacement is long enough.
+size_t TextDiffMapOffset(const TextDiff *diff, size_t offset);
+
+// Joins all the hunks into one spanning them. Each hunk patched into one
+// contiguous buffer moves everything after it, so past a few dozen one
+// replacement is cheaper. Offsets inside the span no longer map exactly:
+// map them before joining.
+void TextDiffJoin(TextDiff *diff);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,84 @@
+// Follow (tail) mode core: appended-bytes decoding and change detection.
+#include "text_follow.h"
+
+#include <string.h>
+
+void TextFollowerInit(TextFollower *follower, TextEncoding encoding, uint64_t offset, uint64_t fileId,
+                      const uint8_t *head, size_t headLen) {
+    memset(follower, 0, sizeof(*follower));
+    TextDecoderInit(&follower->decoder, encoding);
+    follower->offset = offset;
+    follower->fileId = fileId;
+    if (headLen > TEXT_FOLLOW_HEAD_BYTES) headLen = TEXT_FOLLOW_HEAD_BYTES;
+    if (headLen > offset) headLen = (size_t)offset;
+    if (headLen > 0) memcpy(follower->head, head, headLen);
+    follower->headLen = headLen;
+    follower->bomPending = offset == 0 && (encoding == ENC_UTF8 || encoding == ENC_UTF16LE || encoding == ENC_UTF16BE);
+}
+
+void TextFollowerSetDecoder(TextFollower *follower, TextFollowDecode decode, void *context) {
+    follower->decode = decode;
+    follower->decodeContext = context;
+}
+
+TextFollowChange TextFollowerCheck(const TextFollower *follower, uint64_t size, uint64_t fileId,
+                                   const uint8_t *head, size_t headLen) {
+    if (fileId != 0 && follower->fileId != 0 && fileId != follower->fileId) {
+        return TEXT_FOLLOW_REPLACED;
+    }
+    if (size < follower->offset) {
+        return TEXT_FOLLOW_TRUNCATED;
+    }
+    // Same name, same length or longer, but the start changed: the file
+    // was rewritten in place rather than appended to.
+    if (headLen < follower->headLen || memcmp(head, follower->head, follower->headLen) != 0) {
+        return TEXT_FOLLOW_REPLACED;
+    }
+    return size > follower->offset ? TEXT_FOLLOW_GREW : TEXT_FOLLOW_UNCHANGED;
+}
+
+size_t TextFollowerMaxOutput(const TextFollower *follower, size_t size) {
+    if (follower->decode) {
+        return size + 1; // a carried DBCS lead byte
+    }
+    size_t held = follower->bomPending ? (size_t)follower->offset : 0;
+    return TextDecoderMaxOutput(follower->decoder.encoding, size + held);
+}
+
+size_t TextFollowerDecode(TextFollower *follower, const uint8_t *data, size_t size, uint16_t *out) {
+    if (follower->headLen < TEXT_FOLLOW_HEAD_BYTES && follower->offset == follower->headLen) {
+        size_t take = TEXT_FOLLOW_HEAD_BYTES - follower->headLen;
+        if (take > size) take = size;
+        memcpy(follower->head + follower->headLen, data, take);
+        follower->headLen += take;
+    }
+    size_t held = (size_t)follower->offset;
+    follower->offset += size;
+    if (follower->decode) {
+        return follower->decode(follower->decodeContext, data, size, false, out);
+    }
+    if (!follower->bomPending) {
+        return TextDecoderDecode(&follower->decoder, data, size, false, out);
+    }
+
+    // The file was empty when following began, so it may open with a BOM,
+    // and the first polls can see only part of one. Those bytes wait in
+    // head until the BOM is whole or ruled out.
+    TextEncoding encoding = follower->decoder.encoding;
+    static const uint8_t utf8Bom[] = { 0xEF, 0xBB, 0xBF }, le16Bom[] = { 0xFF, 0xFE }, be16Bom[] = { 0xFE, 0xFF };
+    const uint8_t *bom = encoding == ENC_UTF8 ? utf8Bom : encoding == ENC_UTF16LE ? le16Bom : be16Bom;
+    size_t bomSize = encoding == ENC_UTF8 ? 3 : 2;
+    uint8_t start[3];
+    size_t take = bomSize - held < size ? bomSize - held : size;
+    memcpy(start, follower->head, held);
+    memcpy(start + held, data, take);
+    if (held + take < bomSize && memcmp(start, bom, held + take) == 0) return 0;
+    follower->bomPending = false;
+    size_t units = 0;
+    size_t skip = TextBomLength(start, held + take, encoding);
+    if (skip == 0 && held > 0) {
+        units = TextDecoderDecode(&follower->decoder, follower->head, held, false, out);
+    }
+    skip = skip > held ? skip - held : 0;
+    return units + TextDecoderDecode(&follower->decoder, data + skip, size - skip, false, out + units);
+}
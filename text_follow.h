@@ -0,0 +1,62 @@
+// Platform-neutral core of follow (tail) mode for retropad.
+// Decodes only the bytes a file gains after the part already shown,
+// carrying sequences split between polls, and classifies each poll of the
+// file's size and identity: grown, unchanged, truncated, or replaced by a
+// different file (log rotation). Opening and reading the file, and the
+// polling timer, live with the caller (see file_io.c).
+#pragma once
+
+#include "text_codec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Leading bytes remembered to notice a file rewritten in place (for
+// example copy-and-truncate rotation) that has already regrown.
+#define TEXT_FOLLOW_HEAD_BYTES 64u
+
+typedef enum TextFollowChange {
+    TEXT_FOLLOW_UNCHANGED = 0,
+    TEXT_FOLLOW_GREW = 1,      // new bytes past the followed offset
+    TEXT_FOLLOW_TRUNCATED = 2, // shorter than what was already read
+    TEXT_FOLLOW_REPLACED = 3   // a different file, or different leading bytes
+} TextFollowChange;
+
+// Decoder for encodings TextDecoder does not cover (the ANSI code page).
+// Same contract as TextDecoderDecode with a non-NULL `out`.
+typedef size_t (*TextFollowDecode)(void *context, const uint8_t *data, size_t size, bool final, uint16_t *out);
+
+typedef struct TextFollower {
+    TextDecoder decoder;
+    TextFollowDecode decode; // NULL: use `decoder`
+    void *decodeContext;
+    uint64_t offset;         // file bytes consumed so far
+    uint64_t fileId;         // identity of the followed file, 0 if unknown
+    uint8_t head[TEXT_FOLLOW_HEAD_BYTES];
+    size_t headLen;          // always min(TEXT_FOLLOW_HEAD_BYTES, offset)
+    bool bomPending;         // began empty: the bytes so far (in head) may start a BOM
+} TextFollower;
+
+// Starts following a file whose first `offset` bytes are already shown.
+// `head` holds its first min(TEXT_FOLLOW_HEAD_BYTES, offset) bytes.
+void TextFollowerInit(TextFollower *follower, TextEncoding encoding, uint64_t offset, uint64_t fileId,
+                      const uint8_t *head, size_t headLen);
+void TextFollowerSetDecoder(TextFollower *follower, TextFollowDecode decode, void *context);
+
+// Compares a fresh look at the file (its size, identity and first
+// min(TEXT_FOLLOW_HEAD_BYTES, size) bytes) with what was followed so far.
+TextFollowChange TextFollowerCheck(const TextFollower *follower, uint64_t size, uint64_t fileId,
+                                   const uint8_t *head, size_t headLen);
+
+// UTF-16 units `out` must hold for a TextFollowerDecode call fed `size` bytes.
+size_t TextFollowerMaxOutput(const TextFollower *follower, size_t size);
+
+// Decodes `size` bytes read at the followed offset and advances past them.
+// An incomplete trailing sequence is held back until the next call, as is
+// a file's start while it could still be the first bytes of a BOM.
+size_t TextFollowerDecode(TextFollower *follower, const uint8_t *data, size_t size, uint16_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,675 @@
+// Streaming gzip (RFC 1952) over deflate (RFC 1951): inflate and a fixed-
+// Huffman deflate that falls back to stored blocks.
+#include "text_gzip.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define WINDOW_MASK (TEXT_GZIP_WINDOW - 1u)
+#define MIN_MATCH 3u
+#define MAX_MATCH 258u
+#define HASH_BITS 15u
+#define MAX_CHAIN 32u // candidates tried per position: speed over ratio
+#define STORED_MAX 65535u // bytes in one stored block
+
+static const uint32_t kCrcTable[256] = {
+    0x00000000u, 0x77073096u, 0xEE0E612Cu, 0x990951BAu, 0x076DC419u, 0x706AF48Fu,
+    0xE963A535u, 0x9E6495A3u, 0x0EDB8832u, 0x79DCB8A4u, 0xE0D5E91Eu, 0x97D2D988u,
+    0x09B64C2Bu, 0x7EB17CBDu, 0xE7B82D07u, 0x90BF1D91u, 0x1DB71064u, 0x6AB020F2u,
+    0xF3B97148u, 0x84BE41DEu, 0x1ADAD47Du, 0x6DDDE4EBu, 0xF4D4B551u, 0x83D385C7u,
+    0x136C9856u, 0x646BA8C0u, 0xFD62F97Au, 0x8A65C9ECu, 0x14015C4Fu, 0x63066CD9u,
+    0xFA0F3D63u, 0x8D080DF5u, 0x3B6E20C8u, 0x4C69105Eu, 0xD56041E4u, 0xA2677172u,
+    0x3C03E4D1u, 0x4B04D447u, 0xD20D85FDu, 0xA50AB56Bu, 0x35B5A8FAu, 0x42B2986Cu,
+    0xDBBBC9D6u, 0xACBCF940u, 0x32D86CE3u, 0x45DF5C75u, 0xDCD60DCFu, 0xABD13D59u,
+    0x26D930ACu, 0x51DE003Au, 0xC8D75180u, 0xBFD06116u, 0x21B4F4B5u, 0x56B3C423u,
+    0xCFBA9599u, 0xB8BDA50Fu, 0x2802B89Eu, 0x5F058808u, 0xC60CD9B2u, 0xB10BE924u,
+    0x2F6F7C87u, 0x58684C11u, 0xC1611DABu, 0xB6662D3Du, 0x76DC4190u, 0x01DB7106u,
+    0x98D220BCu, 0xEFD5102Au, 0x71B18589u, 0x06B6B51Fu, 0x9FBFE4A5u, 0xE8B8D433u,
+    0x7807C9A2u, 0x0F00F934u, 0x9609A88Eu, 0xE10E9818u, 0x7F6A0DBBu, 0x086D3D2Du,
+    0x91646C97u, 0xE6635C01u, 0x6B6B51F4u, 0x1C6C6162u, 0x856530D8u, 0xF262004Eu,
+    0x6C0695EDu, 0x1B01A57Bu, 0x8208F4C1u, 0xF50FC457u, 0x65B0D9C6u, 0x12B7E950u,
+    0x8BBEB8EAu, 0xFCB9887Cu, 0x62DD1DDFu, 0x15DA2D49u, 0x8CD37CF3u, 0xFBD44C65u,
+    0x4DB26158u, 0x3AB551CEu, 0xA3BC0074u, 0xD4BB30E2u, 0x4ADFA541u, 0x3DD895D7u,
+    0xA4D1C46Du, 0xD3D6F4FBu, 0x4369E96Au, 0x346ED9FCu, 0xAD678846u, 0xDA60B8D0u,
+    0x44042D73u, 0x33031DE5u, 0xAA0A4C5Fu, 0xDD0D7CC9u, 0x5005713Cu, 0x270241AAu,
+    0xBE0B1010u, 0xC90C2086u, 0x5768B525u, 0x206F85B3u, 0xB966D409u, 0xCE61E49Fu,
+    0x5EDEF90Eu, 0x29D9C998u, 0xB0D09822u, 0xC7D7A8B4u, 0x59B33D17u, 0x2EB40D81u,
+    0xB7BD5C3Bu, 0xC0BA6CADu, 0xEDB88320u, 0x9ABFB3B6u, 0x03B6E20Cu, 0x74B1D29Au,
+    0xEAD54739u, 0x9DD277AFu, 0x04DB2615u, 0x73DC1683u, 0xE3630B12u, 0x94643B84u,
+    0x0D6D6A3Eu, 0x7A6A5AA8u, 0xE40ECF0Bu, 0x9309FF9Du, 0x0A00AE27u, 0x7D079EB1u,
+    0xF00F9344u, 0x8708A3D2u, 0x1E01F268u, 0x6906C2FEu, 0xF762575Du, 0x806567CBu,
+    0x196C3671u, 0x6E6B06E7u, 0xFED41B76u, 0x89D32BE0u, 0x10DA7A5Au, 0x67DD4ACCu,
+    0xF9B9DF6Fu, 0x8EBEEFF9u, 0x17B7BE43u, 0x60B08ED5u, 0xD6D6A3E8u, 0xA1D1937Eu,
+    0x38D8C2C4u, 0x4FDFF252u, 0xD1BB67F1u, 0xA6BC5767u, 0x3FB506DDu, 0x48B2364Bu,
+    0xD80D2BDAu, 0xAF0A1B4Cu, 0x36034AF6u, 0x41047A60u, 0xDF60EFC3u, 0xA867DF55u,
+    0x316E8EEFu, 0x4669BE79u, 0xCB61B38Cu, 0xBC66831Au, 0x256FD2A0u, 0x5268E236u,
+    0xCC0C7795u, 0xBB0B4703u, 0x220216B9u, 0x5505262Fu, 0xC5BA3BBEu, 0xB2BD0B28u,
+    0x2BB45A92u, 0x5CB36A04u, 0xC2D7FFA7u, 0xB5D0CF31u, 0x2CD99E8Bu, 0x5BDEAE1Du,
+    0x9B64C2B0u, 0xEC63F226u, 0x756AA39Cu, 0x026D930Au, 0x9C0906A9u, 0xEB0E363Fu,
+    0x72076785u, 0x05005713u, 0x95BF4A82u, 0xE2B87A14u, 0x7BB12BAEu, 0x0CB61B38u,
+    0x92D28E9Bu, 0xE5D5BE0Du, 0x7CDCEFB7u, 0x0BDBDF21u, 0x86D3D2D4u, 0xF1D4E242u,
+    0x68DDB3F8u, 0x1FDA836Eu, 0x81BE16CDu, 0xF6B9265Bu, 0x6FB077E1u, 0x18B74777u,
+    0x88085AE6u, 0xFF0F6A70u, 0x66063BCAu, 0x11010B5Cu, 0x8F659EFFu, 0xF862AE69u,
+    0x616BFFD3u, 0x166CCF45u, 0xA00AE278u, 0xD70DD2EEu, 0x4E048354u, 0x3903B3C2u,
+    0xA7672661u, 0xD06016F7u, 0x4969474Du, 0x3E6E77DBu, 0xAED16A4Au, 0xD9D65ADCu,
+    0x40DF0B66u, 0x37D83BF0u, 0xA9BCAE53u, 0xDEBB9EC5u, 0x47B2CF7Fu, 0x30B5FFE9u,
+    0xBDBDF21Cu, 0xCABAC28Au, 0x53B39330u, 0x24B4A3A6u, 0xBAD03605u, 0xCDD70693u,
+    0x54DE5729u, 0x23D967BFu, 0xB3667A2Eu, 0xC4614AB8u, 0x5D681B02u, 0x2A6F2B94u,
+    0xB40BBE37u, 0xC30C8EA1u, 0x5A05DF1Bu, 0x2D02EF8Du,
+};
+
+static const uint16_t kLengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const uint8_t kLengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+static const uint16_t kDistanceBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577,
+};
+static const uint8_t kDistanceExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+
+bool TextGzipDetect(const uint8_t *data, size_t size) {
+    return size >= 3 && data[0] == 0x1F && data[1] == 0x8B && data[2] == 8;
+}
+
+uint32_t TextCrc32(uint32_t crc, const uint8_t *data, size_t size) {
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = kCrcTable[(crc ^ data[i]) & 0xFFu] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static unsigned ReverseBits(unsigned code, unsigned length) {
+    unsigned reversed = 0;
+    for (unsigned i = 0; i < length; ++i) {
+        reversed = (reversed << 1) | ((code >> i) & 1u);
+    }
+    return reversed;
+}
+
+// ---------------------------------------------------------------------------
+// Inflate
+
+enum {
+    GZ_HEADER,  // member header
+    GZ_BLOCK,   // block header
+    GZ_STORED,  // inside a stored block
+    GZ_CODES,   // inside a Huffman-coded block
+    GZ_TRAILER, // member CRC and size
+    GZ_NEXT,    // another member, or the end
+    GZ_DONE
+};
+
+bool TextGzipReaderInit(TextGzipReader *reader, TextGzipRead read, void *readContext) {
+    memset(reader, 0, sizeof(*reader));
+    reader->read = read;
+    reader->readContext = readContext;
+    reader->state = GZ_HEADER;
+    reader->input = (uint8_t *)malloc(TEXT_GZIP_INPUT_BYTES);
+    reader->window = (uint8_t *)malloc(TEXT_GZIP_WINDOW);
+    return reader->input && reader->window;
+}
+
+void TextGzipReaderFree(TextGzipReader *reader) {
+    free(reader->input);
+    free(reader->window);
+    reader->input = NULL;
+    reader->window = NULL;
+}
+
+// Tops the bit buffer up to at least `need` bits; false if input ran out.
+static bool NeedBits(TextGzipReader *reader, unsigned need) {
+    while (reader->bitCount < need) {
+        if (reader->inputPos == reader->inputLen) {
+            if (reader->inputEnded) return false;
+            reader->inputLen = reader->read(reader->readContext, reader->input, TEXT_GZIP_INPUT_BYTES);
+            reader->inputPos = 0;
+            if (reader->inputLen == 0) {
+                reader->inputEnded = true;
+                return false;
+            }
+        }
+        reader->bits |= (uint64_t)reader->input[reader->inputPos++] << reader->bitCount;
+        reader->bitCount += 8;
+        reader->inputBytes++;
+    }
+    return true;
+}
+
+static void DropBits(TextGzipReader *reader, unsigned count) {
+    reader->bits >>= count;
+    reader->bitCount -= count;
+}
+
+static bool GetBits(TextGzipReader *reader, unsigned count, unsigned *valueOut) {
+    if (!NeedBits(reader, count)) return false;
+    *valueOut = (unsigned)(reader->bits & ((1u << count) - 1u));
+    DropBits(reader, count);
+    return true;
+}
+
+static bool SkipBytes(TextGzipReader *reader, unsigned count) {
+    unsigned ignored;
+    for (unsigned i = 0; i < count; ++i) {
+        if (!GetBits(reader, 8, &ignored)) return false;
+    }
+    return true;
+}
+
+static bool SkipString(TextGzipReader *reader) {
+    unsigned c;
+    do {
+        if (!GetBits(reader, 8, &c)) return false;
+    } while (c != 0);
+    return true;
+}
+
+static bool ReadMemberHeader(TextGzipReader *reader) {
+    unsigned magic, method, flags, extra;
+    if (!GetBits(reader, 16, &magic) || magic != 0x8B1Fu) return false;
+    if (!GetBits(reader, 8, &method) || method != 8) return false;
+    if (!GetBits(reader, 8, &flags) || (flags & 0xE0u) != 0) return false;
+    if (!SkipBytes(reader, 6)) return false; // mtime, extra flags, OS
+    if ((flags & 4u) && (!GetBits(reader, 16, &extra) || !SkipBytes(reader, extra))) return false;
+    if ((flags & 8u) && !SkipString(reader)) return false;  // file name
+    if ((flags & 16u) && !SkipString(reader)) return false; // comment
+    if ((flags & 2u) && !SkipBytes(reader, 2)) return false; // header CRC
+    return true;
+}
+
+// Canonical Huffman table from code lengths; false if over-subscribed.
+static bool BuildHuffman(TextGzipHuffman *h, const uint8_t *lengths, unsigned count) {
+    memset(h->counts, 0, sizeof(h->counts));
+    for (unsigned s = 0; s < count; ++s) h->counts[lengths[s]]++;
+    h->counts[0] = 0;
+    int left = 1;
+    for (unsigned len = 1; len < 16; ++len) {
+        left = left * 2 - h->counts[len];
+        if (left < 0) return false;
+    }
+    uint16_t offsets[16];
+    offsets[1] = 0;
+    for (unsigned len = 1; len < 15; ++len) offsets[len + 1] = (uint16_t)(offsets[len] + h->counts[len]);
+    for (unsigned s = 0; s < count; ++s) {
+        if (lengths[s]) h->symbols[offsets[lengths[s]]++] = (uint16_t)s;
+    }
+    // Codes up to 9 bits decode with one lookup of the next 9 input bits.
+    memset(h->fast, 0, sizeof(h->fast));
+    unsigned code = 0, index = 0;
+    for (unsigned len = 1; len <= 9; ++len) {
+        for (unsigned k = 0; k < h->counts[len]; ++k, ++code) {
+            uint16_t entry = (uint16_t)((len << 12) | h->symbols[index++]);
+            for (unsigned f = ReverseBits(code, len); f < 512; f += 1u << len) h->fast[f] = entry;
+        }
+        code <<= 1;
+    }
+    return true;
+}
+
+// Codes longer than 9 bits: walk the canonical code one bit at a time.
+static int DecodeSlow(TextGzipReader *reader, const TextGzipHuffman *h) {
+    int code = 0, first = 0, index = 0;
+    for (unsigned len = 1; len < 16; ++len) {
+        if (!NeedBits(reader, len)) return -1;
+        code |= (int)((reader->bits >> (len - 1)) & 1u);
+        int count = h->counts[len];
+        if (code - count < first) {
+            DropBits(reader, len);
+            return h->symbols[index + (code - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+static int DecodeSymbol(TextGzipReader *reader, const TextGzipHuffman *h) {
+    NeedBits(reader, 9); // may come up short at the very end of the input
+    uint16_t entry = h->fast[reader->bits & 511u];
+    if (entry) {
+        unsigned len = entry >> 12;
+        if (len > reader->bitCount) return -1;
+        DropBits(reader, len);
+        return entry & 0xFFF;
+    }
+    return DecodeSlow(reader, h);
+}
+
+static bool BuildFixedTables(TextGzipReader *reader) {
+    uint8_t lengths[320];
+    unsigned s = 0;
+    for (; s < 144; ++s) lengths[s] = 8;
+    for (; s < 256; ++s) lengths[s] = 9;
+    for (; s < 280; ++s) lengths[s] = 7;
+    for (; s < 288; ++s) lengths[s] = 8;
+    for (; s < 318; ++s) lengths[s] = 5;
+    return BuildHuffman(&reader->literals, lengths, 288) && BuildHuffman(&reader->distances, lengths + 288, 30);
+}
+
+static bool ReadDynamicTables(TextGzipReader *reader) {
+    static const uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    unsigned nlen, ndist, ncode, value;
+    if (!GetBits(reader, 5, &nlen) || !GetBits(reader, 5, &ndist) || !GetBits(reader, 4, &ncode)) return false;
+    nlen += 257;
+    ndist += 1;
+    ncode += 4;
+    if (nlen > 286 || ndist > 30) return false;
+
+    uint8_t lengths[320];
+    memset(lengths, 0, sizeof(lengths));
+    for (unsigned i = 0; i < ncode; ++i) {
+        if (!GetBits(reader, 3, &value)) return false;
+        lengths[order[i]] = (uint8_t)value;
+    }
+    TextGzipHuffman *codeLengths = &reader->distances; // rebuilt below
+    if (!BuildHuffman(codeLengths, lengths, 19)) return false;
+
+    unsigned n = 0;
+    while (n < nlen + ndist) {
+        int sym = DecodeSymbol(reader, codeLengths);
+        if (sym < 0) return false;
+        if (sym < 16) {
+            lengths[n++] = (uint8_t)sym;
+            continue;
+        }
+        uint8_t repeat = 0;
+        unsigned times;
+        if (sym == 16) {
+            if (n == 0 || !GetBits(reader, 2, &times)) return false;
+            repeat = lengths[n - 1];
+            times += 3;
+        } else if (sym == 17) {
+            if (!GetBits(reader, 3, &times)) return false;
+            times += 3;
+        } else {
+            if (!GetBits(reader, 7, &times)) return false;
+            times += 11;
+        }
+        if (n + times > nlen + ndist) return false;
+        while (times--) lengths[n++] = repeat;
+    }
+    if (lengths[256] == 0) return false; // no end-of-block code
+    return BuildHuffman(&reader->literals, lengths, nlen) && BuildHuffman(&reader->distances, lengths + nlen, ndist);
+}
+
+static bool ReadBlockHeader(TextGzipReader *reader) {
+    unsigned last, type;
+    if (!GetBits(reader, 1, &last) || !GetBits(reader, 2, &type)) return false;
+    reader->lastBlock = last != 0;
+    if (type == 0) {
+        unsigned len, nlen;
+        DropBits(reader, reader->bitCount & 7u);
+        if (!GetBits(reader, 16, &len) || !GetBits(reader, 16, &nlen) || len != (~nlen & 0xFFFFu)) return false;
+        reader->storedLeft = len;
+        reader->state = GZ_STORED;
+        return true;
+    }
+    if (type == 1) {
+        if (!BuildFixedTables(reader)) return false;
+    } else if (type != 2 || !ReadDynamicTables(reader)) {
+        return false;
+    }
+    reader->state = GZ_CODES;
+    return true;
+}
+
+static bool ReadMemberTrailer(TextGzipReader *reader) {
+    unsigned lo, hi, sizeLo, sizeHi;
+    DropBits(reader, reader->bitCount & 7u);
+    if (!GetBits(reader, 16, &lo) || !GetBits(reader, 16, &hi)) return false;
+    if (!GetBits(reader, 16, &sizeLo) || !GetBits(reader, 16, &sizeHi)) return false;
+    uint32_t crc = (uint32_t)lo | ((uint32_t)hi << 16);
+    uint32_t size = (uint32_t)sizeLo | ((uint32_t)sizeHi << 16);
+    return crc == reader->crc && size == (uint32_t)reader->memberBytes;
+}
+
+// Records `size` bytes just handed out in the window.
+static void WindowAppend(TextGzipReader *reader, const uint8_t *data, size_t size) {
+    if (size > TEXT_GZIP_WINDOW) {
+        reader->outputBytes += size - TEXT_GZIP_WINDOW;
+        data += size - TEXT_GZIP_WINDOW;
+        size = TEXT_GZIP_WINDOW;
+    }
+    size_t at = (size_t)(reader->outputBytes & WINDOW_MASK);
+    size_t first = TEXT_GZIP_WINDOW - at < size ? TEXT_GZIP_WINDOW - at : size;
+    memcpy(reader->window + at, data, first);
+    memcpy(reader->window, data + first, size - first);
+    reader->outputBytes += size;
+}
+
+size_t TextGzipReaderRead(TextGzipReader *reader, uint8_t *out, size_t size) {
+    size_t done = 0;
+    size_t crcFrom = 0; // output not yet folded into the member CRC
+    uint8_t *window = reader->window;
+    while (done < size && !reader->failed && reader->state != GZ_DONE) {
+        switch (reader->state) {
+        case GZ_HEADER:
+            if (!ReadMemberHeader(reader)) {
+                reader->failed = true;
+                break;
+            }
+            reader->crc = 0;
+            reader->memberBytes = 0;
+            reader->lastBlock = false;
+            reader->state = GZ_BLOCK;
+            break;
+        case GZ_BLOCK:
+            if (reader->lastBlock) {
+                reader->state = GZ_TRAILER;
+            } else if (!ReadBlockHeader(reader)) {
+                reader->failed = true;
+            }
+            break;
+        case GZ_STORED:
+            while (reader->storedLeft > 0 && done < size) {
+                if (reader->bitCount == 0 && reader->inputPos < reader->inputLen) {
+                    // Nothing buffered in bits: copy straight from the input.
+                    size_t run = reader->inputLen - reader->inputPos;
+                    if (run > reader->storedLeft) run = reader->storedLeft;
+                    if (run > size - done) run = size - done;
+                    memcpy(out + done, reader->input + reader->inputPos, run);
+                    WindowAppend(reader, out + done, run);
+                    done += run;
+                    reader->inputPos += run;
+                    reader->inputBytes += run;
+                    reader->memberBytes += run;
+                    reader->storedLeft -= (uint32_t)run;
+                    continue;
+                }
+                unsigned byte;
+                if (!GetBits(reader, 8, &byte)) {
+                    reader->failed = true;
+                    break;
+                }
+                out[done++] = (uint8_t)byte;
+                window[reader->outputBytes++ & WINDOW_MASK] = (uint8_t)byte;
+                reader->memberBytes++;
+                reader->storedLeft--;
+            }
+            if (reader->storedLeft == 0) reader->state = GZ_BLOCK;
+            break;
+        case GZ_CODES: {
+            // Finish a match the previous call had no room for.
+            while (reader->matchLength > 0 && done < size) {
+                uint8_t byte = window[(reader->outputBytes - reader->matchDistance) & WINDOW_MASK];
+                out[done++] = byte;
+                window[reader->outputBytes++ & WINDOW_MASK] = byte;
+                reader->memberBytes++;
+                reader->matchLength--;
+            }
+            if (done == size) break;
+            int sym = DecodeSymbol(reader, &reader->literals);
+            if (sym < 0) {
+                reader->failed = true;
+            } else if (sym < 256) {
+                out[done++] = (uint8_t)sym;
+                window[reader->outputBytes++ & WINDOW_MASK] = (uint8_t)sym;
+                reader->memberBytes++;
+            } else if (sym == 256) {
+                reader->state = GZ_BLOCK;
+            } else {
+                unsigned index = (unsigned)sym - 257, extra, dextra;
+                int dsym;
+                if (index >= 29 || !GetBits(reader, kLengthExtra[index], &extra) ||
+                    (dsym = DecodeSymbol(reader, &reader->distances)) < 0 || dsym >= 30 ||
+                    !GetBits(reader, kDistanceExtra[dsym], &dextra)) {
+                    reader->failed = true;
+                    break;
+                }
+                unsigned distance = kDistanceBase[dsym] + dextra;
+                if (distance > reader->memberBytes) {
+                    reader->failed = true;
+                    break;
+                }
+                reader->matchLength = kLengthBase[index] + extra;
+                reader->matchDistance = distance;
+            }
+            break;
+        }
+        case GZ_TRAILER:
+            reader->crc = TextCrc32(reader->crc, out + crcFrom, done - crcFrom);
+            crcFrom = done;
+            if (!ReadMemberTrailer(reader)) {
+                reader->failed = true;
+                break;
+            }
+            reader->state = GZ_NEXT;
+            break;
+        case GZ_NEXT:
+            // Another member follows, or the stream ends (anything else
+            // after the last member, such as padding, is ignored).
+            if (NeedBits(reader, 16) && (reader->bits & 0xFFFFu) == 0x8B1Fu) {
+                reader->state = GZ_HEADER;
+            } else {
+                reader->state = GZ_DONE;
+            }
+            break;
+        }
+    }
+    if (reader->state != GZ_NEXT && reader->state != GZ_DONE) {
+        reader->crc = TextCrc32(reader->crc, out + crcFrom, done - crcFrom);
+    }
+    if (reader->failed) return 0;
+    return done;
+}
+
+// ---------------------------------------------------------------------------
+// Deflate
+
+bool TextGzipWriterInit(TextGzipWriter *writer) {
+    memset(writer, 0, sizeof(*writer));
+    writer->window = (uint8_t *)malloc(2 * TEXT_GZIP_WINDOW);
+    writer->head = (int32_t *)malloc(((size_t)1 << HASH_BITS) * sizeof(int32_t));
+    writer->prev = (int32_t *)malloc(2 * TEXT_GZIP_WINDOW * sizeof(int32_t));
+    if (!writer->window || !writer->head || !writer->prev) return false;
+    for (size_t i = 0; i < ((size_t)1 << HASH_BITS); ++i) writer->head[i] = -1;
+    for (unsigned s = 0; s < 288; ++s) {
+        unsigned code, len;
+        if (s < 144) {
+            code = 0x30 + s;
+            len = 8;
+        } else if (s < 256) {
+            code = 0x190 + (s - 144);
+            len = 9;
+        } else if (s < 280) {
+            code = s - 256;
+            len = 7;
+        } else {
+            code = 0xC0 + (s - 280);
+            len = 8;
+        }
+        writer->codes[s] = (uint16_t)ReverseBits(code, len);
+        writer->codeLengths[s] = (uint8_t)len;
+    }
+    return true;
+}
+
+void TextGzipWriterFree(TextGzipWriter *writer) {
+    free(writer->window);
+    free(writer->head);
+    free(writer->prev);
+    writer->window = NULL;
+    writer->head = NULL;
+    writer->prev = NULL;
+}
+
+size_t TextGzipWriterBound(size_t size) {
+    // Nine bits per literal at worst, plus header, block framing and trailer.
+    return size + size / 8 + 32;
+}
+
+typedef struct BitSink {
+    TextGzipWriter *writer;
+    uint8_t *out;
+    size_t len;
+} BitSink;
+
+static void PutBits(BitSink *sink, unsigned value, unsigned count) {
+    TextGzipWriter *w = sink->writer;
+    w->bits |= (uint64_t)value << w->bitCount;
+    w->bitCount += count;
+    while (w->bitCount >= 8) {
+        sink->out[sink->len++] = (uint8_t)w->bits;
+        w->bits >>= 8;
+        w->bitCount -= 8;
+    }
+}
+
+static void PutLiteral(BitSink *sink, unsigned sym) {
+    PutBits(sink, sink->writer->codes[sym], sink->writer->codeLengths[sym]);
+}
+
+static void PutMatch(BitSink *sink, unsigned length, unsigned distance) {
+    unsigned index = 28;
+    while (kLengthBase[index] > length) index--;
+    PutLiteral(sink, 257 + index);
+    PutBits(sink, length - kLengthBase[index], kLengthExtra[index]);
+    unsigned dsym = 29;
+    while (kDistanceBase[dsym] > distance) dsym--;
+    PutBits(sink, ReverseBits(dsym, 5), 5);
+    PutBits(sink, distance - kDistanceBase[dsym], kDistanceExtra[dsym]);
+}
+
+static unsigned HashAt(const uint8_t *p) {
+    uint32_t v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static void InsertHash(TextGzipWriter *w, size_t pos) {
+    unsigned h = HashAt(w->window + pos);
+    w->prev[pos] = w->head[h];
+    w->head[h] = (int32_t)pos;
+}
+
+// Moves the newer half of the window down to make room for more input.
+static void SlideWindow(TextGzipWriter *w) {
+    memmove(w->window, w->window + TEXT_GZIP_WINDOW, TEXT_GZIP_WINDOW);
+    w->windowLen -= TEXT_GZIP_WINDOW;
+    for (size_t i = 0; i < ((size_t)1 << HASH_BITS); ++i) {
+        w->head[i] = w->head[i] >= (int32_t)TEXT_GZIP_WINDOW ? w->head[i] - (int32_t)TEXT_GZIP_WINDOW : -1;
+    }
+    for (size_t i = 0; i < TEXT_GZIP_WINDOW; ++i) {
+        int32_t p = w->prev[i + TEXT_GZIP_WINDOW];
+        w->prev[i] = p >= (int32_t)TEXT_GZIP_WINDOW ? p - (int32_t)TEXT_GZIP_WINDOW : -1;
+    }
+}
+
+// Greedy LZ77 over window[start, end): longest match among the last
+// MAX_CHAIN positions with the same 3-byte hash, within 32 KB.
+static void CompressRange(BitSink *sink, size_t start, size_t end) {
+    TextGzipWriter *w = sink->writer;
+    const uint8_t *win = w->window;
+    size_t pos = start;
+    while (pos < end) {
+        size_t best = 0, bestDistance = 0;
+        if (end - pos >= MIN_MATCH) {
+            size_t maxLength = end - pos < MAX_MATCH ? end - pos : MAX_MATCH;
+            size_t floor = pos > TEXT_GZIP_WINDOW ? pos - TEXT_GZIP_WINDOW : 0;
+            int32_t candidate = w->head[HashAt(win + pos)];
+            for (unsigned chain = MAX_CHAIN; candidate >= 0 && (size_t)candidate >= floor && chain > 0; --chain) {
+                const uint8_t *a = win + candidate;
+                const uint8_t *b = win + pos;
+                if (a[best] == b[best]) {
+                    size_t len = 0;
+                    while (len < maxLength && a[len] == b[len]) len++;
+                    if (len > best) {
+                        best = len;
+                        bestDistance = pos - (size_t)candidate;
+                        if (len == maxLength) break;
+                    }
+                }
+                candidate = w->prev[candidate];
+            }
+            InsertHash(w, pos);
+        }
+        if (best >= MIN_MATCH) {
+            PutMatch(sink, (unsigned)best, (unsigned)bestDistance);
+            for (size_t k = pos + 1; k < pos + best; ++k) {
+                if (end - k >= MIN_MATCH) InsertHash(w, k);
+            }
+            pos += best;
+        } else {
+            PutLiteral(sink, win[pos]);
+            pos++;
+        }
+    }
+}
+
+// Bytes `size` bytes take as stored blocks, framing and padding included.
+static size_t StoredBytes(size_t size) {
+    return size + 5 * ((size + STORED_MAX - 1) / STORED_MAX) + 1;
+}
+
+// Writes `size` bytes (at least one) as stored blocks, the last one final
+// if `finish`.
+static void PutStored(BitSink *sink, const uint8_t *data, size_t size, bool finish) {
+    TextGzipWriter *w = sink->writer;
+    for (size_t at = 0; at < size;) {
+        size_t len = size - at < STORED_MAX ? size - at : STORED_MAX;
+        PutBits(sink, finish && at + len == size ? 1u : 0u, 1);
+        PutBits(sink, 0, 2);
+        if (w->bitCount > 0) PutBits(sink, 0, 8 - w->bitCount);
+        PutBits(sink, (unsigned)len, 16);
+        PutBits(sink, (unsigned)len ^ 0xFFFFu, 16);
+        memcpy(sink->out + sink->len, data + at, len);
+        sink->len += len;
+        at += len;
+    }
+}
+
+size_t TextGzipWriterCompress(TextGzipWriter *writer, const uint8_t *data, size_t size, bool finish, uint8_t *out) {
+    BitSink sink = {writer, out, 0};
+    if (!writer->started) {
+        static const uint8_t header[10] = {0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF};
+        memcpy(out, header, sizeof(header));
+        sink.len = sizeof(header);
+        writer->started = true;
+    }
+    writer->crc = TextCrc32(writer->crc, data, size);
+    writer->inputBytes += size;
+
+    if (size > 0 || finish) {
+        // One fixed-Huffman block per call; matches may still reach back
+        // into earlier blocks.
+        size_t startLen = sink.len;
+        uint64_t startBits = writer->bits;
+        unsigned startBitCount = writer->bitCount;
+        PutBits(&sink, finish ? 1u : 0u, 1);
+        PutBits(&sink, 1, 2);
+        size_t used = 0;
+        while (used < size) {
+            if (writer->windowLen == 2 * TEXT_GZIP_WINDOW) SlideWindow(writer);
+            size_t take = 2 * TEXT_GZIP_WINDOW - writer->windowLen;
+            if (take > size - used) take = size - used;
+            memcpy(writer->window + writer->windowLen, data + used, take);
+            size_t start = writer->windowLen;
+            writer->windowLen += take;
+            used += take;
+            CompressRange(&sink, start, writer->windowLen);
+        }
+        PutLiteral(&sink, 256);
+        if (sink.len - startLen > StoredBytes(size)) {
+            // Input the codes would expand (already compressed or random
+            // bytes) goes out as is instead. The window keeps it, so later
+            // blocks can still match against it.
+            sink.len = startLen;
+            writer->bits = startBits;
+            writer->bitCount = startBitCount;
+            PutStored(&sink, data, size, finish);
+        }
+    }
+    if (finish) {
+        if (writer->bitCount > 0) PutBits(&sink, 0, 8 - writer->bitCount);
+        uint32_t crc = writer->crc;
+        uint32_t isize = (uint32_t)writer->inputBytes;
+        for (unsigned i = 0; i < 4; ++i) out[sink.len++] = (uint8_t)(crc >> (8 * i));
+        for (unsigned i = 0; i < 4; ++i) out[sink.len++] = (uint8_t)(isize >> (8 * i));
+    }
+    return sink.len;
+}
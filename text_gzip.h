@@ -0,0 +1,96 @@
+// Platform-neutral gzip support for retropad.
+// A streaming inflater that pulls compressed bytes from a reader callback
+// and hands out decompressed bytes in caller-sized pieces, and a streaming
+// deflater (LZ77 with hash chains, fixed Huffman codes, or stored blocks
+// for input that would not shrink) that compresses one buffer at a time. Neither ever holds more than its 32 KB window plus
+// one input buffer, so files of any size stream through. Self-contained:
+// no zlib. Opening files and threading live with the caller (file_io.c).
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TEXT_GZIP_WINDOW 32768u
+#define TEXT_GZIP_INPUT_BYTES (64u * 1024u)
+
+// True when `data` starts with the gzip magic and the deflate method.
+bool TextGzipDetect(const uint8_t *data, size_t size);
+
+uint32_t TextCrc32(uint32_t crc, const uint8_t *data, size_t size);
+
+// Reads up to `size` compressed bytes into `buffer`; returns the count,
+// 0 at end of input.
+typedef size_t (*TextGzipRead)(void *context, uint8_t *buffer, size_t size);
+
+typedef struct TextGzipHuffman {
+    uint16_t counts[16];   // codes of each length
+    uint16_t symbols[320]; // symbols ordered by code
+    uint16_t fast[512];    // 9-bit lookup: (length << 12) | symbol, 0 if longer
+} TextGzipHuffman;
+
+typedef struct TextGzipReader {
+    TextGzipRead read;
+    void *readContext;
+    uint8_t *input;        // TEXT_GZIP_INPUT_BYTES of compressed input...
+    size_t inputPos;
+    size_t inputLen;       // ...of which [inputPos, inputLen) is unread
+    bool inputEnded;
+    uint64_t bits;         // bit buffer, least significant bit first
+    unsigned bitCount;
+    uint8_t *window;       // last TEXT_GZIP_WINDOW output bytes
+    int state;
+    bool lastBlock;
+    uint32_t storedLeft;   // bytes left in a stored block
+    unsigned matchLength;  // copy still owed to the output...
+    unsigned matchDistance;
+    TextGzipHuffman literals;
+    TextGzipHuffman distances;
+    uint32_t crc;          // of the current member's output
+    uint64_t memberBytes;
+    uint64_t outputBytes;  // decompressed bytes handed out
+    uint64_t inputBytes;   // compressed bytes consumed
+    bool failed;           // corrupt or truncated stream
+} TextGzipReader;
+
+bool TextGzipReaderInit(TextGzipReader *reader, TextGzipRead read, void *readContext);
+void TextGzipReaderFree(TextGzipReader *reader);
+
+// Decompresses up to `size` bytes into `out` and returns the count; 0 once
+// every member has been read, or on error (`failed` set). Concatenated
+// members are read as one stream.
+size_t TextGzipReaderRead(TextGzipReader *reader, uint8_t *out, size_t size);
+
+typedef struct TextGzipWriter {
+    uint8_t *window;       // 2 * TEXT_GZIP_WINDOW: history, then new input
+    size_t windowLen;
+    int32_t *head;         // hash -> latest position in `window`, -1 if none
+    int32_t *prev;         // position -> previous one with the same hash
+    uint64_t bits;
+    unsigned bitCount;
+    uint16_t codes[288];   // fixed literal/length codes, bit-reversed
+    uint8_t codeLengths[288];
+    uint32_t crc;
+    uint64_t inputBytes;
+    bool started;          // header written
+} TextGzipWriter;
+
+bool TextGzipWriterInit(TextGzipWriter *writer);
+void TextGzipWriterFree(TextGzipWriter *writer);
+
+// Most bytes one TextGzipWriterCompress call writes for `size` input bytes.
+size_t TextGzipWriterBound(size_t size);
+
+// Compresses `size` bytes into `out` (TextGzipWriterBound(size) bytes) and
+// returns the count written. `finish` ends the stream with its trailer.
+// Input the codes would expand is stored, so a call adds at most a few
+// bytes per 64 KB to it.
+size_t TextGzipWriterCompress(TextGzipWriter *writer, const uint8_t *data, size_t size, bool finish, uint8_t *out);
+
+#ifdef __cplusplus
+}
+#endif
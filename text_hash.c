@@ -0,0 +1,131 @@
+// XXH64, streaming.
+#include "text_hash.h"
+
+#include <string.h>
+
+#define PRIME1 0x9E3779B185EBCA87ull
+#define PRIME2 0xC2B2AE3D27D4EB4Full
+#define PRIME3 0x165667B19E3779F9ull
+#define PRIME4 0x85EBCA77C2B2AE63ull
+#define PRIME5 0x27D4EB2F165667C5ull
+
+static uint64_t Rotl(uint64_t x, unsigned r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Supported targets are little-endian; memcpy keeps unaligned reads legal
+// and compiles to a single load.
+static uint64_t Read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t Read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t Round(uint64_t acc, uint64_t input) {
+    acc += input * PRIME2;
+    acc = Rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+static uint64_t MergeRound(uint64_t acc, uint64_t lane) {
+    acc ^= Round(0, lane);
+    return acc * PRIME1 + PRIME4;
+}
+
+// The lanes are independent, so the four multiply chains overlap in the
+// pipeline; this loop is where nearly all the time goes.
+static const uint8_t *ConsumeStripes(uint64_t lanes[4], const uint8_t *p, const uint8_t *end) {
+    uint64_t v1 = lanes[0], v2 = lanes[1], v3 = lanes[2], v4 = lanes[3];
+    while ((size_t)(end - p) >= 32) {
+        v1 = Round(v1, Read64(p));
+        v2 = Round(v2, Read64(p + 8));
+        v3 = Round(v3, Read64(p + 16));
+        v4 = Round(v4, Read64(p + 24));
+        p += 32;
+    }
+    lanes[0] = v1;
+    lanes[1] = v2;
+    lanes[2] = v3;
+    lanes[3] = v4;
+    return p;
+}
+
+void TextHashInit(TextHash *hash, uint64_t seed) {
+    memset(hash, 0, sizeof(*hash));
+    hash->seed = seed;
+    hash->lanes[0] = seed + PRIME1 + PRIME2;
+    hash->lanes[1] = seed + PRIME2;
+    hash->lanes[2] = seed;
+    hash->lanes[3] = seed - PRIME1;
+}
+
+void TextHashUpdate(TextHash *hash, const void *data, size_t size) {
+    const uint8_t *p = (const uint8_t *)data;
+    const uint8_t *end = p + size;
+    hash->total += size;
+    if (hash->stripeLen + size < sizeof(hash->stripe)) {
+        if (size > 0) memcpy(hash->stripe + hash->stripeLen, p, size);
+        hash->stripeLen += size;
+        return;
+    }
+    if (hash->stripeLen > 0) {
+        size_t take = sizeof(hash->stripe) - hash->stripeLen;
+        memcpy(hash->stripe + hash->stripeLen, p, take);
+        p += take;
+        ConsumeStripes(hash->lanes, hash->stripe, hash->stripe + sizeof(hash->stripe));
+        hash->stripeLen = 0;
+    }
+    p = ConsumeStripes(hash->lanes, p, end);
+    hash->stripeLen = (size_t)(end - p);
+    if (hash->stripeLen > 0) memcpy(hash->stripe, p, hash->stripeLen);
+}
+
+uint64_t TextHashDigest(const TextHash *hash) {
+    uint64_t h;
+    if (hash->total >= 32) {
+        const uint64_t *v = hash->lanes;
+        h = Rotl(v[0], 1) + Rotl(v[1], 7) + Rotl(v[2], 12) + Rotl(v[3], 18);
+        h = MergeRound(h, v[0]);
+        h = MergeRound(h, v[1]);
+        h = MergeRound(h, v[2]);
+        h = MergeRound(h, v[3]);
+    } else {
+        h = hash->seed + PRIME5;
+    }
+    h += hash->total;
+
+    const uint8_t *p = hash->stripe;
+    const uint8_t *end = p + hash->stripeLen;
+    for (; end - p >= 8; p += 8) {
+        h ^= Round(0, Read64(p));
+        h = Rotl(h, 27) * PRIME1 + PRIME4;
+    }
+    if (end - p >= 4) {
+        h ^= (uint64_t)Read32(p) * PRIME1;
+        h = Rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= *p * PRIME5;
+        h = Rotl(h, 11) * PRIME1;
+    }
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t TextHash64(const void *data, size_t size, uint64_t seed) {
+    TextHash hash;
+    TextHashInit(&hash, seed);
+    TextHashUpdate(&hash, data, size);
+    return TextHashDigest(&hash);
+}
@@ -0,0 +1,33 @@
+// Platform-neutral content fingerprint for retropad.
+// XXH64 (the 64-bit xxHash): four independent multiply-rotate lanes over
+// 32-byte stripes, several GB/s per core, fed incrementally so files are
+// hashed as they stream through a load or save. Output matches the
+// reference XXH64, so fingerprints can be checked with standard tools.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct TextHash {
+    uint64_t lanes[4];
+    uint8_t stripe[32]; // bytes waiting for a full stripe
+    size_t stripeLen;
+    uint64_t total;     // bytes hashed
+    uint64_t seed;
+} TextHash;
+
+void TextHashInit(TextHash *hash, uint64_t seed);
+void TextHashUpdate(TextHash *hash, const void *data, size_t size);
+// Digest of everything so far; more data may still be added afterwards.
+uint64_t TextHashDigest(const TextHash *hash);
+
+// One-shot XXH64 of a buffer.
+uint64_t TextHash64(const void *data, size_t size, uint64_t seed);
+
+#ifdef __cplusplus
+}
+#endif
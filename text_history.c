@@ -0,0 +1,295 @@
+// FastCDC chunking and the chunk index behind the version store.
+#include "text_history.h"
+
+#include "text_hash.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Random 64-bit values per byte (splitmix64); the rolling hash adds one
+// and shifts left, so its top bits depend on the last few dozen bytes.
+static const uint64_t kGear[256] = {
+    0xdd69eeff4ae47a24ull, 0x2fd69a3bb0cbbca1ull, 0x5a6cec0f3f298be5ull, 0xc61b270615ed6fd9ull,
+    0xecfd85293b8cf65bull, 0x2686491a92825e74ull, 0x3e7ed9f9641f7838ull, 0x33f64d03637a3db5ull,
+    0x147443cd829acc4aull, 0xe7b5412562cba0d3ull, 0x84c03828d0a76df3ull, 0x5bf3a936cfa03245ull,
+    0x257d3f8107acba40ull, 0xed9af2aa14c759f6ull, 0x1c7844955b317524ull, 0x16154bdca2b58437ull,
+    0x054c4838d490bce1ull, 0xf4a211d33593e454ull, 0x2138d974dd8638b4ull, 0xc7196580ca8c3457ull,
+    0xbde29c4ce8160cdbull, 0xacac8b5da66bd928ull, 0x512d8d20cf1770a8ull, 0x771870c6d9d8904full,
+    0x8c1766cf1b632321ull, 0xc7b953ac3e1bad50ull, 0x8ddbd027c50bb777ull, 0xcb6fcc26240647fdull,
+    0x663a06072050e71cull, 0x6e64c79fea9056ccull, 0x58da5db64c5f8369ull, 0x50f4f7f234dff538ull,
+    0xd4b096ca29e0c55full, 0xbe55d48d59c9e276ull, 0x07f3b31a1cfeb5c2ull, 0x0ed79f724b5298f1ull,
+    0x4854f8cda6fa89daull, 0xefadedfad8e54a7aull, 0x4f6a909dd8a1cc83ull, 0x85d8868d922343abull,
+    0x95fcf0f4186d969bull, 0x2e6a9fe96459739dull, 0x17cb96b77cb42956ull, 0x709aedddca5c7108ull,
+    0xe5d77bc49f9f589full, 0x4a4d863e7de76d8full, 0xa2bb61df4ac2aa67ull, 0x1ff31e3f6d3140a8ull,
+    0x28d4dca09bd3738dull, 0xf9990f95d3ae3d86ull, 0x562110ebf594b22dull, 0xc1e144c66c3e84b0ull,
+    0x8803d7903435079bull, 0x9d08d08533a7442eull, 0x0623b370d9b4d4faull, 0xd86e7cce7c299afdull,
+    0xd356ceea4ef5c747ull, 0x31943d43c8f31f38ull, 0xeba0acd41e21744bull, 0xe2aadddb54351973ull,
+    0xc902bcda5b1f73afull, 0x34241b484809e6a2ull, 0xd34d68f000e3a451ull, 0xcdf7977e21fb514cull,
+    0xeee74fabfe360285ull, 0x2a6b4fc032a32afdull, 0x2c96950e058e935dull, 0x1481eb0e8f5c4635ull,
+    0x6da952b39b589adbull, 0xfc404cee411f145eull, 0x430f8bb8268b66f0ull, 0xa9663acc55fccf61ull,
+    0x8f13f38869e9bc5full, 0x7fb2421a91dc05f4ull, 0xbe51ad1a289b4ac7ull, 0x17903201368ecbccull,
+    0x41125641b3e87a11ull, 0xde3cbb2a17e19568ull, 0xf99acf6717b1f43aull, 0x3847fa6a7c6807b2ull,
+    0x390d5b1e416a4422ull, 0x3e697a42cbbfd1d7ull, 0x9f9c401dbe98891bull, 0x3c4eda676214f6dcull,
+    0xc27f1e24804d261aull, 0xb3af9906fdb0523cull, 0x673fd7906b3621bbull, 0x8d52dc7d6ebb8236ull,
+    0xf2a939db15523ca8ull, 0xb23edb599c5dc111ull, 0x961708b10d4df33full, 0x8ce11ba7045b684eull,
+    0x0b8db22095e643ccull, 0x941747de0afdb78aull, 0xb654c697ae37db3aull, 0x3069a3ca73448195ull,
+    0x3699840e3900a75bull, 0x0807572d560b73cfull, 0x94bc1861f148b240ull, 0x9e1192d7ddccc86bull,
+    0x11612220a99a1c39ull, 0xe7a3d72d70389f53ull, 0x1b6ae08a461c3e31ull, 0x3b756d4f70fa2ccaull,
+    0xc22778950d620c0dull, 0x8662d72dad291b7cull, 0xa44fa76e33e6af2cull, 0x228fd0e9a0ad65a9ull,
+    0x42c8369e6c2bd152ull, 0x9cceec5f697a2fbcull, 0x8e36a718a7ee6354ull, 0xabe12299bcf57eedull,
+    0xed8ecbcdc500d3e6ull, 0x670a3de4f698e054ull, 0x4108d0a0b255ef7bull, 0x1aec1ee6a59da146ull,
+    0x16fdd0037ca322a1ull, 0xc24620812d063f78ull, 0xc3f1c8210a2497c9ull, 0xc5f0fe8d2fe36836ull,
+    0x2b73a46cbbd807baull, 0x16357e4c055d8ad2ull, 0x2d9ac87963c421abull, 0x493593849a9a62b0ull,
+    0xb4e3693b2f58f6ecull, 0x7c5f05e1da26a1a6ull, 0xfa0204c97fe015efull, 0xff9feb0465443a71ull,
+    0xd615fb07b4f30bdeull, 0x6785ad799ea0164dull, 0x86cd958d001a9364ull, 0x120b6449e7554b1bull,
+    0x1b66a29c0ab38126ull, 0xe2a5e02192cf20e9ull, 0xc0548f8e890f04e3ull, 0x1828ffba0f5ee285ull,
+    0x18190548899a5494ull, 0x367a403d435d88bfull, 0xb853c307c5629a9full, 0x72d1aaee625d1531ull,
+    0x4be77200f50e66f3ull, 0x617b7cdef3cd0a6aull, 0xeaa82b011c5f4bfaull, 0x603bb8adbbd606b5ull,
+    0xb5947f8e97e0e42full, 0xe4e83fb55ab98cc0ull, 0x8d792c343984e4b7ull, 0x0c0463646a12939cull,
+    0xb51faa9a574bae69ull, 0xd2bd54911a336d01ull, 0x67b565d7623dfb72ull, 0x181a03fe08377d99ull,
+    0x701ab14ede04d6f4ull, 0xec51cc841f48a747ull, 0x283eba05a66f1faaull, 0xc0030254095c9353ull,
+    0x11ebf70181f68282ull, 0x0c263f85cbb789a9ull, 0xa8e0ce3304e1beccull, 0x912cdb26234dc885ull,
+    0xc94930ab808bbd7eull, 0xe5f9baf7ed6af643ull, 0x658589d7ced387afull, 0xf318c934b632a4b4ull,
+    0x0813e6ee20a170efull, 0xf17225a6ea7e3957ull, 0xedde0c6b62d3c6d3ull, 0xb00adf847f4035fcull,
+    0xf517888c941c2f3dull, 0xdc8f4d681323e418ull, 0x53674f6d9428f631ull, 0xfc9ba85cca1e71aaull,
+    0x6981459b362cfd0aull, 0x2904cb8db3162049ull, 0x95ae5685d8bf384eull, 0x1ed1a1b2680cf17cull,
+    0x4b13f9b9a577e837ull, 0x8d4a300f993386d1ull, 0x1d820e2ececaba34ull, 0xe9d74e128214917bull,
+    0x25d628addf1aa0e5ull, 0x15c06fb19486843aull, 0xa414d6af23647778ull, 0xab998d1eb930cce2ull,
+    0x1610e653b8fac379ull, 0x66071f0b0ab4b9c0ull, 0x19e0379e98db2cebull, 0x6a344fdb8256b153ull,
+    0x46025a7f13ee1cdcull, 0x972f905e15ba862full, 0x044d32226d99de78ull, 0x7084985cf03a496dull,
+    0xb33af288803a9d7dull, 0xebda4bbef925bd58ull, 0x5ed05d9ba7e85e35ull, 0x42bbdc4487186c4eull,
+    0x91a4bed2f752e5c1ull, 0x1edc358cbef9e020ull, 0x5994458fb23d3746ull, 0x7257600f7a98954full,
+    0xb3520a375efd8f3bull, 0x8694ffb10e0cd188ull, 0xbe8d99c7eac2fa91ull, 0xef68daf23f3b6830ull,
+    0x71caf77665ed2514ull, 0x47398ea38efea463ull, 0x68659d12bc16ed67ull, 0x1edb0856a39a14dcull,
+    0x3c1db7ec33118107ull, 0xfd0cb3ad7ab3d87cull, 0xe86070b091946710ull, 0x68b5a014a5c742c0ull,
+    0x6a291e0b09e7ad04ull, 0x60d39a7d4fb2cfe6ull, 0xac76940785249212ull, 0x7637d3d9118a8d43ull,
+    0x5fb1a7c2f977f3ebull, 0x51069b547851eb1full, 0xe809a71c9e21067aull, 0x6369f447b372a126ull,
+    0xe7b4129463f01867ull, 0x4478c85fe1246d2cull, 0xf4458a3b65643f78ull, 0x05e3fd8c7b09c004ull,
+    0xf2e7151e74cf7a72ull, 0x628bab5a1980d59full, 0x69b0a2fea1480659ull, 0x7339edcaeb9dbbbbull,
+    0xe268cbac7545904eull, 0x39f5a22d8b2505e4ull, 0xe8604d948151c6e7ull, 0x865aaef75582e9e1ull,
+    0x552fc7b932d83524ull, 0x94b8b8937c7c7625ull, 0xad5256552deb566dull, 0xa60f58e0675c1768ull,
+    0x6c44a3b5ee714406ull, 0xca71eb2b911fc4c6ull, 0xd411164573cd0f54ull, 0x817099a9399970a4ull,
+    0x528892f2738c29dbull, 0xb3d88fe58b29794bull, 0xfbe1ddcce9d26c9full, 0xa10b8acf661ec880ull,
+    0x820c6e40462247e0ull, 0xe6c94fee3a581ae1ull, 0x6db36444898c0155ull, 0x9329e3b8ed1198b6ull,
+    0x662cc38b04d7a2d3ull, 0x3914f92a4c0cf278ull, 0xd6e3e68fae1ec846ull, 0x86c4290801bb4a9bull,
+    0x5da6d5dd530bbd10ull, 0x4b5f1b1c5f6dd774ull, 0x16010423f9a6c352ull, 0x6354da992e29cf06ull,
+};
+
+// Normalised chunking: a harder mask (more bits) before the average size
+// and an easier one after it pulls chunk lengths towards the average.
+// Both test high bits of the hash, which have seen the most bytes; bit 63
+// is left out so that two bytes can be rolled per step below.
+#define MASK_HARD 0x7FFF800000000000ull // 16 bits: 1 in 65536
+#define MASK_EASY 0x7FF8000000000000ull // 12 bits: 1 in 4096
+
+// Scans data[*at, end) two bytes per step, cutting after the first byte
+// whose hash has none of `mask` set. The hash after the odd byte is only
+// seen shifted left once more, which the shifted mask and table allow for.
+// Returns the cut, or 0 when there is none before `end`.
+static size_t ScanCut(const uint8_t *data, size_t *at, size_t end, uint64_t *hashInOut, uint64_t mask) {
+    uint64_t hash = *hashInOut;
+    size_t i = *at;
+    for (; i + 2 <= end; i += 2) {
+        hash = (hash << 2) + (kGear[data[i]] << 1);
+        if (!(hash & (mask << 1))) return i + 1;
+        hash += kGear[data[i + 1]];
+        if (!(hash & mask)) return i + 2;
+    }
+    if (i < end) {
+        hash = (hash << 1) + kGear[data[i]];
+        i++;
+        if (!(hash & mask)) return i;
+    }
+    *at = i;
+    *hashInOut = hash;
+    return 0;
+}
+
+size_t TextChunkCut(const uint8_t *data, size_t size) {
+    if (size <= TEXT_CHUNK_MIN) return size;
+    size_t limit = size < TEXT_CHUNK_MAX ? size : TEXT_CHUNK_MAX;
+    size_t normal = limit < TEXT_CHUNK_AVG ? limit : TEXT_CHUNK_AVG;
+    uint64_t hash = 0;
+    // Nothing can cut before the minimum, so hashing starts just short of
+    // it: 64 bytes is all the hash remembers.
+    size_t i = TEXT_CHUNK_MIN - 64;
+    for (; i < TEXT_CHUNK_MIN; ++i) hash = (hash << 1) + kGear[data[i]];
+    size_t cut = ScanCut(data, &i, normal, &hash, MASK_HARD);
+    if (!cut) cut = ScanCut(data, &i, limit, &hash, MASK_EASY);
+    return cut ? cut : limit;
+}
+
+TextChunkKey TextChunkKeyOf(const uint8_t *data, size_t size) {
+    TextChunkKey key;
+    key.lo = TextHash64(data, size, 0);
+    key.hi = TextHash64(data, size, 0x9E3779B97F4A7C15ull);
+    return key;
+}
+
+void TextChunkIndexInit(TextChunkIndex *index) {
+    memset(index, 0, sizeof(*index));
+}
+
+void TextChunkIndexFree(TextChunkIndex *index) {
+    free(index->records);
+    free(index->slots);
+    memset(index, 0, sizeof(*index));
+}
+
+static bool SameKey(TextChunkKey a, TextChunkKey b) {
+    return a.lo == b.lo && a.hi == b.hi;
+}
+
+static void PlaceSlot(uint32_t *slots, size_t slotCount, TextChunkKey key, uint32_t ordinal) {
+    size_t mask = slotCount - 1;
+    size_t at = (size_t)key.lo & mask;
+    while (slots[at]) at = (at + 1) & mask;
+    slots[at] = ordinal + 1;
+}
+
+static bool Rehash(TextChunkIndex *index, size_t slotCount) {
+    uint32_t *slots = (uint32_t *)calloc(slotCount, sizeof(uint32_t));
+    if (!slots) return false;
+    for (size_t i = 0; i < index->count; ++i) {
+        PlaceSlot(slots, slotCount, index->records[i].key, (uint32_t)i);
+    }
+    free(index->slots);
+    index->slots = slots;
+    index->slotCount = slotCount;
+    return true;
+}
+
+bool TextChunkIndexAdd(TextChunkIndex *index, const TextChunkRecord *record) {
+    if (index->count >= UINT32_MAX - 1) return false;
+    if (index->count == index->capacity) {
+        size_t capacity = index->capacity ? index->capacity * 2 : 1024;
+        TextChunkRecord *records = (TextChunkRecord *)realloc(index->records, capacity * sizeof(TextChunkRecord));
+        if (!records) return false;
+        index->records = records;
+        index->capacity = capacity;
+    }
+    if ((index->count + 1) * 2 > index->slotCount &&
+        !Rehash(index, index->slotCount ? index->slotCount * 2 : 2048)) {
+        return false;
+    }
+    index->records[index->count] = *record;
+    PlaceSlot(index->slots, index->slotCount, record->key, (uint32_t)index->count);
+    index->count++;
+    return true;
+}
+
+bool TextChunkIndexFind(const TextChunkIndex *index, TextChunkKey key, uint32_t *ordinalOut) {
+    if (!index->slotCount) return false;
+    size_t mask = index->slotCount - 1;
+    for (size_t at = (size_t)key.lo & mask; index->slots[at]; at = (at + 1) & mask) {
+        uint32_t ordinal = index->slots[at] - 1;
+        if (SameKey(index->records[ordinal].key, key)) {
+            *ordinalOut = ordinal;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TextChunkIndexTruncate(TextChunkIndex *index, size_t count) {
+    if (count >= index->count) return;
+    index->count = count;
+    // Linear probing cannot simply clear slots, so place the rest afresh.
+    memset(index->slots, 0, index->slotCount * sizeof(uint32_t));
+    for (size_t i = 0; i < count; ++i) {
+        PlaceSlot(index->slots, index->slotCount, index->records[i].key, (uint32_t)i);
+    }
+}
+
+bool TextVersionWriterInit(TextVersionWriter *writer, TextChunkIndex *index, TextChunkStore store, void *context) {
+    memset(writer, 0, sizeof(*writer));
+    writer->index = index;
+    writer->store = store;
+    writer->context = context;
+    writer->firstNew = index->count;
+    writer->buffer = (uint8_t *)malloc(TEXT_CHUNK_MAX);
+    writer->failed = writer->buffer == NULL;
+    return !writer->failed;
+}
+
+void TextVersionWriterFree(TextVersionWriter *writer) {
+    free(writer->buffer);
+    free(writer->chunks);
+    memset(writer, 0, sizeof(*writer));
+}
+
+// Looks the chunk up, stores it if it is new, and lists it.
+static bool AddChunk(TextVersionWriter *writer, const uint8_t *data, size_t size) {
+    TextChunkRecord record;
+    memset(&record, 0, sizeof(record));
+    record.key = TextChunkKeyOf(data, size);
+    uint32_t ordinal;
+    if (!TextChunkIndexFind(writer->index, record.key, &ordinal)) {
+        record.length = (uint32_t)size;
+        if (!writer->store(writer->context, data, size, &record.offset)) return false;
+        if (!TextChunkIndexAdd(writer->index, &record)) return false;
+        ordinal = (uint32_t)(writer->index->count - 1);
+        writer->newBytes += size;
+    }
+    if (writer->count == writer->capacity) {
+        size_t capacity = writer->capacity ? writer->capacity * 2 : 256;
+        uint32_t *chunks = (uint32_t *)realloc(writer->chunks, capacity * sizeof(uint32_t));
+        if (!chunks) return false;
+        writer->chunks = chunks;
+        writer->capacity = capacity;
+    }
+    writer->chunks[writer->count++] = ordinal;
+    return true;
+}
+
+static void Fail(TextVersionWriter *writer) {
+    writer->failed = true;
+    TextChunkIndexTruncate(writer->index, writer->firstNew);
+}
+
+bool TextVersionWriterAdd(TextVersionWriter *writer, const uint8_t *data, size_t size) {
+    if (writer->failed) return false;
+    writer->bytes += size;
+    while (size > 0) {
+        // Whole chunks are cut straight from the caller's bytes; only a
+        // chunk that straddles two calls is gathered in the buffer.
+        if (writer->have == 0 && size >= TEXT_CHUNK_MAX) {
+            size_t cut = TextChunkCut(data, size);
+            if (!AddChunk(writer, data, cut)) {
+                Fail(writer);
+                return false;
+            }
+            data += cut;
+            size -= cut;
+            continue;
+        }
+        size_t take = TEXT_CHUNK_MAX - writer->have;
+        if (take > size) take = size;
+        memcpy(writer->buffer + writer->have, data, take);
+        writer->have += take;
+        data += take;
+        size -= take;
+        if (writer->have < TEXT_CHUNK_MAX) break;
+        size_t cut = TextChunkCut(writer->buffer, writer->have);
+        if (!AddChunk(writer, writer->buffer, cut)) {
+            Fail(writer);
+            return false;
+        }
+        memmove(writer->buffer, writer->buffer + cut, writer->have - cut);
+        writer->have -= cut;
+    }
+    return true;
+}
+
+bool TextVersionWriterFinish(TextVersionWriter *writer) {
+    while (!writer->failed && writer->have > 0) {
+        size_t cut = TextChunkCut(writer->buffer, writer->have);
+        if (!AddChunk(writer, writer->buffer, cut)) {
+            Fail(writer);
+            break;
+        }
+        memmove(writer->buffer, writer->buffer + cut, writer->have - cut);
+        writer->have -= cut;
+    }
+    return !writer->failed;
+}
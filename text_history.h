@@ -0,0 +1,91 @@
+// Platform-neutral version store core for retropad.
+// Saved files are cut into content-defined chunks (FastCDC: a gear rolling
+// hash with normalised cut masks), so an edit only changes the chunks it
+// touches and every other chunk boundary lines up with the previous save.
+// Chunks are keyed by two XXH64s of their bytes and stored once; a version
+// is just the list of its chunks. The index maps keys to where each chunk
+// lives; storing the bytes and keeping the files is up to the caller (see
+// file_io.c).
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TEXT_CHUNK_MIN (4u * 1024u)
+#define TEXT_CHUNK_AVG (16u * 1024u)
+#define TEXT_CHUNK_MAX (64u * 1024u)
+
+// Length of the chunk that starts at `data`: a content-defined cut between
+// TEXT_CHUNK_MIN and TEXT_CHUNK_MAX bytes, or `size` when no cut falls
+// within the bytes given (the caller knows whether more will follow).
+size_t TextChunkCut(const uint8_t *data, size_t size);
+
+typedef struct TextChunkKey {
+    uint64_t lo;
+    uint64_t hi;
+} TextChunkKey;
+
+TextChunkKey TextChunkKeyOf(const uint8_t *data, size_t size);
+
+// Where one stored chunk lives. Also the record format of the index file.
+typedef struct TextChunkRecord {
+    TextChunkKey key;
+    uint64_t offset;
+    uint32_t length;
+    uint32_t reserved;
+} TextChunkRecord;
+
+// Chunk records in the order they were stored, so a chunk's ordinal in
+// `records` names it in version lists, plus an open-addressing table from
+// key to ordinal.
+typedef struct TextChunkIndex {
+    TextChunkRecord *records;
+    size_t count;
+    size_t capacity;
+    uint32_t *slots;  // ordinal + 1; 0 is empty
+    size_t slotCount; // a power of two, kept at least twice `count`
+} TextChunkIndex;
+
+void TextChunkIndexInit(TextChunkIndex *index);
+void TextChunkIndexFree(TextChunkIndex *index);
+// Appends a record; false on memory failure or past UINT32_MAX chunks.
+bool TextChunkIndexAdd(TextChunkIndex *index, const TextChunkRecord *record);
+bool TextChunkIndexFind(const TextChunkIndex *index, TextChunkKey key, uint32_t *ordinalOut);
+// Forgets every record from `count` on (used to undo a failed version).
+void TextChunkIndexTruncate(TextChunkIndex *index, size_t count);
+
+// Stores a new chunk's bytes; sets where they went. False on failure.
+typedef bool (*TextChunkStore)(void *context, const uint8_t *data, size_t size, uint64_t *offsetOut);
+
+// Turns a stream of bytes into a version: cuts it into chunks, stores the
+// ones the index has not seen and lists the ordinals of all of them.
+typedef struct TextVersionWriter {
+    TextChunkIndex *index;
+    TextChunkStore store;
+    void *context;
+    uint8_t *buffer;     // bytes not yet cut, up to TEXT_CHUNK_MAX
+    size_t have;
+    uint32_t *chunks;    // the version so far
+    size_t count;
+    size_t capacity;
+    uint64_t bytes;      // bytes added
+    uint64_t newBytes;   // bytes stored (not deduplicated)
+    size_t firstNew;     // index->count when the version began
+    bool failed;
+} TextVersionWriter;
+
+bool TextVersionWriterInit(TextVersionWriter *writer, TextChunkIndex *index, TextChunkStore store, void *context);
+void TextVersionWriterFree(TextVersionWriter *writer);
+bool TextVersionWriterAdd(TextVersionWriter *writer, const uint8_t *data, size_t size);
+// Cuts and stores the tail. After a failure anywhere the chunks this
+// version added are dropped from the index again.
+bool TextVersionWriterFinish(TextVersionWriter *writer);
+
+#ifdef __cplusplus
+}
+#endif
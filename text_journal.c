@@ -0,0 +1,186 @@
+// Edit journal records and their replay onto a gap buffer.
+#include "text_journal.h"
+
+#include "text_hash.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_GAP 4096u
+
+static uint32_t RecordCheck(const TextJournalRecord *record, const void *units, size_t bytes) {
+    TextJournalRecord head = *record;
+    head.check = 0;
+    TextHash hash;
+    TextHashInit(&hash, 0);
+    TextHashUpdate(&hash, &head, sizeof(head));
+    TextHashUpdate(&hash, units, bytes);
+    return (uint32_t)TextHashDigest(&hash);
+}
+
+void TextJournalBufferInit(TextJournalBuffer *buffer) {
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+void TextJournalBufferFree(TextJournalBuffer *buffer) {
+    free(buffer->data);
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+static bool ReserveBuffer(TextJournalBuffer *buffer, size_t extra) {
+    if (extra > SIZE_MAX - buffer->size) return false;
+    size_t needed = buffer->size + extra;
+    if (needed <= buffer->capacity) return true;
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < needed) capacity = capacity > SIZE_MAX / 2 ? needed : capacity * 2;
+    uint8_t *grown = (uint8_t *)realloc(buffer->data, capacity);
+    if (!grown) return false;
+    buffer->data = grown;
+    buffer->capacity = capacity;
+    return true;
+}
+
+bool TextJournalBufferAppend(TextJournalBuffer *buffer, const void *data, size_t size) {
+    if (!ReserveBuffer(buffer, size)) return false;
+    if (size) memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return true;
+}
+
+static bool AppendRecord(TextJournalBuffer *buffer, TextJournalType type, size_t offset, size_t deleted,
+                         const uint16_t *units, size_t length) {
+    if (length > (SIZE_MAX - sizeof(TextJournalRecord)) / sizeof(uint16_t)) return false;
+    size_t bytes = length * sizeof(uint16_t);
+    if (!ReserveBuffer(buffer, sizeof(TextJournalRecord) + bytes)) return false;
+    TextJournalRecord record;
+    record.type = (uint32_t)type;
+    record.check = 0;
+    record.offset = offset;
+    record.deleted = deleted;
+    record.inserted = length;
+    record.check = RecordCheck(&record, units, bytes);
+    TextJournalBufferAppend(buffer, &record, sizeof(record));
+    TextJournalBufferAppend(buffer, units, bytes);
+    return true;
+}
+
+bool TextJournalAppendEdit(TextJournalBuffer *buffer, size_t offset, size_t deleted, const uint16_t *inserted,
+                           size_t insertedLength) {
+    return AppendRecord(buffer, TEXT_JOURNAL_EDIT, offset, deleted, inserted, insertedLength);
+}
+
+bool TextJournalAppendText(TextJournalBuffer *buffer, const uint16_t *text, size_t length) {
+    return AppendRecord(buffer, TEXT_JOURNAL_TEXT, 0, 0, text, length);
+}
+
+bool TextJournalDocumentInit(TextJournalDocument *doc, const uint16_t *text, size_t length) {
+    memset(doc, 0, sizeof(*doc));
+    if (length > SIZE_MAX / sizeof(uint16_t) - MIN_GAP - 1) return false;
+    doc->capacity = length + MIN_GAP;
+    doc->units = (uint16_t *)malloc((doc->capacity + 1) * sizeof(uint16_t)); // +1 for Detach's NUL
+    if (!doc->units) return false;
+    if (length) memcpy(doc->units, text, length * sizeof(uint16_t));
+    doc->gapStart = length;
+    doc->gapEnd = doc->capacity;
+    return true;
+}
+
+void TextJournalDocumentFree(TextJournalDocument *doc) {
+    free(doc->units);
+    memset(doc, 0, sizeof(*doc));
+}
+
+size_t TextJournalDocumentLength(const TextJournalDocument *doc) {
+    return doc->capacity - (doc->gapEnd - doc->gapStart);
+}
+
+// Moves the gap to start at `at` (a text offset), shifting only the units
+// between the old and new positions.
+static void MoveGap(TextJournalDocument *doc, size_t at) {
+    size_t gap = doc->gapEnd - doc->gapStart;
+    if (at < doc->gapStart) {
+        size_t count = doc->gapStart - at;
+        memmove(doc->units + at + gap, doc->units + at, count * sizeof(uint16_t));
+    } else if (at > doc->gapStart) {
+        size_t count = at - doc->gapStart;
+        memmove(doc->units + doc->gapStart, doc->units + doc->gapEnd, count * sizeof(uint16_t));
+    }
+    doc->gapStart = at;
+    doc->gapEnd = at + gap;
+}
+
+static bool EnsureGap(TextJournalDocument *doc, size_t needed) {
+    size_t gap = doc->gapEnd - doc->gapStart;
+    if (gap >= needed) return true;
+    size_t length = TextJournalDocumentLength(doc);
+    if (needed > SIZE_MAX / sizeof(uint16_t) / 2 - length - MIN_GAP) return false;
+    size_t capacity = length + needed + MIN_GAP;
+    if (capacity < doc->capacity * 2) capacity = doc->capacity * 2;
+    uint16_t *grown = (uint16_t *)realloc(doc->units, (capacity + 1) * sizeof(uint16_t));
+    if (!grown) return false;
+    size_t tail = doc->capacity - doc->gapEnd;
+    memmove(grown + capacity - tail, grown + doc->gapEnd, tail * sizeof(uint16_t));
+    doc->units = grown;
+    doc->gapEnd = capacity - tail;
+    doc->capacity = capacity;
+    return true;
+}
+
+uint16_t *TextJournalDocumentDetach(TextJournalDocument *doc, size_t *lengthOut) {
+    size_t length = TextJournalDocumentLength(doc);
+    MoveGap(doc, length);
+    uint16_t *units = doc->units;
+    units[length] = 0;
+    memset(doc, 0, sizeof(*doc));
+    if (lengthOut) *lengthOut = length;
+    return units;
+}
+
+static TextJournalStatus ApplyRecord(TextJournalDocument *doc, const TextJournalRecord *record, const uint8_t *units) {
+    size_t length = TextJournalDocumentLength(doc);
+    size_t inserted = (size_t)record->inserted;
+    if (record->type == TEXT_JOURNAL_TEXT) {
+        doc->gapStart = 0;
+        doc->gapEnd = doc->capacity; // everything is gap now
+        if (!EnsureGap(doc, inserted)) return TEXT_JOURNAL_NO_MEMORY;
+    } else {
+        if (record->offset > length || record->deleted > length - record->offset) return TEXT_JOURNAL_INVALID;
+        MoveGap(doc, (size_t)record->offset);
+        doc->gapEnd += (size_t)record->deleted;
+        if (!EnsureGap(doc, inserted)) return TEXT_JOURNAL_NO_MEMORY;
+    }
+    if (inserted) memcpy(doc->units + doc->gapStart, units, inserted * sizeof(uint16_t));
+    doc->gapStart += inserted;
+    return TEXT_JOURNAL_OK;
+}
+
+TextJournalStatus TextJournalReplay(TextJournalDocument *doc, const uint8_t *data, size_t size, size_t *recordsOut) {
+    size_t records = 0;
+    size_t pos = 0;
+    TextJournalStatus status = TEXT_JOURNAL_OK;
+    while (pos < size) {
+        TextJournalRecord record;
+        if (size - pos < sizeof(record)) {
+            status = TEXT_JOURNAL_TORN;
+            break;
+        }
+        memcpy(&record, data + pos, sizeof(record));
+        size_t room = (size - pos - sizeof(record)) / sizeof(uint16_t);
+        if ((record.type != TEXT_JOURNAL_EDIT && record.type != TEXT_JOURNAL_TEXT) || record.inserted > room) {
+            status = TEXT_JOURNAL_TORN;
+            break;
+        }
+        const uint8_t *units = data + pos + sizeof(record);
+        size_t bytes = (size_t)record.inserted * sizeof(uint16_t);
+        if (RecordCheck(&record, units, bytes) != record.check) {
+            status = TEXT_JOURNAL_TORN;
+            break;
+        }
+        status = ApplyRecord(doc, &record, units);
+        if (status != TEXT_JOURNAL_OK) break;
+        records++;
+        pos += sizeof(record) + bytes;
+    }
+    if (recordsOut) *recordsOut = records;
+    return status;
+}
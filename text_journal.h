@@ -0,0 +1,79 @@
+// Platform-neutral edit journal for retropad.
+// Unsaved changes are kept as a log of edits (offset, units deleted, units
+// inserted) so they survive a crash without rewriting the document: a
+// keystroke costs one small record. A checkpoint record holds the whole
+// text and makes everything before it moot, which is how a log that has
+// grown past the document gets compacted. Every record carries a checksum,
+// so a log cut short by a crash replays up to its last complete record.
+// Replay edits a gap buffer, so runs of nearby edits (typing) cost time in
+// proportion to their size, not the document's. Files and threads live
+// with the caller (see file_io.c).
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum TextJournalType {
+    TEXT_JOURNAL_EDIT = 1, // replace `deleted` units at `offset` with the inserted ones
+    TEXT_JOURNAL_TEXT = 2  // the whole text is now the inserted units
+} TextJournalType;
+
+// One record as stored, followed by `inserted` UTF-16 units.
+typedef struct TextJournalRecord {
+    uint32_t type;
+    uint32_t check;    // low half of the XXH64 of the record (check zeroed) and its units
+    uint64_t offset;
+    uint64_t deleted;
+    uint64_t inserted;
+} TextJournalRecord;
+
+// Records waiting to be written.
+typedef struct TextJournalBuffer {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} TextJournalBuffer;
+
+void TextJournalBufferInit(TextJournalBuffer *buffer);
+void TextJournalBufferFree(TextJournalBuffer *buffer);
+// Appends raw bytes (a caller's file header, say); false on memory failure.
+bool TextJournalBufferAppend(TextJournalBuffer *buffer, const void *data, size_t size);
+bool TextJournalAppendEdit(TextJournalBuffer *buffer, size_t offset, size_t deleted, const uint16_t *inserted,
+                           size_t insertedLength);
+bool TextJournalAppendText(TextJournalBuffer *buffer, const uint16_t *text, size_t length);
+
+// The text being rebuilt: units[0, gapStart) then units[gapEnd, capacity).
+typedef struct TextJournalDocument {
+    uint16_t *units;
+    size_t capacity;
+    size_t gapStart;
+    size_t gapEnd;
+} TextJournalDocument;
+
+bool TextJournalDocumentInit(TextJournalDocument *doc, const uint16_t *text, size_t length);
+void TextJournalDocumentFree(TextJournalDocument *doc);
+size_t TextJournalDocumentLength(const TextJournalDocument *doc);
+// Hands over the text, contiguous and NUL-terminated, to be released with
+// free(); `doc` is left empty. NULL on memory failure.
+uint16_t *TextJournalDocumentDetach(TextJournalDocument *doc, size_t *lengthOut);
+
+typedef enum TextJournalStatus {
+    TEXT_JOURNAL_OK = 0,      // every record applied
+    TEXT_JOURNAL_TORN = 1,    // stopped at an incomplete or damaged record, as a crash leaves
+    TEXT_JOURNAL_INVALID = 2, // an edit reached past the end of the text
+    TEXT_JOURNAL_NO_MEMORY = 3
+} TextJournalStatus;
+
+// Applies the records in data[0, size) to `doc`. `recordsOut` (optional)
+// receives how many were applied. After TEXT_JOURNAL_TORN the document
+// holds the last state the log fully describes.
+TextJournalStatus TextJournalReplay(TextJournalDocument *doc, const uint8_t *data, size_t size, size_t *recordsOut);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,495 @@
+// Line-start index over decoded UTF-16 text.
+#include "text_lines.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Fenwick trees, 1-based over `count` entries stored from tree[0].
+static uint64_t SumBefore(const uint64_t *tree, size_t count) {
+    uint64_t sum = 0;
+    for (size_t i = count; i > 0; i &= i - 1) sum += tree[i - 1];
+    return sum;
+}
+
+// Adds `delta` (wrapping, so it may stand for a negative) to entry `at`.
+static void TreeAdd(uint64_t *tree, size_t count, size_t at, uint64_t delta) {
+    for (size_t i = at + 1; i <= count; i += i & (~i + 1)) tree[i - 1] += delta;
+}
+
+// The largest k <= count whose first k entries sum to at most `target`.
+static size_t TreeSearch(const uint64_t *tree, size_t count, uint64_t target) {
+    size_t step = 1;
+    while (step <= count / 2) step *= 2;
+    size_t k = 0;
+    for (; step > 0; step /= 2) {
+        if (k + step <= count && tree[k + step - 1] <= target) {
+            k += step;
+            target -= tree[k - 1];
+        }
+    }
+    return k;
+}
+
+// Sets entry `count` (the new last one) to `value`.
+static void TreeAppend(uint64_t *tree, size_t count, uint64_t value) {
+    tree[count - 1] = value + SumBefore(tree, count - 1) - SumBefore(tree, count - (count & (~count + 1)));
+}
+
+static size_t ClosedBlocks(const TextLineIndex *index) {
+    return index->blockCount ? index->blockCount - 1 : 0;
+}
+
+static void RebuildTrees(TextLineIndex *index) {
+    size_t count = ClosedBlocks(index);
+    for (size_t i = 0; i < count; ++i) {
+        index->lineSums[i] = index->blocks[i].lines;
+        index->unitSums[i] = index->blocks[i].units;
+    }
+    for (size_t i = 1; i <= count; ++i) {
+        size_t parent = i + (i & (~i + 1));
+        if (parent <= count) {
+            index->lineSums[parent - 1] += index->lineSums[i - 1];
+            index->unitSums[parent - 1] += index->unitSums[i - 1];
+        }
+    }
+    index->tailBase = SumBefore(index->unitSums, count);
+}
+
+static uint32_t *BlockDeltas(const TextLineIndex *index, size_t block) {
+    return index->deltas + (size_t)index->blocks[block].slot * TEXT_LINES_BLOCK;
+}
+
+static size_t BlockFirstLine(const TextLineIndex *index, size_t block) {
+    return (size_t)SumBefore(index->lineSums, block);
+}
+
+static uint64_t BlockBase(const TextLineIndex *index, size_t block) {
+    return block + 1 == index->blockCount ? index->tailBase : SumBefore(index->unitSums, block);
+}
+
+static size_t BlockOfLine(const TextLineIndex *index, size_t line) {
+    return TreeSearch(index->lineSums, ClosedBlocks(index), line);
+}
+
+static uint64_t StartOf(const TextLineIndex *index, size_t line) {
+    size_t block = BlockOfLine(index, line);
+    return BlockBase(index, block) + BlockDeltas(index, block)[line - BlockFirstLine(index, block)];
+}
+
+// Zero-based line holding `offset`: the last start at or before it.
+static size_t LineAt(const TextLineIndex *index, uint64_t offset) {
+    size_t block = TreeSearch(index->unitSums, ClosedBlocks(index), offset);
+    uint64_t rel = offset - BlockBase(index, block);
+    const uint32_t *deltas = BlockDeltas(index, block);
+    size_t lo = 0, hi = index->blocks[block].lines;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (deltas[mid] <= rel) lo = mid;
+        else hi = mid;
+    }
+    return BlockFirstLine(index, block) + lo;
+}
+
+static bool ReserveBlocks(TextLineIndex *index, size_t needed) {
+    if (needed <= index->blockCapacity) return true;
+    size_t capacity = index->blockCapacity ? index->blockCapacity * 2 : 16;
+    if (capacity < needed) capacity = needed;
+    TextLineBlock *blocks = (TextLineBlock *)realloc(index->blocks, capacity * sizeof(TextLineBlock));
+    if (blocks) index->blocks = blocks;
+    uint64_t *lineSums = (uint64_t *)realloc(index->lineSums, capacity * sizeof(uint64_t));
+    if (lineSums) index->lineSums = lineSums;
+    uint64_t *unitSums = (uint64_t *)realloc(index->unitSums, capacity * sizeof(uint64_t));
+    if (unitSums) index->unitSums = unitSums;
+    if (!blocks || !lineSums || !unitSums) return false;
+    index->blockCapacity = capacity;
+    return true;
+}
+
+static bool NewSlot(TextLineIndex *index, uint32_t *slotOut) {
+    if (index->freeCount > 0) {
+        *slotOut = index->freeSlots[--index->freeCount];
+        return true;
+    }
+    if (index->slotCount == index->slotCapacity) {
+        size_t capacity = index->slotCapacity ? index->slotCapacity * 2 : 1;
+        if (capacity > UINT32_MAX) return false;
+        uint32_t *deltas = (uint32_t *)realloc(index->deltas, capacity * TEXT_LINES_BLOCK * sizeof(uint32_t));
+        if (deltas) index->deltas = deltas;
+        uint32_t *freeSlots = (uint32_t *)realloc(index->freeSlots, capacity * sizeof(uint32_t));
+        if (freeSlots) index->freeSlots = freeSlots;
+        if (!deltas || !freeSlots) return false;
+        index->slotCapacity = capacity;
+    }
+    *slotOut = (uint32_t)index->slotCount++;
+    return true;
+}
+
+// Appends a start after every recorded one.
+static bool AddStart(TextLineIndex *index, uint64_t start) {
+    if (!index->valid) return false;
+    size_t last = index->blockCount - 1;
+    if (index->blockCount == 0 || index->blocks[last].lines == TEXT_LINES_BLOCK) {
+        uint32_t slot;
+        if (!ReserveBlocks(index, index->blockCount + 1) || !NewSlot(index, &slot)) {
+            index->valid = false;
+            return false;
+        }
+        if (index->blockCount > 0) {
+            // The full block's length is known now: it joins the trees.
+            index->blocks[last].units = start - index->tailBase;
+            TreeAppend(index->lineSums, index->blockCount, index->blocks[last].lines);
+            TreeAppend(index->unitSums, index->blockCount, index->blocks[last].units);
+        }
+        last = index->blockCount++;
+        index->blocks[last].units = 0;
+        index->blocks[last].lines = 0;
+        index->blocks[last].slot = slot;
+        index->tailBase = start;
+    }
+    uint64_t delta = start - index->tailBase;
+    if (delta > UINT32_MAX) { // a block of lines spanning 4G units
+        index->valid = false;
+        return false;
+    }
+    BlockDeltas(index, last)[index->blocks[last].lines++] = (uint32_t)delta;
+    index->lines++;
+    return true;
+}
+
+void TextLineIndexInit(TextLineIndex *index) {
+    memset(index, 0, sizeof(*index));
+    index->valid = true;
+}
+
+void TextLineIndexFree(TextLineIndex *index) {
+    free(index->deltas);
+    free(index->blocks);
+    free(index->lineSums);
+    free(index->unitSums);
+    free(index->freeSlots);
+    memset(index, 0, sizeof(*index));
+}
+
+bool TextLineIndexCopy(TextLineIndex *copy, const TextLineIndex *index) {
+    *copy = *index;
+    copy->deltas = NULL;
+    copy->blocks = NULL;
+    copy->lineSums = NULL;
+    copy->unitSums = NULL;
+    copy->freeSlots = NULL;
+    copy->freeCount = copy->slotCount = copy->slotCapacity = 0;
+    copy->blockCount = copy->blockCapacity = 0;
+    if (index->blockCount == 0) return true;
+    // Blocks take slots in text order and the trees are rebuilt, so a copy
+    // is also compacted.
+    size_t blocks = index->blockCount;
+    copy->deltas = (uint32_t *)malloc(blocks * TEXT_LINES_BLOCK * sizeof(uint32_t));
+    copy->blocks = (TextLineBlock *)malloc(blocks * sizeof(TextLineBlock));
+    copy->lineSums = (uint64_t *)malloc(blocks * sizeof(uint64_t));
+    copy->unitSums = (uint64_t *)malloc(blocks * sizeof(uint64_t));
+    copy->freeSlots = (uint32_t *)malloc(blocks * sizeof(uint32_t));
+    if (!copy->deltas || !copy->blocks || !copy->lineSums || !copy->unitSums || !copy->freeSlots) {
+        TextLineIndexFree(copy);
+        return false;
+    }
+    for (size_t b = 0; b < blocks; ++b) {
+        copy->blocks[b] = index->blocks[b];
+        copy->blocks[b].slot = (uint32_t)b;
+        memcpy(copy->deltas + b * TEXT_LINES_BLOCK, BlockDeltas(index, b), index->blocks[b].lines * sizeof(uint32_t));
+    }
+    copy->blockCount = copy->blockCapacity = blocks;
+    copy->slotCount = copy->slotCapacity = blocks;
+    RebuildTrees(copy);
+    return true;
+}
+
+bool TextLineIndexAppend(TextLineIndex *index, const uint16_t *text, size_t units) {
+    if (index->lines == 0 && !AddStart(index, 0)) return false;
+    if (!index->valid) return false;
+
+    size_t k = 0;
+    if (index->afterCR && units > 0) {
+        index->afterCR = false;
+        if (text[0] == 0x0A) {
+            // CRLF split across chunks: the line starts after the LF.
+            size_t last = index->blockCount - 1;
+            index->blocks[last].lines--;
+            index->lines--;
+            if (index->blocks[last].lines == 0) {
+                // It was the block's only start: reopen the block before.
+                index->freeSlots[index->freeCount++] = index->blocks[last].slot;
+                index->blockCount--;
+                index->tailBase = SumBefore(index->unitSums, ClosedBlocks(index));
+            }
+            if (!AddStart(index, index->units + 1)) return false;
+            k = 1;
+        } else {
+            index->bareBreaks++;
+        }
+    }
+    while (k < units) {
+        size_t at = k + TextFindLineBreak(text + k, units - k);
+        if (at == units) break;
+        size_t next = at + 1;
+        if (text[at] == 0x0D && next == units) {
+            index->afterCR = true;
+        } else if (text[at] == 0x0D && text[next] == 0x0A) {
+            next++;
+        } else {
+            index->bareBreaks++;
+        }
+        if (!AddStart(index, index->units + next)) return false;
+        k = next;
+    }
+    index->units += units;
+    // A trailing CR may yet turn out to be half of a CRLF.
+    index->known = index->afterCR ? index->units - 1 : index->units;
+    return true;
+}
+
+void TextLineIndexFinish(TextLineIndex *index) {
+    if (index->lines == 0) AddStart(index, 0);
+    if (index->afterCR) index->bareBreaks++;
+    index->trailingCR = index->afterCR;
+    index->afterCR = false;
+    index->known = index->units;
+    index->complete = index->valid;
+}
+
+bool TextLineIndexExtend(TextLineIndex *index, const uint16_t *text, size_t units) {
+    if (!index->valid || !index->complete) return false;
+    index->complete = false;
+    if (index->trailingCR) {
+        // Back to the state before Finish: the CR may pair with an LF now.
+        index->bareBreaks--;
+        index->afterCR = true;
+        index->trailingCR = false;
+    }
+    if (!TextLineIndexAppend(index, text, units)) return false;
+    TextLineIndexFinish(index);
+    return index->complete;
+}
+
+void TextLineIndexTruncate(TextLineIndex *index, uint64_t offset) {
+    index->complete = false;
+    // The unit before the edit may be a CR whose meaning depends on what
+    // now follows it, so only offsets before that stay exact.
+    uint64_t known = offset > 0 ? offset - 1 : 0;
+    if (known < index->known) index->known = known;
+    if (!index->valid || index->lines == 0) return;
+    // Blocks past the last kept line go; the trees never cover the last
+    // block, so they need no change.
+    size_t lines = LineAt(index, index->known) + 1;
+    size_t block = BlockOfLine(index, lines - 1);
+    for (size_t b = block + 1; b < index->blockCount; ++b) {
+        index->freeSlots[index->freeCount++] = index->blocks[b].slot;
+    }
+    index->tailBase = BlockBase(index, block);
+    index->blocks[block].lines = (uint32_t)(lines - BlockFirstLine(index, block));
+    index->blockCount = block + 1;
+    index->lines = lines;
+}
+
+// Drops block `block` (not the first), now without lines: the block before
+// takes over its stretch of text.
+static void RemoveBlock(TextLineIndex *index, size_t block) {
+    if (block + 1 < index->blockCount) index->blocks[block - 1].units += index->blocks[block].units;
+    index->freeSlots[index->freeCount++] = index->blocks[block].slot;
+    memmove(index->blocks + block, index->blocks + block + 1, (index->blockCount - block - 1) * sizeof(TextLineBlock));
+    index->blockCount--;
+    RebuildTrees(index);
+}
+
+// Moves the upper half of a full block into a new block after it.
+static bool SplitBlock(TextLineIndex *index, size_t block) {
+    uint32_t slot;
+    if (!ReserveBlocks(index, index->blockCount + 1) || !NewSlot(index, &slot)) return false;
+    TextLineBlock *lower = &index->blocks[block];
+    uint32_t half = lower->lines / 2;
+    const uint32_t *from = BlockDeltas(index, block);
+    uint32_t *to = index->deltas + (size_t)slot * TEXT_LINES_BLOCK;
+    uint32_t cut = from[half];
+    for (uint32_t k = half; k < lower->lines; ++k) to[k - half] = from[k] - cut;
+    memmove(index->blocks + block + 2, index->blocks + block + 1, (index->blockCount - block - 1) * sizeof(TextLineBlock));
+    TextLineBlock upper = { lower->units - cut, lower->lines - half, slot };
+    lower->units = cut;
+    lower->lines = half;
+    index->blocks[block + 1] = upper;
+    index->blockCount++;
+    RebuildTrees(index);
+    return true;
+}
+
+// Adds `delta` (wrapping) to every start from `line` on.
+static bool ShiftStarts(TextLineIndex *index, size_t line, uint64_t delta) {
+    if (line >= index->lines || delta == 0) return true;
+    size_t block = BlockOfLine(index, line);
+    size_t at = line - BlockFirstLine(index, block);
+    size_t closed = ClosedBlocks(index);
+    if (at == 0) {
+        // The whole block moves: the one before it grows or shrinks.
+        index->blocks[block - 1].units += delta;
+        TreeAdd(index->unitSums, closed, block - 1, delta);
+        index->tailBase += delta;
+        return true;
+    }
+    uint32_t *deltas = BlockDeltas(index, block);
+    for (size_t k = at; k < index->blocks[block].lines; ++k) {
+        uint64_t moved = deltas[k] + delta;
+        if (moved > UINT32_MAX) return false;
+        deltas[k] = (uint32_t)moved;
+    }
+    if (block < closed) {
+        index->blocks[block].units += delta;
+        TreeAdd(index->unitSums, closed, block, delta);
+        index->tailBase += delta;
+    }
+    return true;
+}
+
+// Removes lines [first, end) of one block, never line 0.
+static void RemoveBlockStarts(TextLineIndex *index, size_t first, size_t end) {
+    size_t block = BlockOfLine(index, first);
+    size_t at = first - BlockFirstLine(index, block);
+    size_t count = end - first;
+    size_t closed = ClosedBlocks(index);
+    TextLineBlock *b = &index->blocks[block];
+    uint32_t *deltas = BlockDeltas(index, block);
+    memmove(deltas + at, deltas + at + count, (b->lines - at - count) * sizeof(uint32_t));
+    b->lines -= (uint32_t)count;
+    index->lines -= count;
+    if (block < closed) TreeAdd(index->lineSums, closed, block, (uint64_t)0 - count);
+    if (b->lines == 0) {
+        RemoveBlock(index, block);
+    } else if (at == 0) {
+        // The block's first start went: measure from the next one.
+        uint32_t rebase = deltas[0];
+        for (size_t k = 0; k < b->lines; ++k) deltas[k] -= rebase;
+        index->blocks[block - 1].units += rebase;
+        TreeAdd(index->unitSums, closed, block - 1, rebase);
+        if (block < closed) {
+            b->units -= rebase;
+            TreeAdd(index->unitSums, closed, block, (uint64_t)0 - rebase);
+        } else {
+            index->tailBase += rebase;
+        }
+    }
+}
+
+// Removes lines [first, end), never line 0, a block at a time.
+static void RemoveStarts(TextLineIndex *index, size_t first, size_t end) {
+    while (end > first) {
+        size_t block = BlockOfLine(index, first);
+        size_t blockEnd = BlockFirstLine(index, block) + index->blocks[block].lines;
+        size_t stop = end < blockEnd ? end : blockEnd;
+        RemoveBlockStarts(index, first, stop);
+        end -= stop - first;
+    }
+}
+
+// Inserts `count` ascending starts as lines [line, line + count); they lie
+// between the starts of lines line - 1 and line.
+static bool InsertStarts(TextLineIndex *index, size_t line, const uint64_t *starts, size_t count) {
+    size_t block = BlockOfLine(index, line - 1);
+    if (index->blocks[block].lines + count > TEXT_LINES_BLOCK) {
+        if (!SplitBlock(index, block)) return false;
+        block = BlockOfLine(index, line - 1);
+    }
+    size_t at = line - BlockFirstLine(index, block);
+    uint64_t base = BlockBase(index, block);
+    if (starts[count - 1] - base > UINT32_MAX) return false;
+    TextLineBlock *b = &index->blocks[block];
+    uint32_t *deltas = BlockDeltas(index, block);
+    memmove(deltas + at + count, deltas + at, (b->lines - at) * sizeof(uint32_t));
+    for (size_t k = 0; k < count; ++k) deltas[at + k] = (uint32_t)(starts[k] - base);
+    b->lines += (uint32_t)count;
+    index->lines += count;
+    if (block < ClosedBlocks(index)) TreeAdd(index->lineSums, ClosedBlocks(index), block, count);
+    return true;
+}
+
+static bool Rescan(TextLineIndex *index, const uint16_t *text, size_t length, uint64_t *bareOut) {
+    TextLineIndex fresh;
+    TextLineIndexInit(&fresh);
+    TextLineIndexAppend(&fresh, text, length);
+    TextLineIndexFinish(&fresh);
+    TextLineIndexFree(index);
+    *index = fresh;
+    if (bareOut) *bareOut = fresh.bareBreaks;
+    return fresh.complete;
+}
+
+bool TextLineIndexEdit(TextLineIndex *index, uint64_t offset, uint64_t deleted, const uint16_t *text, size_t length,
+                       uint64_t *bareOut) {
+    if (bareOut) *bareOut = 0;
+    uint64_t oldLength = index->units;
+    if (!index->valid || !index->complete || index->lines == 0 || offset > oldLength || deleted > oldLength - offset ||
+        length + deleted < oldLength) {
+        TextLineIndexTruncate(index, offset);
+        return false;
+    }
+    uint64_t inserted = length + deleted - oldLength;
+    // A start depends on the unit before it (a break) and, after a CR, the
+    // unit at it (an LF makes it CRLF), so the starts from the edit to the
+    // end of the inserted text are redone; line 0 never changes.
+    uint64_t lo = offset > 0 ? offset : 1;
+    uint64_t oldHi = offset + deleted;
+    uint64_t newHi = offset + inserted;
+    size_t first = lo <= oldLength ? LineAt(index, lo - 1) + 1 : index->lines;
+    size_t end = oldHi >= lo ? LineAt(index, oldHi) + 1 : first;
+
+    uint64_t starts[TEXT_LINES_BLOCK / 2];
+    size_t count = 0;
+    uint64_t bare = 0;
+    bool local = end - first <= TEXT_LINES_BLOCK / 2;
+    for (uint64_t p = lo - 1; local && lo <= newHi && p < newHi;) {
+        p += TextFindLineBreak(text + p, (size_t)(newHi - p));
+        if (p >= newHi) break;
+        bool crlf = text[p] == 0x0D && p + 1 < length && text[p + 1] == 0x0A;
+        if (!crlf) {
+            if (count == TEXT_LINES_BLOCK / 2) {
+                local = false; // a paste: cheaper to rescan it all
+                break;
+            }
+            starts[count++] = p + 1;
+            if (text[p] == 0x0D || p == 0 || text[p - 1] != 0x0D) bare++;
+        }
+        p++;
+    }
+    if (!local) return Rescan(index, text, length, bareOut);
+
+    if (end > first) RemoveStarts(index, first, end);
+    bool ok = ShiftStarts(index, first, (uint64_t)length - oldLength) &&
+              (count == 0 || InsertStarts(index, first, starts, count));
+    if (!ok) {
+        index->valid = false;
+        index->complete = false;
+        return false;
+    }
+    if (oldHi == oldLength) index->trailingCR = length > 0 && text[length - 1] == 0x0D;
+    index->units = index->known = length;
+    index->afterCR = false;
+    index->bareBreaks += bare;
+    if (bareOut) *bareOut = bare;
+    return true;
+}
+
+bool TextLineIndexCount(const TextLineIndex *index, size_t *countOut) {
+    if (!index->valid || !index->complete) return false;
+    *countOut = index->lines;
+    return true;
+}
+
+bool TextLineIndexLineFromOffset(const TextLineIndex *index, uint64_t offset, size_t *lineOut) {
+    if (!index->valid || index->lines == 0 || offset > index->known) return false;
+    *lineOut = LineAt(index, offset);
+    return true;
+}
+
+bool TextLineIndexLineStart(const TextLineIndex *index, size_t line, uint64_t *startOut) {
+    if (!index->valid || line >= index->lines) return false;
+    uint64_t start = StartOf(index, line);
+    if (start > index->known) return false;
+    *startOut = start;
+    return true;
+}
@@ -0,0 +1,95 @@
+// Platform-neutral line-start index for retropad.
+// Built from decoded UTF-16 as it streams in, so line number <-> offset
+// lookups for the status bar and Go To do not have to walk the edit
+// control's text, and kept up to date through edits afterwards. Line
+// starts are grouped in blocks of up to TEXT_LINES_BLOCK, each stored as
+// 32-bit deltas from the block's first start (about four bytes a line).
+// Fenwick trees over the blocks' line counts and lengths give any block's
+// first line and first offset in O(log blocks), so a lookup is that plus a
+// binary search in one block, and an edit usually rewrites only the block
+// it lands in and one entry of each tree. When a block fills up and splits
+// (which takes half a block of added lines), or loses its last line and
+// goes, the blocks after it move and both trees are rebuilt in O(blocks).
+// CR, LF and CRLF each end a line.
+#pragma once
+
+#include "text_codec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TEXT_LINES_BLOCK 1024u
+
+// One block of line starts, in text order.
+typedef struct TextLineBlock {
+    uint64_t units;   // from its first start to the next block's (unused for the last block)
+    uint32_t lines;   // 1 to TEXT_LINES_BLOCK
+    uint32_t slot;    // its deltas are at deltas[slot * TEXT_LINES_BLOCK]
+} TextLineBlock;
+
+typedef struct TextLineIndex {
+    uint32_t *deltas;       // per slot: each line's start minus the block's first
+    TextLineBlock *blocks;
+    uint64_t *lineSums;     // Fenwick trees over every block but the last:
+    uint64_t *unitSums;     // its lines and its units
+    uint32_t *freeSlots;    // slots of blocks merged away, for reuse
+    size_t freeCount;
+    size_t slotCount;       // slots handed out, free or not
+    size_t slotCapacity;
+    size_t blockCount;
+    size_t blockCapacity;
+    size_t lines;     // line starts recorded; line 0 always starts at 0
+    uint64_t tailBase; // first start of the last block
+    uint64_t units;   // text scanned so far
+    uint64_t known;   // lookups for offsets up to here are exact
+    uint64_t bareBreaks; // lone CRs and LFs among the breaks scanned (edits only add)
+    bool afterCR;     // the last unit scanned was a CR
+    bool trailingCR;  // the finished text ends in a CR (counted as bare)
+    bool complete;    // the whole document was scanned and is kept current
+    bool valid;       // false after an allocation failure or overflow
+} TextLineIndex;
+
+void TextLineIndexInit(TextLineIndex *index);
+void TextLineIndexFree(TextLineIndex *index);
+// Fills `copy` with an independent, compacted duplicate; on failure it is
+// left empty. `index` only needs its scalars, blocks and deltas (the sums
+// are rebuilt), so it may be a view of a stored index.
+bool TextLineIndexCopy(TextLineIndex *copy, const TextLineIndex *index);
+
+// Scans the next `units` units of the document.
+bool TextLineIndexAppend(TextLineIndex *index, const uint16_t *text, size_t units);
+
+// Marks the end of the document: every line and the line count are known.
+void TextLineIndexFinish(TextLineIndex *index);
+
+// Scans text added after the end of a finished index (a followed file that
+// grew) and finishes it again; false if the index was not complete.
+bool TextLineIndexExtend(TextLineIndex *index, const uint16_t *text, size_t units);
+
+// Records an edit starting at `offset`. Lines that start before it keep
+// their offsets; anything from there on is dropped until a rescan.
+void TextLineIndexTruncate(TextLineIndex *index, uint64_t offset);
+
+// Records that units [offset, offset + deleted) were replaced, leaving the
+// document as text[0, length). Only the lines from the edit to the end of
+// the inserted text are rescanned, reading `text` no further than the unit
+// after it, unless the edit touches more than about half a block of lines:
+// then the whole text is. On false (the index was not complete, or memory
+// ran out) the edit was recorded as a truncation. `bareOut` (optional)
+// receives how many lone CRs and LFs the rescan met.
+bool TextLineIndexEdit(TextLineIndex *index, uint64_t offset, uint64_t deleted, const uint16_t *text, size_t length,
+                       uint64_t *bareOut);
+
+// Total line count; false unless the index is complete.
+bool TextLineIndexCount(const TextLineIndex *index, size_t *countOut);
+
+// Zero-based line holding `offset`; false if the index cannot tell.
+bool TextLineIndexLineFromOffset(const TextLineIndex *index, uint64_t offset, size_t *lineOut);
+
+// Offset of the start of zero-based `line`; false if not indexed.
+bool TextLineIndexLineStart(const TextLineIndex *index, size_t line, uint64_t *startOut);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,92 @@
+// Progressive chunked decoding on top of TextDecoder.
+#include "text_loader.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool TextLoaderInit(TextLoader *loader, TextEncoding encoding, uint64_t bytesTotal, TextLoaderRead read, void *readContext) {
+    memset(loader, 0, sizeof(*loader));
+    TextDecoderInit(&loader->decoder, encoding);
+    loader->read = read;
+    loader->readContext = readContext;
+    loader->bytesTotal = bytesTotal;
+    loader->chunkBytes = TEXT_LOADER_FIRST_CHUNK;
+    loader->firstNul = TEXT_LOADER_NO_NUL;
+    if (encoding == ENC_UTF16LE) {
+        return true; // read in place; see TextLoaderNext
+    }
+    loader->input = (uint8_t *)malloc(TEXT_LOADER_MAX_CHUNK);
+    return loader->input != NULL;
+}
+
+void TextLoaderSetDecoder(TextLoader *loader, TextLoaderDecode decode, void *context) {
+    loader->decode = decode;
+    loader->decodeContext = context;
+}
+
+void TextLoaderFree(TextLoader *loader) {
+    free(loader->input);
+    loader->input = NULL;
+}
+
+// Offset of the first U+0000 in units[0, count), or `count`. The test has
+// no early exit so it vectorizes; the position is only searched for once
+// there is one, which text files almost never have.
+static size_t FindNul(const uint16_t *units, size_t count) {
+    uint16_t all = 0xFFFF;
+    for (size_t i = 0; i < count; ++i) all &= (uint16_t)(units[i] != 0 ? 0xFFFF : 0);
+    if (all) return count;
+    size_t i = 0;
+    while (units[i] != 0) i++;
+    return i;
+}
+
+size_t TextLoaderChunkCapacity(const TextLoader *loader) {
+    return TextDecoderMaxOutput(loader->decoder.encoding, loader->chunkBytes);
+}
+
+bool TextLoaderNext(TextLoader *loader, uint16_t *out, size_t *unitsOut) {
+    *unitsOut = 0;
+    if (loader->finished) return false;
+
+    size_t want = loader->chunkBytes;
+    if (loader->bytesTotal - loader->bytesDone < want) {
+        want = (size_t)(loader->bytesTotal - loader->bytesDone);
+    }
+    // UTF-16LE bytes already are the output units (see DecodeUtf16), so
+    // they are read straight into `out` with no scratch copy. Chunk sizes
+    // are even, so a unit is only ever split by the end of the input.
+    bool inPlace = !loader->input;
+    uint8_t *target = inPlace ? (uint8_t *)out : loader->input;
+
+    // Fill the whole chunk unless the input ends; short reads are retried.
+    size_t got = 0;
+    while (got < want) {
+        size_t n = loader->read(loader->readContext, target + got, want - got);
+        if (n == 0) break;
+        got += n;
+    }
+    loader->bytesDone += got;
+    bool final = (got < want) || (loader->bytesDone >= loader->bytesTotal);
+
+    if (inPlace) {
+        *unitsOut = got / 2; // a dangling odd byte is not a character
+        loader->decoder.bytesSeen += got;
+    } else if (loader->decode) {
+        *unitsOut = loader->decode(loader->decodeContext, loader->input, got, final, out);
+    } else {
+        *unitsOut = TextDecoderDecode(&loader->decoder, loader->input, got, final, out);
+    }
+
+    if (loader->firstNul == TEXT_LOADER_NO_NUL) {
+        size_t nul = FindNul(out, *unitsOut);
+        if (nul < *unitsOut) loader->firstNul = loader->unitsDone + nul;
+    }
+    loader->unitsDone += *unitsOut;
+    if (final) loader->finished = true;
+    if (loader->chunkBytes < TEXT_LOADER_MAX_CHUNK) {
+        loader->chunkBytes *= 4;
+        if (loader->chunkBytes > TEXT_LOADER_MAX_CHUNK) loader->chunkBytes = TEXT_LOADER_MAX_CHUNK;
+    }
+    return true;
+}
@@ -0,0 +1,56 @@
+// Platform-neutral progressive decoder for retropad.
+// Pulls bytes from a reader callback and hands out decoded chunks that start
+// small, so the first screenful is ready almost immediately, and then grow so
+// the rest of a large file streams with little per-chunk overhead. Threads and
+// the hand-off to the UI live with the caller (see file_io.c).
+#pragma once
+
+#include "text_codec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TEXT_LOADER_FIRST_CHUNK (64u * 1024u)
+#define TEXT_LOADER_MAX_CHUNK (4u * 1024u * 1024u)
+#define TEXT_LOADER_NO_NUL UINT64_MAX
+
+// Reads up to `size` bytes into `buffer`; returns the count, 0 at end of input.
+typedef size_t (*TextLoaderRead)(void *context, uint8_t *buffer, size_t size);
+
+// Decoder for encodings TextDecoder does not cover (the ANSI code page). Same
+// contract as TextDecoderDecode with a non-NULL `out`.
+typedef size_t (*TextLoaderDecode)(void *context, const uint8_t *data, size_t size, bool final, uint16_t *out);
+
+typedef struct TextLoader {
+    TextDecoder decoder;
+    TextLoaderRead read;
+    void *readContext;
+    TextLoaderDecode decode; // NULL: use `decoder`
+    void *decodeContext;
+    uint64_t bytesDone;
+    uint64_t bytesTotal;     // expected input size, for progress and `final`
+    size_t chunkBytes;       // input bytes behind the next chunk
+    uint8_t *input;          // TEXT_LOADER_MAX_CHUNK scratch bytes; NULL for
+                             // UTF-16LE, which is read straight into the chunk
+    uint64_t unitsDone;      // units handed out so far
+    uint64_t firstNul;       // offset of the first U+0000 handed out, or
+                             // TEXT_LOADER_NO_NUL; text shown through a
+                             // NUL-terminated API is cut short there
+    bool finished;
+} TextLoader;
+
+bool TextLoaderInit(TextLoader *loader, TextEncoding encoding, uint64_t bytesTotal, TextLoaderRead read, void *readContext);
+void TextLoaderSetDecoder(TextLoader *loader, TextLoaderDecode decode, void *context);
+void TextLoaderFree(TextLoader *loader);
+
+// UTF-16 units `out` must hold for the next TextLoaderNext call.
+size_t TextLoaderChunkCapacity(const TextLoader *loader);
+
+// Decodes the next chunk into `out` and stores its length in `unitsOut`
+// (possibly 0 for the final flush). Returns false once the input is done.
+bool TextLoaderNext(TextLoader *loader, uint16_t *out, size_t *unitsOut);
+
+#ifdef __cplusplus
+}
+#endif
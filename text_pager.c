@@ -0,0 +1,289 @@
+// Paged, cached decoding of files too large to hold as one document.
+#include "text_pager.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PAGER_EMPTY_SLOT UINT64_MAX
+#define PAGER_SEAM_BYTES 4u // bytes read on each side of a page for seam fixing
+
+static uint64_t Min64(uint64_t a, uint64_t b) { return a < b ? a : b; }
+
+bool TextPagerInit(TextPager *pager, TextEncoding encoding, uint64_t fileSize, uint64_t dataStart, size_t maxPages,
+                   TextPagerRead read, void *readContext) {
+    memset(pager, 0, sizeof(*pager));
+    if (dataStart > fileSize) dataStart = fileSize;
+    pager->encoding = encoding;
+    pager->fileSize = fileSize;
+    pager->dataStart = dataStart;
+    pager->pageCount = (fileSize - dataStart + TEXT_PAGER_PAGE_BYTES - 1) / TEXT_PAGER_PAGE_BYTES;
+    if (pager->pageCount == 0) pager->pageCount = 1;
+    pager->read = read;
+    pager->readContext = readContext;
+    if (maxPages < TEXT_PAGER_MIN_PAGES) maxPages = TEXT_PAGER_MIN_PAGES;
+    pager->slots = (TextPage *)calloc(maxPages, sizeof(TextPage));
+    pager->input = (uint8_t *)malloc(TEXT_PAGER_PAGE_BYTES + 2 * PAGER_SEAM_BYTES);
+    if (!pager->slots || !pager->input) {
+        TextPagerFree(pager);
+        return false;
+    }
+    pager->slotCount = maxPages;
+    for (size_t i = 0; i < maxPages; ++i) pager->slots[i].page = PAGER_EMPTY_SLOT;
+    return true;
+}
+
+void TextPagerSetDecoder(TextPager *pager, TextPagerDecode decode, void *context) {
+    pager->decode = decode;
+    pager->decodeContext = context;
+}
+
+void TextPagerFree(TextPager *pager) {
+    if (pager->slots) {
+        for (size_t i = 0; i < pager->slotCount; ++i) free(pager->slots[i].text);
+    }
+    free(pager->slots);
+    free(pager->input);
+    memset(pager, 0, sizeof(*pager));
+}
+
+// Bytes the real page boundary lies past the nominal `seam`, so no
+// character straddles two pages. `buffer` holds file bytes from `bufStart`
+// to `bufEnd`. Both neighbouring pages work this out from the same bytes,
+// so they always agree. ANSI DBCS lead bytes cannot be told from trail
+// bytes without context, so those seams are left where they fall.
+static size_t SeamSkip(const TextPager *pager, const uint8_t *buffer, uint64_t bufStart, uint64_t bufEnd, uint64_t seam) {
+    if (seam <= pager->dataStart || seam >= pager->fileSize) return 0;
+    const uint8_t *at = buffer + (seam - bufStart);
+    if (pager->encoding == ENC_UTF8) {
+        size_t skip = 0;
+        while (skip < 3 && seam + skip < bufEnd && (at[skip] & 0xC0) == 0x80) skip++;
+        return skip;
+    }
+    if (pager->encoding == ENC_UTF16LE || pager->encoding == ENC_UTF16BE) {
+        if (seam - 2 < bufStart || seam + 2 > bufEnd) return 0;
+        bool le = (pager->encoding == ENC_UTF16LE);
+        unsigned before = le ? (unsigned)(at[-2] | (at[-1] << 8)) : (unsigned)((at[-2] << 8) | at[-1]);
+        unsigned after = le ? (unsigned)(at[0] | (at[1] << 8)) : (unsigned)((at[0] << 8) | at[1]);
+        return (before >= 0xD800 && before <= 0xDBFF && after >= 0xDC00 && after <= 0xDFFF) ? 2 : 0;
+    }
+    return 0;
+}
+
+static bool DecodePage(TextPager *pager, TextPage *slot, uint64_t page) {
+    uint64_t nominalStart = pager->dataStart + page * TEXT_PAGER_PAGE_BYTES;
+    uint64_t nominalEnd = Min64(pager->fileSize, nominalStart + TEXT_PAGER_PAGE_BYTES);
+    uint64_t bufStart = nominalStart - Min64(PAGER_SEAM_BYTES, nominalStart - pager->dataStart);
+    uint64_t bufEnd = Min64(pager->fileSize, nominalEnd + PAGER_SEAM_BYTES);
+    size_t want = (size_t)(bufEnd - bufStart);
+    size_t got = 0;
+    while (got < want) {
+        size_t n = pager->read(pager->readContext, bufStart + got, pager->input + got, want - got);
+        if (n == 0) return false;
+        got += n;
+    }
+
+    uint64_t start = nominalStart + SeamSkip(pager, pager->input, bufStart, bufEnd, nominalStart);
+    uint64_t end = nominalEnd + SeamSkip(pager, pager->input, bufStart, bufEnd, nominalEnd);
+    if (!slot->text) {
+        size_t capacity = TextDecoderMaxOutput(pager->encoding, TEXT_PAGER_PAGE_BYTES + 2 * PAGER_SEAM_BYTES);
+        slot->text = (uint16_t *)malloc(capacity * sizeof(uint16_t));
+        if (!slot->text) return false;
+    }
+    const uint8_t *data = pager->input + (start - bufStart);
+    size_t size = (size_t)(end - start);
+    if (pager->encoding == ENC_ANSI) {
+        if (!pager->decode) return false;
+        slot->units = pager->decode(pager->decodeContext, data, size, slot->text);
+    } else {
+        TextDecoder dec;
+        TextDecoderInit(&dec, pager->encoding);
+        slot->units = TextDecoderDecode(&dec, data, size, true, slot->text);
+    }
+    slot->page = page;
+    slot->byteStart = start;
+    slot->byteEnd = end;
+    slot->hasBreak = TextFindLineBreak(slot->text, slot->units) < slot->units;
+    return true;
+}
+
+const TextPage *TextPagerGetPage(TextPager *pager, uint64_t page) {
+    if (page >= pager->pageCount) return NULL;
+    TextPage *victim = &pager->slots[0];
+    for (size_t i = 0; i < pager->slotCount; ++i) {
+        TextPage *slot = &pager->slots[i];
+        if (slot->page == page) {
+            slot->lastUse = ++pager->clock;
+            pager->hits++;
+            return slot;
+        }
+        if (slot->lastUse < victim->lastUse) victim = slot;
+    }
+    pager->misses++;
+    if (!DecodePage(pager, victim, page)) {
+        victim->page = PAGER_EMPTY_SLOT;
+        victim->lastUse = 0;
+        return NULL;
+    }
+    victim->lastUse = ++pager->clock;
+    return victim;
+}
+
+// Moves a position off the end of a page onto the start of the next one.
+static bool Normalize(TextPager *pager, TextPagerPos *pos) {
+    for (;;) {
+        const TextPage *pg = TextPagerGetPage(pager, pos->page);
+        if (!pg) return false;
+        if (pos->unit > pg->units) pos->unit = pg->units;
+        if (pos->unit < pg->units || pos->page + 1 >= pager->pageCount) return true;
+        pos->page++;
+        pos->unit = 0;
+    }
+}
+
+// Moves `pos` back to the latest line start at or before it. A line starts
+// after LF, after a CR not followed by LF, or at a page start when the
+// previous page holds no line break at all (unless the text ends there).
+static bool FindLineStart(TextPager *pager, TextPagerPos *pos) {
+    if (!Normalize(pager, pos)) return false;
+    uint64_t q = pos->page;
+    size_t u = pos->unit; // candidates are (q, 0..u)
+    for (;;) {
+        const TextPage *pg = TextPagerGetPage(pager, q);
+        if (!pg) return false;
+        const uint16_t *t = pg->text;
+        size_t n = pg->units;
+        if (u > n) u = n;
+        for (size_t i = u; i-- > 0;) {
+            // A CR ending a normalized page's candidates is the text's end.
+            if (t[i] == 0x0A || (t[i] == 0x0D && (i + 1 == n || t[i + 1] != 0x0A))) {
+                pos->page = q;
+                pos->unit = i + 1;
+                return Normalize(pager, pos);
+            }
+        }
+        bool firstIsLF = (n > 0 && t[0] == 0x0A);
+        if (q == 0) break;
+        const TextPage *prev = TextPagerGetPage(pager, q - 1);
+        if (!prev) return false;
+        if (!prev->hasBreak && n > 0) break;
+        if (prev->units == 0) break;
+        uint16_t last = prev->text[prev->units - 1];
+        if (last == 0x0A || (last == 0x0D && !firstIsLF)) break;
+        // Keep looking in the previous page, skipping a CR whose LF opens
+        // this one.
+        u = (last == 0x0D) ? prev->units - 1 : prev->units;
+        q--;
+    }
+    pos->page = q;
+    pos->unit = 0;
+    return true;
+}
+
+bool TextPagerSeek(TextPager *pager, uint64_t offset, TextPagerPos *pos) {
+    if (offset < pager->dataStart) offset = pager->dataStart;
+    uint64_t page = (offset - pager->dataStart) / TEXT_PAGER_PAGE_BYTES;
+    if (page >= pager->pageCount) page = pager->pageCount - 1;
+    const TextPage *pg = TextPagerGetPage(pager, page);
+    if (!pg) return false;
+    TextPagerPos at = { page, 0 };
+    if (offset > pg->byteStart && pg->byteEnd > pg->byteStart) {
+        uint64_t into = Min64(offset, pg->byteEnd) - pg->byteStart;
+        at.unit = (size_t)(into * pg->units / (pg->byteEnd - pg->byteStart));
+    }
+    if (!FindLineStart(pager, &at)) return false;
+    *pos = at;
+    return true;
+}
+
+bool TextPagerNextLine(TextPager *pager, TextPagerPos *pos) {
+    uint64_t q = pos->page;
+    size_t u = pos->unit;
+    for (;;) {
+        const TextPage *pg = TextPagerGetPage(pager, q);
+        if (!pg) return false;
+        size_t n = pg->units;
+        if (u > n) u = n;
+        size_t at = u + TextFindLineBreak(pg->text + u, n - u);
+        TextPagerPos next = { q, at + 1 };
+        if (at < n) {
+            if (pg->text[at] == 0x0D && at + 1 == n && q + 1 < pager->pageCount) {
+                // A CR ends the page; its LF may open the next one.
+                const TextPage *following = TextPagerGetPage(pager, q + 1);
+                if (!following) return false;
+                next.page = q + 1;
+                next.unit = (following->units > 0 && following->text[0] == 0x0A) ? 1 : 0;
+            } else if (pg->text[at] == 0x0D && at + 1 < n && pg->text[at + 1] == 0x0A) {
+                next.unit = at + 2;
+            }
+            if (!Normalize(pager, &next)) return false;
+            *pos = next;
+            return true;
+        }
+        if (q + 1 >= pager->pageCount) return false;
+        if (!pg->hasBreak) {
+            TextPagerPos forced = { q + 1, 0 };
+            if (!Normalize(pager, &forced)) return false;
+            const TextPage *tail = TextPagerGetPage(pager, forced.page);
+            if (!tail || forced.unit == tail->units) return false; // only the end is left
+            *pos = forced;
+            return true;
+        }
+        q++;
+        u = 0;
+    }
+}
+
+bool TextPagerPrevLine(TextPager *pager, TextPagerPos *pos) {
+    // The unit just before `pos` belongs to the previous line.
+    TextPagerPos at = *pos;
+    while (at.unit == 0) {
+        if (at.page == 0) return false;
+        const TextPage *pg = TextPagerGetPage(pager, at.page - 1);
+        if (!pg) return false;
+        at.page--;
+        at.unit = pg->units;
+    }
+    at.unit--;
+    if (!FindLineStart(pager, &at)) return false;
+    *pos = at;
+    return true;
+}
+
+bool TextPagerLastLine(TextPager *pager, TextPagerPos *pos) {
+    uint64_t page = pager->pageCount - 1;
+    const TextPage *pg = TextPagerGetPage(pager, page);
+    if (!pg) return false;
+    TextPagerPos at = { page, pg->units };
+    if (!FindLineStart(pager, &at)) return false;
+    *pos = at;
+    return true;
+}
+
+size_t TextPagerCopyLine(TextPager *pager, TextPagerPos pos, uint16_t *out, size_t max) {
+    size_t copied = 0;
+    uint64_t q = pos.page;
+    size_t u = pos.unit;
+    while (copied < max) {
+        const TextPage *pg = TextPagerGetPage(pager, q);
+        if (!pg) break;
+        size_t n = pg->units;
+        if (u > n) u = n;
+        size_t run = TextFindLineBreak(pg->text + u, n - u);
+        bool ended = (u + run < n);
+        if (run > max - copied) run = max - copied;
+        memcpy(out + copied, pg->text + u, run * sizeof(uint16_t));
+        copied += run;
+        if (ended || !pg->hasBreak || q + 1 >= pager->pageCount) break;
+        q++;
+        u = 0;
+    }
+    return copied;
+}
+
+uint64_t TextPagerByteOffset(TextPager *pager, TextPagerPos pos) {
+    const TextPage *pg = TextPagerGetPage(pager, pos.page);
+    if (!pg) return pager->dataStart + pos.page * TEXT_PAGER_PAGE_BYTES;
+    if (pg->units == 0) return pg->byteStart;
+    size_t unit = pos.unit < pg->units ? pos.unit : pg->units;
+    return pg->byteStart + (pg->byteEnd - pg->byteStart) * unit / pg->units;
+}
@@ -0,0 +1,96 @@
+// Platform-neutral paging engine for the read-only large-file viewer.
+// The file is split into fixed-size byte pages that are decoded on demand
+// into a small LRU cache, so memory stays flat however big the file is and
+// any jump costs at most a few page decodes. Page seams are moved to
+// character boundaries so every page decodes on its own. Line navigation
+// works across pages; a run with no line break for a whole page is broken
+// at the page start so no line walk ever spans more than a few pages.
+// The reader callback and the window that draws the lines live with the
+// caller (see file_io.c and pager_view.c).
+#pragma once
+
+#include "text_codec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TEXT_PAGER_PAGE_BYTES (256u * 1024u)
+#define TEXT_PAGER_MIN_PAGES 4u
+
+// Reads up to `size` bytes at file `offset` into `buffer`; returns the count.
+typedef size_t (*TextPagerRead)(void *context, uint64_t offset, uint8_t *buffer, size_t size);
+
+// Stateless decoder for encodings TextDecoder does not cover (the ANSI code
+// page): decodes all of `data` into `out` (room for `size` units) and
+// returns the units written.
+typedef size_t (*TextPagerDecode)(void *context, const uint8_t *data, size_t size, uint16_t *out);
+
+typedef struct TextPage {
+    uint64_t page;      // page number, UINT64_MAX while the slot is empty
+    uint64_t byteStart; // file bytes the decoded text came from
+    uint64_t byteEnd;
+    uint16_t *text;
+    size_t units;
+    bool hasBreak;      // any CR or LF in the page
+    uint64_t lastUse;   // LRU stamp
+} TextPage;
+
+typedef struct TextPager {
+    TextEncoding encoding;
+    uint64_t dataStart;  // first byte after the BOM
+    uint64_t fileSize;
+    uint64_t pageCount;  // at least 1, even for an empty file
+    TextPagerRead read;
+    void *readContext;
+    TextPagerDecode decode; // used for ENC_ANSI
+    void *decodeContext;
+    TextPage *slots;
+    size_t slotCount;
+    uint8_t *input;      // one page plus seam slack
+    uint64_t clock;
+    uint64_t hits;       // page lookups served from the cache
+    uint64_t misses;     // page lookups that had to decode
+} TextPager;
+
+// A place in the text: unit `unit` of page `page`. The end of one page and
+// the start of the next are the same place; the pager always hands out the
+// latter except at the very end of the text.
+typedef struct TextPagerPos {
+    uint64_t page;
+    size_t unit;
+} TextPagerPos;
+
+// Sets up a pager over `fileSize` bytes whose text starts at `dataStart`,
+// caching at most `maxPages` decoded pages (at least TEXT_PAGER_MIN_PAGES).
+bool TextPagerInit(TextPager *pager, TextEncoding encoding, uint64_t fileSize, uint64_t dataStart, size_t maxPages,
+                   TextPagerRead read, void *readContext);
+void TextPagerSetDecoder(TextPager *pager, TextPagerDecode decode, void *context);
+void TextPagerFree(TextPager *pager);
+
+// Decoded page `page`, from the cache or freshly decoded (evicting the
+// least recently used page). The pointer stays valid until the next call
+// that may decode. NULL if the page cannot be read.
+const TextPage *TextPagerGetPage(TextPager *pager, uint64_t page);
+
+// Start of the line holding file byte `offset` (clamped to the file).
+bool TextPagerSeek(TextPager *pager, uint64_t offset, TextPagerPos *pos);
+
+// Start of the line after / before the one starting at `pos`. False at the
+// last / first line, leaving `pos` alone.
+bool TextPagerNextLine(TextPager *pager, TextPagerPos *pos);
+bool TextPagerPrevLine(TextPager *pager, TextPagerPos *pos);
+
+// Start of the last line in the text.
+bool TextPagerLastLine(TextPager *pager, TextPagerPos *pos);
+
+// Copies up to `max` units of the line starting at `pos`, without its line
+// break, into `out` and returns the count.
+size_t TextPagerCopyLine(TextPager *pager, TextPagerPos pos, uint16_t *out, size_t max);
+
+// Approximate file byte offset of `pos`, for scroll bars and progress.
+uint64_t TextPagerByteOffset(TextPager *pager, TextPagerPos pos);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,402 @@
+// Piece table over UTF-16 text, kept in a persistent treap of pieces.
+#include "text_piece.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define NODE_SLAB 1024u
+#define ADDED_CHUNK_UNITS 65536u
+
+// Added text lives in chunks that are filled and never moved, so pieces
+// (and snapshots' pieces) can point straight into them.
+typedef struct AddedChunk {
+    struct AddedChunk *next;
+    uint16_t *units;
+    size_t used;
+    size_t capacity;
+} AddedChunk;
+
+typedef struct NodeSlab {
+    struct NodeSlab *next;
+    TextPieceNode nodes[NODE_SLAB];
+} NodeSlab;
+
+struct TextPieceStore {
+    size_t refs;           // the table and each snapshot
+    uint16_t *original;
+    AddedChunk *chunks;    // newest first; only the newest is still filled
+    NodeSlab *slabs;       // newest first
+    size_t slabUsed;       // nodes handed out of the newest slab
+    TextPieceNode *freeNodes; // released nodes, chained through `left`
+};
+
+struct TextPieceSnapshot {
+    TextPieceStore *store;
+    TextPieceNode *root;
+};
+
+static size_t Total(const TextPieceNode *node) {
+    return node ? node->total : 0;
+}
+
+static void Update(TextPieceNode *node) {
+    node->total = node->length + Total(node->left) + Total(node->right);
+    node->count = 1 + (node->left ? node->left->count : 0) + (node->right ? node->right->count : 0);
+}
+
+static uint32_t NextPriority(TextPieceTable *table) {
+    // xorshift32: enough to keep the treap balanced in expectation.
+    uint32_t x = table->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    table->seed = x;
+    return x;
+}
+
+static TextPieceNode *AllocNode(TextPieceStore *store) {
+    TextPieceNode *node = store->freeNodes;
+    if (node) {
+        store->freeNodes = node->left;
+        return node;
+    }
+    if (!store->slabs || store->slabUsed == NODE_SLAB) {
+        NodeSlab *slab = (NodeSlab *)malloc(sizeof(NodeSlab));
+        if (!slab) return NULL;
+        slab->next = store->slabs;
+        store->slabs = slab;
+        store->slabUsed = 0;
+    }
+    return &store->slabs->nodes[store->slabUsed++];
+}
+
+static TextPieceNode *NewNode(TextPieceTable *table, const uint16_t *units, size_t length) {
+    TextPieceNode *node = AllocNode(table->store);
+    if (!node) return NULL;
+    node->units = units;
+    node->length = length;
+    node->total = length;
+    node->count = 1;
+    node->left = NULL;
+    node->right = NULL;
+    node->priority = NextPriority(table);
+    node->refs = 1;
+    return node;
+}
+
+static TextPieceNode *Retain(TextPieceNode *node) {
+    if (node) node->refs++;
+    return node;
+}
+
+// Drops one reference; nodes nobody holds any more go back to the store.
+static void Release(TextPieceStore *store, TextPieceNode *node) {
+    while (node && --node->refs == 0) {
+        Release(store, node->right);
+        TextPieceNode *left = node->left;
+        node->left = store->freeNodes;
+        store->freeNodes = node;
+        node = left;
+    }
+}
+
+static void ReleaseStore(TextPieceStore *store) {
+    if (!store || --store->refs > 0) return;
+    while (store->chunks) {
+        AddedChunk *next = store->chunks->next;
+        free(store->chunks);
+        store->chunks = next;
+    }
+    while (store->slabs) {
+        NodeSlab *next = store->slabs->next;
+        free(store->slabs);
+        store->slabs = next;
+    }
+    free(store->original);
+    free(store);
+}
+
+// Takes over the caller's reference to `node` and returns a node with the
+// same contents that only the caller holds, copying it if it is shared.
+// NULL (the reference still the caller's) when no node can be had.
+static TextPieceNode *Unshare(TextPieceTable *table, TextPieceNode *node) {
+    if (node->refs == 1) return node;
+    TextPieceNode *copy = AllocNode(table->store);
+    if (!copy) return NULL;
+    *copy = *node;
+    copy->refs = 1;
+    Retain(copy->left);
+    Retain(copy->right);
+    node->refs--; // still held elsewhere, so never the last
+    return copy;
+}
+
+// The edit functions below take over the references they are passed and
+// hand back references of their own. When one fails the tree is abandoned
+// half-built (see TextPieceTableFree), but shared nodes were never changed.
+
+static bool Merge(TextPieceTable *table, TextPieceNode *a, TextPieceNode *b, TextPieceNode **out) {
+    if (!a || !b) {
+        *out = a ? a : b;
+        return true;
+    }
+    TextPieceNode *joined;
+    if (a->priority > b->priority) {
+        if (!(a = Unshare(table, a)) || !Merge(table, a->right, b, &joined)) return false;
+        a->right = joined;
+        Update(a);
+        *out = a;
+    } else {
+        if (!(b = Unshare(table, b)) || !Merge(table, a, b->left, &joined)) return false;
+        b->left = joined;
+        Update(b);
+        *out = b;
+    }
+    return true;
+}
+
+// Splits `node` into its first `at` units and the rest, cutting the piece
+// that straddles `at` in two.
+static bool Split(TextPieceTable *table, TextPieceNode *node, size_t at, TextPieceNode **leftOut,
+                  TextPieceNode **rightOut) {
+    if (!node || at == 0 || at >= node->total) {
+        // Nothing to cut: the whole subtree goes to one side untouched.
+        *leftOut = node && at > 0 ? node : NULL;
+        *rightOut = node && at == 0 ? node : NULL;
+        return true;
+    }
+    if (!(node = Unshare(table, node))) return false;
+    size_t leftTotal = Total(node->left);
+    TextPieceNode *a, *b;
+    if (at <= leftTotal) {
+        if (!Split(table, node->left, at, &a, &b)) return false;
+        node->left = b;
+        Update(node);
+        *leftOut = a;
+        *rightOut = node;
+        return true;
+    }
+    if (at >= leftTotal + node->length) {
+        if (!Split(table, node->right, at - leftTotal - node->length, &a, &b)) return false;
+        node->right = a;
+        Update(node);
+        *leftOut = node;
+        *rightOut = b;
+        return true;
+    }
+    // The cut falls inside this piece: its tail becomes a node of its own.
+    size_t keep = at - leftTotal;
+    TextPieceNode *tail = NewNode(table, node->units + keep, node->length - keep);
+    if (!tail) return false;
+    node->length = keep;
+    TextPieceNode *right = node->right;
+    node->right = NULL;
+    Update(node);
+    *leftOut = node;
+    return Merge(table, tail, right, rightOut);
+}
+
+// Whether the piece ending exactly at `at` ends at `end` in memory.
+static bool EndsAt(const TextPieceNode *node, size_t at, const uint16_t *end) {
+    while (node) {
+        size_t leftTotal = Total(node->left);
+        if (at <= leftTotal) {
+            node = node->left;
+        } else if (at > leftTotal + node->length) {
+            at -= leftTotal + node->length;
+            node = node->right;
+        } else {
+            return at == leftTotal + node->length && node->units + node->length == end;
+        }
+    }
+    return false;
+}
+
+// Lengthens the piece ending at `at` (see EndsAt) by `extra` units,
+// unsharing the path down to it.
+static bool ExtendAt(TextPieceTable *table, TextPieceNode **link, size_t at, size_t extra) {
+    TextPieceNode *node = Unshare(table, *link);
+    if (!node) return false;
+    *link = node;
+    size_t leftTotal = Total(node->left);
+    if (at <= leftTotal) {
+        if (!ExtendAt(table, &node->left, at, extra)) return false;
+    } else if (at > leftTotal + node->length) {
+        if (!ExtendAt(table, &node->right, at - leftTotal - node->length, extra)) return false;
+    } else {
+        node->length += extra;
+    }
+    node->total += extra;
+    return true;
+}
+
+// Room for `length` more added units, kept right after the last ones when
+// the newest chunk has space.
+static uint16_t *ReserveAdded(TextPieceStore *store, size_t length) {
+    AddedChunk *chunk = store->chunks;
+    if (chunk && chunk->capacity - chunk->used >= length) return chunk->units + chunk->used;
+    size_t capacity = length > ADDED_CHUNK_UNITS ? length : ADDED_CHUNK_UNITS;
+    if (capacity > (SIZE_MAX - sizeof(AddedChunk)) / sizeof(uint16_t)) return NULL;
+    chunk = (AddedChunk *)malloc(sizeof(AddedChunk) + capacity * sizeof(uint16_t));
+    if (!chunk) return NULL;
+    chunk->units = (uint16_t *)(chunk + 1);
+    chunk->used = 0;
+    chunk->capacity = capacity;
+    chunk->next = store->chunks;
+    store->chunks = chunk;
+    return chunk->units;
+}
+
+static size_t SpanAt(const TextPieceNode *node, size_t offset, const uint16_t **unitsOut) {
+    while (node) {
+        size_t leftTotal = Total(node->left);
+        if (offset < leftTotal) {
+            node = node->left;
+        } else if (offset < leftTotal + node->length) {
+            size_t into = offset - leftTotal;
+            *unitsOut = node->units + into;
+            return node->length - into;
+        } else {
+            offset -= leftTotal + node->length;
+            node = node->right;
+        }
+    }
+    *unitsOut = NULL;
+    return 0;
+}
+
+static size_t CopyFrom(const TextPieceNode *root, size_t offset, size_t length, uint16_t *out) {
+    size_t copied = 0;
+    while (copied < length) {
+        const uint16_t *units = NULL;
+        size_t span = SpanAt(root, offset + copied, &units);
+        if (span == 0) break;
+        if (span > length - copied) span = length - copied;
+        memcpy(out + copied, units, span * sizeof(uint16_t));
+        copied += span;
+    }
+    return copied;
+}
+
+void TextPieceTableInit(TextPieceTable *table) {
+    memset(table, 0, sizeof(*table));
+    table->seed = 0x9E3779B9u;
+}
+
+void TextPieceTableFree(TextPieceTable *table) {
+    TextPieceStore *store = table->store;
+    // A tree abandoned by a failed edit is not walked: the store goes with
+    // the last snapshot. Nor is one that nothing else shares.
+    if (store && table->valid && store->refs > 1) Release(store, table->root);
+    ReleaseStore(store);
+    TextPieceTableInit(table);
+}
+
+bool TextPieceTableReset(TextPieceTable *table, const uint16_t *text, size_t length) {
+    TextPieceTableFree(table);
+    if (length > SIZE_MAX / sizeof(uint16_t)) return false;
+    TextPieceStore *store = (TextPieceStore *)calloc(1, sizeof(TextPieceStore));
+    if (!store) return false;
+    store->refs = 1;
+    table->store = store;
+    if (length) {
+        store->original = (uint16_t *)malloc(length * sizeof(uint16_t));
+        if (!store->original) {
+            TextPieceTableFree(table);
+            return false;
+        }
+        memcpy(store->original, text, length * sizeof(uint16_t));
+        table->root = NewNode(table, store->original, length);
+        if (!table->root) {
+            TextPieceTableFree(table);
+            return false;
+        }
+    }
+    table->valid = true;
+    return true;
+}
+
+size_t TextPieceTableLength(const TextPieceTable *table) {
+    return Total(table->root);
+}
+
+size_t TextPieceTablePieceCount(const TextPieceTable *table) {
+    return table->root ? table->root->count : 0;
+}
+
+bool TextPieceTableReplace(TextPieceTable *table, size_t offset, size_t deleted, const uint16_t *inserted,
+                           size_t insertedLength) {
+    if (!table->valid) return false;
+    size_t length = TextPieceTableLength(table);
+    if (offset > length || deleted > length - offset) {
+        table->valid = false;
+        return false;
+    }
+    table->valid = false; // until it all worked
+    if (deleted) {
+        TextPieceNode *a, *rest, *mid, *b;
+        if (!Split(table, table->root, offset, &a, &rest) || !Split(table, rest, deleted, &mid, &b)) return false;
+        Release(table->store, mid);
+        table->root = NULL;
+        if (!Merge(table, a, b, &table->root)) return false;
+    }
+    if (insertedLength) {
+        TextPieceStore *store = table->store;
+        const uint16_t *end = store->chunks ? store->chunks->units + store->chunks->used : NULL;
+        uint16_t *units = ReserveAdded(store, insertedLength);
+        if (!units) return false;
+        memcpy(units, inserted, insertedLength * sizeof(uint16_t));
+        store->chunks->used += insertedLength;
+        // Typing: the previous insertion ends right here, so just grow it.
+        if (units == end && EndsAt(table->root, offset, end)) {
+            if (!ExtendAt(table, &table->root, offset, insertedLength)) return false;
+        } else {
+            TextPieceNode *a, *b, *left;
+            TextPieceNode *node = NewNode(table, units, insertedLength);
+            if (!node || !Split(table, table->root, offset, &a, &b) || !Merge(table, a, node, &left) ||
+                !Merge(table, left, b, &table->root)) {
+                return false;
+            }
+        }
+    }
+    table->valid = true;
+    return true;
+}
+
+size_t TextPieceTableSpan(const TextPieceTable *table, size_t offset, const uint16_t **unitsOut) {
+    return SpanAt(table->root, offset, unitsOut);
+}
+
+size_t TextPieceTableCopy(const TextPieceTable *table, size_t offset, size_t length, uint16_t *out) {
+    return CopyFrom(table->root, offset, length, out);
+}
+
+TextPieceSnapshot *TextPieceTableSnapshot(TextPieceTable *table) {
+    if (!table->valid) return NULL;
+    TextPieceSnapshot *snapshot = (TextPieceSnapshot *)malloc(sizeof(TextPieceSnapshot));
+    if (!snapshot) return NULL;
+    snapshot->store = table->store;
+    snapshot->store->refs++;
+    snapshot->root = Retain(table->root);
+    return snapshot;
+}
+
+void TextPieceSnapshotRelease(TextPieceSnapshot *snapshot) {
+    if (!snapshot) return;
+    // The last holder of the store frees it whole without walking nodes.
+    if (snapshot->store->refs > 1) Release(snapshot->store, snapshot->root);
+    ReleaseStore(snapshot->store);
+    free(snapshot);
+}
+
+size_t TextPieceSnapshotLength(const TextPieceSnapshot *snapshot) {
+    return Total(snapshot->root);
+}
+
+size_t TextPieceSnapshotSpan(const TextPieceSnapshot *snapshot, size_t offset, const uint16_t **unitsOut) {
+    return SpanAt(snapshot->root, offset, unitsOut);
+}
+
+size_t TextPieceSnapshotCopy(const TextPieceSnapshot *snapshot, size_t offset, size_t length, uint16_t *out) {
+    return CopyFrom(snapshot->root, offset, length, out);
+}
@@ -0,0 +1,79 @@
+// Platform-neutral piece table for retropad.
+// The document is a sequence of pieces, each a stretch of either the
+// original text (copied once when the table is built) or an append-only
+// buffer of everything inserted since. Pieces sit in a treap ordered by
+// position and sized by their subtrees' lengths, so inserting, deleting and
+// finding the piece at an offset are O(log pieces) whatever the document
+// size, and consecutive typing just lengthens the last piece. Readers walk
+// the text one contiguous span at a time (TextPieceTableSpan) rather than
+// asking for a flat copy.
+//
+// Nodes are reference counted and never change once shared, and neither
+// the text buffers nor the nodes ever move, so TextPieceTableSnapshot can
+// hand out an immutable view of the document in O(1) that shares every
+// piece with the table: an edit afterwards copies only the nodes on the
+// path it changes. Snapshots are taken and released on the thread that
+// edits the table; any thread may read one in between.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct TextPieceNode {
+    const uint16_t *units; // into the original or the added text
+    size_t length;
+    size_t total;         // units in this subtree
+    size_t count;         // pieces in this subtree
+    struct TextPieceNode *left;
+    struct TextPieceNode *right;
+    uint32_t priority;
+    uint32_t refs;        // parents and roots holding it; shared once above 1
+} TextPieceNode;
+
+// The text and nodes of one table, kept until it and its snapshots are gone.
+typedef struct TextPieceStore TextPieceStore;
+
+// An immutable view of the text at the time it was taken.
+typedef struct TextPieceSnapshot TextPieceSnapshot;
+
+typedef struct TextPieceTable {
+    TextPieceStore *store;
+    TextPieceNode *root;
+    uint32_t seed;        // priorities
+    bool valid;           // false after an allocation failure; rebuild it
+} TextPieceTable;
+
+void TextPieceTableInit(TextPieceTable *table);
+void TextPieceTableFree(TextPieceTable *table);
+// Starts over from a copy of text[0, length); false on memory failure.
+bool TextPieceTableReset(TextPieceTable *table, const uint16_t *text, size_t length);
+size_t TextPieceTableLength(const TextPieceTable *table);
+// Replaces units [offset, offset + deleted) with inserted[0, insertedLength).
+// On failure (memory, or a range past the end) the table is left invalid.
+bool TextPieceTableReplace(TextPieceTable *table, size_t offset, size_t deleted, const uint16_t *inserted,
+                           size_t insertedLength);
+// The contiguous units starting at `offset`, up to the end of their piece:
+// sets *unitsOut and returns how many (0 at or past the end).
+size_t TextPieceTableSpan(const TextPieceTable *table, size_t offset, const uint16_t **unitsOut);
+// Copies units [offset, offset + length), clamped to the text; returns the
+// number copied.
+size_t TextPieceTableCopy(const TextPieceTable *table, size_t offset, size_t length, uint16_t *out);
+size_t TextPieceTablePieceCount(const TextPieceTable *table);
+
+// The text as it is now, unaffected by later edits, Reset or Free; NULL if
+// the table is invalid or memory ran out.
+TextPieceSnapshot *TextPieceTableSnapshot(TextPieceTable *table);
+void TextPieceSnapshotRelease(TextPieceSnapshot *snapshot);
+size_t TextPieceSnapshotLength(const TextPieceSnapshot *snapshot);
+// As TextPieceTableSpan and TextPieceTableCopy, over the snapshot.
+size_t TextPieceSnapshotSpan(const TextPieceSnapshot *snapshot, size_t offset, const uint16_t **unitsOut);
+size_t TextPieceSnapshotCopy(const TextPieceSnapshot *snapshot, size_t offset, size_t length, uint16_t *out);
+
+#ifdef __cplusplus
+}
+#endif
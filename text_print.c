@@ -0,0 +1,161 @@
+// Header/footer expansion and line/page layout for printing.
+#include "text_print.h"
+
+// Writes `value` in decimal to `out` (room for 12 units) and returns how
+// many units that took; no terminator.
+static size_t FormatInt(int value, uint16_t *out) {
+    char digits[12];
+    size_t count = 0;
+    unsigned magnitude = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+    do {
+        digits[count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    size_t n = 0;
+    if (value < 0) out[n++] = '-';
+    while (count > 0) out[n++] = (uint16_t)digits[--count];
+    return n;
+}
+
+static size_t UnitLength(const uint16_t *s) {
+    size_t n = 0;
+    if (s) {
+        while (s[n]) n++;
+    }
+    return n;
+}
+
+void TextPrintExpandHeaderFooter(const uint16_t *format, const TextPrintFields *fields, uint16_t *left,
+                                 size_t leftCapacity, uint16_t *center, size_t centerCapacity, uint16_t *right,
+                                 size_t rightCapacity) {
+    uint16_t *targets[3] = { left, center, right };
+    size_t capacities[3] = { leftCapacity, centerCapacity, rightCapacity };
+    size_t lengths[3] = { 0, 0, 0 }; // so appending never rescans a segment
+    for (int s = 0; s < 3; ++s) {
+        if (!targets[s] || capacities[s] == 0) targets[s] = NULL;
+        else targets[s][0] = 0;
+    }
+    if (!format) return;
+
+    int seg = 1;
+    for (const uint16_t *p = format; *p; ++p) {
+        const uint16_t *insert = p;
+        size_t insertLength = 1;
+        uint16_t number[12];
+        if (*p == '&') {
+            switch (p[1]) {
+            case 'l': case 'L': seg = 0; p++; continue;
+            case 'c': case 'C': seg = 1; p++; continue;
+            case 'r': case 'R': seg = 2; p++; continue;
+            case '&': p++; break;
+            case 'f': case 'F': insert = fields->fileName; insertLength = UnitLength(insert); p++; break;
+            case 'p':
+                insertLength = FormatInt(fields->page, number);
+                insert = number;
+                p++;
+                break;
+            case 'P':
+                insertLength = FormatInt(fields->totalPages > 1 ? fields->totalPages : 1, number);
+                insert = number;
+                p++;
+                break;
+            case 'd': case 'D': insert = fields->date; insertLength = UnitLength(insert); p++; break;
+            case 't': case 'T': insert = fields->time; insertLength = UnitLength(insert); p++; break;
+            default: break; // a lone '&' is kept as is
+            }
+        }
+        uint16_t *target = targets[seg];
+        if (!target || insertLength == 0) continue;
+        size_t room = capacities[seg] - 1 - lengths[seg];
+        if (insertLength > room) insertLength = room;
+        for (size_t i = 0; i < insertLength; ++i) target[lengths[seg] + i] = insert[i];
+        lengths[seg] += insertLength;
+        target[lengths[seg]] = 0;
+    }
+}
+
+// Whether a unit is left at c->p, moving to the next span when the current
+// one is used up.
+static bool More(TextPrintCursor *c) {
+    if (c->p < c->end) return true;
+    if (!c->snapshot) return false;
+    const uint16_t *units = NULL;
+    size_t count = TextPieceSnapshotSpan(c->snapshot, c->next, &units);
+    if (count == 0) return false;
+    c->p = units;
+    c->end = units + count;
+    c->next += count;
+    return true;
+}
+
+void TextPrintLayoutInit(TextPrintLayout *layout, const TextPieceSnapshot *snapshot, const uint16_t *text,
+                         size_t length, int charsPerLine, int linesPerPage) {
+    TextPrintCursor *c = &layout->cursor;
+    c->snapshot = snapshot;
+    c->next = 0;
+    c->p = snapshot ? NULL : text;
+    c->end = c->p ? c->p + length : NULL;
+    layout->charsPerLine = charsPerLine > 1 ? charsPerLine : 1;
+    layout->linesPerPage = linesPerPage > 1 ? linesPerPage : 1;
+    layout->lineOnPage = 0;
+    layout->page = 1;
+    layout->inLine = false;
+    layout->breakPending = false;
+    layout->lineLength = 0;
+}
+
+bool TextPrintLayoutNext(TextPrintLayout *layout) {
+    TextPrintCursor *c = &layout->cursor;
+    if (layout->breakPending) {
+        layout->page++;
+        layout->lineOnPage = 0;
+        layout->breakPending = false;
+    }
+    if (!layout->inLine && !More(c)) return false;
+
+    int length = 0, col = 0;
+    bool wrapped = false;
+    while (More(c) && *c->p != '\r' && *c->p != '\n') {
+        uint16_t ch = *c->p++;
+        if (ch == '\t') {
+            int spaces = TEXT_PRINT_TAB_WIDTH - col % TEXT_PRINT_TAB_WIDTH;
+            for (int i = 0; i < spaces && col < layout->charsPerLine; ++i, ++col) {
+                if (length < (int)TEXT_PRINT_LINE_UNITS) layout->line[length++] = ' ';
+            }
+        } else {
+            if (length < (int)TEXT_PRINT_LINE_UNITS) layout->line[length++] = ch;
+            col++;
+        }
+        if (col >= layout->charsPerLine) {
+            wrapped = true;
+            break;
+        }
+    }
+    // A wrapped line leaves the rest of its document line for the next
+    // call, even when that rest is empty.
+    layout->inLine = wrapped;
+    if (!wrapped && More(c)) {
+        if (*c->p == '\r') {
+            c->p++;
+            if (More(c) && *c->p == '\n') c->p++;
+        } else {
+            c->p++;
+        }
+    }
+    layout->lineLength = length;
+    layout->lineOnPage++;
+    if (layout->lineOnPage >= layout->linesPerPage) {
+        TextPrintCursor peek = *c;
+        while (More(&peek) && (*peek.p == '\r' || *peek.p == '\n')) peek.p++;
+        layout->breakPending = More(&peek);
+    }
+    return true;
+}
+
+int TextPrintCountPages(const TextPieceSnapshot *snapshot, const uint16_t *text, size_t length, int charsPerLine,
+                        int linesPerPage) {
+    TextPrintLayout layout;
+    TextPrintLayoutInit(&layout, snapshot, text, length, charsPerLine, linesPerPage);
+    while (TextPrintLayoutNext(&layout)) {}
+    return layout.page;
+}
@@ -0,0 +1,74 @@
+// Platform-neutral print layout for retropad.
+// Expands header/footer formats (&l &c &r pick the segment; &f file name,
+// &p page, &P page count, &d date, &t time, && an ampersand) in one pass
+// that tracks each segment's length instead of rescanning it, and lays the
+// document out into printed lines and pages: tabs expand to every eighth
+// column, lines wrap at `charsPerLine`, and CR, LF and CRLF end a line.
+// The document is a pointer and a length, or a piece table snapshot walked
+// span by span, so NUL characters are laid out like any other. Rendering
+// and page counting share the one walk, so they always agree.
+#pragma once
+
+#include "text_piece.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TEXT_PRINT_LINE_UNITS 4096u // a printed line keeps this many units
+#define TEXT_PRINT_TAB_WIDTH 8
+
+// Values the header/footer tokens expand to. The strings are
+// NUL-terminated; NULL expands to nothing.
+typedef struct TextPrintFields {
+    const uint16_t *fileName;
+    const uint16_t *date;
+    const uint16_t *time;
+    int page;
+    int totalPages; // shown as at least 1
+} TextPrintFields;
+
+// Expands `format` (NUL-terminated; NULL is empty) into the left, center
+// and right segments, each NUL-terminated and cut to its capacity. Text
+// before any &l/&c/&r goes to the center. A NULL segment is skipped.
+void TextPrintExpandHeaderFooter(const uint16_t *format, const TextPrintFields *fields, uint16_t *left,
+                                 size_t leftCapacity, uint16_t *center, size_t centerCapacity, uint16_t *right,
+                                 size_t rightCapacity);
+
+// Walks the document a unit at a time, through flat text or span by span
+// through a snapshot. A copy walks on independently, so lookahead is a copy.
+typedef struct TextPrintCursor {
+    const TextPieceSnapshot *snapshot; // the document; when NULL, the text
+    size_t next;          // snapshot offset just past the current span
+    const uint16_t *p;    // the next unit...
+    const uint16_t *end;  // ...and the end of its span
+} TextPrintCursor;
+
+typedef struct TextPrintLayout {
+    TextPrintCursor cursor;
+    int charsPerLine;
+    int linesPerPage;
+    int lineOnPage;       // lines laid out on `page` so far
+    int page;             // one-based page of the last line
+    bool inLine;          // a wrapped document line has more to lay out
+    bool breakPending;    // the page is full and more text follows
+    uint16_t line[TEXT_PRINT_LINE_UNITS]; // the last line, tabs expanded
+    int lineLength;
+} TextPrintLayout;
+
+// Starts laying out `snapshot`, or text[0, length) when it is NULL.
+void TextPrintLayoutInit(TextPrintLayout *layout, const TextPieceSnapshot *snapshot, const uint16_t *text,
+                         size_t length, int charsPerLine, int linesPerPage);
+
+// Lays out the next printed line into line[0, lineLength) and sets `page`
+// to the page it goes on; false once the document is used up. A page
+// break is taken only when text other than line breaks follows.
+bool TextPrintLayoutNext(TextPrintLayout *layout);
+
+// Pages the document needs at this layout: at least 1.
+int TextPrintCountPages(const TextPieceSnapshot *snapshot, const uint16_t *text, size_t length, int charsPerLine,
+                        int linesPerPage);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,37 @@
+// Length-delimited UTF-16 substring search.
+#include "text_search.h"
+
+#include "text_codec.h"
+
+#include <string.h>
+
+size_t TextFind(const uint16_t *text, size_t length, const uint16_t *needle, size_t needleLength) {
+    if (needleLength == 0 || needleLength > length) return length;
+    const size_t gap = needleLength - 1;
+    const size_t starts = length - gap; // a match can start at [0, starts)
+    size_t pos = 0;
+    while (pos < starts) {
+        pos += TextFindUnitPair(text + pos, starts - pos, needle[0], needle[gap], gap);
+        if (pos >= starts) break;
+        if (memcmp(text + pos, needle, needleLength * sizeof(uint16_t)) == 0) return pos;
+        pos++;
+    }
+    return length;
+}
+
+// Searching backwards only happens once per Find Previous, so a scalar scan
+// with the same first/last filter is enough.
+size_t TextFindLast(const uint16_t *text, size_t length, const uint16_t *needle, size_t needleLength, size_t before) {
+    if (needleLength == 0 || needleLength > length) return length;
+    const size_t gap = needleLength - 1;
+    size_t pos = length - gap;
+    if (pos > before) pos = before;
+    while (pos > 0) {
+        pos--;
+        if (text[pos] == needle[0] && text[pos + gap] == needle[gap] &&
+            memcmp(text + pos, needle, needleLength * sizeof(uint16_t)) == 0) {
+            return pos;
+        }
+    }
+    return length;
+}
@@ -0,0 +1,28 @@
+// Platform-neutral substring search for retropad.
+// Text is a pointer and a length in UTF-16 units rather than a
+// NUL-terminated string, so documents holding NUL characters are searched
+// (and replaced) in full instead of stopping at the first one. Candidates
+// are found with the vector kernel behind TextFindUnitPair (text_codec.h),
+// which checks the needle's first and last units together, and confirmed
+// with a compare. Matching is exact; callers fold case beforehand.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Offset of the first occurrence of needle[0, needleLength) in
+// text[0, length), or `length` when there is none. An empty needle matches
+// nothing.
+size_t TextFind(const uint16_t *text, size_t length, const uint16_t *needle, size_t needleLength);
+
+// Offset of the last occurrence that starts before `before` (it may run on
+// past it), or `length` when there is none.
+size_t TextFindLast(const uint16_t *text, size_t length, const uint16_t *needle, size_t needleLength, size_t before);
+
+#ifdef __cplusplus
+}
+#endif
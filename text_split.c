@@ -0,0 +1,223 @@
+// Line-boundary split and BOM-aware join over encoded bytes.
+#include "text_split.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define NOT_SCANNED SIZE_MAX
+
+// Line breaks in the raw bytes: a unit is one byte, or two with the
+// significant one at `low` (0 for UTF-16LE, 1 for UTF-16BE) and a zero
+// beside it. Trail bytes of the double-byte code pages are never CR or LF.
+typedef struct BreakScan {
+    size_t unit;
+    size_t low;
+    size_t lf; // next LF / CR found so far, or NOT_SCANNED
+    size_t cr;
+} BreakScan;
+
+static void InitBreakScan(BreakScan *scan, TextEncoding encoding) {
+    scan->unit = (encoding == ENC_UTF16LE || encoding == ENC_UTF16BE) ? 2 : 1;
+    scan->low = encoding == ENC_UTF16BE ? 1 : 0;
+    scan->lf = NOT_SCANNED;
+    scan->cr = NOT_SCANNED;
+}
+
+// First unit at or after `from` (unit-aligned) equal to `value`, or `have`.
+// memchr does the scanning; for UTF-16 a hit must also sit in the right
+// half of an aligned unit whose other half is zero.
+static size_t FindUnit(const BreakScan *scan, const uint8_t *buf, size_t from, size_t have, uint8_t value) {
+    size_t p = from;
+    while (p < have) {
+        const uint8_t *hit = (const uint8_t *)memchr(buf + p, value, have - p);
+        if (!hit) return have;
+        size_t at = (size_t)(hit - buf);
+        if (scan->unit == 1) return at;
+        if (at >= scan->low) {
+            size_t start = at - scan->low;
+            if (start % 2 == 0 && start + 2 <= have && buf[start + 1 - scan->low] == 0) return start;
+        }
+        p = at + 1;
+    }
+    return have;
+}
+
+// Next CR or LF at or after `from`, or `have`. Each kind is remembered
+// until passed, so files without CRs pay for one fruitless scan per buffer.
+static size_t NextBreak(BreakScan *scan, const uint8_t *buf, size_t from, size_t have) {
+    if (scan->lf == NOT_SCANNED || scan->lf < from) scan->lf = FindUnit(scan, buf, from, have, 0x0A);
+    if (scan->cr == NOT_SCANNED || scan->cr < from) scan->cr = FindUnit(scan, buf, from, have, 0x0D);
+    return scan->lf < scan->cr ? scan->lf : scan->cr;
+}
+
+static bool IsUnit(const BreakScan *scan, const uint8_t *buf, size_t at, uint8_t value) {
+    return buf[at + scan->low] == value && (scan->unit == 1 || buf[at + 1 - scan->low] == 0);
+}
+
+// Whether buf[from, to) contains the pattern at a unit boundary.
+static bool ContainsPattern(const BreakScan *scan, const uint8_t *buf, size_t from, size_t to, const uint8_t *pattern,
+                            size_t length) {
+    size_t p = from;
+    while (to - p >= length) {
+        const uint8_t *hit = (const uint8_t *)memchr(buf + p, pattern[0], to - p - length + 1);
+        if (!hit) return false;
+        size_t at = (size_t)(hit - buf);
+        if ((at - from) % scan->unit == 0 && memcmp(buf + at, pattern, length) == 0) return true;
+        p = at + 1;
+    }
+    return false;
+}
+
+// Fills buf[*have, capacity) until it is full or the input ends.
+static void FillBuffer(TextSplitRead read, void *context, uint8_t *buf, size_t capacity, size_t *have, bool *eof) {
+    while (!*eof && *have < capacity) {
+        size_t n = read(context, buf + *have, capacity - *have);
+        if (n == 0) {
+            *eof = true;
+        } else {
+            *have += n;
+        }
+    }
+}
+
+bool TextSplit(const TextSplitOptions *options, TextSplitRead read, void *readContext, const TextSplitSink *sink,
+               uint32_t *piecesOut) {
+    *piecesOut = 0;
+    if (options->mode == TEXT_SPLIT_MATCH ? options->patternLength == 0 : options->limit == 0) return false;
+    uint8_t *buf = (uint8_t *)malloc(TEXT_SPLIT_BUFFER);
+    if (!buf) return false;
+
+    size_t have = 0;
+    bool eof = false;
+    FillBuffer(read, readContext, buf, TEXT_SPLIT_BUFFER, &have, &eof);
+    size_t bomLength = TextBomLength(buf, have, options->encoding);
+    uint8_t bom[4];
+    memcpy(bom, buf, bomLength);
+    BreakScan scan;
+    InitBreakScan(&scan, options->encoding);
+
+    bool ok = true;
+    bool open = false;     // a piece has begun and not yet ended
+    uint32_t pieces = 0;
+    uint64_t pieceBytes = 0;
+    uint64_t pieceLines = 0;
+    bool midLine = false;  // the last thing passed was a fragment of a long line
+    size_t base = bomLength; // content start in the current buffer
+    while (ok && have > base) {
+        scan.lf = NOT_SCANNED;
+        scan.cr = NOT_SCANNED;
+        size_t pos = base;
+        size_t run = base; // bytes [run, pos) are bound for the open piece
+        while (ok && pos < have) {
+            size_t b = NextBreak(&scan, buf, pos, have);
+            size_t end = have;
+            bool complete = true;
+            if (b < have) {
+                end = b + scan.unit;
+                if (IsUnit(&scan, buf, b, 0x0D)) {
+                    if (end + scan.unit <= have) {
+                        if (IsUnit(&scan, buf, end, 0x0A)) end += scan.unit;
+                    } else if (!eof) {
+                        complete = false; // an LF may follow in the next read
+                    }
+                }
+            } else if (!eof) {
+                complete = false;
+            }
+            if (!complete) {
+                if (pos > base) break; // carry the partial line over
+                // The whole buffer is one unfinished line: pass a fragment,
+                // keeping a trailing CR back for its possible LF.
+                end = have - (have - pos) % scan.unit;
+                if (b < have && b > pos) end = b;
+            }
+
+            bool cut = false;
+            if (open && !midLine) {
+                switch (options->mode) {
+                case TEXT_SPLIT_BYTES:
+                    cut = pieceBytes > 0 && pieceBytes + (end - pos) > options->limit;
+                    break;
+                case TEXT_SPLIT_LINES:
+                    cut = pieceLines >= options->limit;
+                    break;
+                case TEXT_SPLIT_MATCH:
+                    cut = pieceBytes > 0 &&
+                          ContainsPattern(&scan, buf, pos, end, options->pattern, options->patternLength);
+                    break;
+                }
+            }
+            if (cut) {
+                ok = (pos == run || sink->write(sink->context, buf + run, pos - run)) && sink->end(sink->context);
+                open = false;
+                run = pos;
+            }
+            if (ok && !open) {
+                ok = sink->begin(sink->context, pieces) &&
+                     (bomLength == 0 || sink->write(sink->context, bom, bomLength));
+                open = ok;
+                pieces++;
+                pieceBytes = 0;
+                pieceLines = 0;
+            }
+            pieceBytes += end - pos;
+            if (complete) pieceLines++;
+            midLine = !complete;
+            pos = end;
+        }
+        if (ok && pos > run) ok = sink->write(sink->context, buf + run, pos - run);
+        if (!ok) break;
+
+        memmove(buf, buf + pos, have - pos);
+        have -= pos;
+        base = 0;
+        FillBuffer(read, readContext, buf, TEXT_SPLIT_BUFFER, &have, &eof);
+    }
+    if (open && !sink->end(sink->context)) ok = false;
+    free(buf);
+    *piecesOut = pieces;
+    return ok;
+}
+
+bool TextJoinerInit(TextJoiner *joiner) {
+    memset(joiner, 0, sizeof(*joiner));
+    joiner->buffer = (uint8_t *)malloc(TEXT_SPLIT_BUFFER);
+    return joiner->buffer != NULL;
+}
+
+void TextJoinerFree(TextJoiner *joiner) {
+    free(joiner->buffer);
+    memset(joiner, 0, sizeof(*joiner));
+}
+
+TextJoinStatus TextJoinerAdd(TextJoiner *joiner, TextSplitRead read, void *readContext, TextSplitWrite write,
+                             void *writeContext) {
+    uint8_t *buf = joiner->buffer;
+    size_t have = 0;
+    bool eof = false;
+    FillBuffer(read, readContext, buf, TEXT_SPLIT_BUFFER, &have, &eof);
+    TextEncoding encoding = ENC_UTF8;
+    bool hasBom = TextDetectBom(buf, have, &encoding);
+    size_t bomLength = hasBom ? TextBomLength(buf, have, encoding) : 0;
+    size_t skip = 0;
+    if (joiner->bytesWritten == 0 && !joiner->hasBom) {
+        joiner->hasBom = hasBom;
+        joiner->bomLength = bomLength;
+        memcpy(joiner->bom, buf, bomLength);
+    } else if (hasBom) {
+        // A part without a BOM is taken as a continuation of the first.
+        if (!joiner->hasBom || bomLength != joiner->bomLength || memcmp(buf, joiner->bom, bomLength) != 0) {
+            return TEXT_JOIN_MISMATCH;
+        }
+        skip = bomLength;
+    }
+    joiner->parts++;
+    while (have > skip) {
+        if (!write(writeContext, buf + skip, have - skip)) return TEXT_JOIN_FAILED;
+        joiner->bytesWritten += have - skip;
+        skip = 0;
+        have = 0;
+        FillBuffer(read, readContext, buf, TEXT_SPLIT_BUFFER, &have, &eof);
+    }
+    return TEXT_JOIN_OK;
+}
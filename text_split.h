@@ -0,0 +1,81 @@
+// Platform-neutral split and join for retropad.
+// Cuts a file into pieces at line boundaries, or joins pieces back into one
+// file. Both work on the encoded bytes: nothing is decoded to UTF-16, so
+// every encoding passes through unchanged, and memory stays at one fixed
+// buffer whatever the file size. Each piece repeats the source's byte order
+// mark so it opens on its own; a join keeps only the first part's. Lines
+// end at CR, LF or CRLF, as in text_lines.h. Files, threads and naming live
+// with the caller (see file_io.c).
+#pragma once
+
+#include "text_codec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bytes read at a time. A line longer than this is passed through in
+// buffer-sized fragments and is never cut.
+#define TEXT_SPLIT_BUFFER (4u * 1024u * 1024u)
+
+typedef enum TextSplitMode {
+    TEXT_SPLIT_BYTES = 0, // at most `limit` bytes per piece (BOM aside); a
+                          // longer line gets a piece to itself
+    TEXT_SPLIT_LINES = 1, // `limit` lines per piece
+    TEXT_SPLIT_MATCH = 2  // a new piece at each line containing `pattern`
+} TextSplitMode;
+
+typedef struct TextSplitOptions {
+    TextSplitMode mode;
+    uint64_t limit;
+    const uint8_t *pattern; // TEXT_SPLIT_MATCH: exact bytes, in the file's encoding
+    size_t patternLength;
+    TextEncoding encoding;  // as detected; a matching BOM is kept on every piece
+} TextSplitOptions;
+
+// Reads up to `size` bytes into `buffer`; returns the count, 0 at end of input.
+typedef size_t (*TextSplitRead)(void *context, uint8_t *buffer, size_t size);
+// Writes all `size` bytes; false on failure.
+typedef bool (*TextSplitWrite)(void *context, const uint8_t *data, size_t size);
+
+// Where the pieces go: `begin` opens piece `index` (from 0), `write` fills
+// it and `end` closes it. A failure from any of them stops the split.
+typedef struct TextSplitSink {
+    bool (*begin)(void *context, uint32_t index);
+    TextSplitWrite write;
+    bool (*end)(void *context);
+    void *context;
+} TextSplitSink;
+
+// Splits the input into pieces. Empty input (or a bare BOM) makes none.
+// False on bad options, memory or a sink failure; pieces already begun
+// are closed but left for the caller to remove.
+bool TextSplit(const TextSplitOptions *options, TextSplitRead read, void *readContext, const TextSplitSink *sink,
+               uint32_t *piecesOut);
+
+typedef enum TextJoinStatus {
+    TEXT_JOIN_OK = 0,
+    TEXT_JOIN_MISMATCH = 1, // the part's BOM names a different encoding
+    TEXT_JOIN_FAILED = 2    // memory or a write failure
+} TextJoinStatus;
+
+typedef struct TextJoiner {
+    uint8_t *buffer;
+    uint8_t bom[4];   // the first part's BOM...
+    size_t bomLength;
+    bool hasBom;      // ...if it had one
+    uint32_t parts;
+    uint64_t bytesWritten;
+} TextJoiner;
+
+bool TextJoinerInit(TextJoiner *joiner);
+void TextJoinerFree(TextJoiner *joiner);
+
+// Appends one part. Later parts drop a BOM matching the first part's; one
+// naming another encoding stops the join before anything is written.
+TextJoinStatus TextJoinerAdd(TextJoiner *joiner, TextSplitRead read, void *readContext, TextSplitWrite write,
+                             void *writeContext);
+
+#ifdef __cplusplus
+}
+#endif